@@ -487,6 +487,9 @@ void dumpOptDirectory(const DexFile* pDexFile)
         case kDexChunkRegisterMaps:
             verboseStr = "register maps";
             break;
+        case kDexChunkLinkImage:
+            verboseStr = "class link image";
+            break;
         default:
             verboseStr = "(unknown chunk type)";
             break;
@@ -170,37 +170,59 @@ static u4 classDescriptorHash(const char* str)
     return hash;
 }
 
+/*
+ * Return the hash used by the class lookup table for "descriptor".
+ */
+u4 dexComputeClassDescriptorHash(const char* descriptor)
+{
+    return classDescriptorHash(descriptor);
+}
+
+/*
+ * Return the bucket array of a lookup table we're building.
+ */
+static DexClassLookupBucket* getWritableBuckets(DexClassLookup* pLookup)
+{
+    return (DexClassLookupBucket*) ((u1*) pLookup + pLookup->bucketOffset);
+}
+
 /*
  * Add an entry to the class lookup table.  We hash the string and probe
- * until we find an open slot.
+ * until we find a bucket with an open slot.
  */
 static void classLookupAdd(DexFile* pDexFile, DexClassLookup* pLookup,
     int stringOff, int classDefOff, int* pNumProbes)
 {
     const char* classDescriptor =
         (const char*) (pDexFile->baseAddr + stringOff);
-    const DexClassDef* pClassDef =
-        (const DexClassDef*) (pDexFile->baseAddr + classDefOff);
     u4 hash = classDescriptorHash(classDescriptor);
-    int mask = pLookup->numEntries-1;
+    DexClassLookupBucket* pBuckets = getWritableBuckets(pLookup);
+    int mask = pLookup->numBuckets-1;
     int idx = hash & mask;
 
     /*
-     * Find the first empty slot.  We oversized the table, so this is
-     * guaranteed to finish.
+     * Find the first bucket with an empty slot.  We oversized the table,
+     * so this is guaranteed to finish.
      */
     int probes = 0;
-    while (pLookup->table[idx].classDescriptorOffset != 0) {
+    while (true) {
+        DexClassLookupEntry* pEntries = pBuckets[idx].entries;
+        int i;
+
+        for (i = 0; i < kDexClassLookupBucketEntries; i++) {
+            if (pEntries[i].classDescriptorOffset == 0) {
+                pEntries[i].classDescriptorHash = hash;
+                pEntries[i].classDescriptorOffset = stringOff;
+                pEntries[i].classDefOffset = classDefOff;
+                pLookup->numClasses++;
+                *pNumProbes = probes;
+                return;
+            }
+        }
+
         idx = (idx + 1) & mask;
         probes++;
     }
-    //if (probes > 1)
-    //    ALOGW("classLookupAdd: probes=%d", probes);
-
-    pLookup->table[idx].classDescriptorHash = hash;
-    pLookup->table[idx].classDescriptorOffset = stringOff;
-    pLookup->table[idx].classDefOffset = classDefOff;
-    *pNumProbes = probes;
 }
 
 /*
@@ -212,29 +234,43 @@ DexClassLookup* dexCreateClassLookup(DexFile* pDexFile)
 {
     DexClassLookup* pLookup;
     int allocSize;
-    int i, numEntries;
+    int i, numBuckets;
     int numProbes, totalProbes, maxProbes;
 
     numProbes = totalProbes = maxProbes = 0;
 
     assert(pDexFile != NULL);
+    assert(sizeof(DexClassLookupBucket) == kDexClassLookupAlign);
+
+    /*
+     * Keep roughly twice as many slots as classes.  With several entries
+     * per bucket, the chance of spilling into the next bucket is small
+     * even when the table is half full, so nearly every lookup is a
+     * single cache line.
+     */
+    int numSlots = pDexFile->pHeader->classDefsSize * 2;
+    numBuckets = dexRoundUpPower2(
+        (numSlots + kDexClassLookupBucketEntries - 1)
+            / kDexClassLookupBucketEntries);
+    if (numBuckets == 0)
+        numBuckets = 1;
 
     /*
-     * Using a factor of 3 results in far less probing than a factor of 2,
-     * but almost doubles the flash storage requirements for the bootstrap
-     * DEX files.  The overall impact on class loading performance seems
-     * to be minor.  We could probably get some performance improvement by
-     * using a secondary hash.
+     * Leave room to slide the buckets forward to a cache-line boundary.
+     * We align them for the heap address here; dexAlignClassLookup() will
+     * adjust them again if the table is written somewhere else.
      */
-    numEntries = dexRoundUpPower2(pDexFile->pHeader->classDefsSize * 2);
-    allocSize = offsetof(DexClassLookup, table)
-                    + numEntries * sizeof(pLookup->table[0]);
+    allocSize = sizeof(DexClassLookup) + kDexClassLookupAlign
+                    + numBuckets * sizeof(DexClassLookupBucket);
 
     pLookup = (DexClassLookup*) calloc(1, allocSize);
     if (pLookup == NULL)
         return NULL;
     pLookup->size = allocSize;
-    pLookup->numEntries = numEntries;
+    pLookup->numBuckets = numBuckets;
+    pLookup->numClasses = 0;
+    pLookup->bucketOffset = sizeof(DexClassLookup);
+    dexAlignClassLookup(pLookup, (u4) (uintptr_t) pLookup);
 
     for (i = 0; i < (int)pDexFile->pHeader->classDefsSize; i++) {
         const DexClassDef* pClassDef;
@@ -252,15 +288,38 @@ DexClassLookup* dexCreateClassLookup(DexFile* pDexFile)
         totalProbes += numProbes;
     }
 
-    ALOGV("Class lookup: classes=%d slots=%d (%d%% occ) alloc=%d"
-         " total=%d max=%d",
-        pDexFile->pHeader->classDefsSize, numEntries,
-        (100 * pDexFile->pHeader->classDefsSize) / numEntries,
+    ALOGV("Class lookup: classes=%d buckets=%d (%d%% occ) alloc=%d"
+         " spills=%d max=%d",
+        pDexFile->pHeader->classDefsSize, numBuckets,
+        (100 * pDexFile->pHeader->classDefsSize) /
+            (numBuckets * kDexClassLookupBucketEntries),
         allocSize, totalProbes, maxProbes);
 
     return pLookup;
 }
 
+/*
+ * Slide the buckets so that they start on a cache-line boundary when the
+ * first byte of the lookup structure lives at "fileOffset" (or any address
+ * congruent to it).  The bucket contents don't change.
+ */
+void dexAlignClassLookup(DexClassLookup* pLookup, u4 fileOffset)
+{
+    const int mask = kDexClassLookupAlign - 1;
+    u4 start = fileOffset + sizeof(DexClassLookup);
+    int newOffset = sizeof(DexClassLookup) + ((kDexClassLookupAlign -
+        (start & mask)) & mask);
+
+    if (newOffset == pLookup->bucketOffset)
+        return;
+
+    assert(newOffset + pLookup->numBuckets * (int) sizeof(DexClassLookupBucket)
+        <= pLookup->size);
+    memmove((u1*) pLookup + newOffset, (u1*) pLookup + pLookup->bucketOffset,
+        pLookup->numBuckets * sizeof(DexClassLookupBucket));
+    pLookup->bucketOffset = newOffset;
+}
+
 
 /*
  * Set up the basic raw data pointers of a DexFile. This function isn't
@@ -440,32 +499,46 @@ void dexFileFree(DexFile* pDexFile)
  */
 const DexClassDef* dexFindClass(const DexFile* pDexFile,
     const char* descriptor)
+{
+    return dexFindClassWithHash(pDexFile, descriptor,
+        classDescriptorHash(descriptor));
+}
+
+/*
+ * Look up a class definition entry by descriptor, with the hash already
+ * computed.
+ */
+const DexClassDef* dexFindClassWithHash(const DexFile* pDexFile,
+    const char* descriptor, u4 hash)
 {
     const DexClassLookup* pLookup = pDexFile->pClassLookup;
-    u4 hash;
+    const DexClassLookupBucket* pBuckets = dexGetClassLookupBuckets(pLookup);
     int idx, mask;
 
-    hash = classDescriptorHash(descriptor);
-    mask = pLookup->numEntries - 1;
+    mask = pLookup->numBuckets - 1;
     idx = hash & mask;
 
     /*
-     * Search until we find a matching entry or an empty slot.
+     * Search until we find a matching entry or an empty slot.  The string
+     * is only examined when the full hash matches.
      */
     while (true) {
-        int offset;
-
-        offset = pLookup->table[idx].classDescriptorOffset;
-        if (offset == 0)
-            return NULL;
-
-        if (pLookup->table[idx].classDescriptorHash == hash) {
-            const char* str;
-
-            str = (const char*) (pDexFile->baseAddr + offset);
-            if (strcmp(str, descriptor) == 0) {
-                return (const DexClassDef*)
-                    (pDexFile->baseAddr + pLookup->table[idx].classDefOffset);
+        const DexClassLookupEntry* pEntries = pBuckets[idx].entries;
+        int i;
+
+        for (i = 0; i < kDexClassLookupBucketEntries; i++) {
+            int offset = pEntries[i].classDescriptorOffset;
+            if (offset == 0)
+                return NULL;
+
+            if (pEntries[i].classDescriptorHash == hash) {
+                const char* str;
+
+                str = (const char*) (pDexFile->baseAddr + offset);
+                if (strcmp(str, descriptor) == 0) {
+                    return (const DexClassDef*)
+                        (pDexFile->baseAddr + pEntries[i].classDefOffset);
+                }
             }
         }
 
@@ -473,7 +546,6 @@ const DexClassDef* dexFindClass(const DexFile* pDexFile,
     }
 }
 
-
 /*
  * Compute the DEX file checksum for a memory-mapped DEX file.
  */
@@ -61,7 +61,7 @@
 
 /* same, but for optimized DEX header */
 #define DEX_OPT_MAGIC   "dey\n"
-#define DEX_OPT_MAGIC_VERS  "036\0"
+#define DEX_OPT_MAGIC_VERS  "037\0"
 
 #define DEX_DEP_MAGIC   "deps"
 
@@ -189,6 +189,7 @@ enum {
 enum {
     kDexChunkClassLookup            = 0x434c4b50,   /* CLKP */
     kDexChunkRegisterMaps           = 0x524d4150,   /* RMAP */
+    kDexChunkLinkImage              = 0x4c494d47,   /* LIMG */
 
     kDexChunkEnd                    = 0x41454e44,   /* AEND */
 };
@@ -452,15 +453,39 @@ struct DexEncodedArray {
  * don't need the same hash table in every VM.  This is slightly slower than
  * a hash table with direct pointers to the items, but because it's shared
  * there's less of a penalty for using a fairly sparse table.
+ *
+ * The table is divided into buckets that exactly fill one cache line.  A
+ * class is placed in the first bucket with a free entry, starting from the
+ * bucket selected by its hash, so a lookup usually touches a single line.
+ * Each entry carries the full 32-bit hash, which means a miss almost never
+ * has to look at the string data.  Entries within a bucket are filled in
+ * order, so an empty entry terminates the search.
+ *
+ * The buckets start "bucketOffset" bytes from the start of the structure.
+ * dexopt chooses the offset so that the buckets are cache-line aligned in
+ * the output file; the padding bytes ahead of them are unused.
  */
+enum {
+    kDexClassLookupAlign = 64,          /* bucket alignment, in bytes */
+    kDexClassLookupBucketEntries = 5,   /* entries per bucket */
+};
+
+struct DexClassLookupEntry {
+    u4      classDescriptorHash;        // class descriptor hash code
+    int     classDescriptorOffset;      // in bytes, from start of DEX
+    int     classDefOffset;             // in bytes, from start of DEX
+};
+
+struct DexClassLookupBucket {
+    DexClassLookupEntry entries[kDexClassLookupBucketEntries];
+    u4      pad;
+};
+
 struct DexClassLookup {
     int     size;                       // total size, including "size"
-    int     numEntries;                 // size of table[]; always power of 2
-    struct {
-        u4      classDescriptorHash;    // class descriptor hash code
-        int     classDescriptorOffset;  // in bytes, from start of DEX
-        int     classDefOffset;         // in bytes, from start of DEX
-    } table[1];
+    int     numBuckets;                 // number of buckets; always power of 2
+    int     bucketOffset;               // in bytes, from start of this struct
+    int     numClasses;                 // number of occupied entries
 };
 
 /*
@@ -489,7 +514,7 @@ struct DexOptHeader {
 
 #define DEX_OPT_FLAG_BIG            (1<<1)  /* swapped to big-endian */
 
-#define DEX_INTERFACE_CACHE_SIZE    128     /* must be power of 2 */
+#define DEX_INTERFACE_CACHE_SIZE    128     /* default; -Xinterfacecache */
 
 /*
  * Structure representing a DEX file.
@@ -517,6 +542,7 @@ struct DexFile {
      */
     const DexClassLookup* pClassLookup;
     const void*         pRegisterMapPool;       // RegisterMapClassPool
+    const void*         pLinkImagePool;         // LinkImageClassPool
 
     /* points to start of DEX file data */
     const u1*           baseAddr;
@@ -588,17 +614,50 @@ void dexFileFree(DexFile* pDexFile);
  */
 DexClassLookup* dexCreateClassLookup(DexFile* pDexFile);
 
+/*
+ * Move the class lookup buckets so they will be cache-line aligned when the
+ * structure is stored at "fileOffset" in a page-aligned mapping.
+ */
+void dexAlignClassLookup(DexClassLookup* pLookup, u4 fileOffset);
+
+/*
+ * Compute the hash used by the class lookup table for a class descriptor.
+ */
+u4 dexComputeClassDescriptorHash(const char* descriptor);
+
 /*
  * Find a class definition by descriptor.
  */
 const DexClassDef* dexFindClass(const DexFile* pFile, const char* descriptor);
 
+/*
+ * Find a class definition by descriptor, using a hash value previously
+ * obtained from dexComputeClassDescriptorHash().  Useful when the same
+ * descriptor is looked up in several DEX files.
+ */
+const DexClassDef* dexFindClassWithHash(const DexFile* pFile,
+    const char* descriptor, u4 hash);
+
 /*
  * Set up the basic raw data pointers of a DexFile. This function isn't
  * meant for general use.
  */
 void dexFileSetupBasicPointers(DexFile* pDexFile, const u1* data);
 
+/* return the first bucket of a class lookup table */
+DEX_INLINE const DexClassLookupBucket* dexGetClassLookupBuckets(
+    const DexClassLookup* pLookup) {
+    return (const DexClassLookupBucket*)
+        ((const u1*) pLookup + pLookup->bucketOffset);
+}
+
+/* start pulling in the lookup bucket for "hash", ahead of a probe */
+DEX_INLINE void dexPrefetchClassLookup(const DexFile* pDexFile, u4 hash) {
+    const DexClassLookup* pLookup = pDexFile->pClassLookup;
+    __builtin_prefetch(dexGetClassLookupBuckets(pLookup) +
+        (hash & (pLookup->numBuckets - 1)));
+}
+
 /* return the DexMapList of the file, if any */
 DEX_INLINE const DexMapList* dexGetMap(const DexFile* pDexFile) {
     u4 mapOff = pDexFile->pHeader->mapOff;
@@ -33,6 +33,43 @@ static bool isValidPointer(const void* ptr, const void* start, const void* end)
     return (ptr >= start) && (ptr < end) && (((uintptr_t) ptr & 7) == 0);
 }
 
+/*
+ * Check the offsets in a link image chunk (see vm/oo/LinkImage.h).  The
+ * chunk starts with a u4 class count and one u4 offset per class; each
+ * non-zero offset names a 4-byte aligned entry holding four u2 counts
+ * followed by (virtualMethodCount + ifviPoolCount) u2 slots.  Returns
+ * true if every entry lies inside the chunk.
+ */
+static bool isValidLinkImage(const u1* pData, u4 size)
+{
+    if (size < sizeof(u4))
+        return false;
+
+    const u4* pPool = (const u4*) pData;
+    u4 numClasses = pPool[0];
+    if (numClasses > (size / sizeof(u4)) - 1)
+        return false;
+
+    u4 headerEnd = (numClasses + 1) * sizeof(u4);
+    for (u4 i = 0; i < numClasses; i++) {
+        u4 offset = pPool[i + 1];
+        if (offset == 0)
+            continue;
+        if ((offset & 3) != 0 || offset < headerEnd || offset > size ||
+            size - offset < 4 * sizeof(u2))
+        {
+            return false;
+        }
+
+        const u2* pEntry = (const u2*) (pData + offset);
+        u4 dataLen = (4 + (u4) pEntry[2] + (u4) pEntry[3]) * sizeof(u2);
+        if (dataLen > size - offset)
+            return false;
+    }
+
+    return true;
+}
+
 /* (documented in header file) */
 u4 dexComputeOptChecksum(const DexOptHeader* pOptHeader)
 {
@@ -106,12 +143,36 @@ bool dexParseOptData(const u1* data, size_t length, DexFile* pDexFile)
 
         switch (*pOpt) {
         case kDexChunkClassLookup:
-            pDexFile->pClassLookup = (const DexClassLookup*) pOptData;
+            {
+                const DexClassLookup* pLookup =
+                    (const DexClassLookup*) pOptData;
+                u4 bucketEnd = pLookup->bucketOffset +
+                    pLookup->numBuckets * sizeof(DexClassLookupBucket);
+                if (size < sizeof(DexClassLookup) ||
+                    pLookup->numBuckets <= 0 ||
+                    (pLookup->numBuckets & (pLookup->numBuckets - 1)) != 0 ||
+                    pLookup->bucketOffset < (int) sizeof(DexClassLookup) ||
+                    bucketEnd > size)
+                {
+                    ALOGE("Bogus class lookup table (size=%u)", size);
+                    return false;
+                }
+                pDexFile->pClassLookup = pLookup;
+            }
             break;
         case kDexChunkRegisterMaps:
             ALOGV("+++ found register maps, size=%u", size);
             pDexFile->pRegisterMapPool = pOptData;
             break;
+        case kDexChunkLinkImage:
+            ALOGV("+++ found link image, size=%u", size);
+            if (!isValidLinkImage(pOptData, size)) {
+                /* just an accelerator; link the slow way instead */
+                ALOGW("Bogus link image (size=%u), ignoring", size);
+                break;
+            }
+            pDexFile->pLinkImagePool = pOptData;
+            break;
         default:
             ALOGI("Unknown chunk 0x%08x (%c%c%c%c), size=%d in opt data area",
                 *pOpt,
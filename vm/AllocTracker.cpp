@@ -29,6 +29,15 @@
  * Because this is an optional feature it's best to leave the existing
  * code undisturbed and just use an additional lock.
  *
+ * Recording every allocation is too expensive to leave on, so there is
+ * also a sampling mode (-Xallocsample or dalvik.vm.allocTrackerSample).
+ * Each thread records one allocation for every N bytes (on average) that
+ * it allocates, and keeps the samples in a small thread-local buffer that
+ * is moved into the shared set when it fills up.  In either mode stacks
+ * are hash-consed, so each record only holds an index into the stack
+ * table, and the table doubles as a per-stack summary that can be written
+ * out as a pprof heap profile.
+ *
  * We don't currently track allocations of class objects.  We could, but
  * with the possible exception of Proxy objects they're not that interesting.
  *
@@ -52,19 +61,78 @@ static bool isPowerOfTwo(int x) { return (x & (x - 1)) == 0; }
 
 #define kDefaultNumAllocRecords 64*1024 /* MUST be power of 2 */
 
+#define kAllocSampleBufferSize      8       /* samples buffered per thread */
+
+#define kInitialStackBuckets        1024    /* MUST be power of 2 */
+
+#define kNoStack                    0xffffffff
+
+/*
+ * One frame of an allocation stack trace.
+ */
+struct AllocStackElem {
+    const Method*   method;     /* which method we're executing in */
+    int             pc;         /* current execution offset, in 16-bit units */
+};
+
+/*
+ * A unique combination of allocated class and stack trace.  The frames
+ * live in AllocStackTable.frames, starting at "firstFrame".
+ */
+struct AllocStack {
+    ClassObject*    clazz;      /* class allocated */
+    u4              hash;
+    u4              next;       /* next stack in the hash chain */
+    u4              firstFrame;
+    u4              depth;
+    u4              count;      /* #of recorded allocations with this stack */
+    u8              bytes;      /* total size of those allocations */
+};
+
+/*
+ * Hash-consed stack traces.  Every distinct stack is stored once, and
+ * records refer to it by index.
+ */
+struct AllocStackTable {
+    AllocStack*     stacks;
+    u4              numStacks;
+    u4              maxStacks;
+
+    AllocStackElem* frames;
+    u4              numFrames;
+    u4              maxFrames;
+
+    u4*             buckets;    /* head of each hash chain */
+    u4              numBuckets;
+};
+
 /*
  * Record the details of an allocation.
  */
 struct AllocRecord {
-    ClassObject*    clazz;      /* class allocated in this block */
+    u4              stackId;    /* index into gDvm.allocStacks */
     u4              size;       /* total size requested */
     u2              threadId;   /* simple thread ID; could be recycled */
+};
 
-    /* stack trace elements; unused entries have method==NULL */
-    struct {
-        const Method* method;   /* which method we're executing in */
-        int         pc;         /* current execution offset, in 16-bit units */
-    } stackElem[kMaxAllocRecordStackDepth];
+/*
+ * An allocation whose stack has been captured but which hasn't been
+ * added to the records yet.  Unused entries have method==NULL.
+ */
+struct AllocSample {
+    ClassObject*    clazz;
+    u4              size;
+    AllocStackElem  stackElem[kMaxAllocRecordStackDepth];
+};
+
+/*
+ * Per-thread buffer of samples.  Only used in sampling mode, so that a
+ * thread only takes gDvm.allocTrackerLock once every
+ * kAllocSampleBufferSize samples.
+ */
+struct AllocSampleBuffer {
+    int             count;
+    AllocSample     samples[kAllocSampleBufferSize];
 };
 
 /*
@@ -79,15 +147,35 @@ bool dvmAllocTrackerStartup()
     /* initialized when enabled by DDMS */
     assert(gDvm.allocRecords == NULL);
 
+    /* -Xallocsample turns tracking on from the start */
+    if (gDvm.allocSampleInterval != 0)
+        return dvmEnableAllocTracker();
+
     return true;
 }
 
+/*
+ * Free the stack table.
+ */
+static void freeStackTable(AllocStackTable* pTable)
+{
+    if (pTable == NULL)
+        return;
+
+    free(pTable->stacks);
+    free(pTable->frames);
+    free(pTable->buckets);
+    free(pTable);
+}
+
 /*
  * Release anything we're holding on to.
  */
 void dvmAllocTrackerShutdown()
 {
     free(gDvm.allocRecords);
+    freeStackTable(gDvm.allocStacks);
+    free(gDvm.allocProfileFile);
     dvmDestroyMutex(&gDvm.allocTrackerLock);
 }
 
@@ -120,6 +208,48 @@ static int getAllocRecordMax() {
     return kDefaultNumAllocRecords;
 }
 
+/*
+ * Get the sampling interval, in bytes.  Zero means every allocation is
+ * recorded.
+ */
+static size_t getAllocSampleInterval() {
+#ifdef HAVE_ANDROID_OS
+    // Check whether there's a system property asking for sampling.
+    const char* propertyName = "dalvik.vm.allocTrackerSample";
+    char intervalString[PROPERTY_VALUE_MAX];
+    if (property_get(propertyName, intervalString, "") > 0) {
+        char* end;
+        size_t value = strtoul(intervalString, &end, 10);
+        if (*end != '\0') {
+            ALOGE("Ignoring %s '%s' --- invalid", propertyName, intervalString);
+            return gDvm.allocSampleInterval;
+        }
+        return value;
+    }
+#endif
+    return gDvm.allocSampleInterval;
+}
+
+/*
+ * Allocate an empty stack table.
+ */
+static AllocStackTable* allocStackTable()
+{
+    AllocStackTable* pTable =
+        (AllocStackTable*) calloc(1, sizeof(AllocStackTable));
+    if (pTable == NULL)
+        return NULL;
+
+    pTable->numBuckets = kInitialStackBuckets;
+    pTable->buckets = (u4*) malloc(sizeof(u4) * pTable->numBuckets);
+    if (pTable->buckets == NULL) {
+        free(pTable);
+        return NULL;
+    }
+    memset(pTable->buckets, 0xff, sizeof(u4) * pTable->numBuckets);
+    return pTable;
+}
+
 /*
  * Enable allocation tracking.  Does nothing if tracking is already enabled.
  *
@@ -132,15 +262,24 @@ bool dvmEnableAllocTracker()
 
     if (gDvm.allocRecords == NULL) {
         gDvm.allocRecordMax = getAllocRecordMax();
+        gDvm.allocSampleInterval = getAllocSampleInterval();
 
-        ALOGI("Enabling alloc tracker (%d entries, %d frames --> %d bytes)",
+        ALOGI("Enabling alloc tracker (%d entries, %d frames --> %d bytes, "
+              "sampling every %zd bytes)",
               gDvm.allocRecordMax, kMaxAllocRecordStackDepth,
-              sizeof(AllocRecord) * gDvm.allocRecordMax);
+              sizeof(AllocRecord) * gDvm.allocRecordMax,
+              gDvm.allocSampleInterval);
         gDvm.allocRecordHead = gDvm.allocRecordCount = 0;
+        gDvm.allocStacks = allocStackTable();
         gDvm.allocRecords = (AllocRecord*) malloc(sizeof(AllocRecord) * gDvm.allocRecordMax);
 
-        if (gDvm.allocRecords == NULL)
+        if (gDvm.allocRecords == NULL || gDvm.allocStacks == NULL) {
+            free(gDvm.allocRecords);
+            gDvm.allocRecords = NULL;
+            freeStackTable(gDvm.allocStacks);
+            gDvm.allocStacks = NULL;
             result = false;
+        }
     }
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
@@ -149,6 +288,9 @@ bool dvmEnableAllocTracker()
 
 /*
  * Disable allocation tracking.  Does nothing if tracking is not enabled.
+ *
+ * Samples still sitting in thread-local buffers are discarded the next
+ * time the owning thread flushes them.
  */
 void dvmDisableAllocTracker()
 {
@@ -157,6 +299,9 @@ void dvmDisableAllocTracker()
     if (gDvm.allocRecords != NULL) {
         free(gDvm.allocRecords);
         gDvm.allocRecords = NULL;
+        gDvm.allocRecordCount = 0;
+        freeStackTable(gDvm.allocStacks);
+        gDvm.allocStacks = NULL;
     }
 
     dvmUnlockMutex(&gDvm.allocTrackerLock);
@@ -165,7 +310,7 @@ void dvmDisableAllocTracker()
 /*
  * Get the last few stack frames.
  */
-static void getStackFrames(Thread* self, AllocRecord* pRec)
+static void getStackFrames(Thread* self, AllocSample* pSample)
 {
     int stackDepth = 0;
     void* fp;
@@ -177,14 +322,14 @@ static void getStackFrames(Thread* self, AllocRecord* pRec)
         const Method* method = saveArea->method;
 
         if (!dvmIsBreakFrame((u4*) fp)) {
-            pRec->stackElem[stackDepth].method = method;
+            pSample->stackElem[stackDepth].method = method;
             if (dvmIsNativeMethod(method)) {
-                pRec->stackElem[stackDepth].pc = 0;
+                pSample->stackElem[stackDepth].pc = 0;
             } else {
                 assert(saveArea->xtra.currentPc >= method->insns &&
                         saveArea->xtra.currentPc <
                         method->insns + dvmGetMethodInsnsSize(method));
-                pRec->stackElem[stackDepth].pc =
+                pSample->stackElem[stackDepth].pc =
                     (int) (saveArea->xtra.currentPc - method->insns);
             }
             stackDepth++;
@@ -196,46 +341,296 @@ static void getStackFrames(Thread* self, AllocRecord* pRec)
 
     /* clear out the rest (normally there won't be any) */
     while (stackDepth < kMaxAllocRecordStackDepth) {
-        pRec->stackElem[stackDepth].method = NULL;
-        pRec->stackElem[stackDepth].pc = 0;
+        pSample->stackElem[stackDepth].method = NULL;
+        pSample->stackElem[stackDepth].pc = 0;
         stackDepth++;
     }
 }
 
 /*
- * Add a new allocation to the set.
+ * Compute the number of valid frames in a sample.
  */
-void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
+static int getSampleDepth(const AllocSample* pSample)
 {
-    Thread* self = dvmThreadSelf();
-    if (self == NULL) {
-        ALOGW("alloc tracker: no thread");
-        return;
+    int depth;
+    for (depth = 0; depth < kMaxAllocRecordStackDepth; depth++) {
+        if (pSample->stackElem[depth].method == NULL)
+            break;
     }
+    return depth;
+}
 
-    dvmLockMutex(&gDvm.allocTrackerLock);
-    if (gDvm.allocRecords == NULL) {
-        dvmUnlockMutex(&gDvm.allocTrackerLock);
-        return;
+/*
+ * Hash the class and stack frames of a sample.
+ */
+static u4 computeSampleHash(const AllocSample* pSample, int depth)
+{
+    u4 hash = (u4)(uintptr_t) pSample->clazz;
+    for (int i = 0; i < depth; i++) {
+        hash = hash * 31 + (u4)(uintptr_t) pSample->stackElem[i].method;
+        hash = hash * 31 + pSample->stackElem[i].pc;
+    }
+    return hash;
+}
+
+/*
+ * Compare two sets of stack frames.
+ */
+static bool sameFrames(const AllocStackElem* pElem1,
+    const AllocStackElem* pElem2, int depth)
+{
+    for (int i = 0; i < depth; i++) {
+        if (pElem1[i].method != pElem2[i].method ||
+            pElem1[i].pc != pElem2[i].pc)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Double the number of hash buckets and rebuild the chains.
+ */
+static bool growStackBuckets(AllocStackTable* pTable)
+{
+    u4 newNumBuckets = pTable->numBuckets * 2;
+    u4* newBuckets = (u4*) malloc(sizeof(u4) * newNumBuckets);
+    if (newBuckets == NULL)
+        return false;
+    memset(newBuckets, 0xff, sizeof(u4) * newNumBuckets);
+
+    for (u4 i = 0; i < pTable->numStacks; i++) {
+        AllocStack* pStack = &pTable->stacks[i];
+        u4 bucket = pStack->hash & (newNumBuckets - 1);
+        pStack->next = newBuckets[bucket];
+        newBuckets[bucket] = i;
+    }
+
+    free(pTable->buckets);
+    pTable->buckets = newBuckets;
+    pTable->numBuckets = newNumBuckets;
+    return true;
+}
+
+/*
+ * Find the stack matching the sample, adding it if it's new.  Returns the
+ * stack index, or kNoStack if we ran out of memory.
+ *
+ * The caller must hold gDvm.allocTrackerLock.
+ */
+static u4 internStack(AllocStackTable* pTable, const AllocSample* pSample)
+{
+    int depth = getSampleDepth(pSample);
+    u4 hash = computeSampleHash(pSample, depth);
+
+    u4 idx = pTable->buckets[hash & (pTable->numBuckets - 1)];
+    while (idx != kNoStack) {
+        const AllocStack* pStack = &pTable->stacks[idx];
+        if (pStack->hash == hash && pStack->clazz == pSample->clazz &&
+            pStack->depth == (u4) depth &&
+            sameFrames(&pTable->frames[pStack->firstFrame],
+                pSample->stackElem, depth))
+        {
+            return idx;
+        }
+        idx = pStack->next;
     }
 
+    /* not found, make room for a new one */
+    if (pTable->numStacks == pTable->maxStacks) {
+        u4 newMax = (pTable->maxStacks == 0) ? 256 : pTable->maxStacks * 2;
+        AllocStack* newStacks = (AllocStack*)
+            realloc(pTable->stacks, sizeof(AllocStack) * newMax);
+        if (newStacks == NULL)
+            return kNoStack;
+        pTable->stacks = newStacks;
+        pTable->maxStacks = newMax;
+    }
+    if (pTable->numFrames + depth > pTable->maxFrames) {
+        u4 newMax = (pTable->maxFrames == 0) ? 2048 : pTable->maxFrames * 2;
+        AllocStackElem* newFrames = (AllocStackElem*)
+            realloc(pTable->frames, sizeof(AllocStackElem) * newMax);
+        if (newFrames == NULL)
+            return kNoStack;
+        pTable->frames = newFrames;
+        pTable->maxFrames = newMax;
+    }
+    if (pTable->numStacks >= pTable->numBuckets)
+        (void) growStackBuckets(pTable);    /* chains just get longer */
+
+    idx = pTable->numStacks++;
+    AllocStack* pStack = &pTable->stacks[idx];
+    pStack->clazz = pSample->clazz;
+    pStack->hash = hash;
+    pStack->firstFrame = pTable->numFrames;
+    pStack->depth = depth;
+    pStack->count = 0;
+    pStack->bytes = 0;
+    memcpy(&pTable->frames[pTable->numFrames], pSample->stackElem,
+        depth * sizeof(AllocStackElem));
+    pTable->numFrames += depth;
+
+    u4 bucket = hash & (pTable->numBuckets - 1);
+    pStack->next = pTable->buckets[bucket];
+    pTable->buckets[bucket] = idx;
+    return idx;
+}
+
+/*
+ * Add a captured allocation to the set.
+ *
+ * The caller must hold gDvm.allocTrackerLock, and tracking must be enabled.
+ */
+static void addRecord(u2 threadId, const AllocSample* pSample)
+{
+    u4 stackId = internStack(gDvm.allocStacks, pSample);
+    if (stackId == kNoStack)
+        return;
+
     /* advance and clip */
     if (++gDvm.allocRecordHead == gDvm.allocRecordMax)
         gDvm.allocRecordHead = 0;
 
     AllocRecord* pRec = &gDvm.allocRecords[gDvm.allocRecordHead];
 
-    pRec->clazz = clazz;
-    pRec->size = size;
-    pRec->threadId = self->threadId;
-    getStackFrames(self, pRec);
+    pRec->stackId = stackId;
+    pRec->size = pSample->size;
+    pRec->threadId = threadId;
+
+    AllocStack* pStack = &gDvm.allocStacks->stacks[stackId];
+    pStack->count++;
+    pStack->bytes += pSample->size;
 
     if (gDvm.allocRecordCount < gDvm.allocRecordMax)
         gDvm.allocRecordCount++;
+}
 
+/*
+ * Move the samples buffered by "thread" into the set.  If tracking has
+ * been disabled in the meantime, they are dropped.
+ */
+static void flushSampleBuffer(Thread* thread)
+{
+    AllocSampleBuffer* pBuf = thread->allocSampleBuf;
+    if (pBuf == NULL || pBuf->count == 0)
+        return;
+
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    if (gDvm.allocRecords != NULL) {
+        for (int i = 0; i < pBuf->count; i++)
+            addRecord(thread->threadId, &pBuf->samples[i]);
+    }
+    pBuf->count = 0;
+    dvmUnlockMutex(&gDvm.allocTrackerLock);
+}
+
+/*
+ * Pick the number of bytes until the next sample.  We randomize it a bit
+ * around the configured interval so that periodic allocation patterns
+ * don't line up with the sampling.
+ */
+static size_t nextSampleInterval(Thread* self, size_t interval)
+{
+    self->allocSampleSeed = self->allocSampleSeed * 1103515245 + 12345;
+    u4 rand = self->allocSampleSeed >> 8;
+    return interval / 2 + rand % (interval + 1);
+}
+
+/*
+ * Record a sampled allocation in the thread's buffer.
+ */
+static void sampleAllocation(Thread* self, ClassObject* clazz, size_t size,
+    size_t interval)
+{
+    AllocSampleBuffer* pBuf = self->allocSampleBuf;
+    if (pBuf == NULL) {
+        pBuf = (AllocSampleBuffer*) calloc(1, sizeof(AllocSampleBuffer));
+        if (pBuf == NULL)
+            return;
+        self->allocSampleBuf = pBuf;
+        self->allocSampleSeed = self->threadId ^ (u4)(uintptr_t) self;
+    }
+    self->allocSampleBytesLeft = nextSampleInterval(self, interval);
+
+    AllocSample* pSample = &pBuf->samples[pBuf->count];
+    pSample->clazz = clazz;
+    pSample->size = size;
+    getStackFrames(self, pSample);
+
+    if (++pBuf->count == kAllocSampleBufferSize)
+        flushSampleBuffer(self);
+}
+
+/*
+ * Add a new allocation to the set.
+ *
+ * In sampling mode, we only capture one allocation every
+ * gDvm.allocSampleInterval bytes (on average) per thread, and buffer the
+ * samples locally.  Otherwise every allocation is recorded right away.
+ * Either way the stack is walked without holding the lock.
+ */
+void dvmDoTrackAllocation(ClassObject* clazz, size_t size)
+{
+    Thread* self = dvmThreadSelf();
+    if (self == NULL) {
+        ALOGW("alloc tracker: no thread");
+        return;
+    }
+
+    size_t interval = gDvm.allocSampleInterval;
+    if (interval != 0) {
+        if (self->allocSampleBytesLeft > size) {
+            self->allocSampleBytesLeft -= size;
+        } else {
+            sampleAllocation(self, clazz, size, interval);
+        }
+        return;
+    }
+
+    AllocSample sample;
+    sample.clazz = clazz;
+    sample.size = size;
+    getStackFrames(self, &sample);
+
+    dvmLockMutex(&gDvm.allocTrackerLock);
+    if (gDvm.allocRecords != NULL)
+        addRecord(self->threadId, &sample);
     dvmUnlockMutex(&gDvm.allocTrackerLock);
 }
 
+/*
+ * Flush and free a thread's sample buffer.  Called when the thread is
+ * going away.
+ */
+void dvmAllocTrackerThreadExit(Thread* thread)
+{
+    flushSampleBuffer(thread);
+    free(thread->allocSampleBuf);
+    thread->allocSampleBuf = NULL;
+}
+
+/*
+ * Flush the sample buffers of all threads, so a report includes the most
+ * recent samples.  The other threads are suspended while we do this.
+ */
+static void flushAllSampleBuffers()
+{
+    Thread* self = dvmThreadSelf();
+    if (gDvm.allocSampleInterval == 0 || self == NULL)
+        return;
+
+    dvmSuspendAllThreads(SUSPEND_FOR_SAMPLING);
+    dvmLockThreadList(self);
+    for (Thread* thread = gDvm.threadList; thread != NULL;
+         thread = thread->next)
+    {
+        flushSampleBuffer(thread);
+    }
+    dvmUnlockThreadList();
+    dvmResumeAllThreads(SUSPEND_FOR_SAMPLING);
+}
+
 
 /*
  * ===========================================================================
@@ -305,6 +700,18 @@ inline static int headIndex()
             & (gDvm.allocRecordMax-1);
 }
 
+/*
+ * Get the stack for a record, and its frames.
+ */
+inline static const AllocStack* getRecordStack(const AllocRecord* pRec)
+{
+    return &gDvm.allocStacks->stacks[pRec->stackId];
+}
+inline static const AllocStackElem* getStackElems(const AllocStack* pStack)
+{
+    return &gDvm.allocStacks->frames[pStack->firstFrame];
+}
+
 /*
  * Dump the contents of a PointerSet full of character pointers.
  */
@@ -350,17 +757,15 @@ static bool populateStringTables(PointerSet* classNames,
     classCount = methodCount = fileCount = 0;
 
     while (count--) {
-        AllocRecord* pRec = &gDvm.allocRecords[idx];
+        const AllocStack* pStack = getRecordStack(&gDvm.allocRecords[idx]);
+        const AllocStackElem* stackElem = getStackElems(pStack);
 
-        dvmPointerSetAddEntry(classNames, pRec->clazz->descriptor);
+        dvmPointerSetAddEntry(classNames, pStack->clazz->descriptor);
         classCount++;
 
-        int i;
-        for (i = 0; i < kMaxAllocRecordStackDepth; i++) {
-            if (pRec->stackElem[i].method == NULL)
-                break;
-
-            const Method* method = pRec->stackElem[i].method;
+        u4 i;
+        for (i = 0; i < pStack->depth; i++) {
+            const Method* method = stackElem[i].method;
             dvmPointerSetAddEntry(classNames, method->clazz->descriptor);
             classCount++;
             dvmPointerSetAddEntry(methodNames, method->name);
@@ -412,20 +817,16 @@ static size_t generateBaseOutput(u1* ptr, size_t baseLen,
 
     while (count--) {
         AllocRecord* pRec = &gDvm.allocRecords[idx];
-
-        /* compute depth */
-        int  depth;
-        for (depth = 0; depth < kMaxAllocRecordStackDepth; depth++) {
-            if (pRec->stackElem[depth].method == NULL)
-                break;
-        }
+        const AllocStack* pStack = getRecordStack(pRec);
+        const AllocStackElem* stackElem = getStackElems(pStack);
+        int depth = pStack->depth;
 
         /* output header */
         if (origPtr != NULL) {
             set4BE(&ptr[0], pRec->size);
             set2BE(&ptr[4], pRec->threadId);
             set2BE(&ptr[6],
-                dvmPointerSetFind(classNames, pRec->clazz->descriptor));
+                dvmPointerSetFind(classNames, pStack->clazz->descriptor));
             set1(&ptr[8], depth);
         }
         ptr += kEntryHeaderLen;
@@ -434,10 +835,10 @@ static size_t generateBaseOutput(u1* ptr, size_t baseLen,
         int i;
         for (i = 0; i < depth; i++) {
             if (origPtr != NULL) {
-                const Method* method = pRec->stackElem[i].method;
+                const Method* method = stackElem[i].method;
                 int lineNum;
 
-                lineNum = dvmLineNumFromPC(method, pRec->stackElem[i].pc);
+                lineNum = dvmLineNumFromPC(method, stackElem[i].pc);
                 if (lineNum > 32767)
                     lineNum = 32767;
 
@@ -529,6 +930,7 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen)
     bool result = false;
     u1* buffer = NULL;
 
+    flushAllSampleBuffers();
     dvmLockMutex(&gDvm.allocTrackerLock);
 
     /*
@@ -638,22 +1040,21 @@ void dvmDumpTrackedAllocations(bool enable)
         gDvm.allocRecordHead, count);
     while (count--) {
         AllocRecord* pRec = &gDvm.allocRecords[idx];
+        const AllocStack* pStack = getRecordStack(pRec);
+        const AllocStackElem* stackElem = getStackElems(pStack);
         ALOGI(" T=%-2d %6d %s",
-            pRec->threadId, pRec->size, pRec->clazz->descriptor);
+            pRec->threadId, pRec->size, pStack->clazz->descriptor);
 
         if (true) {
-            for (int i = 0; i < kMaxAllocRecordStackDepth; i++) {
-                if (pRec->stackElem[i].method == NULL)
-                    break;
-
-                const Method* method = pRec->stackElem[i].method;
+            for (u4 i = 0; i < pStack->depth; i++) {
+                const Method* method = stackElem[i].method;
                 if (dvmIsNativeMethod(method)) {
                     ALOGI("    %s.%s (Native)",
                         method->clazz->descriptor, method->name);
                 } else {
                     ALOGI("    %s.%s +%d",
                         method->clazz->descriptor, method->name,
-                        pRec->stackElem[i].pc);
+                        stackElem[i].pc);
                 }
             }
         }
@@ -673,3 +1074,127 @@ void dvmDumpTrackedAllocations(bool enable)
             free(data);
     }
 }
+
+/*
+ * Symbolic addresses for the profile.  Frame "n" of the stack table gets
+ * kProfileAddrBase + n * kProfileAddrStep, and the allocated class of
+ * stack "n" gets the address just after the last frame's plus
+ * n * kProfileAddrStep.
+ */
+#define kProfileAddrBase    0x10000
+#define kProfileAddrStep    16
+
+static u8 frameProfileAddr(u4 frameIdx)
+{
+    return kProfileAddrBase + (u8) frameIdx * kProfileAddrStep;
+}
+static u8 classProfileAddr(u4 stackId)
+{
+    return frameProfileAddr(gDvm.allocStacks->numFrames + stackId);
+}
+
+/*
+ * Write the stack table out as a pprof heap profile, in the symbolized
+ * legacy text format:
+ *
+ *   --- symbol
+ *   binary=dalvikvm
+ *   0x<addr> <symbol>
+ *   ...
+ *   ---
+ *   --- heap
+ *   heap profile: <count>: <bytes> [<count>: <bytes>] @ heap_v2/<interval>
+ *   <count>: <bytes> [<count>: <bytes>] @ 0x<addr> 0x<addr> ...
+ *   ...
+ *
+ * Each stack starts with a pseudo-frame naming the allocated class.  We
+ * don't track frees, so both the "in use" and the "allocated" columns
+ * hold everything allocated since tracking was enabled.  In sampling mode
+ * these are the sampled counts; pprof scales them using the interval.
+ */
+static bool writeProfile(FILE* fp)
+{
+    const AllocStackTable* pTable = gDvm.allocStacks;
+
+    fprintf(fp, "--- symbol\nbinary=dalvikvm\n");
+    for (u4 i = 0; i < pTable->numStacks; i++) {
+        const AllocStack* pStack = &pTable->stacks[i];
+        const AllocStackElem* stackElem = getStackElems(pStack);
+
+        fprintf(fp, "0x%016llx new %s\n",
+            classProfileAddr(i), pStack->clazz->descriptor);
+        for (u4 j = 0; j < pStack->depth; j++) {
+            const Method* method = stackElem[j].method;
+            fprintf(fp, "0x%016llx %s.%s (%s:%d)\n",
+                frameProfileAddr(pStack->firstFrame + j),
+                method->clazz->descriptor, method->name,
+                getMethodSourceFile(method),
+                dvmLineNumFromPC(method, stackElem[j].pc));
+        }
+    }
+    fprintf(fp, "---\n--- heap\n");
+
+    u8 totalCount = 0, totalBytes = 0;
+    for (u4 i = 0; i < pTable->numStacks; i++) {
+        totalCount += pTable->stacks[i].count;
+        totalBytes += pTable->stacks[i].bytes;
+    }
+    fprintf(fp, "heap profile: %llu: %llu [%llu: %llu] @ heap_v2/%zd\n",
+        totalCount, totalBytes, totalCount, totalBytes,
+        gDvm.allocSampleInterval != 0 ? gDvm.allocSampleInterval : 1);
+
+    for (u4 i = 0; i < pTable->numStacks; i++) {
+        const AllocStack* pStack = &pTable->stacks[i];
+        if (pStack->count == 0)
+            continue;
+
+        fprintf(fp, "%u: %llu [%u: %llu] @ 0x%016llx",
+            pStack->count, pStack->bytes, pStack->count, pStack->bytes,
+            classProfileAddr(i));
+        for (u4 j = 0; j < pStack->depth; j++)
+            fprintf(fp, " 0x%016llx", frameProfileAddr(pStack->firstFrame + j));
+        fprintf(fp, "\n");
+    }
+
+    return !ferror(fp);
+}
+
+/*
+ * Write the allocation profile to "fileName" in pprof format.
+ *
+ * Returns "true" on success.
+ */
+bool dvmWriteAllocProfile(const char* fileName)
+{
+    bool result = false;
+
+    flushAllSampleBuffers();
+    dvmLockMutex(&gDvm.allocTrackerLock);
+
+    if (gDvm.allocRecords == NULL) {
+        ALOGW("Alloc tracker not enabled, not writing %s", fileName);
+        goto bail;
+    }
+
+    FILE* fp;
+    fp = fopen(fileName, "w");
+    if (fp == NULL) {
+        ALOGE("Unable to open '%s' for alloc profile: %s",
+            fileName, strerror(errno));
+        goto bail;
+    }
+
+    result = writeProfile(fp);
+    if (fclose(fp) != 0)
+        result = false;
+    if (!result) {
+        ALOGE("Failed writing alloc profile to '%s'", fileName);
+    } else {
+        ALOGI("Wrote alloc profile (%d stacks) to '%s'",
+            gDvm.allocStacks->numStacks, fileName);
+    }
+
+bail:
+    dvmUnlockMutex(&gDvm.allocTrackerLock);
+    return result;
+}
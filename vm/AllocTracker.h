@@ -45,6 +45,12 @@ void dvmDisableAllocTracker(void);
     }
 void dvmDoTrackAllocation(ClassObject* clazz, size_t size);
 
+/*
+ * Flush and free the thread's allocation samples.  Called when a thread
+ * is being freed.
+ */
+void dvmAllocTrackerThreadExit(Thread* thread);
+
 /*
  * Generate a DDM packet with all of the tracked allocation data.
  *
@@ -59,4 +65,10 @@ bool dvmGenerateTrackedAllocationReport(u1** pData, size_t* pDataLen);
  */
 void dvmDumpTrackedAllocations(bool enable);
 
+/*
+ * Write a pprof-format heap profile with the per-stack allocation totals
+ * to "fileName".  Returns "true" on success.
+ */
+bool dvmWriteAllocProfile(const char* fileName);
+
 #endif  // DALVIK_ALLOCTRACKER_H_
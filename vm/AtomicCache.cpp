@@ -29,7 +29,7 @@
 #define BOOL_TO_INT(x)  (x)
 //#define BOOL_TO_INT(x)  ((x) ? 1 : 0)
 
-#define CPU_CACHE_WIDTH         32
+#define CPU_CACHE_WIDTH         64
 #define CPU_CACHE_WIDTH_1       (CPU_CACHE_WIDTH-1)
 
 #define ATOMIC_LOCK_FLAG        (1 << 31)
@@ -40,28 +40,39 @@
 AtomicCache* dvmAllocAtomicCache(int numEntries)
 {
     AtomicCache* newCache;
+    int size;
+
+    size = ATOMIC_CACHE_WAYS;
+    while (size < numEntries)
+        size <<= 1;
 
     newCache = (AtomicCache*) calloc(1, sizeof(AtomicCache));
     if (newCache == NULL)
         return NULL;
 
-    newCache->numEntries = numEntries;
+    newCache->numEntries = size;
+    newCache->setMask = size / ATOMIC_CACHE_WAYS - 1;
+    newCache->calcStats = gDvm.atomicCacheStats;
 
     newCache->entryAlloc = calloc(1,
-        sizeof(AtomicCacheEntry) * numEntries + CPU_CACHE_WIDTH);
-    if (newCache->entryAlloc == NULL) {
+        sizeof(AtomicCacheEntry) * size + CPU_CACHE_WIDTH);
+    newCache->nextVictim = (u1*) calloc(1, size / ATOMIC_CACHE_WAYS);
+    if (newCache->entryAlloc == NULL || newCache->nextVictim == NULL) {
+        free(newCache->entryAlloc);
+        free(newCache->nextVictim);
         free(newCache);
         return NULL;
     }
 
     /*
-     * Adjust storage to align on a 32-byte boundary.  Each entry is 16 bytes
-     * wide.  This ensures that each cache entry sits on a single CPU cache
+     * Adjust storage to align on a 64-byte boundary.  Each entry is 16 bytes
+     * wide, so this puts each set of four entries on a single CPU cache
      * line.
      */
     assert(sizeof(AtomicCacheEntry) == 16);
     newCache->entries = (AtomicCacheEntry*)
-        (((int) newCache->entryAlloc + CPU_CACHE_WIDTH_1) & ~CPU_CACHE_WIDTH_1);
+        (((uintptr_t) newCache->entryAlloc + CPU_CACHE_WIDTH_1) &
+            ~CPU_CACHE_WIDTH_1);
 
     return newCache;
 }
@@ -73,6 +84,7 @@ void dvmFreeAtomicCache(AtomicCache* cache)
 {
     if (cache != NULL) {
         free(cache->entryAlloc);
+        free(cache->nextVictim);
         free(cache);
     }
 }
@@ -81,21 +93,39 @@ void dvmFreeAtomicCache(AtomicCache* cache)
 /*
  * Update a cache entry.
  *
- * In the event of a collision with another thread, the update may be skipped.
+ * We use an empty entry in the set if there is one, and otherwise replace
+ * the entries in round-robin order.
  *
- * We only need "pCache" for stats.
+ * In the event of a collision with another thread, the update may be skipped.
  */
-void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
-    u4 firstVersion
-#if CALC_CACHE_STATS > 0
-    , AtomicCache* pCache
-#endif
-    )
+void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pSet,
+    u4 setIdx, AtomicCache* pCache)
 {
+    AtomicCacheEntry* pEntry = NULL;
+    bool fill = false;
+    int way;
+
+    /* assume a key value of zero indicates an empty entry */
+    for (way = 0; way < ATOMIC_CACHE_WAYS; way++) {
+        if (pSet[way].key1 == 0) {
+            pEntry = &pSet[way];
+            fill = true;
+            break;
+        }
+    }
+    if (pEntry == NULL) {
+        way = pCache->nextVictim[setIdx];
+        pCache->nextVictim[setIdx] = (way + 1) & (ATOMIC_CACHE_WAYS - 1);
+        pEntry = &pSet[way & (ATOMIC_CACHE_WAYS - 1)];
+    }
+
+    u4 firstVersion =
+        android_atomic_acquire_load((int32_t*) &pEntry->version);
+
     /*
-     * The fields don't match, so we want to update them.  There is a risk
-     * that another thread is also trying to update them, so we grab an
-     * ownership flag to lock out other threads.
+     * We want to update the fields.  There is a risk that another thread
+     * is also trying to update them, so we grab an ownership flag to lock
+     * out other threads.
      *
      * If the lock flag was already set in "firstVersion", somebody else
      * was in mid-update, and we don't want to continue here.  (This means
@@ -115,22 +145,20 @@ void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
         /*
          * We couldn't get the write lock.  Return without updating the table.
          */
-#if CALC_CACHE_STATS > 0
-        pCache->fail++;
-#endif
+        if (pCache->calcStats)
+            pCache->fail++;
         return;
     }
 
     /* must be even-valued on entry */
     assert((firstVersion & 0x01) == 0);
 
-#if CALC_CACHE_STATS > 0
-    /* for stats, assume a key value of zero indicates an empty entry */
-    if (pEntry->key1 == 0)
-        pCache->fills++;
-    else
-        pCache->misses++;
-#endif
+    if (pCache->calcStats) {
+        if (fill)
+            pCache->fills++;
+        else
+            pCache->evictions++;
+    }
 
     /*
      * We have the write lock, but somebody could be reading this entry
@@ -165,18 +193,18 @@ void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
 
 
 /*
- * Dump the "instanceof" cache stats.
+ * Dump the cache stats.
  */
 void dvmDumpAtomicCacheStats(const AtomicCache* pCache)
 {
     if (pCache == NULL)
         return;
+    int lookups = pCache->hits + pCache->misses + pCache->fail;
     dvmFprintf(stdout,
-        "Cache stats: trv=%d fai=%d hit=%d mis=%d fil=%d %d%% (size=%d)\n",
+        "Cache stats: trv=%d fai=%d hit=%d mis=%d fil=%d evi=%d %d%% "
+        "(size=%d, %d-way)\n",
         pCache->trivial, pCache->fail, pCache->hits,
-        pCache->misses, pCache->fills,
-        (pCache->hits == 0) ? 0 :
-            pCache->hits * 100 /
-                (pCache->fail + pCache->hits + pCache->misses + pCache->fills),
-        pCache->numEntries);
+        pCache->misses, pCache->fills, pCache->evictions,
+        (lookups == 0) ? 0 : (int) ((s8) pCache->hits * 100 / lookups),
+        pCache->numEntries, ATOMIC_CACHE_WAYS);
 }
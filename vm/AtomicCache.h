@@ -20,9 +20,12 @@
 #define DALVIK_ATOMICCACHE_H_
 
 /*
- * If set to "1", gather some stats on our caching success rate.
+ * Number of entries in each set.  A key pair can live in any entry of the
+ * set it hashes to, so two hot pairs that collide don't keep evicting
+ * each other.  Must be a power of 2; four 16-byte entries fill one
+ * 64-byte CPU cache line.
  */
-#define CALC_CACHE_STATS 0
+#define ATOMIC_CACHE_WAYS   4
 
 
 /*
@@ -42,21 +45,31 @@ struct AtomicCacheEntry {
  * One cache.
  *
  * Thought: we might be able to save a few cycles by storing the cache
- * struct and "entries" separately, avoiding an indirection.  (We already
- * handle "numEntries" separately in ATOMIC_CACHE_LOOKUP.)
+ * struct and "entries" separately, avoiding an indirection.
  */
 struct AtomicCache {
-    AtomicCacheEntry*   entries;        /* array of entries */
+    AtomicCacheEntry*   entries;        /* array of entries, set by set */
     int         numEntries;             /* #of entries, must be power of 2 */
+    u4          setMask;                /* #of sets - 1 */
 
     void*       entryAlloc;             /* memory allocated for entries */
 
+    /*
+     * Per-set round-robin replacement pointer.  Updated without any
+     * synchronization; a lost update just means a less fair choice.
+     */
+    u1*         nextVictim;
+
+    /* if set, keep the stats below (see -Xcachestats) */
+    bool        calcStats;
+
     /* cache stats; note we don't guarantee atomic increments for these */
     int         trivial;                /* cache access not required */
     int         fail;                   /* contention failure */
     int         hits;                   /* found entry in cache */
-    int         misses;                 /* entry was for other keys */
-    int         fills;                  /* entry was empty */
+    int         misses;                 /* keys not in cache */
+    int         fills;                  /* filled an empty entry */
+    int         evictions;              /* replaced entry for other keys */
 };
 
 /*
@@ -78,33 +91,43 @@ struct AtomicCache {
  * We expect a 95+% hit rate for the things we use this for, so #2 is
  * much better than #1.
  *
+ * The keys select a set of ATOMIC_CACHE_WAYS entries, and each entry in
+ * the set is checked in turn.  Each entry has its own version, so a
+ * writer only locks out readers of the entry it is replacing.
+ *
  * _cache is an AtomicCache*
- * _cacheSize is _cache->cacheSize (can save a cycle avoiding the lookup)
  * _key1, _key2 are the keys
  *
  * Define a function ATOMIC_CACHE_CALC that returns a 32-bit value.  This
- * will be invoked when we need to compute the value.
+ * will be invoked when we need to compute the value.  Define
+ * ATOMIC_CACHE_NULL_ALLOWED as "true" if a zero result may be cached.
  *
  * Returns the value.
  */
-#if CALC_CACHE_STATS > 0
-# define CACHE_XARG(_value) ,_value
-#else
-# define CACHE_XARG(_value)
-#endif
-#define ATOMIC_CACHE_LOOKUP(_cache, _cacheSize, _key1, _key2) ({            \
+#define ATOMIC_CACHE_LOOKUP(_cache, _key1, _key2) ({                        \
+    AtomicCacheEntry* pSet;                                                 \
     AtomicCacheEntry* pEntry;                                               \
-    int hash;                                                               \
+    u4 hash;                                                                \
     u4 firstVersion, secondVersion;                                         \
     u4 value;                                                               \
+    int way;                                                                \
+    bool found = false;                                                     \
                                                                             \
     /* simple hash function */                                              \
-    hash = (((u4)(_key1) >> 2) ^ (u4)(_key2)) & ((_cacheSize)-1);           \
-    pEntry = (_cache)->entries + hash;                                      \
+    hash = (((u4)(_key1) >> 2) ^ (u4)(_key2)) & (_cache)->setMask;          \
+    pSet = (_cache)->entries + hash * ATOMIC_CACHE_WAYS;                    \
                                                                             \
-    firstVersion = android_atomic_acquire_load((int32_t*)&pEntry->version); \
+    for (way = 0; way < ATOMIC_CACHE_WAYS; way++) {                         \
+        pEntry = pSet + way;                                                \
+        firstVersion =                                                      \
+            android_atomic_acquire_load((int32_t*)&pEntry->version);        \
+        if (pEntry->key1 == (u4)(_key1) && pEntry->key2 == (u4)(_key2)) {   \
+            found = true;                                                   \
+            break;                                                          \
+        }                                                                   \
+    }                                                                       \
                                                                             \
-    if (pEntry->key1 == (u4)(_key1) && pEntry->key2 == (u4)(_key2)) {       \
+    if (found) {                                                            \
         /*                                                                  \
          * The fields match.  Get the value, then read the version a        \
          * second time to verify that we didn't catch a partial update.     \
@@ -120,12 +143,12 @@ struct AtomicCache {
              * spinning, which might not complete if we're a high priority  \
              * thread, just do the regular computation.                     \
              */                                                             \
-            if (CALC_CACHE_STATS)                                           \
+            if ((_cache)->calcStats)                                        \
                 (_cache)->fail++;                                           \
             value = (u4) ATOMIC_CACHE_CALC;                                 \
         } else {                                                            \
             /* all good */                                                  \
-            if (CALC_CACHE_STATS)                                           \
+            if ((_cache)->calcStats)                                        \
                 (_cache)->hits++;                                           \
         }                                                                   \
     } else {                                                                \
@@ -135,17 +158,20 @@ struct AtomicCache {
          * setup for this method simpler, which gives us a ~10% speed       \
          * boost.                                                           \
          */                                                                 \
+        if ((_cache)->calcStats)                                            \
+            (_cache)->misses++;                                             \
         value = (u4) ATOMIC_CACHE_CALC;                                     \
-        if (value == 0 && ATOMIC_CACHE_NULL_ALLOWED) { \
-            dvmUpdateAtomicCache((u4) (_key1), (u4) (_key2), value, pEntry, \
-                        firstVersion CACHE_XARG(_cache) ); \
-        } \
+        if (value != 0 || ATOMIC_CACHE_NULL_ALLOWED) {                      \
+            dvmUpdateAtomicCache((u4) (_key1), (u4) (_key2), value, pSet,   \
+                        hash, (_cache));                                    \
+        }                                                                   \
     }                                                                       \
     value;                                                                  \
 })
 
 /*
- * Allocate a cache.
+ * Allocate a cache with room for at least "numEntries" entries.  The size
+ * is rounded up to a power of 2, and to at least one full set.
  */
 AtomicCache* dvmAllocAtomicCache(int numEntries);
 
@@ -155,17 +181,11 @@ AtomicCache* dvmAllocAtomicCache(int numEntries);
 void dvmFreeAtomicCache(AtomicCache* cache);
 
 /*
- * Update a cache entry.
- *
- * Making the last argument optional, instead of merely unused, saves us
- * a few percent in the ATOMIC_CACHE_LOOKUP time.
+ * Add an entry to set number "setIdx", which starts at "pSet".  May
+ * silently do nothing if another thread is updating the same entry.
  */
-void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pEntry,
-    u4 firstVersion
-#if CALC_CACHE_STATS > 0
-    , AtomicCache* pCache
-#endif
-    );
+void dvmUpdateAtomicCache(u4 key1, u4 key2, u4 value, AtomicCacheEntry* pSet,
+    u4 setIdx, AtomicCache* pCache);
 
 /*
  * Debugging.
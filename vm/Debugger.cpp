@@ -65,8 +65,13 @@ being executed.
 don't interfere with the GC, and can support JDWP requests like
 "ObjectReference.IsCollected".
 
-The current implementation is #2.  The set should be reasonably small and
-performance isn't critical, so a simple expanding array can be used.
+The current implementation is #3.  Object IDs are indices into a table
+of object pointers, tagged with a serial number so that an ID whose slot
+has been reused is recognized as stale.  Entries are weak unless the
+debugger has issued a DisableCollection for them: the GC drops entries
+for unreachable objects, and the slots go back on a free list.  Since no
+GC happens while the VM is suspended for the debugger, objects handed to
+the debugger during a suspension stay valid until it resumes.
 
 
 Notes on threads:
@@ -91,17 +96,129 @@ same time.
 
 #define kSlot0Sub   1000    // Eclipse workaround
 
+/* keep track of type, in case we need to distinguish them someday */
+enum RegistryType {
+    kObjectId = 0xc1, kRefTypeId
+};
+
+/*
+ * One slot in the object registry.  Free slots have a NULL "obj" and are
+ * linked through "next"; used ones are chained into a hash table keyed
+ * by object address.
+ */
+struct DbgRegistryEntry {
+    Object*     obj;
+    u4          serial;         /* high word of the ID */
+    s4          next;           /* hash chain or free list; -1 ends it */
+    u2          pinCount;       /* DisableCollection count; >0 is a root */
+    u1          type;           /* RegistryType of first registration */
+};
+
+/*
+ * Registry of objects known to the debugger.
+ *
+ * An ID is (serial << 32) | slot.  Serial numbers are never zero, so an
+ * ID can't be mistaken for the null reference or THREAD_GROUP_ALL.
+ */
+struct DbgRegistry {
+    pthread_mutex_t     lock;
+
+    DbgRegistryEntry*   entries;
+    u4                  capacity;       /* #of slots, power of 2 */
+    u4                  numEntries;     /* #of slots in use */
+    s4                  freeList;
+
+    s4*                 buckets;        /* "capacity" hash chains */
+    int                 hashShift;      /* 32 - log2(capacity) */
+
+    u4                  nextSerial;
+};
+
+#define kRegistryInitialSize    64
+
+/*
+ * Hash function for objects.  The low bits are always zero, so use a
+ * multiplicative hash and take the high bits.
+ */
+static inline u4 registryHash(const DbgRegistry* reg, const Object* obj)
+{
+    return ((u4)(uintptr_t) obj * 2654435761u) >> reg->hashShift;
+}
+
 /*
- * System init.  We don't allocate the registry until first use.
- * Make sure we do this before initializing JDWP.
+ * Rebuild the hash chains and the free list from the entries.
+ */
+static void rebuildRegistry(DbgRegistry* reg)
+{
+    memset(reg->buckets, 0xff, reg->capacity * sizeof(s4));
+    reg->freeList = -1;
+    reg->numEntries = 0;
+    for (int i = reg->capacity - 1; i >= 0; i--) {
+        DbgRegistryEntry* pEntry = &reg->entries[i];
+        if (pEntry->obj == NULL) {
+            pEntry->next = reg->freeList;
+            reg->freeList = i;
+        } else {
+            u4 hash = registryHash(reg, pEntry->obj);
+            pEntry->next = reg->buckets[hash];
+            reg->buckets[hash] = i;
+            reg->numEntries++;
+        }
+    }
+}
+
+/*
+ * Resize the registry to "capacity" slots.  Existing entries keep their
+ * slots, so "capacity" must be larger than the highest slot in use.
+ */
+static bool resizeRegistry(DbgRegistry* reg, u4 capacity)
+{
+    DbgRegistryEntry* newEntries = (DbgRegistryEntry*)
+        realloc(reg->entries, capacity * sizeof(DbgRegistryEntry));
+    if (newEntries == NULL)
+        return false;
+    reg->entries = newEntries;
+
+    s4* newBuckets = (s4*) realloc(reg->buckets, capacity * sizeof(s4));
+    if (newBuckets == NULL)
+        return false;
+    reg->buckets = newBuckets;
+
+    if (capacity > reg->capacity) {
+        memset(&reg->entries[reg->capacity], 0,
+            (capacity - reg->capacity) * sizeof(DbgRegistryEntry));
+    }
+    reg->capacity = capacity;
+    reg->hashShift = 32;
+    while (capacity > 1) {
+        reg->hashShift--;
+        capacity >>= 1;
+    }
+    rebuildRegistry(reg);
+    return true;
+}
+
+/*
+ * System init.  Make sure we do this before initializing JDWP.
  */
 bool dvmDebuggerStartup()
 {
     if (!dvmBreakpointStartup())
         return false;
 
-    gDvm.dbgRegistry = dvmHashTableCreate(1000, NULL);
-    return (gDvm.dbgRegistry != NULL);
+    DbgRegistry* reg = (DbgRegistry*) calloc(1, sizeof(DbgRegistry));
+    if (reg == NULL)
+        return false;
+    dvmInitMutex(&reg->lock);
+    reg->nextSerial = 1;
+    if (!resizeRegistry(reg, kRegistryInitialSize)) {
+        free(reg->entries);
+        free(reg->buckets);
+        free(reg);
+        return false;
+    }
+    gDvm.dbgRegistry = reg;
+    return true;
 }
 
 /*
@@ -109,8 +226,14 @@ bool dvmDebuggerStartup()
  */
 void dvmDebuggerShutdown()
 {
-    dvmHashTableFree(gDvm.dbgRegistry);
-    gDvm.dbgRegistry = NULL;
+    DbgRegistry* reg = gDvm.dbgRegistry;
+    if (reg != NULL) {
+        dvmDestroyMutex(&reg->lock);
+        free(reg->entries);
+        free(reg->buckets);
+        free(reg);
+        gDvm.dbgRegistry = NULL;
+    }
     dvmBreakpointShutdown();
 }
 
@@ -152,53 +275,45 @@ void dvmDbgCondBroadcast(pthread_cond_t* pCond)
 }
 
 
-/* keep track of type, in case we need to distinguish them someday */
-enum RegistryType {
-    kObjectId = 0xc1, kRefTypeId
-};
-
-/*
- * Hash function for object IDs.  Since objects are at least 8 bytes, and
- * could someday be allocated on 16-byte boundaries, we don't want to use
- * the low 4 bits in our hash.
- */
-static inline u4 registryHash(u4 val)
-{
-    return val >> 4;
-}
-
 /*
- * (This is a dvmHashTableLookup() callback.)
+ * Find the slot holding "obj", or -1 if it isn't registered.
+ *
+ * Lock the registry before calling here.
  */
-static int registryCompare(const void* obj1, const void* obj2)
+static s4 findRegistryEntry(const DbgRegistry* reg, const Object* obj)
 {
-    return (int) obj1 - (int) obj2;
+    s4 idx = reg->buckets[registryHash(reg, obj)];
+    while (idx >= 0 && reg->entries[idx].obj != obj)
+        idx = reg->entries[idx].next;
+    return idx;
 }
 
-
 /*
- * Determine if an id is already in the list.
- *
- * If the list doesn't yet exist, this creates it.
+ * Find the entry for an ID, or NULL if the ID is stale or bogus.
  *
  * Lock the registry before calling here.
  */
-#ifndef NDEBUG
-static bool lookupId(ObjectId id)
+static DbgRegistryEntry* lookupId(const DbgRegistry* reg, ObjectId id)
 {
-    void* found;
+    u4 slot = (u4) id;
+    u4 serial = (u4) (id >> 32);
+    if (slot >= reg->capacity)
+        return NULL;
+    DbgRegistryEntry* pEntry = &reg->entries[slot];
+    if (pEntry->obj == NULL || pEntry->serial != serial)
+        return NULL;
+    return pEntry;
+}
 
-    found = dvmHashTableLookup(gDvm.dbgRegistry, registryHash((u4) id),
-                (void*)(u4) id, registryCompare, false);
-    if (found == NULL)
-        return false;
-    assert(found == (void*)(u4) id);
-    return true;
+static inline ObjectId makeId(const DbgRegistry* reg, s4 slot)
+{
+    return ((u8) reg->entries[slot].serial) << 32 | (u4) slot;
 }
-#endif
 
 /*
- * Register an object, if it hasn't already been.
+ * Register an object, if it hasn't already been.  If "reg" is false we
+ * only return an existing ID, or zero if there isn't one.  (That's
+ * enough for comparisons against IDs the debugger already has.)
  *
  * This is used for both ObjectId and RefTypeId.  In theory we don't have
  * to register RefTypeIds unless we're worried about classes unloading.
@@ -208,59 +323,170 @@ static bool lookupId(ObjectId id)
  */
 static ObjectId registerObject(const Object* obj, RegistryType type, bool reg)
 {
-    ObjectId id;
+    DbgRegistry* registry = gDvm.dbgRegistry;
+    ObjectId id = 0;
 
     if (obj == NULL)
         return 0;
 
-    assert((u4) obj != 0xcccccccc);
-    assert((u4) obj > 0x100);
-
-    id = (ObjectId)(u4)obj | ((u8) type) << 32;
-    if (!reg)
-        return id;
+    assert((uintptr_t) obj != 0xcccccccc);
+    assert((uintptr_t) obj > 0x100);
 
-    dvmHashTableLock(gDvm.dbgRegistry);
+    dvmLockMutex(&registry->lock);
     if (!gDvm.debuggerConnected) {
         /* debugger has detached while we were doing stuff? */
         ALOGI("ignoring registerObject request in thread=%d",
             dvmThreadSelf()->threadId);
-        //dvmAbort();
         goto bail;
     }
 
-    dvmHashTableLookup(gDvm.dbgRegistry, registryHash((u4) id),
-                (void*)(u4) id, registryCompare, true);
+    s4 slot;
+    slot = findRegistryEntry(registry, obj);
+    if (slot < 0 && reg) {
+        if (registry->freeList < 0 &&
+            !resizeRegistry(registry, registry->capacity * 2))
+        {
+            ALOGE("Unable to grow debugger object registry (%d entries)",
+                registry->numEntries);
+            goto bail;
+        }
+
+        slot = registry->freeList;
+        DbgRegistryEntry* pEntry = &registry->entries[slot];
+        registry->freeList = pEntry->next;
+
+        pEntry->obj = (Object*) obj;
+        pEntry->serial = registry->nextSerial++;
+        if (registry->nextSerial == 0)
+            registry->nextSerial = 1;
+        pEntry->pinCount = 0;
+        pEntry->type = type;
+
+        u4 hash = registryHash(registry, obj);
+        pEntry->next = registry->buckets[hash];
+        registry->buckets[hash] = slot;
+        registry->numEntries++;
+    }
+    if (slot >= 0)
+        id = makeId(registry, slot);
 
 bail:
-    dvmHashTableUnlock(gDvm.dbgRegistry);
+    dvmUnlockMutex(&registry->lock);
     return id;
 }
 
 /*
- * Verify that an object has been registered.  If it hasn't, the debugger
- * is asking for something we didn't send it, which means something
- * somewhere is broken.
- *
- * If speed is an issue we can encode the registry index in the high
- * four bytes.  We could also just hard-wire this to "true".
- *
- * Note this actually takes both ObjectId and RefTypeId.
+ * Convert an ID back to an object.  Returns NULL if the ID is zero or if
+ * the object has been collected.
  */
-#ifndef NDEBUG
-static bool objectIsRegistered(ObjectId id, RegistryType type)
+static Object* lookupObject(ObjectId id)
 {
-    UNUSED_PARAMETER(type);
+    DbgRegistry* reg = gDvm.dbgRegistry;
+    Object* obj = NULL;
 
     if (id == 0)        // null reference?
-        return true;
+        return NULL;
+
+    dvmLockMutex(&reg->lock);
+    DbgRegistryEntry* pEntry = lookupId(reg, id);
+    if (pEntry != NULL)
+        obj = pEntry->obj;
+    dvmUnlockMutex(&reg->lock);
+
+    if (obj == NULL)
+        ALOGW("Debugger asked for unknown or collected object 0x%llx", id);
+    return obj;
+}
+
+/*
+ * Returns "true" if the object has been collected (or the ID was never
+ * valid).  Used for ObjectReference.IsCollected, and by the JDWP handlers
+ * to reject stale IDs before acting on them.
+ */
+bool dvmDbgIsCollected(ObjectId id)
+{
+    DbgRegistry* reg = gDvm.dbgRegistry;
 
-    dvmHashTableLock(gDvm.dbgRegistry);
-    bool result = lookupId(id);
-    dvmHashTableUnlock(gDvm.dbgRegistry);
+    if (id == 0)
+        return false;
+
+    dvmLockMutex(&reg->lock);
+    bool result = (lookupId(reg, id) == NULL);
+    dvmUnlockMutex(&reg->lock);
     return result;
 }
-#endif
+
+/*
+ * Prevent or allow garbage collection of an object.  Calls nest.
+ * Returns "false" if the object has already been collected.
+ */
+bool dvmDbgDisableCollection(ObjectId id)
+{
+    DbgRegistry* reg = gDvm.dbgRegistry;
+
+    dvmLockMutex(&reg->lock);
+    DbgRegistryEntry* pEntry = lookupId(reg, id);
+    if (pEntry != NULL && pEntry->pinCount != 0xffff)
+        pEntry->pinCount++;
+    dvmUnlockMutex(&reg->lock);
+    return (pEntry != NULL);
+}
+bool dvmDbgEnableCollection(ObjectId id)
+{
+    DbgRegistry* reg = gDvm.dbgRegistry;
+
+    dvmLockMutex(&reg->lock);
+    DbgRegistryEntry* pEntry = lookupId(reg, id);
+    if (pEntry != NULL && pEntry->pinCount > 0)
+        pEntry->pinCount--;
+    dvmUnlockMutex(&reg->lock);
+    return (pEntry != NULL);
+}
+
+/*
+ * Visit the registered objects.  Only entries the debugger has pinned
+ * are GC roots; pass "weakToo" to visit the rest as well.
+ */
+void dvmDbgVisitRegistry(void (*visitor)(void* addr, void* arg), void* arg,
+    bool weakToo)
+{
+    DbgRegistry* reg = gDvm.dbgRegistry;
+    if (reg == NULL)
+        return;
+
+    dvmLockMutex(&reg->lock);
+    for (u4 i = 0; i < reg->capacity; i++) {
+        DbgRegistryEntry* pEntry = &reg->entries[i];
+        if (pEntry->obj != NULL && (weakToo || pEntry->pinCount > 0))
+            (*visitor)(&pEntry->obj, arg);
+    }
+    dvmUnlockMutex(&reg->lock);
+}
+
+/*
+ * Drop unpinned entries for objects the GC is about to free.
+ */
+void dvmDbgSweepRegistry(int (*isUnmarkedObject)(void*))
+{
+    DbgRegistry* reg = gDvm.dbgRegistry;
+    if (reg == NULL)
+        return;
+
+    dvmLockMutex(&reg->lock);
+    bool changed = false;
+    for (u4 i = 0; i < reg->capacity; i++) {
+        DbgRegistryEntry* pEntry = &reg->entries[i];
+        if (pEntry->obj != NULL && pEntry->pinCount == 0 &&
+            isUnmarkedObject(pEntry->obj))
+        {
+            pEntry->obj = NULL;
+            changed = true;
+        }
+    }
+    if (changed)
+        rebuildRegistry(reg);
+    dvmUnlockMutex(&reg->lock);
+}
 
 /*
  * Convert to/from a RefTypeId.
@@ -279,8 +505,7 @@ static RefTypeId classObjectToRefTypeIdNoReg(ClassObject* clazz)
 #endif
 static ClassObject* refTypeIdToClassObject(RefTypeId id)
 {
-    assert(objectIsRegistered(id, kRefTypeId) || !gDvm.debuggerConnected);
-    return (ClassObject*)(u4) id;
+    return (ClassObject*) lookupObject(id);
 }
 
 /*
@@ -296,22 +521,7 @@ static ObjectId objectToObjectIdNoReg(const Object* obj)
 }
 static Object* objectIdToObject(ObjectId id)
 {
-    assert(objectIsRegistered(id, kObjectId) || !gDvm.debuggerConnected);
-    return (Object*)(u4) id;
-}
-
-/*
- * Register an object ID that might not have been registered previously.
- *
- * Normally this wouldn't happen -- the conversion to an ObjectId would
- * have added the object to the registry -- but in some cases (e.g.
- * throwing exceptions) we really want to do the registration late.
- */
-void dvmDbgRegisterObjectId(ObjectId id)
-{
-    Object* obj = (Object*)(u4) id;
-    ALOGV("+++ registering %p (%s)", obj, obj->clazz->descriptor);
-    registerObject(obj, kObjectId, true);
+    return lookupObject(id);
 }
 
 /*
@@ -379,7 +589,7 @@ void dvmDbgConnected()
     assert(!gDvm.debuggerConnected);
 
     ALOGV("JDWP has attached");
-    assert(dvmHashTableNumEntries(gDvm.dbgRegistry) == 0);
+    assert(gDvm.dbgRegistry->numEntries == 0);
     gDvm.debuggerConnected = true;
 }
 
@@ -422,17 +632,29 @@ void dvmDbgDisconnected()
     dvmCompilerUpdateGlobalState();
 #endif
 
-    dvmHashTableLock(gDvm.dbgRegistry);
+    DbgRegistry* reg = gDvm.dbgRegistry;
+    dvmLockMutex(&reg->lock);
     gDvm.debuggerConnected = false;
 
     ALOGD("Debugger has detached; object registry had %d entries",
-        dvmHashTableNumEntries(gDvm.dbgRegistry));
-    //int i;
-    //for (i = 0; i < gDvm.dbgRegistryNext; i++)
-    //    LOGVV("%4d: 0x%llx", i, gDvm.dbgRegistryTable[i]);
-
-    dvmHashTableClear(gDvm.dbgRegistry);
-    dvmHashTableUnlock(gDvm.dbgRegistry);
+        reg->numEntries);
+
+    /* drop everything, and give back the memory if the table grew */
+    memset(reg->entries, 0, reg->capacity * sizeof(DbgRegistryEntry));
+    if (reg->capacity > kRegistryInitialSize) {
+        free(reg->entries);
+        free(reg->buckets);
+        reg->entries = NULL;
+        reg->buckets = NULL;
+        reg->capacity = 0;
+        if (!resizeRegistry(reg, kRegistryInitialSize)) {
+            ALOGE("Unable to reallocate debugger object registry");
+            dvmAbort();
+        }
+    } else {
+        rebuildRegistry(reg);
+    }
+    dvmUnlockMutex(&reg->lock);
 }
 
 /*
@@ -490,7 +712,7 @@ void dvmDbgExit(int status)
     // TODO? invoke System.exit() to perform exit processing; ends up
     // in System.exitInternal(), which can call JNI exit hook
     ALOGI("GC lifetime allocation: %d bytes", gDvm.allocProf.allocCount);
-    if (CALC_CACHE_STATS) {
+    if (gDvm.atomicCacheStats) {
         dvmDumpAtomicCacheStats(gDvm.instanceofCache);
         dvmDumpBootClassPath();
     }
@@ -1718,7 +1940,8 @@ bool dvmDbgGetThreadStatus(ObjectId threadId, u4* pThreadStatus,
     bool result = false;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return false;
 
     /* lock the thread list, so the thread doesn't vanish while we work */
     dvmLockThreadList(NULL);
@@ -1766,7 +1989,8 @@ u4 dvmDbgGetThreadSuspendCount(ObjectId threadId)
     u4 result = 0;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return 0;
 
     /* lock the thread list, so the thread doesn't vanish while we work */
     dvmLockThreadList(NULL);
@@ -1794,7 +2018,8 @@ bool dvmDbgThreadExists(ObjectId threadId)
     bool result;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return false;
 
     /* lock the thread list, so the thread doesn't vanish while we work */
     dvmLockThreadList(NULL);
@@ -1821,7 +2046,8 @@ bool dvmDbgIsSuspended(ObjectId threadId)
     bool result = false;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return false;
 
     /* lock the thread list, so the thread doesn't vanish while we work */
     dvmLockThreadList(NULL);
@@ -1858,7 +2084,7 @@ ObjectId dvmDbgGetMainThreadGroupId()
 /*
  * Get the name of a thread.
  *
- * Returns a newly-allocated string.
+ * Returns a newly-allocated string, or NULL if the thread ID is stale.
  */
 char* dvmDbgGetThreadName(ObjectId threadId)
 {
@@ -1868,7 +2094,8 @@ char* dvmDbgGetThreadName(ObjectId threadId)
     char* result;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return NULL;
 
     nameStr = (StringObject*) dvmGetFieldObject(threadObj,
                                                 gDvm.offJavaLangThread_name);
@@ -1889,7 +2116,7 @@ char* dvmDbgGetThreadName(ObjectId threadId)
 }
 
 /*
- * Get a thread's group.
+ * Get a thread's group.  Returns 0 if the thread ID is stale.
  */
 ObjectId dvmDbgGetThreadGroup(ObjectId threadId)
 {
@@ -1897,7 +2124,8 @@ ObjectId dvmDbgGetThreadGroup(ObjectId threadId)
     Object* group;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return 0;
 
     group = dvmGetFieldObject(threadObj, gDvm.offJavaLangThread_group);
     return objectToObjectId(group);
@@ -1907,7 +2135,7 @@ ObjectId dvmDbgGetThreadGroup(ObjectId threadId)
 /*
  * Get the name of a thread group.
  *
- * Returns a newly-allocated string.
+ * Returns a newly-allocated string, or NULL if the group ID is stale.
  */
 char* dvmDbgGetThreadGroupName(ObjectId threadGroupId)
 {
@@ -1915,7 +2143,8 @@ char* dvmDbgGetThreadGroupName(ObjectId threadGroupId)
     StringObject* nameStr;
 
     threadGroup = objectIdToObject(threadGroupId);
-    assert(threadGroup != NULL);
+    if (threadGroup == NULL)
+        return NULL;
 
     nameStr = (StringObject*)
         dvmGetFieldObject(threadGroup, gDvm.offJavaLangThreadGroup_name);
@@ -1923,9 +2152,7 @@ char* dvmDbgGetThreadGroupName(ObjectId threadGroupId)
 }
 
 /*
- * Get the parent of a thread group.
- *
- * Returns a newly-allocated string.
+ * Get the parent of a thread group.  Returns 0 if the group ID is stale.
  */
 ObjectId dvmDbgGetThreadGroupParent(ObjectId threadGroupId)
 {
@@ -1933,7 +2160,8 @@ ObjectId dvmDbgGetThreadGroupParent(ObjectId threadGroupId)
     Object* parent;
 
     threadGroup = objectIdToObject(threadGroupId);
-    assert(threadGroup != NULL);
+    if (threadGroup == NULL)
+        return 0;
 
     parent = dvmGetFieldObject(threadGroup, gDvm.offJavaLangThreadGroup_parent);
     return objectToObjectId(parent);
@@ -1959,7 +2187,11 @@ void dvmDbgGetThreadGroupThreads(ObjectId threadGroupId,
 
     if (threadGroupId != THREAD_GROUP_ALL) {
         targetThreadGroup = objectIdToObject(threadGroupId);
-        assert(targetThreadGroup != NULL);
+        if (targetThreadGroup == NULL) {
+            *ppThreadIds = NULL;
+            *pThreadCount = 0;
+            return;
+        }
     }
 
     dvmLockThreadList(NULL);
@@ -2469,16 +2701,11 @@ void dvmDbgPostException(void* throwFp, int throwRelPc, void* catchFp,
     Object* thisObj = getThisObject((u4*)throwFp);
 
     /*
-     * Hand the event to the JDWP exception handler.  Note we're using the
-     * "NoReg" objectID on the exception, which is not strictly correct --
-     * the exception object WILL be passed up to the debugger if the
-     * debugger is interested in the event.  We do this because the current
-     * implementation of the debugger object registry never throws anything
-     * away, and some people were experiencing a fatal build up of exception
-     * objects when dealing with certain libraries.
+     * Hand the event to the JDWP exception handler.  Registry entries are
+     * weak, so registering every exception doesn't keep them around.
      */
     dvmJdwpPostException(gDvm.jdwpState, &throwLoc,
-        objectToObjectIdNoReg(exception),
+        objectToObjectId(exception),
         classObjectToRefTypeId(exception->clazz), &catchLoc,
         objectToObjectId(thisObj));
 }
@@ -2553,6 +2780,23 @@ void dvmDbgUnwatchLocation(const JdwpLocation* pLoc)
     dvmClearBreakAddr(method, pLoc->idx);
 }
 
+/*
+ * The JDWP event mechanism is about to watch or unwatch a lot of
+ * locations.  Hold the breakpoint lock until dvmDbgEndLocationBatch().
+ */
+void dvmDbgBeginLocationBatch()
+{
+    dvmBreakpointBatchBegin();
+}
+
+/*
+ * Done with a batch of location changes.
+ */
+void dvmDbgEndLocationBatch()
+{
+    dvmBreakpointBatchEnd();
+}
+
 /*
  * The JDWP event mechanism has registered a single-step event.  Tell
  * the interpreter about it.
@@ -2565,7 +2809,8 @@ bool dvmDbgConfigureStep(ObjectId threadId, JdwpStepSize size,
     bool result = false;
 
     threadObj = objectIdToObject(threadId);
-    assert(threadObj != NULL);
+    if (threadObj == NULL)
+        return false;
 
     /*
      * Get a pointer to the Thread struct for this ID.  The pointer will
@@ -194,6 +194,23 @@ ObjectId dvmDbgCreateArrayObject(RefTypeId arrayTypeId, u4 length);
 
 bool dvmDbgMatchType(RefTypeId instClassId, RefTypeId classId);
 
+/*
+ * Object lifetime.  IDs handed to the debugger don't keep objects alive
+ * unless it asks for that with DisableCollection.
+ */
+bool dvmDbgIsCollected(ObjectId id);
+bool dvmDbgDisableCollection(ObjectId id);
+bool dvmDbgEnableCollection(ObjectId id);
+
+/*
+ * GC support for the object registry.  dvmDbgVisitRegistry visits the
+ * pinned entries (and the weak ones, if "weakToo" is set);
+ * dvmDbgSweepRegistry drops weak entries for unmarked objects.
+ */
+void dvmDbgVisitRegistry(void (*visitor)(void* addr, void* arg), void* arg,
+    bool weakToo);
+void dvmDbgSweepRegistry(int (*isUnmarkedObject)(void*));
+
 /*
  * Method and Field
  */
@@ -278,6 +295,8 @@ enum {
 
 bool dvmDbgWatchLocation(const JdwpLocation* pLoc);
 void dvmDbgUnwatchLocation(const JdwpLocation* pLoc);
+void dvmDbgBeginLocationBatch(void);
+void dvmDbgEndLocationBatch(void);
 bool dvmDbgConfigureStep(ObjectId threadId, JdwpStepSize size,
     JdwpStepDepth depth);
 void dvmDbgUnconfigureStep(ObjectId threadId);
@@ -290,9 +309,6 @@ void dvmDbgExecuteMethod(DebugInvokeReq* pReq);
 /* Make an AddressSet for a line, for single stepping */
 const AddressSet *dvmAddressSetForLine(const Method* method, int line);
 
-/* perform "late registration" of an object ID */
-void dvmDbgRegisterObjectId(ObjectId id);
-
 /*
  * DDM support.
  */
@@ -179,6 +179,8 @@ LOCAL_SRC_FILES := \
 	oo/AccessCheck.cpp \
 	oo/Array.cpp \
 	oo/Class.cpp \
+	oo/ClassPreload.cpp \
+	oo/LinkImage.cpp \
 	oo/Object.cpp \
 	oo/Resolve.cpp \
 	oo/TypeCheck.cpp \
@@ -223,7 +225,9 @@ ifeq ($(WITH_JIT),true)
 	compiler/SSATransformation.cpp \
 	compiler/Loop.cpp \
 	compiler/Ralloc.cpp \
-	interp/Jit.cpp
+	compiler/ValueNumbering.cpp \
+	interp/Jit.cpp \
+	interp/JitProfile.cpp
 endif
 
 LOCAL_C_INCLUDES += \
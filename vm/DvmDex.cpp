@@ -18,6 +18,9 @@
  * VM-specific state associated with a DEX file.
  */
 #include "Dalvik.h"
+#if defined(WITH_JIT)
+#include "interp/JitProfile.h"
+#endif
 #include <sys/mman.h>
 
 /*
@@ -77,7 +80,7 @@ static DvmDex* allocateAuxStructures(DexFile* pDexFile)
         pDvmDex, stringSize/4, classSize/4, methodSize/4, fieldSize/4,
         stringSize + classSize + methodSize + fieldSize);
 
-    pDvmDex->pInterfaceCache = dvmAllocAtomicCache(DEX_INTERFACE_CACHE_SIZE);
+    pDvmDex->pInterfaceCache = dvmAllocAtomicCache(gDvm.interfaceCacheSize);
 
     dvmInitMutex(&pDvmDex->modLock);
 
@@ -188,6 +191,10 @@ void dvmDexFileFree(DvmDex* pDvmDex)
 
     dvmDestroyMutex(&pDvmDex->modLock);
 
+#if defined(WITH_JIT)
+    dvmJitProfileClose(pDvmDex);
+#endif
+
     totalSize  = pDvmDex->pHeader->stringIdsSize * sizeof(struct StringObject*);
     totalSize += pDvmDex->pHeader->typeIdsSize * sizeof(struct ClassObject*);
     totalSize += pDvmDex->pHeader->methodIdsSize * sizeof(struct Method*);
@@ -28,6 +28,7 @@
 struct ClassObject;
 struct HashTable;
 struct InstField;
+struct JitProfile;
 struct Method;
 struct StringObject;
 
@@ -64,6 +65,9 @@ struct DvmDex {
 
     jobject dex_object;
 
+    /* persistent JIT profile, if any */
+    struct JitProfile*  pJitProfile;
+
     /* lock ensuring mutual exclusion during updates */
     pthread_mutex_t     modLock;
 };
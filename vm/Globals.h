@@ -38,6 +38,9 @@
 /* private structures */
 struct GcHeap;
 struct BreakpointSet;
+struct DbgRegistry;
+struct AllocStackTable;
+struct RegisterMapCache;
 struct InlineSub;
 
 /*
@@ -131,6 +134,22 @@ struct DvmGlobals {
     bool        verifyDexChecksum;
     char*       stackTraceFile;     // for SIGQUIT-inspired output
 
+    /*
+     * Boot classes to load and link in parallel at startup, and the number
+     * of threads to use for it (see ClassPreload.cpp).
+     */
+    char*       preloadClassesFile;
+    int         preloadThreads;
+
+    /*
+     * Number of entries in the instanceof cache and in each DEX file's
+     * interface method cache, and whether to keep hit/miss counts for
+     * them (see AtomicCache.h).
+     */
+    int         instanceofCacheSize;
+    int         interfaceCacheSize;
+    bool        atomicCacheStats;
+
     bool        logStdio;
 
     DexOptimizerMode    dexOptMode;
@@ -619,7 +638,7 @@ struct DvmGlobals {
     /*
      * Registry of objects known to the debugger.
      */
-    HashTable*  dbgRegistry;
+    DbgRegistry*    dbgRegistry;
 
     /*
      * Debugger breakpoint table.
@@ -653,6 +672,15 @@ struct DvmGlobals {
     int             allocRecordHead;        /* most-recently-added entry */
     int             allocRecordCount;       /* #of valid entries */
     int             allocRecordMax;         /* Number of allocated entries. */
+    AllocStackTable* allocStacks;           /* stacks the records refer to */
+
+    /*
+     * If nonzero, record one allocation per this many bytes per thread
+     * instead of every allocation (-Xallocsample).  If allocProfileFile is
+     * set, a pprof profile is written there on SIGQUIT and at shutdown.
+     */
+    size_t          allocSampleInterval;
+    char*           allocProfileFile;
 
     /*
      * When a profiler is enabled, this is incremented.  Distinct profilers
@@ -730,6 +758,9 @@ struct DvmGlobals {
     /* some RegisterMap statistics, useful during development */
     void*       registerMapStats;
 
+    /* indexed forms of compressed register maps, used at GC time */
+    RegisterMapCache* registerMapCache;
+
 #ifdef VERIFIER_STATS
     VerifierStats verifierStats;
 #endif
@@ -770,22 +801,38 @@ enum NoChainExits {
  */
 struct DvmJitGlobals {
     /*
-     * Guards writes to Dalvik PC (dPC), translated code address (codeAddr) and
-     * chain fields within the JIT hash table.  Note carefully the access
-     * mechanism.
-     * Only writes are guarded, and the guarded fields must be updated in a
-     * specific order using atomic operations.  Further, once a field is
-     * written it cannot be changed without halting all threads.
-     *
-     * The write order is:
+     * Serializes JitTable resizes and resets, and the code that walks the
+     * whole table.  Lookups and inserts do not take it: a slot is claimed
+     * with a CAS on its info word (setting inUse), and the fields are then
+     * published in this order:
      *    1) codeAddr
      *    2) dPC
-     *    3) chain [if necessary]
-     *
-     * This mutex also guards both read and write of curJitTableEntries.
+     *    3) chain of the previous tail [if necessary]
+     * Once a field is written it cannot be changed without halting all
+     * threads.
      */
     pthread_mutex_t tableLock;
 
+    /*
+     * JitTable resize handshake.  Inserts and code address updates count
+     * themselves in jitTableWriters; a resize sets jitTableResizing and
+     * waits for the count to drain before copying the table.
+     */
+    volatile int32_t jitTableWriters;
+    volatile int32_t jitTableResizing;
+
+    /* Number of times the JitTable has grown */
+    int jitTableResizes;
+
+    /*
+     * Tables replaced by a resize.  Lock-free readers may still be
+     * walking them, and compiler workers keep reading while the mutators
+     * are suspended, so they are never freed.  Each one is half the size
+     * of its successor, so together they cost less than the live table.
+     */
+    struct JitEntry *retiredJitTables[JIT_TABLE_MAX_RETIRED];
+    int numRetiredJitTables;
+
     /* The JIT hash table.  Note that for access speed, copies of this pointer
      * are stored in each thread. */
     struct JitEntry *pJitEntryTable;
@@ -814,13 +861,21 @@ struct DvmJitGlobals {
     /* Trigger for trace selection */
     unsigned short threshold;
 
+    /* Persistent profiles: one per optimized DEX, see interp/JitProfile.h */
+    bool profileCacheEnabled;
+    pthread_mutex_t profileCacheLock;
+    struct JitProfile *profileCache;
+    unsigned int profileCacheSaveCount;
+
     /* JIT Compiler Control */
     bool               haltCompilerThread;
     bool               blockingMode;
     bool               methodTraceSupport;
     bool               genSuspendPoll;
     Thread*            compilerThread;
-    pthread_t          compilerHandle;
+    pthread_t          compilerHandle[COMPILER_MAX_THREADS];
+    int                numCompilerThreads;
+    pthread_key_t      compilerWorkerKey;
     pthread_mutex_t    compilerLock;
     pthread_mutex_t    compilerICPatchLock;
     pthread_cond_t     compilerQueueActivity;
@@ -830,14 +885,27 @@ struct DvmJitGlobals {
     int                compilerWorkEnqueueIndex;
     int                compilerWorkDequeueIndex;
     int                compilerICPatchIndex;
+    int                chainPatchIndex;     // guarded by compilerICPatchLock
 
     /* JIT internal stats */
     int                compilerMaxQueued;
     int                translationChains;
 
+    /* Checks and loads removed by global value numbering (atomic adds) */
+    volatile int32_t   numNullChecksEliminated;
+    volatile int32_t   numRangeChecksEliminated;
+    volatile int32_t   numLoadsEliminated;
+
     /* Compiled code cache */
     void* codeCache;
 
+    /*
+     * Distance from the executable view of the code cache to its writable
+     * view, or 0 if the cache is a single mapping whose protection is
+     * toggled around each write.
+     */
+    intptr_t codeCacheRWOffset;
+
     /*
      * This is used to store the base address of an in-flight compilation whose
      * class object pointers have been calculated to populate literal pool.
@@ -845,9 +913,10 @@ struct DvmJitGlobals {
      * guarantee whether GC has happened before the code address has been
      * installed to the JIT table. Because of that, this field can only
      * been cleared/overwritten by the compiler thread if it is in the
-     * THREAD_RUNNING state or in a safe point.
+     * THREAD_RUNNING state or in a safe point.  There is one slot per
+     * compiler worker.
      */
-    void *inflightBaseAddr;
+    void *inflightBaseAddr[COMPILER_MAX_THREADS];
 
     /* Translation cache version (protected by compilerLock */
     int cacheVersion;
@@ -959,6 +1028,8 @@ struct DvmJitGlobals {
     int                invokeMonoSetterInlined;
     int                invokePolyGetterInlined;
     int                invokePolySetterInlined;
+    int                invokeMultiGuardInlined;
+    int                invokeMegamorphic;
     int                returnOp;
     int                icPatchInit;
     int                icPatchLockFree;
@@ -966,6 +1037,7 @@ struct DvmJitGlobals {
     int                icPatchRejected;
     int                icPatchDropped;
     int                codeCachePatches;
+    int                chainPatchFlushes;
     int                numCompilerThreadBlockGC;
     u8                 jitTime;
     u8                 compilerThreadBlockGCStart;
@@ -984,6 +1056,12 @@ struct DvmJitGlobals {
 
     /* Work order queue for predicted chain patching */
     ICPatchWorkOrder compilerICPatchQueue[COMPILER_IC_PATCH_QUEUE_SIZE];
+
+    /* Chaining branches waiting to be installed as one batch */
+    ChainPatchWorkOrder chainPatchQueue[COMPILER_CHAIN_PATCH_QUEUE_SIZE];
+
+    /* Receiver classes seen at polymorphic call sites */
+    JitCallsiteProfile callsiteProfiles[COMPILER_CALLSITE_PROFILE_SIZE];
 };
 
 extern struct DvmJitGlobals gDvmJit;
@@ -33,6 +33,7 @@
 #endif
 
 #include "Dalvik.h"
+#include "oo/ClassPreload.h"
 #include "test/Test.h"
 #include "mterp/Mterp.h"
 #include "Hash.h"
@@ -40,6 +41,7 @@
 
 #if defined(WITH_JIT)
 #include "compiler/codegen/Optimizer.h"
+#include "interp/JitProfile.h"
 #endif
 
 #define kMinHeapStartSize   (1*1024*1024)
@@ -125,6 +127,13 @@ static void usage()
     dvmFprintf(stderr, "  -Xjniopts:{warnonly,forcecopy}\n");
     dvmFprintf(stderr, "  -Xjnitrace:substring (eg NativeClass or nativeMethod)\n");
     dvmFprintf(stderr, "  -Xstacktracefile:<filename>\n");
+    dvmFprintf(stderr, "  -Xpreloadclasses:<filename>\n");
+    dvmFprintf(stderr, "  -Xpreloadthreads:N  (0 means one per CPU)\n");
+    dvmFprintf(stderr, "  -Xinstanceofcache:N  (entries, power of two)\n");
+    dvmFprintf(stderr, "  -Xinterfacecache:N  (entries per DEX, power of two)\n");
+    dvmFprintf(stderr, "  -Xcachestats\n");
+    dvmFprintf(stderr, "  -Xallocsample:N  (bytes between samples)\n");
+    dvmFprintf(stderr, "  -Xallocprofile:<filename>\n");
     dvmFprintf(stderr, "  -Xgc:[no]precise\n");
     dvmFprintf(stderr, "  -Xgc:[no]preverify\n");
     dvmFprintf(stderr, "  -Xgc:[no]postverify\n");
@@ -140,6 +149,8 @@ static void usage()
                        "[,hexopvalue[-endvalue]]*\n");
     dvmFprintf(stderr, "  -Xincludeselectedmethod\n");
     dvmFprintf(stderr, "  -Xjitthreshold:decimalvalue\n");
+    dvmFprintf(stderr, "  -Xjitthreads:decimalvalue\n");
+    dvmFprintf(stderr, "  -Xjitnoprofilecache\n");
     dvmFprintf(stderr, "  -Xjitcodecachesize:decimalvalueofkbytes\n");
     dvmFprintf(stderr, "  -Xjitblocking\n");
     dvmFprintf(stderr, "  -Xjitmethod:signature[,signature]* "
@@ -312,6 +323,30 @@ static size_t parseMemOption(const char* s, size_t div)
     return 0;
 }
 
+/* upper bound on -Xinstanceofcache and -Xinterfacecache */
+static const unsigned long kMaxAtomicCacheSize = 64 * 1024;
+
+/*
+ * Parse the entry count for one of the atomic caches.  The count must be
+ * a power of two no smaller than one set and no larger than
+ * kMaxAtomicCacheSize.
+ *
+ * Returns 0 if "s" is malformed or out of range.
+ */
+static int parseAtomicCacheSize(const char* s)
+{
+    if (!isdigit(*s))
+        return 0;
+
+    char* end;
+    unsigned long val = strtoul(s, &end, 10);
+    if (*end != '\0' || val < ATOMIC_CACHE_WAYS || val > kMaxAtomicCacheSize)
+        return 0;
+    if ((val & (val - 1)) != 0)
+        return 0;
+    return (int) val;
+}
+
 /*
  * Handle one of the JDWP name/value pairs.
  *
@@ -1123,6 +1158,10 @@ static int processOptions(int argc, const char* const argv[],
           gDvmJit.blockingMode = true;
         } else if (strncmp(argv[i], "-Xjitthreshold:", 15) == 0) {
           gDvmJit.threshold = atoi(argv[i] + 15);
+        } else if (strncmp(argv[i], "-Xjitthreads:", 13) == 0) {
+          gDvmJit.numCompilerThreads = atoi(argv[i] + 13);
+        } else if (strncmp(argv[i], "-Xjitnoprofilecache", 19) == 0) {
+          gDvmJit.profileCacheEnabled = false;
         } else if (strncmp(argv[i], "-Xjitcodecachesize:", 19) == 0) {
           gDvmJit.codeCacheSize = atoi(argv[i] + 19) * 1024;
           if (gDvmJit.codeCacheSize == 0) {
@@ -1157,6 +1196,41 @@ static int processOptions(int argc, const char* const argv[],
         } else if (strncmp(argv[i], "-Xstacktracefile:", 17) == 0) {
             gDvm.stackTraceFile = strdup(argv[i]+17);
 
+        } else if (strncmp(argv[i], "-Xpreloadclasses:", 17) == 0) {
+            free(gDvm.preloadClassesFile);
+            gDvm.preloadClassesFile = strdup(argv[i]+17);
+        } else if (strncmp(argv[i], "-Xpreloadthreads:", 17) == 0) {
+            gDvm.preloadThreads = atoi(argv[i]+17);
+
+        } else if (strncmp(argv[i], "-Xinstanceofcache:", 18) == 0) {
+            int val = parseAtomicCacheSize(argv[i]+18);
+            if (val == 0) {
+                dvmFprintf(stderr,
+                    "Invalid -Xinstanceofcache '%s', must be a power of two"
+                    " from %d to %lu\n",
+                    argv[i], ATOMIC_CACHE_WAYS, kMaxAtomicCacheSize);
+                return -1;
+            }
+            gDvm.instanceofCacheSize = val;
+        } else if (strncmp(argv[i], "-Xinterfacecache:", 17) == 0) {
+            int val = parseAtomicCacheSize(argv[i]+17);
+            if (val == 0) {
+                dvmFprintf(stderr,
+                    "Invalid -Xinterfacecache '%s', must be a power of two"
+                    " from %d to %lu\n",
+                    argv[i], ATOMIC_CACHE_WAYS, kMaxAtomicCacheSize);
+                return -1;
+            }
+            gDvm.interfaceCacheSize = val;
+        } else if (strcmp(argv[i], "-Xcachestats") == 0) {
+            gDvm.atomicCacheStats = true;
+
+        } else if (strncmp(argv[i], "-Xallocsample:", 14) == 0) {
+            gDvm.allocSampleInterval = atoi(argv[i]+14);
+        } else if (strncmp(argv[i], "-Xallocprofile:", 15) == 0) {
+            free(gDvm.allocProfileFile);
+            gDvm.allocProfileFile = strdup(argv[i]+15);
+
         } else if (strcmp(argv[i], "-Xgenregmap") == 0) {
             gDvm.generateRegisterMaps = true;
         } else if (strcmp(argv[i], "-Xnogenregmap") == 0) {
@@ -1270,6 +1344,10 @@ static void setCommandLineDefaults()
     gDvm.generateRegisterMaps = true;
     gDvm.registerMapMode = kRegisterMapModeTypePrecise;
 
+    /* sizes of the lock-free lookup caches */
+    gDvm.instanceofCacheSize = 1024;
+    gDvm.interfaceCacheSize = DEX_INTERFACE_CACHE_SIZE;
+
     /*
      * Default execution mode.
      *
@@ -1285,6 +1363,8 @@ static void setCommandLineDefaults()
     gDvmJit.methodTable = NULL;
     gDvmJit.classTable = NULL;
     gDvmJit.codeCacheSize = DEFAULT_CODE_CACHE_SIZE;
+    gDvmJit.numCompilerThreads = 1;
+    gDvmJit.profileCacheEnabled = true;
 
     gDvm.constInit = false;
     gDvm.commonInit = false;
@@ -1465,6 +1545,11 @@ std::string dvmStartup(int argc, const char* const argv[],
     if (!dvmInstanceofStartup()) {
         return "dvmInstanceofStartup failed";
     }
+#if defined(WITH_JIT)
+    if (!dvmJitProfileStartup()) {
+        return "dvmJitProfileStartup failed";
+    }
+#endif
     if (!dvmClassStartup()) {
         return "dvmClassStartup failed";
     }
@@ -1573,6 +1658,13 @@ std::string dvmStartup(int argc, const char* const argv[],
         return "dvmGcStartupClasses failed";
     }
 
+    /*
+     * Get a head start on the classes the zygote is going to preload.
+     * This only loads and links; ZygoteInit still initializes them in
+     * order.  The worker threads are gone by the time this returns.
+     */
+    dvmPreloadClasses();
+
     /*
      * Init for either zygote mode or non-zygote mode.  The key difference
      * is that we don't start any additional threads in Zygote mode.
@@ -1980,8 +2072,11 @@ void dvmShutdown()
 {
     ALOGV("VM shutting down");
 
-    if (CALC_CACHE_STATS)
+    if (gDvm.atomicCacheStats) {
         dvmDumpAtomicCacheStats(gDvm.instanceofCache);
+        dvmDumpBootInterfaceCacheStats();
+        dvmDumpUserDexCacheStats();
+    }
 
     /*
      * Stop our internal threads.
@@ -1996,6 +2091,8 @@ void dvmShutdown()
     gDvm.jniTrace = NULL;
     free(gDvm.stackTraceFile);
     gDvm.stackTraceFile = NULL;
+    free(gDvm.preloadClassesFile);
+    gDvm.preloadClassesFile = NULL;
 
     /* tell signal catcher to shut down if it was started */
     dvmSignalCatcherShutdown();
@@ -2010,6 +2107,9 @@ void dvmShutdown()
     }
 #endif
 
+    if (gDvm.allocProfileFile != NULL)
+        dvmWriteAllocProfile(gDvm.allocProfileFile);
+
     /*
      * Kill any daemon threads that still exist.  Actively-running threads
      * are likely to crash the process if they continue to execute while
@@ -24,6 +24,9 @@
 
 #include "Dalvik.h"
 #include "libdex/OptInvocation.h"
+#if defined(WITH_JIT)
+#include "interp/JitProfile.h"
+#endif
 
 #include <stdlib.h>
 #include <string.h>
@@ -347,6 +350,10 @@ tryArchive:
 
     ALOGV("Successfully opened '%s' in '%s'", kDexInJarName, fileName);
 
+#if defined(WITH_JIT)
+    dvmJitProfileOpen(pDvmDex, cachedName);
+#endif
+
     *ppJarFile = (JarFile*) calloc(1, sizeof(JarFile));
     (*ppJarFile)->archive = archive;
     (*ppJarFile)->cacheFileName = cachedName;
@@ -63,6 +63,22 @@ loader, which is never unloaded (until the VM shuts down).
 
 Because the memory is not expected to be updated, we can use mprotect to
 guard the pages on debug builds.  Handy when tracking down corruption.
+
+To keep parallel class loading from serializing on the region lock, a
+thread that opts in with dvmLinearAllocUseThreadChunk (the class preload
+workers) reserves a THREAD_CHUNK_SIZE range of the region and
+bump-allocates small blocks out of it without locking.  The pages of the
+range are made writable with a single mprotect when it is reserved.  The
+unused tail of a thread's range is always covered by a block marked as
+free, so the region can still be walked from "firstOffset" to "curOffset"
+one length word at a time.
+
+A range is given up when it can't satisfy an allocation, or when the
+thread calls dvmLinearAllocReleaseThreadChunk.  If nobody has reserved
+anything past it, "curOffset" is wound back to the start of the unused
+tail.  Otherwise the tail stays behind as a free block and is lost; that
+costs at most THREAD_CHUNK_SIZE per range, and only the few opted-in
+threads ever hold one.
 */
 
 /* alignment for allocations; must be power of 2, and currently >= hdr_xtra */
@@ -79,6 +95,17 @@ guard the pages on debug builds.  Handy when tracking down corruption.
 #define LENGTHFLAG_RW      0x40000000
 #define LENGTHFLAG_MASK    (~(LENGTHFLAG_FREE|LENGTHFLAG_RW))
 
+/* size of the range reserved by a thread; must be a BLOCK_ALIGN multiple */
+#define THREAD_CHUNK_SIZE   (16*1024)
+
+/* larger allocations come straight from the shared region */
+#define MAX_CHUNK_ALLOC     (THREAD_CHUNK_SIZE / 8)
+
+static const char* kKindNames[kLinearAllocKindCount] = {
+    "other", "methods", "fields", "vtables", "interfaces", "strings", "code",
+    "supertypes",
+};
+
 
 /* fwd */
 static void checkAllFree(Object* classLoader);
@@ -112,7 +139,7 @@ LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader)
 #endif
     LinearAllocHdr* pHdr;
 
-    pHdr = (LinearAllocHdr*) malloc(sizeof(*pHdr));
+    pHdr = (LinearAllocHdr*) calloc(1, sizeof(*pHdr));
 
 
     /*
@@ -241,6 +268,10 @@ void dvmLinearAllocDestroy(Object* classLoader)
         ALOGD("LinearAlloc %p used %d of %d (%d%%)",
             classLoader, pHdr->curOffset, pHdr->mapLength,
             (pHdr->curOffset * 100) / pHdr->mapLength);
+
+        DebugOutputTarget target;
+        dvmCreateLogOutputTarget(&target, ANDROID_LOG_DEBUG, LOG_TAG);
+        dvmLinearAllocDumpStats(classLoader, &target);
     }
 
     if (munmap(pHdr->mapAddr, pHdr->mapLength) != 0) {
@@ -251,58 +282,92 @@ void dvmLinearAllocDestroy(Object* classLoader)
 }
 
 /*
- * Allocate "size" bytes of storage, associated with a particular class
- * loader.
+ * Compute the offset of the header following a block of "size" bytes
+ * whose header is at "startOffset".
  *
- * It's okay for size to be zero.
- *
- * We always leave "curOffset" pointing at the next place where we will
- * store the header that precedes the returned storage.
+ * The old offset points at the address where we will store the hidden
+ * block header, so we advance past that, add the size of data they want,
+ * add another header's worth so we know we have room for that, and round
+ * up to BLOCK_ALIGN.  That's the next location where we'll put user data.
+ * We then subtract the chunk header size off so we're back to the header
+ * pointer.
  *
- * This aborts the VM on failure, so it's not necessary to check for a
- * NULL return value.
+ * Examples:
+ *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
+ *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
  */
-void* dvmLinearAlloc(Object* classLoader, size_t size)
+static inline int computeNextOffset(int startOffset, size_t size)
 {
-    LinearAllocHdr* pHdr = getHeader(classLoader);
-    int startOffset, nextOffset;
-    int lastGoodOff, firstWriteOff, lastWriteOff;
+    assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
+    return ((startOffset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
+                & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
+}
 
-#ifdef DISABLE_LINEAR_ALLOC
-    return calloc(1, size);
-#endif
+/*
+ * Write the header of a free block that spans [startOffset, endOffset).
+ */
+static inline void setFreeBlock(LinearAllocHdr* pHdr, int startOffset,
+    int endOffset)
+{
+    *(u4*)(pHdr->mapAddr + startOffset) =
+        (endOffset - startOffset - HEADER_EXTRA) | LENGTHFLAG_FREE;
+}
 
-    LOGVV("--- LinearAlloc(%p, %d)", classLoader, size);
+/*
+ * Find the stats slot for "classLoader".  New loaders claim an empty slot
+ * with a CAS, so this doesn't need the lock.
+ */
+static LinearAllocStats* getStats(LinearAllocHdr* pHdr, Object* classLoader)
+{
+    /* slot 0 is the bootstrap class loader */
+    if (classLoader == NULL)
+        return &pHdr->stats[0];
+
+    for (int i = 1; i < LINEAR_ALLOC_STATS_SLOTS-1; i++) {
+        LinearAllocStats* pStats = &pHdr->stats[i];
+        if (pStats->classLoader == classLoader)
+            return pStats;
+        if (pStats->classLoader == NULL &&
+            android_atomic_release_cas(0, (int32_t) classLoader,
+                (int32_t*) (void*) &pStats->classLoader) == 0)
+        {
+            return pStats;
+        }
+        /* somebody else may have claimed it for the same loader */
+        if (pStats->classLoader == classLoader)
+            return pStats;
+    }
 
-    /*
-     * What we'd like to do is just determine the new end-of-alloc size
-     * and atomic-swap the updated value in.  The trouble is that, the
-     * first time we reach a new page, we need to call mprotect() to
-     * make the page available, and we don't want to call mprotect() on
-     * every allocation.  The troubled situation is:
-     *  - thread A allocs across a page boundary, but gets preempted
-     *    before mprotect() completes
-     *  - thread B allocs within the new page, and doesn't call mprotect()
-     */
-    dvmLockMutex(&pHdr->lock);
+    /* table is full, lump the rest together */
+    return &pHdr->stats[LINEAR_ALLOC_STATS_SLOTS-1];
+}
 
-    startOffset = pHdr->curOffset;
-    assert(((startOffset + HEADER_EXTRA) & (BLOCK_ALIGN-1)) == 0);
+/*
+ * Account for an allocation of "size" bytes.
+ */
+static inline void recordAlloc(LinearAllocHdr* pHdr, Object* classLoader,
+    LinearAllocKind kind, size_t size)
+{
+    assert(kind >= 0 && kind < kLinearAllocKindCount);
+    LinearAllocStats* pStats = getStats(pHdr, classLoader);
+    android_atomic_add(size, &pStats->bytes[kind]);
+    android_atomic_inc(&pStats->count[kind]);
+}
 
-    /*
-     * Compute the new offset.  The old offset points at the address where
-     * we will store the hidden block header, so we advance past that,
-     * add the size of data they want, add another header's worth so we
-     * know we have room for that, and round up to BLOCK_ALIGN.  That's
-     * the next location where we'll put user data.  We then subtract the
-     * chunk header size off so we're back to the header pointer.
-     *
-     * Examples:
-     *   old=12 size=3 new=((12+(4*2)+3+7) & ~7)-4 = 24-4 --> 20
-     *   old=12 size=5 new=((12+(4*2)+5+7) & ~7)-4 = 32-4 --> 28
-     */
-    nextOffset = ((startOffset + HEADER_EXTRA*2 + size + (BLOCK_ALIGN-1))
-                    & ~(BLOCK_ALIGN-1)) - HEADER_EXTRA;
+/*
+ * Reserve the area from "curOffset" up to computeNextOffset(size), and
+ * make it writable.  Returns the offset of the new block's header.  The
+ * caller must hold the region lock, and must fill in the header.
+ *
+ * This aborts the VM if the region is full.
+ */
+static int reserveShared(LinearAllocHdr* pHdr, size_t size)
+{
+    int startOffset, nextOffset;
+    int lastGoodOff, firstWriteOff, lastWriteOff;
+
+    startOffset = pHdr->curOffset;
+    nextOffset = computeNextOffset(startOffset, size);
     LOGVV("--- old=%d size=%d new=%d", startOffset, size, nextOffset);
 
     if (nextOffset > pHdr->mapLength) {
@@ -317,15 +382,6 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
         dvmAbort();
     }
 
-    /*
-     * Round up "size" to encompass the entire region, including the 0-7
-     * pad bytes before the next chunk header.  This way we get maximum
-     * utility out of "realloc", and when we're doing ENFORCE_READ_ONLY
-     * stuff we always treat the full extent.
-     */
-    size = nextOffset - (startOffset + HEADER_EXTRA);
-    LOGVV("--- (size now %d)", size);
-
     /*
      * See if we are starting on or have crossed into a new page.  If so,
      * call mprotect on the page(s) we're about to write to.  We have to
@@ -374,21 +430,172 @@ void* dvmLinearAlloc(Object* classLoader, size_t size)
             pHdr->writeRefCount[i]++;
     }
 
+    pHdr->curOffset = nextOffset;
+    return startOffset;
+}
+
+/*
+ * Give up the range "self" is allocating from.  If it's the last thing
+ * reserved in the region, the unused tail goes back to the region.  The
+ * caller must hold the region lock.
+ */
+static void releaseThreadChunk(LinearAllocHdr* pHdr, Thread* self)
+{
+    if (self->linearAllocEnd != 0 &&
+        self->linearAllocEnd == pHdr->curOffset)
+    {
+        LOGVV("--- LinearAlloc: thread %d returns %d-%d",
+            self->threadId, self->linearAllocOffset, self->linearAllocEnd);
+        pHdr->curOffset = self->linearAllocOffset;
+    }
+    self->linearAllocOffset = self->linearAllocEnd = 0;
+}
+
+/*
+ * Reserve a new range of the region for "self".  The whole range starts
+ * out as one free block.
+ */
+static void newThreadChunk(LinearAllocHdr* pHdr, Thread* self)
+{
+    dvmLockMutex(&pHdr->lock);
+
+    releaseThreadChunk(pHdr, self);
+    int startOffset =
+        reserveShared(pHdr, THREAD_CHUNK_SIZE - HEADER_EXTRA*2);
+    int endOffset = pHdr->curOffset;
+    assert(endOffset - startOffset == THREAD_CHUNK_SIZE);
+    setFreeBlock(pHdr, startOffset, endOffset);
+    pHdr->chunkCount++;
+
+    dvmUnlockMutex(&pHdr->lock);
+
+    LOGVV("--- LinearAlloc: thread %d chunk %d-%d",
+        self->threadId, startOffset, endOffset);
+    self->linearAllocOffset = startOffset;
+    self->linearAllocEnd = endOffset;
+}
+
+/*
+ * Allocate "size" bytes of storage, associated with a particular class
+ * loader.
+ *
+ * It's okay for size to be zero.
+ *
+ * We always leave "curOffset" pointing at the next place where we will
+ * store the header that precedes the returned storage.
+ *
+ * This aborts the VM on failure, so it's not necessary to check for a
+ * NULL return value.
+ */
+void* dvmLinearAlloc(Object* classLoader, size_t size, LinearAllocKind kind)
+{
+    LinearAllocHdr* pHdr = getHeader(classLoader);
+    int startOffset, nextOffset;
+
+#ifdef DISABLE_LINEAR_ALLOC
+    return calloc(1, size);
+#endif
+
+    LOGVV("--- LinearAlloc(%p, %d)", classLoader, size);
+
+    /*
+     * Small allocations come out of the current thread's chunk, which
+     * nobody else writes to, so we don't need the lock.  The page
+     * reference counts used by ENFORCE_READ_ONLY are per-allocation, so
+     * that mode always takes the slow path.
+     */
+    Thread* self = dvmThreadSelf();
+    if (!ENFORCE_READ_ONLY && self != NULL && self->linearAllocChunks &&
+        size <= MAX_CHUNK_ALLOC)
+    {
+        if (self->linearAllocEnd == 0)
+            newThreadChunk(pHdr, self);
+        startOffset = self->linearAllocOffset;
+        nextOffset = computeNextOffset(startOffset, size);
+        if (nextOffset > self->linearAllocEnd) {
+            newThreadChunk(pHdr, self);
+            startOffset = self->linearAllocOffset;
+            nextOffset = computeNextOffset(startOffset, size);
+        }
+        size = nextOffset - (startOffset + HEADER_EXTRA);
+
+        /*
+         * Keep the rest of the chunk walkable.  The free block header has
+         * to be visible before the new length word, which is what tells a
+         * walker to look there.
+         */
+        if (nextOffset < self->linearAllocEnd)
+            setFreeBlock(pHdr, nextOffset, self->linearAllocEnd);
+        ANDROID_MEMBAR_STORE();
+        *(u4*)(pHdr->mapAddr + startOffset) = size;
+        self->linearAllocOffset = nextOffset;
+
+        recordAlloc(pHdr, classLoader, kind, size);
+        return pHdr->mapAddr + startOffset + HEADER_EXTRA;
+    }
+
+    /*
+     * What we'd like to do is just determine the new end-of-alloc size
+     * and atomic-swap the updated value in.  The trouble is that, the
+     * first time we reach a new page, we need to call mprotect() to
+     * make the page available, and we don't want to call mprotect() on
+     * every allocation.  The troubled situation is:
+     *  - thread A allocs across a page boundary, but gets preempted
+     *    before mprotect() completes
+     *  - thread B allocs within the new page, and doesn't call mprotect()
+     */
+    dvmLockMutex(&pHdr->lock);
+
+    startOffset = reserveShared(pHdr, size);
+    nextOffset = pHdr->curOffset;
+
+    /*
+     * Round up "size" to encompass the entire region, including the 0-7
+     * pad bytes before the next chunk header.  This way we get maximum
+     * utility out of "realloc", and when we're doing ENFORCE_READ_ONLY
+     * stuff we always treat the full extent.
+     */
+    size = nextOffset - (startOffset + HEADER_EXTRA);
+    LOGVV("--- (size now %d)", size);
+
     /* stow the size in the header */
     if (ENFORCE_READ_ONLY)
         *(u4*)(pHdr->mapAddr + startOffset) = size | LENGTHFLAG_RW;
     else
         *(u4*)(pHdr->mapAddr + startOffset) = size;
 
-    /*
-     * Update data structure.
-     */
-    pHdr->curOffset = nextOffset;
-
     dvmUnlockMutex(&pHdr->lock);
+
+    recordAlloc(pHdr, classLoader, kind, size);
     return pHdr->mapAddr + startOffset + HEADER_EXTRA;
 }
 
+/*
+ * Start carving the current thread's small allocations out of a range of
+ * its own.
+ */
+void dvmLinearAllocUseThreadChunk()
+{
+    dvmThreadSelf()->linearAllocChunks = true;
+}
+
+/*
+ * Stop using a per-thread range, and give back what's left of it.
+ */
+void dvmLinearAllocReleaseThreadChunk()
+{
+    LinearAllocHdr* pHdr = getHeader(NULL);
+    Thread* self = dvmThreadSelf();
+
+    self->linearAllocChunks = false;
+    if (pHdr == NULL || self->linearAllocEnd == 0)
+        return;
+
+    dvmLockMutex(&pHdr->lock);
+    releaseThreadChunk(pHdr, self);
+    dvmUnlockMutex(&pHdr->lock);
+}
+
 /*
  * Helper function, replaces strdup().
  */
@@ -398,7 +605,7 @@ char* dvmLinearStrdup(Object* classLoader, const char* str)
     return strdup(str);
 #endif
     int len = strlen(str);
-    void* mem = dvmLinearAlloc(classLoader, len+1);
+    void* mem = dvmLinearAlloc(classLoader, len+1, kLinearAllocStrings);
     memcpy(mem, str, len+1);
     if (ENFORCE_READ_ONLY)
         dvmLinearSetReadOnly(classLoader, mem);
@@ -414,7 +621,8 @@ char* dvmLinearStrdup(Object* classLoader, const char* str)
  * If the new size is > the old size, we allocate new storage, copy the
  * old stuff over, and mark the new stuff as free.
  */
-void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize)
+void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize,
+    LinearAllocKind kind)
 {
 #ifdef DISABLE_LINEAR_ALLOC
     return realloc(mem, newSize);
@@ -437,7 +645,7 @@ void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize)
 
     void* newMem;
 
-    newMem = dvmLinearAlloc(classLoader, newSize);
+    newMem = dvmLinearAlloc(classLoader, newSize, kind);
     assert(newMem != NULL);
     memcpy(newMem, mem, *pLen);
     dvmLinearFree(classLoader, mem);
@@ -467,36 +675,40 @@ static void updatePages(Object* classLoader, void* mem, int direction)
     LOGVV("--- updating pages %d-%d (%d)", firstPage, lastPage, direction);
 
     int i, cc;
+    int runStart = -1;
+    int prot = (direction < 0) ? PROT_READ : PROT_READ | PROT_WRITE;
+
+    /*
+     * The header is on the first page, which is still writable if we're
+     * going read-only.
+     */
+    if (direction < 0) {
+        if ((*pLen & LENGTHFLAG_RW) == 0) {
+            ALOGW("Double RO on %p", mem);
+            dvmAbort();
+        } else
+            *pLen &= ~LENGTHFLAG_RW;
+    }
 
     /*
-     * Update individual pages.  We could do some sort of "lazy update" to
-     * combine mprotect calls, but that's almost certainly more trouble
-     * than it's worth.
+     * Update the ref counts, and collect runs of adjacent pages that need
+     * to change state so we can handle each run with a single mprotect.
      */
-    for (i = firstPage; i <= lastPage; i++) {
-        if (direction < 0) {
+    for (i = firstPage; i <= lastPage + 1; i++) {
+        bool change = false;
+
+        if (i > lastPage) {
+            /* flush the final run */
+        } else if (direction < 0) {
             /*
              * Trying to mark read-only.
              */
-            if (i == firstPage) {
-                if ((*pLen & LENGTHFLAG_RW) == 0) {
-                    ALOGW("Double RO on %p", mem);
-                    dvmAbort();
-                } else
-                    *pLen &= ~LENGTHFLAG_RW;
-            }
-
             if (pHdr->writeRefCount[i] == 0) {
                 ALOGE("Can't make page %d any less writable", i);
                 dvmAbort();
             }
             pHdr->writeRefCount[i]--;
-            if (pHdr->writeRefCount[i] == 0) {
-                LOGVV("---  prot page %d RO", i);
-                cc = mprotect(pHdr->mapAddr + SYSTEM_PAGE_SIZE * i,
-                        SYSTEM_PAGE_SIZE, PROT_READ);
-                assert(cc == 0);
-            }
+            change = (pHdr->writeRefCount[i] == 0);
         } else {
             /*
              * Trying to mark writable.
@@ -505,24 +717,31 @@ static void updatePages(Object* classLoader, void* mem, int direction)
                 ALOGE("Can't make page %d any more writable", i);
                 dvmAbort();
             }
-            if (pHdr->writeRefCount[i] == 0) {
-                LOGVV("---  prot page %d RW", i);
-                cc = mprotect(pHdr->mapAddr + SYSTEM_PAGE_SIZE * i,
-                        SYSTEM_PAGE_SIZE, PROT_READ | PROT_WRITE);
-                assert(cc == 0);
-            }
+            change = (pHdr->writeRefCount[i] == 0);
             pHdr->writeRefCount[i]++;
+        }
 
-            if (i == firstPage) {
-                if ((*pLen & LENGTHFLAG_RW) != 0) {
-                    ALOGW("Double RW on %p", mem);
-                    dvmAbort();
-                } else
-                    *pLen |= LENGTHFLAG_RW;
-            }
+        if (change) {
+            if (runStart < 0)
+                runStart = i;
+        } else if (runStart >= 0) {
+            LOGVV("---  prot pages %d-%d %s", runStart, i-1,
+                direction < 0 ? "RO" : "RW");
+            cc = mprotect(pHdr->mapAddr + SYSTEM_PAGE_SIZE * runStart,
+                    SYSTEM_PAGE_SIZE * (i - runStart), prot);
+            assert(cc == 0);
+            runStart = -1;
         }
     }
 
+    if (direction > 0) {
+        if ((*pLen & LENGTHFLAG_RW) != 0) {
+            ALOGW("Double RW on %p", mem);
+            dvmAbort();
+        } else
+            *pLen |= LENGTHFLAG_RW;
+    }
+
     dvmUnlockMutex(&pHdr->lock);
 }
 
@@ -579,6 +798,8 @@ void dvmLinearFree(Object* classLoader, void* mem)
 
     u4* pLen = getBlockHeader(mem);
     *pLen |= LENGTHFLAG_FREE;
+    android_atomic_add(*pLen & LENGTHFLAG_MASK,
+        &getHeader(classLoader)->freedBytes);
 
     if (ENFORCE_READ_ONLY)
         dvmLinearSetReadOnly(classLoader, mem);
@@ -649,6 +870,57 @@ void dvmLinearAllocDump(Object* classLoader)
         (pHdr->curOffset * 100) / pHdr->mapLength);
 
     dvmUnlockMutex(&pHdr->lock);
+
+    DebugOutputTarget target;
+    dvmCreateLogOutputTarget(&target, ANDROID_LOG_INFO, LOG_TAG);
+    dvmLinearAllocDumpStats(classLoader, &target);
+}
+
+/*
+ * Dump the usage statistics.  The counters are updated without the lock,
+ * so the numbers may be slightly stale.
+ */
+void dvmLinearAllocDumpStats(Object* classLoader,
+    const DebugOutputTarget* target)
+{
+#ifdef DISABLE_LINEAR_ALLOC
+    return;
+#endif
+    LinearAllocHdr* pHdr = getHeader(classLoader);
+    if (pHdr == NULL)
+        return;
+
+    dvmPrintDebugMessage(target,
+        "LinearAlloc %p: %d of %d used, %d thread chunks, %d freed\n",
+        classLoader, pHdr->curOffset, pHdr->mapLength, pHdr->chunkCount,
+        pHdr->freedBytes);
+
+    for (int i = 0; i < LINEAR_ALLOC_STATS_SLOTS; i++) {
+        const LinearAllocStats* pStats = &pHdr->stats[i];
+        int total = 0;
+        for (int kind = 0; kind < kLinearAllocKindCount; kind++)
+            total += pStats->bytes[kind];
+        if (total == 0)
+            continue;
+
+        if (i == 0) {
+            dvmPrintDebugMessage(target, "  loader (bootstrap): %d bytes\n",
+                total);
+        } else if (i == LINEAR_ALLOC_STATS_SLOTS-1) {
+            dvmPrintDebugMessage(target, "  loader (others): %d bytes\n",
+                total);
+        } else {
+            dvmPrintDebugMessage(target, "  loader %p: %d bytes\n",
+                pStats->classLoader, total);
+        }
+
+        for (int kind = 0; kind < kLinearAllocKindCount; kind++) {
+            if (pStats->count[kind] == 0)
+                continue;
+            dvmPrintDebugMessage(target, "    %-10s %8d bytes in %6d blocks\n",
+                kKindNames[kind], pStats->bytes[kind], pStats->count[kind]);
+        }
+    }
 }
 
 /*
@@ -25,6 +25,39 @@
  */
 #define ENFORCE_READ_ONLY   false
 
+/*
+ * What a block of linear alloc storage is used for.  Only used for the
+ * usage statistics.
+ */
+enum LinearAllocKind {
+    kLinearAllocOther = 0,
+    kLinearAllocMethods,        /* Method arrays */
+    kLinearAllocFields,         /* InstField arrays */
+    kLinearAllocVtables,        /* vtables and Miranda method lists */
+    kLinearAllocInterfaces,     /* interface lists, iftables, ifviPools */
+    kLinearAllocStrings,        /* dvmLinearStrdup() */
+    kLinearAllocCode,           /* copies of DexCode */
+    kLinearAllocSupertypes,     /* supertype displays, interface hashes */
+
+    kLinearAllocKindCount
+};
+
+/*
+ * Usage statistics for one class loader.  "classLoader" is only used as
+ * a key; it is not a GC root and is never dereferenced.
+ */
+struct LinearAllocStats {
+    Object* classLoader;
+    int     bytes[kLinearAllocKindCount];
+    int     count[kLinearAllocKindCount];
+};
+
+/*
+ * Number of per-loader stats slots.  Slot 0 is the bootstrap class
+ * loader, and the last slot collects everything that didn't fit.
+ */
+#define LINEAR_ALLOC_STATS_SLOTS    8
+
 /*
  * Linear allocation state.  We could tuck this into the start of the
  * allocated region, but that would prevent us from sharing the rest of
@@ -39,6 +72,10 @@ struct LinearAllocHdr {
     int     firstOffset;        /* for chasing through */
 
     short*  writeRefCount;      /* for ENFORCE_READ_ONLY */
+
+    int     chunkCount;         /* per-thread chunks handed out */
+    int     freedBytes;         /* bytes passed to dvmLinearFree */
+    LinearAllocStats stats[LINEAR_ALLOC_STATS_SLOTS];
 };
 
 
@@ -53,11 +90,26 @@ LinearAllocHdr* dvmLinearAllocCreate(Object* classLoader);
 void dvmLinearAllocDestroy(Object* classLoader);
 
 /*
- * Allocate a chunk of memory.  The memory will be zeroed out.
+ * Allocate a chunk of memory.  The memory will be zeroed out.  "kind"
+ * says what the memory is for, and is only used for statistics.
+ *
+ * Small allocations from a thread that called dvmLinearAllocUseThreadChunk
+ * are carved out of a chunk owned by that thread, and don't take the
+ * region lock.
  *
  * For ENFORCE_READ_ONLY, call dvmLinearReadOnly on the result.
  */
-void* dvmLinearAlloc(Object* classLoader, size_t size);
+void* dvmLinearAlloc(Object* classLoader, size_t size, LinearAllocKind kind);
+
+/*
+ * Let the current thread make small allocations from a range it owns,
+ * without taking the region lock.  This is meant for the handful of
+ * threads that load classes in parallel; every call must be paired with
+ * dvmLinearAllocReleaseThreadChunk before the thread detaches, which
+ * hands the unused part of the range back.
+ */
+void dvmLinearAllocUseThreadChunk(void);
+void dvmLinearAllocReleaseThreadChunk(void);
 
 /*
  * Reallocate a chunk.  The original storage is not released, but may be
@@ -66,7 +118,8 @@ void* dvmLinearAlloc(Object* classLoader, size_t size);
  * For ENFORCE_READ_ONLY, call dvmLinearReadOnly on the result.  Also, the
  * caller should probably mark the "mem" argument read-only before calling.
  */
-void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize);
+void* dvmLinearRealloc(Object* classLoader, void* mem, size_t newSize,
+    LinearAllocKind kind);
 
 /* don't call these directly */
 void dvmLinearSetReadOnly(Object* classLoader, void* mem);
@@ -111,6 +164,13 @@ char* dvmLinearStrdup(Object* classLoader, const char* str);
  */
 void dvmLinearAllocDump(Object* classLoader);
 
+/*
+ * Dump the usage statistics of a linear alloc area, broken down by class
+ * loader and kind.
+ */
+void dvmLinearAllocDumpStats(Object* classLoader,
+    const DebugOutputTarget* target);
+
 /*
  * Determine if [start, start+length) is contained in the in-use area of
  * a single LinearAlloc.  The full set of linear allocators is scanned.
@@ -20,6 +20,9 @@
 
 #include "Dalvik.h"
 #include "libdex/OptInvocation.h"
+#if defined(WITH_JIT)
+#include "interp/JitProfile.h"
+#endif
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -226,6 +229,10 @@ int dvmRawDexFileOpen(const char* fileName, const char* odexOutputName,
 
     ALOGV("Successfully opened '%s'", fileName);
 
+#if defined(WITH_JIT)
+    dvmJitProfileOpen(pDvmDex, cachedName);
+#endif
+
     *ppRawDexFile = (RawDexFile*) calloc(1, sizeof(RawDexFile));
     (*ppRawDexFile)->cacheFileName = cachedName;
     (*ppRawDexFile)->pDvmDex = pDvmDex;
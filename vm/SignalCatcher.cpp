@@ -148,6 +148,10 @@ static void handleSigQuit()
 
     dvmDumpLoaderStats("sig");
 
+    DebugOutputTarget logTarget;
+    dvmCreateLogOutputTarget(&logTarget, ANDROID_LOG_INFO, LOG_TAG);
+    dvmLinearAllocDumpStats(NULL, &logTarget);
+
     if (gDvm.stackTraceFile == NULL) {
         /* just dump to log */
         DebugOutputTarget target;
@@ -175,6 +179,9 @@ static void handleSigQuit()
 
     dvmResumeAllThreads(SUSPEND_FOR_STACK_DUMP);
 
+    if (gDvm.allocProfileFile != NULL)
+        dvmWriteAllocProfile(gDvm.allocProfileFile);
+
     if (traceBuf != NULL) {
         /*
          * We don't know how long it will take to do the disk I/O, so put us
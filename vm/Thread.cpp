@@ -998,6 +998,7 @@ static void freeThread(Thread* thread)
     dvmSelfVerificationShadowSpaceFree(thread);
 #endif
     free(thread->stackTraceSample);
+    dvmAllocTrackerThreadExit(thread);
     free(thread);
 }
 
@@ -97,6 +97,8 @@ union InterpBreak {
     } ctl;
 };
 
+struct AllocSampleBuffer;
+
 /*
  * Our per-thread data.
  *
@@ -294,6 +296,21 @@ struct Thread {
     /* memory allocation profiling state */
     AllocProfState allocProf;
 
+    /* allocation tracker sampling state (see AllocTracker.cpp) */
+    size_t      allocSampleBytesLeft;
+    u4          allocSampleSeed;
+    AllocSampleBuffer* allocSampleBuf;
+
+    /*
+     * Range of the boot loader's LinearAlloc region reserved for this
+     * thread: the offset of the next block header, and the end of the
+     * range.  Both are zero until the first allocation, and only threads
+     * that set linearAllocChunks ever get one.
+     */
+    bool        linearAllocChunks;
+    int         linearAllocOffset;
+    int         linearAllocEnd;
+
 #ifdef WITH_JNI_STACK_CHECK
     u4          stackCrc;
 #endif
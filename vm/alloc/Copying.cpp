@@ -1422,6 +1422,18 @@ static void pinHashTableEntries(HashTable *table)
     LOG_PIN("<<< pinHashTableEntries(table=%p)", table);
 }
 
+static void pinDbgRegistryVisitor(void *addr, void *arg)
+{
+    pinObject(*(Object **)addr);
+}
+
+static void pinDbgRegistry()
+{
+    LOG_PIN(">>> pinDbgRegistry()");
+    dvmDbgVisitRegistry(pinDbgRegistryVisitor, NULL, true);
+    LOG_PIN("<<< pinDbgRegistry()");
+}
+
 static void pinPrimitiveClasses()
 {
     size_t length = ARRAYSIZE(gDvm.primitiveClass);
@@ -2083,7 +2095,7 @@ void dvmScavengeRoots()  /* Needs a new name badly */
     pinReferenceTable(&gDvm.jniGlobalRefTable);
     pinReferenceTable(&gDvm.jniPinRefTable);
     pinHashTableEntries(gDvm.loadedClasses);
-    pinHashTableEntries(gDvm.dbgRegistry);
+    pinDbgRegistry();
     pinPrimitiveClasses();
     pinInternedStrings();
 
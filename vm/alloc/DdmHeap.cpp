@@ -174,7 +174,6 @@ enum HpsgKind {
     ((u1)((((kind) & 0x7) << 3) | ((solidity) & 0x7)))
 
 struct HeapChunkContext {
-    void* startOfNextMemoryChunk;
     u1 *buf;
     u1 *p;
     u1 *pieceLenField;
@@ -183,10 +182,39 @@ struct HeapChunkContext {
     int type;
     bool merge;
     bool needHeader;
+
+    /* The run of chunks that hasn't been written to the buffer yet.
+     * When merging, adjacent chunks with the same state are folded
+     * into a single run.
+     */
+    u1 runState;
+    char *runStart;
+    size_t runLength;
+
+    /* The address just past the last chunk we were handed.  A chunk
+     * that doesn't start here begins a new piece.
+     */
+    char *pieceEnd;
+
+    /* In incremental mode, the regions that changed since the last
+     * dump, indexed from regionBase.  NULL if everything is sent.
+     * regionCursor is the end of the last segment we were handed;
+     * anything between it and the next segment is free.
+     */
+    const u1 *changedRegions;
+    size_t numRegions;
+    uintptr_t regionBase;
+    uintptr_t regionCursor;
 };
 
 #define ALLOCATION_UNIT_SIZE 8
 
+/*
+ * Incremental HPSG dumps track a signature for each region of this
+ * many bytes of the managed heap.
+ */
+#define HPSG_REGION_SHIFT 18
+
 static void flush_hpsg_chunk(HeapChunkContext *ctx)
 {
     if (ctx->pieceLenField == NULL && ctx->needHeader) {
@@ -270,114 +298,356 @@ static void append_chunk(HeapChunkContext *ctx, u1 state, void* ptr, size_t leng
 }
 
 /*
- * Called by dlmalloc_inspect_all. If used_bytes != 0 then start is
- * the start of a malloc-ed piece of memory of size used_bytes. If
- * start is 0 then start is the beginning of any free space not
- * including dlmalloc's book keeping and end the start of the next
- * dlmalloc chunk. Regions purely containing book keeping don't
+ * Write out the pending run, if any.
+ */
+static void flush_run(HeapChunkContext *ctx)
+{
+    if (ctx->runLength != 0) {
+        append_chunk(ctx, ctx->runState, ctx->runStart, ctx->runLength);
+        ctx->runLength = 0;
+    }
+}
+
+/*
+ * Finish the current piece and send whatever is buffered.
+ */
+static void end_piece(HeapChunkContext *ctx)
+{
+    flush_run(ctx);
+    flush_hpsg_chunk(ctx);
+    ctx->pieceEnd = NULL;
+}
+
+/*
+ * Add a chunk of "length" bytes at "ptr".  Chunks are expected in
+ * address order; a gap between chunks starts a new piece.
+ */
+static void add_chunk(HeapChunkContext *ctx, u1 state, void* ptr,
+                      size_t length)
+{
+    char *start = (char *)ptr;
+
+    if (start != ctx->pieceEnd) {
+        end_piece(ctx);
+    } else if (ctx->merge && ctx->runLength != 0 &&
+               state == ctx->runState) {
+        ctx->runLength += length;
+        ctx->pieceEnd = start + length;
+        return;
+    } else {
+        flush_run(ctx);
+    }
+    ctx->runState = state;
+    ctx->runStart = start;
+    ctx->runLength = length;
+    ctx->pieceEnd = start + length;
+}
+
+/*
+ * Called by dlmalloc_inspect_all for the native heap. If used_bytes
+ * != 0 then start is the start of a malloc-ed piece of memory of size
+ * used_bytes. If start is 0 then start is the beginning of any free
+ * space not including dlmalloc's book keeping and end the start of the
+ * next dlmalloc chunk. Regions purely containing book keeping don't
  * callback.
  */
-static void heap_chunk_callback(void* start, void* end, size_t used_bytes,
-                                void* arg)
+static void native_chunk_callback(void* start, void* end, size_t used_bytes,
+                                  void* arg)
 {
-    u1 state;
     HeapChunkContext *ctx = (HeapChunkContext *)arg;
     UNUSED_PARAMETER(end);
 
     if (used_bytes == 0) {
         if (start == NULL) {
             // Reset for start of new heap.
-            ctx->startOfNextMemoryChunk = NULL;
-            flush_hpsg_chunk(ctx);
+            end_piece(ctx);
         }
         // Only process in use memory so that free region information
         // also includes dlmalloc book keeping.
         return;
     }
 
-    /* If we're looking at the native heap, we'll just return
-     * (SOLIDITY_HARD, KIND_NATIVE) for all allocated chunks
-     */
-    bool native = ctx->type == CHUNK_TYPE("NHSG");
-
-    if (ctx->startOfNextMemoryChunk != NULL) {
-        // Transmit any pending free memory. Native free memory of
-        // over kMaxFreeLen could be because of the use of mmaps, so
-        // don't report. If not free memory then start a new segment.
-        bool flush = true;
-        if (start > ctx->startOfNextMemoryChunk) {
-            const size_t kMaxFreeLen = 2 * SYSTEM_PAGE_SIZE;
-            void* freeStart = ctx->startOfNextMemoryChunk;
-            void* freeEnd = start;
-            size_t freeLen = (char*)freeEnd - (char*)freeStart;
-            if (!native || freeLen < kMaxFreeLen) {
-                append_chunk(ctx, HPSG_STATE(SOLIDITY_FREE, 0),
-                             freeStart, freeLen);
-                flush = false;
-            }
+    // Transmit any pending free memory. Free memory of over
+    // kMaxFreeLen could be because of the use of mmaps, so don't
+    // report it; the gap will start a new segment.
+    if (ctx->pieceEnd != NULL && (char *)start > ctx->pieceEnd) {
+        const size_t kMaxFreeLen = 2 * SYSTEM_PAGE_SIZE;
+        size_t freeLen = (char *)start - ctx->pieceEnd;
+        if (freeLen < kMaxFreeLen) {
+            add_chunk(ctx, HPSG_STATE(SOLIDITY_FREE, 0), ctx->pieceEnd,
+                      freeLen);
         }
-        if (flush) {
-            ctx->startOfNextMemoryChunk = NULL;
-            flush_hpsg_chunk(ctx);
+    }
+    add_chunk(ctx, HPSG_STATE(SOLIDITY_HARD, KIND_NATIVE), start,
+              used_bytes + HEAP_SOURCE_CHUNK_OVERHEAD);
+}
+
+/*
+ * Figure out what kind of managed heap object "obj" is.
+ */
+static u1 objectState(const Object *obj)
+{
+    ClassObject *clazz = obj->clazz;
+    if (clazz == NULL) {
+        /* The object was probably just created
+         * but hasn't been initialized yet.
+         */
+        return HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
+    } else if (dvmIsTheClassClass(clazz)) {
+        return HPSG_STATE(SOLIDITY_HARD, KIND_CLASS_OBJECT);
+    } else if (IS_CLASS_FLAG_SET(clazz, CLASS_ISARRAY)) {
+        if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOBJECTARRAY)) {
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
+        }
+        switch (clazz->elementClass->primitiveType) {
+        case PRIM_BOOLEAN:
+        case PRIM_BYTE:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_1);
+        case PRIM_CHAR:
+        case PRIM_SHORT:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_2);
+        case PRIM_INT:
+        case PRIM_FLOAT:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
+        case PRIM_DOUBLE:
+        case PRIM_LONG:
+            return HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_8);
+        default:
+            assert(!"Unknown GC heap object type");
+            return HPSG_STATE(SOLIDITY_HARD, KIND_UNKNOWN);
         }
     }
-    const Object *obj = (const Object *)start;
+    return HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
+}
 
-    /* It's an allocated chunk.  Figure out what it is.
-     */
-//TODO: if ctx.merge, see if this chunk is different from the last chunk.
-//      If it's the same, we should combine them.
-    if (!native && dvmIsValidObject(obj)) {
-        ClassObject *clazz = obj->clazz;
-        if (clazz == NULL) {
-            /* The object was probably just created
-             * but hasn't been initialized yet.
-             */
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
-        } else if (dvmIsTheClassClass(clazz)) {
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_CLASS_OBJECT);
-        } else if (IS_CLASS_FLAG_SET(clazz, CLASS_ISARRAY)) {
-            if (IS_CLASS_FLAG_SET(clazz, CLASS_ISOBJECTARRAY)) {
-                state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
-            } else {
-                switch (clazz->elementClass->primitiveType) {
-                case PRIM_BOOLEAN:
-                case PRIM_BYTE:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_1);
-                    break;
-                case PRIM_CHAR:
-                case PRIM_SHORT:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_2);
-                    break;
-                case PRIM_INT:
-                case PRIM_FLOAT:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_4);
-                    break;
-                case PRIM_DOUBLE:
-                case PRIM_LONG:
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_ARRAY_8);
-                    break;
-                default:
-                    assert(!"Unknown GC heap object type");
-                    state = HPSG_STATE(SOLIDITY_HARD, KIND_UNKNOWN);
-                    break;
+typedef void SegmentVisitor(uintptr_t start, size_t length, u1 state,
+                            void *arg);
+
+/*
+ * Walk the live bitmap between "base" and "max", calling "visitor" for
+ * each object and for each free gap between objects, in address order.
+ * An object covers its dlmalloc chunk, so the chunk overhead of the
+ * following object is folded into the preceding chunk or gap.
+ */
+static void walkObjects(const HeapBitmap *liveBits, uintptr_t base,
+                        uintptr_t max, SegmentVisitor *visitor, void *arg)
+{
+    if (max > liveBits->max) {
+        max = liveBits->max;
+    }
+    if (max < base) {
+        return;
+    }
+    uintptr_t next = 0;
+    uintptr_t start = HB_OFFSET_TO_INDEX(base - liveBits->base);
+    uintptr_t end = HB_OFFSET_TO_INDEX(max - liveBits->base);
+    for (uintptr_t i = start; i <= end; ++i) {
+        unsigned long word = liveBits->bits[i];
+        if (UNLIKELY(word != 0)) {
+            unsigned long highBit = (uintptr_t)1 << (HB_BITS_PER_WORD - 1);
+            uintptr_t ptrBase = HB_INDEX_TO_OFFSET(i) + liveBits->base;
+            while (word != 0) {
+                const int shift = CLZ(word);
+                uintptr_t addr = ptrBase + shift * HB_OBJECT_ALIGNMENT;
+                const Object *obj = (const Object *)addr;
+                size_t length = dvmHeapSourceChunkSize(obj) +
+                    HEAP_SOURCE_CHUNK_OVERHEAD;
+                if (next != 0 && addr > next) {
+                    (*visitor)(next, addr - next,
+                               HPSG_STATE(SOLIDITY_FREE, 0), arg);
                 }
+                (*visitor)(addr, length, objectState(obj), arg);
+                next = addr + length;
+                word &= ~(highBit >> shift);
             }
-        } else {
-            state = HPSG_STATE(SOLIDITY_HARD, KIND_OBJECT);
         }
-    } else {
-        obj = NULL; // it's not actually an object
-        state = HPSG_STATE(SOLIDITY_HARD, KIND_NATIVE);
     }
-    append_chunk(ctx, state, start, used_bytes + HEAP_SOURCE_CHUNK_OVERHEAD);
-    ctx->startOfNextMemoryChunk =
-        (char*)start + used_bytes + HEAP_SOURCE_CHUNK_OVERHEAD;
+}
+
+#define HPSG_REGION_SIZE ((uintptr_t)1 << HPSG_REGION_SHIFT)
+
+/*
+ * Send the parts of [start, end) that lie in changed regions.  A run of
+ * consecutive changed regions goes out as a single chunk, so an object
+ * is only split where it crosses into or out of an unchanged region.
+ */
+static void emitChangedParts(HeapChunkContext *ctx, uintptr_t start,
+                             uintptr_t end, u1 state)
+{
+    while (start < end) {
+        size_t region = (start - ctx->regionBase) >> HPSG_REGION_SHIFT;
+        if (region >= ctx->numRegions) {
+            return;
+        }
+        bool changed = ctx->changedRegions[region];
+        uintptr_t partEnd = ctx->regionBase + (region + 1) * HPSG_REGION_SIZE;
+        while (partEnd < end && region + 1 < ctx->numRegions &&
+               (bool)ctx->changedRegions[region + 1] == changed) {
+            region++;
+            partEnd += HPSG_REGION_SIZE;
+        }
+        partEnd = MIN(partEnd, end);
+        if (changed) {
+            add_chunk(ctx, state, (void *)start, partEnd - start);
+        }
+        start = partEnd;
+    }
+}
+
+/*
+ * Sends every chunk, or only the parts that lie in a changed region.
+ * In incremental mode the space between chunks is sent as free too, so
+ * a changed region that no longer holds any objects is cleared.
+ */
+static void emitSegment(uintptr_t start, size_t length, u1 state, void *arg)
+{
+    HeapChunkContext *ctx = (HeapChunkContext *)arg;
+
+    if (ctx->changedRegions == NULL) {
+        add_chunk(ctx, state, (void *)start, length);
+        return;
+    }
+    if (start > ctx->regionCursor) {
+        emitChangedParts(ctx, ctx->regionCursor, start,
+                         HPSG_STATE(SOLIDITY_FREE, 0));
+    }
+    emitChangedParts(ctx, MAX(start, ctx->regionCursor), start + length,
+                     state);
+    ctx->regionCursor = MAX(ctx->regionCursor, start + length);
+}
+
+struct RegionSigContext {
+    u4 *sigs;
+    size_t numRegions;
+    uintptr_t base;
+};
+
+/*
+ * Fold a chunk into the signature of every region it overlaps, clipped
+ * to that region the same way emitChangedParts clips what it sends.
+ */
+static void hashSegment(uintptr_t start, size_t length, u1 state, void *arg)
+{
+    RegionSigContext *ctx = (RegionSigContext *)arg;
+    uintptr_t offset = start - ctx->base;
+    uintptr_t end = offset + length;
+
+    while (offset < end) {
+        size_t region = offset >> HPSG_REGION_SHIFT;
+        if (region >= ctx->numRegions) {
+            return;
+        }
+        uintptr_t partEnd = MIN(end, (region + 1) * HPSG_REGION_SIZE);
+        u4 *sig = &ctx->sigs[region];
+
+        u4 hash = (*sig != 0) ? *sig : 2166136261u;
+        hash = (hash ^ (u4)offset) * 16777619u;
+        hash = (hash ^ (u4)(partEnd - offset)) * 16777619u;
+        hash = (hash ^ state) * 16777619u;
+        *sig = hash;
+        offset = partEnd;
+    }
+}
+
+/*
+ * Compute the region signatures of the managed heap, compare them to
+ * the ones from the last dump, and return an array with a non-zero
+ * entry for each region that changed.  Every region counts as changed
+ * on the first dump.  Returns NULL on failure, in which case everything
+ * should be sent.
+ */
+static u1 *findChangedRegions(const uintptr_t *base, const uintptr_t *max,
+                              size_t numHeaps)
+{
+    GcHeap *gcHeap = gDvm.gcHeap;
+    HeapBitmap *liveBits = dvmHeapSourceGetLiveBits();
+    size_t numRegions =
+        ((liveBits->allocLen * CHAR_BIT * HB_OBJECT_ALIGNMENT) >>
+         HPSG_REGION_SHIFT) + 1;
+
+    bool first = (gcHeap->ddmHpsgRegionSigs == NULL);
+    if (first) {
+        gcHeap->ddmHpsgRegionSigs = (u4 *)calloc(numRegions, sizeof(u4));
+        if (gcHeap->ddmHpsgRegionSigs == NULL) {
+            return NULL;
+        }
+        gcHeap->ddmHpsgNumRegions = numRegions;
+    }
+    assert(gcHeap->ddmHpsgNumRegions == numRegions);
+
+    RegionSigContext sigCtx;
+    sigCtx.sigs = (u4 *)calloc(numRegions, sizeof(u4));
+    sigCtx.numRegions = numRegions;
+    sigCtx.base = liveBits->base;
+    u1 *changed = (u1 *)malloc(numRegions);
+    if (sigCtx.sigs == NULL || changed == NULL) {
+        free(sigCtx.sigs);
+        free(changed);
+        return NULL;
+    }
+
+    for (size_t i = numHeaps; i > 0; --i) {
+        walkObjects(liveBits, base[i-1], max[i-1], hashSegment, &sigCtx);
+    }
+
+    u4 *oldSigs = gcHeap->ddmHpsgRegionSigs;
+    for (size_t i = 0; i < numRegions; ++i) {
+        changed[i] = first || (sigCtx.sigs[i] != oldSigs[i]);
+    }
+    free(oldSigs);
+    gcHeap->ddmHpsgRegionSigs = sigCtx.sigs;
+    return changed;
+}
+
+/*
+ * Walk the managed heaps, oldest first, using the live bitmap.
+ */
+static void walkManagedHeap(HeapChunkContext *ctx, bool incremental)
+{
+    uintptr_t base[HEAP_SOURCE_MAX_HEAP_COUNT];
+    uintptr_t max[HEAP_SOURCE_MAX_HEAP_COUNT];
+    HeapBitmap *liveBits = dvmHeapSourceGetLiveBits();
+    size_t numHeaps = dvmHeapSourceGetNumHeaps();
+    u1 *changed = NULL;
+
+    dvmHeapSourceGetRegions(base, max, numHeaps);
+    if (incremental) {
+        changed = findChangedRegions(base, max, numHeaps);
+    }
+    ctx->changedRegions = changed;
+    ctx->numRegions = gDvm.gcHeap->ddmHpsgNumRegions;
+    ctx->regionBase = liveBits->base;
+
+    for (size_t i = numHeaps; i > 0; --i) {
+        /* The mspace header sits at the start of each heap, so the
+         * leading free space is only counted from the next region.
+         */
+        ctx->regionCursor = (base[i-1] - ctx->regionBase + HPSG_REGION_SIZE)
+            & ~(HPSG_REGION_SIZE - 1);
+        ctx->regionCursor += ctx->regionBase;
+        walkObjects(liveBits, base[i-1], max[i-1], emitSegment, ctx);
+        if (changed != NULL) {
+            /* Clear out to the next heap, or to the end of the bitmap */
+            uintptr_t limit = (i > 1) ? base[i-2] :
+                ctx->regionBase + ctx->numRegions * HPSG_REGION_SIZE;
+            if (limit > ctx->regionCursor) {
+                emitChangedParts(ctx, ctx->regionCursor, limit,
+                                 HPSG_STATE(SOLIDITY_FREE, 0));
+            }
+        }
+        end_piece(ctx);
+    }
+    free(changed);
 }
 
 enum HpsgWhen {
     HPSG_WHEN_NEVER = 0,
     HPSG_WHEN_EVERY_GC = 1,
+    /* Like EVERY_GC, but after the first dump only send the regions
+     * of the managed heap that changed.  Native heaps are always
+     * sent in full.
+     */
+    HPSG_WHEN_EVERY_GC_INCREMENTAL = 2,
 };
 enum HpsgWhat {
     HPSG_WHAT_MERGED_OBJECTS = 0,
@@ -388,10 +658,13 @@ enum HpsgWhat {
  * Maximum chunk size.  Obtain this from the formula:
  *
  * (((maximum_heap_size / ALLOCATION_UNIT_SIZE) + 255) / 256) * 2
+ *
+ * Bigger chunks mean fewer round trips to the debugger; a heap that
+ * doesn't fit is simply split across several chunks.
  */
-#define HPSx_CHUNK_SIZE (16384 - 16)
+#define HPSx_CHUNK_SIZE (65536 - 16)
 
-static void walkHeap(bool merge, bool native)
+static void walkHeap(bool merge, bool native, bool incremental)
 {
     HeapChunkContext ctx;
 
@@ -416,13 +689,11 @@ static void walkHeap(bool merge, bool native)
     ctx.p = ctx.buf;
     ctx.needHeader = true;
     if (native) {
-        dlmalloc_inspect_all(heap_chunk_callback, (void*)&ctx);
+        dlmalloc_inspect_all(native_chunk_callback, (void*)&ctx);
     } else {
-        dvmHeapSourceWalk(heap_chunk_callback, (void *)&ctx);
-    }
-    if (ctx.p > ctx.buf) {
-        flush_hpsg_chunk(&ctx);
+        walkManagedHeap(&ctx, incremental);
     }
+    end_piece(&ctx);
 
     free(ctx.buf);
 }
@@ -473,7 +744,8 @@ void dvmDdmSendHeapSegments(bool shouldLock, bool native)
 
     /* Send a series of heap segment chunks.
      */
-    walkHeap(merge, native);
+    walkHeap(merge, native,
+             !native && when == HPSG_WHEN_EVERY_GC_INCREMENTAL);
 
     /* Finally, send a heap end chunk.
      */
@@ -492,6 +764,7 @@ bool dvmDdmHandleHpsgNhsgChunk(int when, int what, bool native)
     switch (when) {
     case HPSG_WHEN_NEVER:
     case HPSG_WHEN_EVERY_GC:
+    case HPSG_WHEN_EVERY_GC_INCREMENTAL:
         break;
     default:
         ALOGI("%s(): bad when value 0x%08x", __func__, when);
@@ -511,6 +784,10 @@ bool dvmDdmHandleHpsgNhsgChunk(int when, int what, bool native)
         if (!native) {
             gDvm.gcHeap->ddmHpsgWhen = when;
             gDvm.gcHeap->ddmHpsgWhat = what;
+            /* The next incremental dump starts from scratch. */
+            free(gDvm.gcHeap->ddmHpsgRegionSigs);
+            gDvm.gcHeap->ddmHpsgRegionSigs = NULL;
+            gDvm.gcHeap->ddmHpsgNumRegions = 0;
         } else {
             gDvm.gcHeap->ddmNhsgWhen = when;
             gDvm.gcHeap->ddmNhsgWhat = what;
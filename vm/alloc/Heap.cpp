@@ -111,6 +111,8 @@ bool dvmHeapStartup()
     gcHeap->ddmHpsgWhat = 0;
     gcHeap->ddmNhsgWhen = 0;
     gcHeap->ddmNhsgWhat = 0;
+    gcHeap->ddmHpsgRegionSigs = NULL;
+    gcHeap->ddmHpsgNumRegions = 0;
     gDvm.gcHeap = gcHeap;
 
     /* Set up the lists we'll use for cleared reference objects.
@@ -135,6 +137,7 @@ void dvmHeapShutdown()
 //TODO: make sure we're locked
     if (gDvm.gcHeap != NULL) {
         dvmCardTableShutdown();
+        free(gDvm.gcHeap->ddmHpsgRegionSigs);
         /* Destroy the heap.  Any outstanding pointers will point to
          * unmapped memory (unless/until someone else maps it).  This
          * frees gDvm.gcHeap as a side-effect.
@@ -749,6 +752,17 @@ void dvmCollectGarbageInternal(const GcSpec* spec)
              currAllocated / 1024, currFootprint / 1024,
              rootTime, dirtyTime, gcTime);
     }
+    RegisterMapCacheStats regMapStats;
+    dvmRegisterMapCacheGetStats(&regMapStats, true);
+    if (debugalloc() && regMapStats.hits + regMapStats.misses != 0) {
+        ALOGD("%s register map cache: %d%% hit (%d/%d), %d maps %zdK, "
+              "%d evicted",
+             spec->reason,
+             (regMapStats.hits * 100) / (regMapStats.hits + regMapStats.misses),
+             regMapStats.hits, regMapStats.hits + regMapStats.misses,
+             regMapStats.numMaps, regMapStats.totalSize / 1024,
+             regMapStats.evictions);
+    }
     if (gcHeap->ddmHpifWhen != 0) {
         LOGD_HEAP("Sending VM heap info to DDM");
         dvmDdmSendHeapInfo(gcHeap->ddmHpifWhen, false);
@@ -63,6 +63,11 @@ struct GcHeap {
     int ddmHpsgWhat;
     int ddmNhsgWhen;
     int ddmNhsgWhat;
+
+    /* Per-region signatures from the last incremental HPSG dump.
+     */
+    u4 *ddmHpsgRegionSigs;
+    size_t ddmHpsgNumRegions;
 };
 
 bool dvmLockHeap(void);
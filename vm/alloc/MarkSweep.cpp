@@ -905,6 +905,7 @@ void dvmHeapSweepSystemWeaks()
     dvmGcDetachDeadInternedStrings(isUnmarkedObject);
     dvmSweepMonitorList(&gDvm.monitorList, isUnmarkedObject);
     sweepWeakJniGlobals();
+    dvmDbgSweepRegistry(isUnmarkedObject);
 }
 
 /*
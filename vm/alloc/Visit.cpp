@@ -48,6 +48,27 @@ static void visitHashTable(RootVisitor *visitor, HashTable *table,
     dvmHashTableUnlock(table);
 }
 
+struct DbgRegistryVisitorArgs {
+    RootVisitor*    visitor;
+    void*           arg;
+};
+
+static void dbgRegistryVisitor(void *addr, void *arg)
+{
+    DbgRegistryVisitorArgs *args = (DbgRegistryVisitorArgs *)arg;
+    (*args->visitor)(addr, 0, ROOT_DEBUGGER, args->arg);
+}
+
+/*
+ * Visits the objects the debugger has asked us to keep.  The rest of the
+ * debugger's object registry is weak.
+ */
+static void visitDbgRegistry(RootVisitor *visitor, void *arg)
+{
+    DbgRegistryVisitorArgs args = { visitor, arg };
+    dvmDbgVisitRegistry(dbgRegistryVisitor, &args, false);
+}
+
 /*
  * Visits all entries in the reference table.
  */
@@ -214,9 +235,7 @@ void dvmVisitRoots(RootVisitor *visitor, void *arg)
     assert(visitor != NULL);
     visitHashTable(visitor, gDvm.loadedClasses, ROOT_STICKY_CLASS, arg);
     visitPrimitiveTypes(visitor, arg);
-    if (gDvm.dbgRegistry != NULL) {
-        visitHashTable(visitor, gDvm.dbgRegistry, ROOT_DEBUGGER, arg);
-    }
+    visitDbgRegistry(visitor, arg);
     if (gDvm.literalStrings != NULL) {
         visitHashTable(visitor, gDvm.literalStrings, ROOT_INTERNED_STRING, arg);
     }
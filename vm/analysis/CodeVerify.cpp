@@ -68,6 +68,43 @@ static bool gDebugVerbose = false;
 #define kExtraRegs  2
 #define RESULT_REGISTER(_insnRegCount)  (_insnRegCount)
 
+/*
+ * Storage for register lines is carved out of chunks of this many lines.
+ */
+#define kLinesPerChunk  64
+
+/*
+ * Methods with fewer code units than this are processed in address order,
+ * since computing the reverse post-order isn't worth it.
+ */
+#define kRpoMinInsnsSize    256
+
+/*
+ * Methods whose register tables need more than this many bytes have their
+ * memory use logged.
+ */
+#define kVerifyMemoryReportThreshold    (1024 * 1024)
+
+/*
+ * Chunk of register line storage.  The lines immediately follow.
+ */
+struct RegisterLineChunk {
+    RegisterLineChunk* next;
+};
+
+/*
+ * Queue of branch targets whose "changed" flag is set, ordered by their
+ * position in a reverse post-order traversal of the method.  This way we
+ * generally see all of a block's predecessors before the block itself,
+ * and loops converge in a couple of passes.
+ */
+struct VerifyWorklist {
+    int*        order;          /* priority for each address, lower first */
+    int*        heap;           /* binary min-heap of addresses */
+    int         heapCount;
+    u1*         queued;         /* non-zero if address is in the heap */
+};
+
 /*
  * Big fat collection of register data.
  */
@@ -76,6 +113,11 @@ typedef struct RegisterTable {
      * Array of RegisterLine structs, one per address in the method.  We only
      * set the pointers for certain addresses, based on instruction widths
      * and what we're trying to accomplish.
+     *
+     * Lines start out pointing at "sharedLine", which is all zeroes
+     * (kRegTypeUnknown).  A line gets its own storage the first time
+     * something is copied into it, so addresses that are never reached
+     * cost nothing beyond the RegisterLine struct.
      */
     RegisterLine* registerLines;
 
@@ -96,10 +138,28 @@ typedef struct RegisterTable {
     RegisterLine savedLine;
 
     /*
-     * A single large alloc, with all of the storage needed for RegisterLine
-     * data (RegType array, MonitorEntries array, monitor stack).
+     * Read-only line storage shared by every line that hasn't been
+     * written yet.
      */
-    void*       lineAlloc;
+    u1*         sharedLine;
+
+    /*
+     * Storage for lines that have been written: RegType array, and, if
+     * we're tracking monitors, MonitorEntries array and monitor stack.
+     */
+    RegisterLineChunk* lineChunks;
+    u1*         chunkNext;          /* next free line in current chunk */
+    int         chunkLinesLeft;
+
+    size_t      regTypeSize;
+    size_t      monEntSize;
+    size_t      stackSize;
+    bool        trackMonitors;
+
+    /* work queue, and memory use for reporting */
+    VerifyWorklist worklist;
+    size_t      bytesAllocated;
+    int         privateLineCount;
 } RegisterTable;
 
 
@@ -1805,14 +1865,88 @@ static inline void copyRegisterLine(RegisterLine* dst, const RegisterLine* src,
 }
 
 /*
- * Copy a register line into the table.
+ * Returns "true" if the line is still using the shared "unknown" storage.
+ */
+static inline bool isSharedLine(const RegisterTable* regTable,
+    const RegisterLine* line)
+{
+    return (const u1*) line->regTypes == regTable->sharedLine;
+}
+
+/*
+ * Point "line" at the storage in "storage".  Returns an updated copy of
+ * "storage".
  */
-static inline void copyLineToTable(RegisterTable* regTable, int insnIdx,
+static u1* assignLineStorage(u1* storage, RegisterLine* line,
+    bool trackMonitors, size_t regTypeSize, size_t monEntSize, size_t stackSize)
+{
+    line->regTypes = (RegType*) storage;
+    storage += regTypeSize;
+
+    if (trackMonitors) {
+        line->monitorEntries = (MonitorEntries*) storage;
+        storage += monEntSize;
+        line->monitorStack = (u4*) storage;
+        storage += stackSize;
+
+        assert(line->monitorStackTop == 0);
+    }
+
+    return storage;
+}
+
+/*
+ * Give "line" storage of its own.  The contents are undefined.
+ *
+ * Returns "false" if we run out of memory.
+ */
+static bool allocLineStorage(RegisterTable* regTable, RegisterLine* line)
+{
+    size_t lineSize = regTable->regTypeSize +
+        (regTable->trackMonitors ? regTable->monEntSize + regTable->stackSize
+                                 : 0);
+
+    if (regTable->chunkLinesLeft == 0) {
+        /* line sizes are multiples of 4, so the lines stay aligned */
+        size_t chunkSize = sizeof(RegisterLineChunk) +
+            kLinesPerChunk * lineSize;
+        RegisterLineChunk* chunk = (RegisterLineChunk*) malloc(chunkSize);
+        if (chunk == NULL) {
+            ALOGE("VFY: unable to allocate %zd bytes of register lines",
+                chunkSize);
+            return false;
+        }
+        chunk->next = regTable->lineChunks;
+        regTable->lineChunks = chunk;
+        regTable->chunkNext = (u1*) (chunk + 1);
+        regTable->chunkLinesLeft = kLinesPerChunk;
+        regTable->bytesAllocated += chunkSize;
+    }
+
+    line->monitorStackTop = 0;
+    regTable->chunkNext = assignLineStorage(regTable->chunkNext, line,
+        regTable->trackMonitors, regTable->regTypeSize, regTable->monEntSize,
+        regTable->stackSize);
+    regTable->chunkLinesLeft--;
+    regTable->privateLineCount++;
+    return true;
+}
+
+/*
+ * Copy a register line into the table, giving the line its own storage
+ * if it doesn't have any yet.
+ *
+ * Returns "false" if we run out of memory.
+ */
+static inline bool copyLineToTable(RegisterTable* regTable, int insnIdx,
     const RegisterLine* src)
 {
     RegisterLine* dst = getRegisterLine(regTable, insnIdx);
     assert(dst->regTypes != NULL);
+    if (isSharedLine(regTable, dst) && !allocLineStorage(regTable, dst))
+        return false;
     copyRegisterLine(dst, src, regTable->insnRegCountPlus);
+    return true;
 }
 
 /*
@@ -2552,22 +2686,71 @@ static RegType mergeTypes(RegType type1, RegType type2, bool* pChanged)
 }
 
 /*
- * Merge the bits that indicate which monitor entry addresses on the stack
- * are associated with this register.
- *
- * The merge is a simple bitwise AND.
- *
- * Sets "*pChanged" to "true" if the result doesn't match "ents1".
+ * Add "insnIdx" to the worklist, unless it's already there.
  */
-static MonitorEntries mergeMonitorEntries(MonitorEntries ents1,
-    MonitorEntries ents2, bool* pChanged)
+static void worklistPush(VerifyWorklist* worklist, int insnIdx)
 {
-    MonitorEntries result = ents1 & ents2;
-    if (result != ents1)
-        *pChanged = true;
+    if (worklist->queued[insnIdx])
+        return;
+    worklist->queued[insnIdx] = 1;
+
+    int* heap = worklist->heap;
+    const int* order = worklist->order;
+    int pos = worklist->heapCount++;
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (order[heap[parent]] <= order[insnIdx])
+            break;
+        heap[pos] = heap[parent];
+        pos = parent;
+    }
+    heap[pos] = insnIdx;
+}
+
+/*
+ * Remove the first address from the worklist.  Returns -1 if it's empty.
+ */
+static int worklistPop(VerifyWorklist* worklist)
+{
+    if (worklist->heapCount == 0)
+        return -1;
+
+    int* heap = worklist->heap;
+    const int* order = worklist->order;
+    int result = heap[0];
+    int last = heap[--worklist->heapCount];
+    int count = worklist->heapCount;
+    int pos = 0;
+
+    while (true) {
+        int child = pos * 2 + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && order[heap[child+1]] < order[heap[child]])
+            child++;
+        if (order[last] <= order[heap[child]])
+            break;
+        heap[pos] = heap[child];
+        pos = child;
+    }
+    heap[pos] = last;
+
+    worklist->queued[result] = 0;
     return result;
 }
 
+/*
+ * Set the "changed" flag on "insnIdx".  Branch targets go on the worklist;
+ * anything else is reached by falling through, and will be processed next.
+ */
+static inline void markChanged(RegisterTable* regTable, InsnFlags* insnFlags,
+    int insnIdx)
+{
+    dvmInsnSetChanged(insnFlags, insnIdx, true);
+    if (dvmInsnIsBranchTarget(insnFlags, insnIdx))
+        worklistPush(&regTable->worklist, insnIdx);
+}
+
 /*
  * Control can transfer to "nextInsn".
  *
@@ -2575,7 +2758,8 @@ static MonitorEntries mergeMonitorEntries(MonitorEntries ents1,
  * set the "changed" flag on the target address if any of the registers
  * has changed.
  *
- * Returns "false" if we detect mis-matched monitor stacks.
+ * Returns "false" if we detect mis-matched monitor stacks, or run out of
+ * memory.
  */
 static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
     RegisterTable* regTable, int nextInsn, const RegisterLine* workLine)
@@ -2593,8 +2777,9 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
          * just an optimization.)
          */
         LOGVV("COPY into 0x%04x", nextInsn);
-        copyLineToTable(regTable, nextInsn, workLine);
-        dvmInsnSetChanged(insnFlags, nextInsn, true);
+        if (!copyLineToTable(regTable, nextInsn, workLine))
+            return false;
+        markChanged(regTable, insnFlags, nextInsn);
 #ifdef VERIFIER_STATS
         gDvm.verifierStats.copyRegCount++;
 #endif
@@ -2613,6 +2798,7 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
         unsigned int idx;
 
         assert(targetRegs != NULL);
+        assert(!isSharedLine(regTable, targetLine));
 
         if (targetMonEnts != NULL) {
             /*
@@ -2634,14 +2820,33 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
             }
         }
 
-        for (idx = 0; idx < insnRegCountPlus; idx++) {
-            targetRegs[idx] =
-                    mergeTypes(targetRegs[idx], workRegs[idx], &changed);
+        /*
+         * Most merges don't change anything, especially once a loop has
+         * settled down, so check for that with memcmp() before going
+         * register by register.
+         *
+         * The bits that indicate which monitor entry addresses on the
+         * stack are associated with each register are merged with a
+         * simple bitwise AND, which the compiler can vectorize.
+         */
+        if (memcmp(targetRegs, workRegs,
+                insnRegCountPlus * sizeof(RegType)) != 0)
+        {
+            for (idx = 0; idx < insnRegCountPlus; idx++) {
+                targetRegs[idx] =
+                        mergeTypes(targetRegs[idx], workRegs[idx], &changed);
+            }
+        }
 
-            if (targetMonEnts != NULL) {
-                targetMonEnts[idx] = mergeMonitorEntries(targetMonEnts[idx],
-                    workMonEnts[idx], &changed);
+        if (targetMonEnts != NULL) {
+            MonitorEntries diff = 0;
+            for (idx = 0; idx < insnRegCountPlus; idx++) {
+                MonitorEntries merged = targetMonEnts[idx] & workMonEnts[idx];
+                diff |= merged ^ targetMonEnts[idx];
+                targetMonEnts[idx] = merged;
             }
+            if (diff != 0)
+                changed = true;
         }
 
         if (gDebugVerbose) {
@@ -2655,7 +2860,7 @@ static bool updateRegisters(const Method* meth, InsnFlags* insnFlags,
 #endif
 
         if (changed)
-            dvmInsnSetChanged(insnFlags, nextInsn, true);
+            markChanged(regTable, insnFlags, nextInsn);
     }
 
     return true;
@@ -2984,26 +3189,164 @@ static ClassObject* getCaughtExceptionType(const Method* meth, int insnIdx,
 }
 
 /*
- * Helper for initRegisterTable.
+ * Get the "which"th successor of the instruction at "insnIdx", for the
+ * reverse post-order traversal.  Returns "false" when there are no more.
  *
- * Returns an updated copy of "storage".
+ * This follows the same edges verifyInstruction() does, but doesn't need
+ * to be exact: it only affects the order in which we visit things.
  */
-static u1* assignLineStorage(u1* storage, RegisterLine* line,
-    bool trackMonitors, size_t regTypeSize, size_t monEntSize, size_t stackSize)
+static bool getSuccessor(const Method* meth, const InsnFlags* insnFlags,
+    int insnIdx, int which, int* pTarget)
 {
-    line->regTypes = (RegType*) storage;
-    storage += regTypeSize;
+    const int insnsSize = dvmGetMethodInsnsSize(meth);
+    const u2* insns = meth->insns + insnIdx;
+    Opcode opcode = dexOpcodeFromCodeUnit(*insns);
+    int nextFlags = dexGetFlagsFromOpcode(opcode);
 
-    if (trackMonitors) {
-        line->monitorEntries = (MonitorEntries*) storage;
-        storage += monEntSize;
-        line->monitorStack = (u4*) storage;
-        storage += stackSize;
+    if ((nextFlags & kInstrCanContinue) != 0) {
+        if (which-- == 0) {
+            *pTarget = insnIdx + dvmInsnGetWidth(insnFlags, insnIdx);
+            return *pTarget < insnsSize;
+        }
+    }
 
-        assert(line->monitorStackTop == 0);
+    if ((nextFlags & kInstrCanBranch) != 0) {
+        if (which-- == 0) {
+            s4 branchTarget;
+            bool isConditional;
+            if (!dvmGetBranchOffset(meth, insnFlags, insnIdx, &branchTarget,
+                    &isConditional))
+                return false;
+            *pTarget = insnIdx + branchTarget;
+            return true;
+        }
     }
 
-    return storage;
+    if ((nextFlags & kInstrCanSwitch) != 0) {
+        int offsetToSwitch = insns[1] | (((s4)insns[2]) << 16);
+        const u2* switchInsns = insns + offsetToSwitch;
+        int switchCount = switchInsns[1];
+
+        if (which < switchCount) {
+            int offsetToTargets = (opcode == OP_PACKED_SWITCH) ?
+                4 : 2 + 2*switchCount;
+            *pTarget = insnIdx +
+                (switchInsns[offsetToTargets + which*2] |
+                 (((s4) switchInsns[offsetToTargets + which*2 +1]) << 16));
+            return true;
+        }
+        which -= switchCount;
+    }
+
+    if ((nextFlags & kInstrCanThrow) != 0 && dvmInsnIsInTry(insnFlags, insnIdx))
+    {
+        DexCatchIterator iterator;
+        if (dexFindCatchHandler(&iterator, dvmGetMethodCode(meth), insnIdx)) {
+            DexCatchHandler* handler;
+            while ((handler = dexCatchIteratorNext(&iterator)) != NULL) {
+                if (which-- == 0) {
+                    *pTarget = handler->address;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Fill in "order" with each address's position in a reverse post-order
+ * traversal of the method, starting from address 0.  Addresses we can't
+ * reach are put at the end, in address order.
+ *
+ * Returns "false" if we run out of memory.
+ */
+static bool computeReversePostOrder(const Method* meth,
+    const InsnFlags* insnFlags, int insnsSize, int* order)
+{
+    /* explicit DFS stack: address, and next successor to look at */
+    int* stack = (int*) malloc(insnsSize * 2 * sizeof(int));
+    if (stack == NULL)
+        return false;
+
+    const int kUnvisited = -1;
+    const int kOnStack = -2;
+    int i;
+    for (i = 0; i < insnsSize; i++)
+        order[i] = kUnvisited;
+
+    int postCount = 0;
+    int depth = 1;
+    stack[0] = 0;
+    stack[1] = 0;
+    order[0] = kOnStack;
+
+    while (depth > 0) {
+        int* frame = &stack[(depth-1) * 2];
+        int target;
+
+        if (getSuccessor(meth, insnFlags, frame[0], frame[1]++, &target)) {
+            if (target >= 0 && target < insnsSize &&
+                order[target] == kUnvisited)
+            {
+                assert(depth < insnsSize);
+                order[target] = kOnStack;
+                stack[depth * 2] = target;
+                stack[depth * 2 + 1] = 0;
+                depth++;
+            }
+        } else {
+            order[frame[0]] = postCount++;
+            depth--;
+        }
+    }
+    free(stack);
+
+    /* reverse it, and tack the unreachable stuff on the end */
+    int unreachable = postCount;
+    for (i = 0; i < insnsSize; i++) {
+        if (order[i] == kUnvisited)
+            order[i] = unreachable++;
+        else
+            order[i] = postCount - 1 - order[i];
+    }
+
+    return true;
+}
+
+/*
+ * Set up the worklist.
+ *
+ * Returns "false" if we run out of memory.
+ */
+static bool initWorklist(const VerifierData* vdata, RegisterTable* regTable)
+{
+    const int insnsSize = vdata->insnsSize;
+    VerifyWorklist* worklist = &regTable->worklist;
+
+    size_t allocSize = insnsSize * (2 * sizeof(int) + sizeof(u1));
+    u1* storage = (u1*) malloc(allocSize);
+    if (storage == NULL)
+        return false;
+    regTable->bytesAllocated += allocSize;
+
+    worklist->order = (int*) storage;
+    worklist->heap = worklist->order + insnsSize;
+    worklist->queued = (u1*) (worklist->heap + insnsSize);
+    worklist->heapCount = 0;
+    memset(worklist->queued, 0, insnsSize);
+
+    if (insnsSize >= kRpoMinInsnsSize) {
+        if (!computeReversePostOrder(vdata->method, vdata->insnFlags,
+                insnsSize, worklist->order))
+            return false;
+    } else {
+        for (int i = 0; i < insnsSize; i++)
+            worklist->order[i] = i;
+    }
+
+    return true;
 }
 
 /*
@@ -3013,11 +3356,11 @@ static u1* assignLineStorage(u1* storage, RegisterLine* line,
  * what's in which register, but for verification purposes we only need to
  * store it at branch target addresses (because we merge into that).
  *
- * By zeroing out the regType storage we are effectively initializing the
- * register information to kRegTypeUnknown.
- *
- * We jump through some hoops here to minimize the total number of
- * allocations we have to perform per method verified.
+ * All of the "interesting" lines start out pointing at a single shared
+ * line of zeroes, which is effectively initializing the register
+ * information to kRegTypeUnknown.  Storage is allocated when we first
+ * copy registers into a line (see copyLineToTable), which is the only
+ * way a line can transition out of "unknown".
  */
 static bool initRegisterTable(const VerifierData* vdata,
     RegisterTable* regTable, RegisterTrackingMode trackRegsFor)
@@ -3025,7 +3368,6 @@ static bool initRegisterTable(const VerifierData* vdata,
     const Method* meth = vdata->method;
     const int insnsSize = vdata->insnsSize;
     const InsnFlags* insnFlags = vdata->insnFlags;
-    const int kExtraLines = 2;  /* workLine, savedLine */
     int i;
 
     /*
@@ -3038,81 +3380,43 @@ static bool initRegisterTable(const VerifierData* vdata,
         (RegisterLine*) calloc(insnsSize, sizeof(RegisterLine));
     if (regTable->registerLines == NULL)
         return false;
+    regTable->bytesAllocated += insnsSize * sizeof(RegisterLine);
 
     assert(insnsSize > 0);
 
     /*
-     * Count up the number of "interesting" instructions.
-     *
-     * "All" means "every address that holds the start of an instruction".
-     * "Branches" and "GcPoints" mean just those addresses.
-     *
-     * "GcPoints" fills about half the addresses, "Branches" about 15%.
-     */
-    int interestingCount = kExtraLines;
-
-    for (i = 0; i < insnsSize; i++) {
-        bool interesting;
-
-        switch (trackRegsFor) {
-        case kTrackRegsAll:
-            interesting = dvmInsnIsOpcode(insnFlags, i);
-            break;
-        case kTrackRegsGcPoints:
-            interesting = dvmInsnIsGcPoint(insnFlags, i) ||
-                          dvmInsnIsBranchTarget(insnFlags, i);
-            break;
-        case kTrackRegsBranches:
-            interesting = dvmInsnIsBranchTarget(insnFlags, i);
-            break;
-        default:
-            dvmAbort();
-            return false;
-        }
-
-        if (interesting)
-            interestingCount++;
-
-        /* count instructions, for display only */
-        //if (dvmInsnIsOpcode(insnFlags, i))
-        //    insnCount++;
-    }
-
-    /*
-     * Allocate storage for the register type arrays.
+     * Work out how much storage a line needs.
      * TODO: set trackMonitors based on global config option
      */
-    size_t regTypeSize = regTable->insnRegCountPlus * sizeof(RegType);
-    size_t monEntSize = regTable->insnRegCountPlus * sizeof(MonitorEntries);
-    size_t stackSize = kMaxMonitorStackDepth * sizeof(u4);
-    bool trackMonitors;
+    regTable->regTypeSize = regTable->insnRegCountPlus * sizeof(RegType);
+    regTable->monEntSize =
+        regTable->insnRegCountPlus * sizeof(MonitorEntries);
+    regTable->stackSize = kMaxMonitorStackDepth * sizeof(u4);
 
     if (gDvm.monitorVerification) {
-        trackMonitors = (vdata->monitorEnterCount != 0);
+        regTable->trackMonitors = (vdata->monitorEnterCount != 0);
     } else {
-        trackMonitors = false;
+        regTable->trackMonitors = false;
     }
 
-    size_t spacePerEntry = regTypeSize +
-        (trackMonitors ? monEntSize + stackSize : 0);
-    regTable->lineAlloc = calloc(interestingCount, spacePerEntry);
-    if (regTable->lineAlloc == NULL)
+    size_t lineSize = regTable->regTypeSize + (regTable->trackMonitors ?
+        regTable->monEntSize + regTable->stackSize : 0);
+    regTable->sharedLine = (u1*) calloc(1, lineSize);
+    if (regTable->sharedLine == NULL)
         return false;
-
-#ifdef VERIFIER_STATS
-    size_t totalSpace = interestingCount * spacePerEntry +
-        insnsSize * sizeof(RegisterLine);
-    if (gDvm.verifierStats.biggestAlloc < totalSpace)
-        gDvm.verifierStats.biggestAlloc = totalSpace;
-#endif
+    regTable->bytesAllocated += lineSize;
 
     /*
      * Populate the sparse register line table.
      *
      * There is a RegisterLine associated with every address, but not
      * every RegisterLine has non-NULL pointers to storage for its fields.
+     *
+     * "All" means "every address that holds the start of an instruction".
+     * "Branches" and "GcPoints" mean just those addresses.
+     *
+     * "GcPoints" fills about half the addresses, "Branches" about 15%.
      */
-    u1* storage = (u1*)regTable->lineAlloc;
     for (i = 0; i < insnsSize; i++) {
         bool interesting;
 
@@ -3133,26 +3437,44 @@ static bool initRegisterTable(const VerifierData* vdata,
         }
 
         if (interesting) {
-            storage = assignLineStorage(storage, &regTable->registerLines[i],
-                trackMonitors, regTypeSize, monEntSize, stackSize);
+            assignLineStorage(regTable->sharedLine,
+                &regTable->registerLines[i], regTable->trackMonitors,
+                regTable->regTypeSize, regTable->monEntSize,
+                regTable->stackSize);
         }
     }
 
     /*
-     * Grab storage for our "temporary" register lines.
+     * The first line is filled in from the method signature, and we need
+     * storage for our "temporary" register lines.
      */
-    storage = assignLineStorage(storage, &regTable->workLine,
-        trackMonitors, regTypeSize, monEntSize, stackSize);
-    storage = assignLineStorage(storage, &regTable->savedLine,
-        trackMonitors, regTypeSize, monEntSize, stackSize);
+    assert(regTable->registerLines[0].regTypes != NULL);
+    if (!allocLineStorage(regTable, &regTable->registerLines[0]) ||
+        !allocLineStorage(regTable, &regTable->workLine) ||
+        !allocLineStorage(regTable, &regTable->savedLine))
+    {
+        return false;
+    }
+    memset(regTable->registerLines[0].regTypes, 0, lineSize);
 
-    //ALOGD("Tracking registers for [%d], total %d in %d units",
-    //    trackRegsFor, interestingCount-kExtraLines, insnsSize);
+    return initWorklist(vdata, regTable);
+}
 
-    assert(storage - (u1*)regTable->lineAlloc ==
-        (int) (interestingCount * spacePerEntry));
-    assert(regTable->registerLines[0].regTypes != NULL);
-    return true;
+/*
+ * Free the storage allocated by initRegisterTable.
+ */
+static void freeRegisterTable(RegisterTable* regTable)
+{
+    RegisterLineChunk* chunk = regTable->lineChunks;
+    while (chunk != NULL) {
+        RegisterLineChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(regTable->registerLines);
+    free(regTable->sharedLine);
+    free(regTable->worklist.order);
 }
 
 /*
@@ -3547,9 +3869,18 @@ bool dvmVerifyCodeFlow(VerifierData* vdata)
     result = true;
 
 bail:
+#ifdef VERIFIER_STATS
+    if (gDvm.verifierStats.biggestAlloc < regTable.bytesAllocated)
+        gDvm.verifierStats.biggestAlloc = regTable.bytesAllocated;
+#endif
+    if (regTable.bytesAllocated >= kVerifyMemoryReportThreshold) {
+        ALOGD("VFY: %s.%s used %zd bytes (%d of %d lines written)",
+            meth->clazz->descriptor, meth->name, regTable.bytesAllocated,
+            regTable.privateLineCount, insnsSize);
+    }
+
     freeRegisterLineInnards(vdata);
-    free(regTable.registerLines);
-    free(regTable.lineAlloc);
+    freeRegisterTable(&regTable);
     return result;
 }
 
@@ -3558,7 +3889,10 @@ bail:
  *
  * The basic strategy is as outlined in v3 4.11.1.2: set the "changed" bit
  * on the first instruction, process it (setting additional "changed" bits),
- * and repeat until there are no more.
+ * and repeat until there are no more.  We keep going straight through to
+ * the next instruction when we can; otherwise the next branch target to
+ * process comes off a worklist ordered by reverse post-order, so there's
+ * no need to scan the flags for the next one.
  *
  * v3 4.11.1.1
  * - (N/A) operand stack is always the same size
@@ -3616,7 +3950,7 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
     /*
      * Begin by marking the first instruction as "changed".
      */
-    dvmInsnSetChanged(insnFlags, 0, true);
+    markChanged(regTable, insnFlags, 0);
 
     if (dvmWantVerboseVerification(meth)) {
         IF_ALOGI() {
@@ -3640,20 +3974,19 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
      */
     while (true) {
         /*
-         * Find the first marked one.  Use "startGuess" as a way to find
-         * one quickly.
+         * Prefer to continue on to "startGuess", since we already have its
+         * registers in the work line.  Otherwise, take the next branch
+         * target off the worklist.  Entries whose "changed" flag has been
+         * cleared (because we fell into them) are simply skipped.
          */
-        for (insnIdx = startGuess; insnIdx < insnsSize; insnIdx++) {
-            if (dvmInsnIsChanged(insnFlags, insnIdx))
-                break;
-        }
+        if (dvmInsnIsChanged(insnFlags, startGuess)) {
+            insnIdx = startGuess;
+        } else {
+            do {
+                insnIdx = worklistPop(&regTable->worklist);
+            } while (insnIdx >= 0 && !dvmInsnIsChanged(insnFlags, insnIdx));
 
-        if (insnIdx == insnsSize) {
-            if (startGuess != 0) {
-                /* try again, starting from the top */
-                startGuess = 0;
-                continue;
-            } else {
+            if (insnIdx < 0) {
                 /* all flags are clear */
                 break;
             }
@@ -3716,6 +4049,11 @@ static bool doCodeVerification(VerifierData* vdata, RegisterTable* regTable)
         dvmInsnSetChanged(insnFlags, insnIdx, false);
     }
 
+#ifndef NDEBUG
+    for (insnIdx = 0; insnIdx < insnsSize; insnIdx++)
+        assert(!dvmInsnIsChanged(insnFlags, insnIdx));
+#endif
+
     if (DEAD_CODE_SCAN && !IS_METHOD_FLAG_SET(meth, METHOD_ISWRITABLE)) {
         /*
          * Scan for dead code.  There's nothing "evil" about dead code
@@ -5889,7 +6227,7 @@ sput_1nr_common:
              * so we don't know what the prior state was.  We have to
              * assume that something has changed and re-evaluate it.
              */
-            dvmInsnSetChanged(insnFlags, insnIdx+insnWidth, true);
+            markChanged(regTable, insnFlags, insnIdx+insnWidth);
         }
     }
 
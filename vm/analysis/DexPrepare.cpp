@@ -28,6 +28,7 @@
 #include "libdex/OptInvocation.h"
 #include "analysis/RegisterMap.h"
 #include "analysis/Optimize.h"
+#include "oo/LinkImage.h"
 
 #include <string>
 
@@ -55,8 +56,9 @@ static void verifyAndOptimizeClass(DexFile* pDexFile, ClassObject* clazz,
     const DexClassDef* pClassDef, bool doVerify, bool doOpt);
 static void updateChecksum(u1* addr, int len, DexHeader* pHeader);
 static int writeDependencies(int fd, u4 modWhen, u4 crc);
-static bool writeOptData(int fd, const DexClassLookup* pClassLookup,\
-    const RegisterMapBuilder* pRegMapBuilder);
+static bool writeOptData(int fd, DexClassLookup* pClassLookup,\
+    const RegisterMapBuilder* pRegMapBuilder,
+    const LinkImageBuilder* pLinkImageBuilder);
 static bool computeFileChecksum(int fd, off_t start, size_t length, u4* pSum);
 
 /*
@@ -529,6 +531,7 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
 {
     DexClassLookup* pClassLookup = NULL;
     RegisterMapBuilder* pRegMapBuilder = NULL;
+    LinkImageBuilder* pLinkImageBuilder = NULL;
 
     assert(gDvm.optimizing);
 
@@ -623,6 +626,18 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
                     }
                 }
 
+                /*
+                 * Record the vtable and interface table layout of the
+                 * classes we linked, so the VM can skip recomputing it.
+                 * Classes are only loaded if we verified or optimized.
+                 * This is optional, so a failure here isn't fatal.
+                 */
+                if (doVerify || doOpt) {
+                    pLinkImageBuilder = dvmGenerateLinkImage(pDvmDex);
+                    if (pLinkImageBuilder == NULL)
+                        ALOGW("Failed generating link image");
+                }
+
                 DexHeader* pHeader = (DexHeader*)pDvmDex->pHeader;
                 updateChecksum(dexAddr, dexLength, pHeader);
 
@@ -693,7 +708,7 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
     /*
      * Append any optimized pre-computed data structures.
      */
-    if (!writeOptData(fd, pClassLookup, pRegMapBuilder)) {
+    if (!writeOptData(fd, pClassLookup, pRegMapBuilder, pLinkImageBuilder)) {
         ALOGW("Failed writing opt data");
         goto bail;
     }
@@ -742,6 +757,7 @@ bool dvmContinueOptimization(int fd, off_t dexOffset, long dexLength,
 
 bail:
     dvmFreeRegisterMapBuilder(pRegMapBuilder);
+    dvmFreeLinkImageBuilder(pLinkImageBuilder);
     free(pClassLookup);
     return result;
 }
@@ -1479,10 +1495,17 @@ static bool writeChunk(int fd, u4 type, const void* data, size_t size)
  * type and a 4-byte length.  We guarantee 64-bit alignment for the data,
  * so it can be used directly when the file is mapped for reading.
  */
-static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
-    const RegisterMapBuilder* pRegMapBuilder)
+static bool writeOptData(int fd, DexClassLookup* pClassLookup,
+    const RegisterMapBuilder* pRegMapBuilder,
+    const LinkImageBuilder* pLinkImageBuilder)
 {
-    /* pre-computed class lookup hash table */
+    /*
+     * Pre-computed class lookup hash table.  The file is mapped from the
+     * start, so aligning the buckets relative to their file offset puts
+     * them on cache-line boundaries in memory.  The chunk header is 8 bytes.
+     */
+    off_t chunkOffset = lseek(fd, 0, SEEK_CUR);
+    dexAlignClassLookup(pClassLookup, (u4) chunkOffset + 8);
     if (!writeChunk(fd, (u4) kDexChunkClassLookup,
             pClassLookup, pClassLookup->size))
     {
@@ -1498,6 +1521,15 @@ static bool writeOptData(int fd, const DexClassLookup* pClassLookup,
         }
     }
 
+    /* class link image (optional) */
+    if (pLinkImageBuilder != NULL) {
+        if (!writeChunk(fd, (u4) kDexChunkLinkImage,
+                pLinkImageBuilder->data, pLinkImageBuilder->size))
+        {
+            return false;
+        }
+    }
+
     /* write the end marker */
     if (!writeChunk(fd, (u4) kDexChunkEnd, NULL, 0)) {
         return false;
@@ -42,7 +42,7 @@ struct VerifierStats {
     size_t mergeRegCount;      /* calls from updateRegisters->merge */
     size_t mergeRegChanged;    /* calls from updateRegisters->merge, changed */
     size_t uninitSearches;     /* times we've had to search the uninit table */
-    size_t biggestAlloc;       /* largest RegisterLine table alloc */
+    size_t biggestAlloc;       /* high-water mark of register table memory */
 };
 
 /*
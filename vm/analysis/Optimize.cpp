@@ -20,6 +20,7 @@
  */
 #include "Dalvik.h"
 #include "libdex/InstrUtils.h"
+#include "interp/InterpDefs.h"
 #include "Optimize.h"
 
 #include <zlib.h>
@@ -49,6 +50,7 @@ static bool rewriteExecuteInlineRange(Method* method, u2* insns,
     MethodType methodType);
 static void rewriteReturnVoid(Method* method, u2* insns);
 static bool needsReturnBarrier(Method* method);
+static void rewriteDenseSparseSwitches(Method* method);
 
 /*
  * Create a table of inline substitutions.  Sets gDvm.inlineSubs.
@@ -345,6 +347,13 @@ rewrite_static_field:
     }
 
     assert(insnsSize == 0);
+
+    /*
+     * non-essential substitutions:
+     *  sparse-switch with dense keys --> packed-switch
+     */
+    if (!essentialOnly)
+        rewriteDenseSparseSwitches(method);
 }
 
 /*
@@ -1187,3 +1196,141 @@ static void rewriteReturnVoid(Method* method, u2* insns)
     assert((insns[0] & 0xff) == OP_RETURN_VOID);
     updateOpcode(method, insns, OP_RETURN_VOID_BARRIER);
 }
+
+/*
+ * Return the address of the payload for the switch instruction at "insns".
+ */
+static const u2* getSwitchPayload(const u2* insns)
+{
+    s4 offset = insns[1] | (((s4) insns[2]) << 16);
+    return insns + offset;
+}
+
+/*
+ * Rewrite a sparse-switch whose keys are dense enough to be handled with
+ * a jump table as a packed-switch.  The packed payload is written over
+ * the sparse one; it needs (4 + 2 * range) code units against the sparse
+ * payload's (2 + 4 * size), so any table with range < 2 * size fits.
+ * Keys inside the range that aren't in the table get a branch offset of
+ * 3, which lands on the instruction after the switch, same as the
+ * fall-through case.  Code units left over at the end are set to zero,
+ * which decodes as a run of nops.
+ *
+ * Returns "true" if the instruction was rewritten.
+ */
+static bool rewriteDenseSparseSwitch(Method* method, u2* insns)
+{
+    u2* payload = (u2*) getSwitchPayload(insns);
+    u4 size, range, i;
+
+    assert((insns[0] & 0xff) == OP_SPARSE_SWITCH);
+    if (payload[0] != kSparseSwitchSignature)
+        return false;
+
+    size = payload[1];
+    if (size < 2)
+        return false;
+
+    const s4* keys = (const s4*) (payload + 2);
+    const s4* entries = keys + size;
+    s4 firstKey = s4FromSwitchData(&keys[0]);
+    s4 lastKey = s4FromSwitchData(&keys[size - 1]);
+
+    range = (u4) lastKey - (u4) firstKey + 1;
+    if (range == 0 || range > 2 * size - 1 || range > 0xffff)
+        return false;
+
+    /*
+     * We're writing over the table we're reading from, so make a copy of
+     * the targets first.  Holes are filled with the fall-through offset.
+     */
+    s4* targets = (s4*) malloc(range * sizeof(s4));
+    if (targets == NULL)
+        return false;
+    for (i = 0; i < range; i++)
+        targets[i] = 3;
+    for (i = 0; i < size; i++) {
+        u4 idx = (u4) s4FromSwitchData(&keys[i]) - (u4) firstKey;
+        assert(idx < range);
+        targets[idx] = s4FromSwitchData(&entries[i]);
+    }
+
+    u4 sparseWidth = 2 + size * 4;
+    u4 packedWidth = 4 + range * 2;
+    u4 pos = 0;
+
+    assert(packedWidth <= sparseWidth);
+    dvmUpdateCodeUnit(method, &payload[pos++], kPackedSwitchSignature);
+    dvmUpdateCodeUnit(method, &payload[pos++], (u2) range);
+    dvmUpdateCodeUnit(method, &payload[pos++], (u2) firstKey);
+    dvmUpdateCodeUnit(method, &payload[pos++], (u2) ((u4) firstKey >> 16));
+    for (i = 0; i < range; i++) {
+        dvmUpdateCodeUnit(method, &payload[pos++], (u2) targets[i]);
+        dvmUpdateCodeUnit(method, &payload[pos++],
+            (u2) ((u4) targets[i] >> 16));
+    }
+    assert(pos == packedWidth);
+    while (pos < sparseWidth)
+        dvmUpdateCodeUnit(method, &payload[pos++], 0);
+
+    free(targets);
+
+    updateOpcode(method, insns, OP_PACKED_SWITCH);
+    return true;
+}
+
+/*
+ * Find sparse-switch instructions with dense key sets and turn them into
+ * packed-switch, so the interpreter and JIT can index straight into the
+ * table instead of searching it.  Payloads that are shared by more than
+ * one switch instruction are left alone.
+ */
+static void rewriteDenseSparseSwitches(Method* method)
+{
+    u2* insns = (u2*) method->insns;
+    u4 insnsSize = dvmGetMethodInsnsSize(method);
+    const u2** payloads = NULL;
+    u4 payloadCount = 0;
+    u4 sparseCount = 0;
+    u4 offset, i;
+
+    /* collect the payload addresses of all switch instructions */
+    for (int pass = 0; pass < 2; pass++) {
+        payloadCount = 0;
+        for (offset = 0; offset < insnsSize; ) {
+            Opcode opc = dexOpcodeFromCodeUnit(insns[offset]);
+            if (opc == OP_PACKED_SWITCH || opc == OP_SPARSE_SWITCH) {
+                if (payloads != NULL)
+                    payloads[payloadCount] = getSwitchPayload(&insns[offset]);
+                payloadCount++;
+                if (opc == OP_SPARSE_SWITCH)
+                    sparseCount++;
+            }
+            offset += dexGetWidthFromInstruction(&insns[offset]);
+        }
+        if (pass == 0) {
+            if (sparseCount == 0)
+                return;
+            payloads = (const u2**) malloc(payloadCount * sizeof(u2*));
+            if (payloads == NULL)
+                return;
+        }
+    }
+
+    for (offset = 0; offset < insnsSize; ) {
+        u2* insn = &insns[offset];
+        if (dexOpcodeFromCodeUnit(*insn) == OP_SPARSE_SWITCH) {
+            const u2* payload = getSwitchPayload(insn);
+            u4 refs = 0;
+            for (i = 0; i < payloadCount; i++) {
+                if (payloads[i] == payload)
+                    refs++;
+            }
+            if (refs == 1)
+                rewriteDenseSparseSwitch(method, insn);
+        }
+        offset += dexGetWidthFromInstruction(insn);
+    }
+
+    free(payloads);
+}
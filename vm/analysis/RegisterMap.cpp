@@ -22,6 +22,7 @@
  */
 #include "Dalvik.h"
 #include "UniquePtr.h"
+#include "alloc/HeapInternal.h"
 #include "analysis/CodeVerify.h"
 #include "analysis/RegisterMap.h"
 #include "libdex/DexCatch.h"
@@ -38,6 +39,15 @@
 
 //#define REGISTER_MAP_STATS
 
+/* limit on the memory used by the register map cache */
+#define REGISTER_MAP_CACHE_MAX_BYTES    (128 * 1024)
+
+/* number of hash chains in the cache; must be a power of 2 */
+#define REGISTER_MAP_CACHE_BUCKETS      256
+
+/* number of map entries between checkpoints in an indexed map */
+#define REGISTER_MAP_INDEX_INTERVAL     16
+
 // fwd
 static void outputTypeVector(const RegType* regs, int insnRegCount, u1* data);
 static bool verifyMap(VerifierData* vdata, const RegisterMap* pMap);
@@ -49,6 +59,7 @@ static void computeMapStats(RegisterMap* pMap, const Method* method);
 static RegisterMap* compressMapDifferential(const RegisterMap* pMap,\
     const Method* meth);
 static RegisterMap* uncompressMapDifferential(const RegisterMap* pMap);
+static const u1* getIndexedLine(const RegisterMap* pMap, int addr);
 
 #ifdef REGISTER_MAP_STATS
 /*
@@ -106,6 +117,61 @@ struct MapStats {
 };
 #endif
 
+/*
+ * Decoded state at one entry of a differential map.
+ */
+struct RegisterMapCheckpoint {
+    u2      addr;           /* address of the entry */
+    u4      srcOffset;      /* offset of the following entry's key byte */
+};
+
+/*
+ * A differential map with enough of an index that a single line can be
+ * decoded without expanding the whole map.  Every REGISTER_MAP_INDEX_INTERVAL
+ * entries we record the address, the position in the encoded data, and
+ * the full bit vector, so a lookup decodes at most that many entries.
+ *
+ * These are created and owned by the register map cache.  The first four
+ * bytes match RegisterMap, so we can hand them out as a RegisterMap with
+ * format kRegMapFormatIndexed.
+ */
+struct IndexedRegisterMap {
+    /* RegisterMap header */
+    u1      format;
+    u1      regWidth;
+    u1      numEntries[2];
+
+    const Method* method;           /* cache key */
+    const RegisterMap* pSource;     /* differential map we were built from */
+    const u1* encodedData;          /* first entry after the initial one */
+    size_t  size;                   /* size of this allocation */
+    int     numCheckpoints;
+
+    RegisterMapCheckpoint* checkpoints;
+    u1*     checkpointBits;         /* regWidth bytes per checkpoint */
+    u1*     lineBuf;                /* result of the last lookup */
+
+    IndexedRegisterMap* hashNext;
+    IndexedRegisterMap* lruPrev;
+    IndexedRegisterMap* lruNext;
+};
+
+/*
+ * LRU cache of indexed maps, keyed by Method.  This is only used at GC
+ * time, under the heap lock, so it doesn't have a lock of its own.
+ */
+struct RegisterMapCache {
+    IndexedRegisterMap* buckets[REGISTER_MAP_CACHE_BUCKETS];
+    IndexedRegisterMap* lruHead;    /* most recently used */
+    IndexedRegisterMap* lruTail;    /* next to be evicted */
+    size_t  totalSize;
+    int     numMaps;
+
+    int     hits;
+    int     misses;
+    int     evictions;
+};
+
 /*
  * Prepare some things.
  */
@@ -115,6 +181,10 @@ bool dvmRegisterMapStartup()
     MapStats* pStats = calloc(1, sizeof(MapStats));
     gDvm.registerMapStats = pStats;
 #endif
+    gDvm.registerMapCache =
+        (RegisterMapCache*) calloc(1, sizeof(RegisterMapCache));
+    if (gDvm.registerMapCache == NULL)
+        return false;
     return true;
 }
 
@@ -126,6 +196,17 @@ void dvmRegisterMapShutdown()
 #ifdef REGISTER_MAP_STATS
     free(gDvm.registerMapStats);
 #endif
+    RegisterMapCache* pCache = gDvm.registerMapCache;
+    if (pCache != NULL) {
+        IndexedRegisterMap* pIndex = pCache->lruHead;
+        while (pIndex != NULL) {
+            IndexedRegisterMap* next = pIndex->lruNext;
+            free(pIndex);
+            pIndex = next;
+        }
+        free(pCache);
+        gDvm.registerMapCache = NULL;
+    }
 }
 
 /*
@@ -911,6 +992,8 @@ const u1* dvmRegisterMapGetLine(const RegisterMap* pMap, int addr)
     case kRegMapFormatCompact16:
         addrWidth = 2;
         break;
+    case kRegMapFormatIndexed:
+        return getIndexedLine(pMap, addr);
     default:
         ALOGE("Unknown format %d", format);
         dvmAbort();
@@ -993,11 +1076,307 @@ static int compareMaps(const RegisterMap* pMap1, const RegisterMap* pMap2)
 
 
 /*
- * Get the expanded form of the register map associated with the method.
+ * ===========================================================================
+ *      Register map cache
+ * ===========================================================================
+ */
+
+/*
+ * Pick a hash chain for "method".
+ */
+static inline u4 hashMethod(const Method* method)
+{
+    return (((u4) (uintptr_t) method * 2654435761u) >> 24) &
+        (REGISTER_MAP_CACHE_BUCKETS-1);
+}
+
+static void lruUnlink(RegisterMapCache* pCache, IndexedRegisterMap* pIndex)
+{
+    if (pIndex->lruPrev != NULL)
+        pIndex->lruPrev->lruNext = pIndex->lruNext;
+    else
+        pCache->lruHead = pIndex->lruNext;
+    if (pIndex->lruNext != NULL)
+        pIndex->lruNext->lruPrev = pIndex->lruPrev;
+    else
+        pCache->lruTail = pIndex->lruPrev;
+    pIndex->lruPrev = pIndex->lruNext = NULL;
+}
+
+static void lruPushFront(RegisterMapCache* pCache, IndexedRegisterMap* pIndex)
+{
+    pIndex->lruPrev = NULL;
+    pIndex->lruNext = pCache->lruHead;
+    if (pCache->lruHead != NULL)
+        pCache->lruHead->lruPrev = pIndex;
+    else
+        pCache->lruTail = pIndex;
+    pCache->lruHead = pIndex;
+}
+
+/*
+ * Remove an entry from the cache and free it.
+ */
+static void cacheRemove(RegisterMapCache* pCache, IndexedRegisterMap* pIndex)
+{
+    IndexedRegisterMap** ppLink = &pCache->buckets[hashMethod(pIndex->method)];
+    while (*ppLink != pIndex) {
+        assert(*ppLink != NULL);
+        ppLink = &(*ppLink)->hashNext;
+    }
+    *ppLink = pIndex->hashNext;
+
+    lruUnlink(pCache, pIndex);
+    pCache->totalSize -= pIndex->size;
+    pCache->numMaps--;
+    free(pIndex);
+}
+
+/*
+ * Toggle the value of the "idx"th bit in "ptr".
+ */
+static inline void toggleBit(u1* ptr, int idx)
+{
+    ptr[idx >> 3] ^= 1 << (idx & 0x07);
+}
+
+/*
+ * Apply one entry of a differential map to "bits", which holds the bit
+ * vector of the previous entry, and advance "*pAddr" to the entry's
+ * address.  Returns a pointer to the next entry.
+ *
+ * See "Notes on map compression" below for the format.
+ */
+static inline const u1* applyDiffEntry(const u1* srcPtr, int* pAddr,
+    u1* bits, int regWidth)
+{
+    u1 key = *srcPtr++;
+
+    if ((key & 0x07) == 7) {
+        /* address diff follows in ULEB128 */
+        *pAddr += readUnsignedLeb128(&srcPtr);
+    } else {
+        *pAddr += (key & 0x07) +1;
+    }
+
+    if ((key & 0x08) == 0) {
+        /* one bit, from 0-15 inclusive, was changed */
+        toggleBit(bits, key >> 4);
+    } else {
+        int bitCount = key >> 4;
+        if (bitCount == 15) {
+            /* full copy of bit vector is present */
+            memcpy(bits, srcPtr, regWidth);
+            srcPtr += regWidth;
+        } else {
+            /* zero or more bit indices follow */
+            while (bitCount--)
+                toggleBit(bits, readUnsignedLeb128(&srcPtr));
+        }
+    }
+
+    return srcPtr;
+}
+
+/*
+ * Build an indexed map from a differential map.  This makes one pass
+ * through the encoded data.
+ *
+ * Returns a newly-allocated map, or NULL on failure.
+ */
+static IndexedRegisterMap* buildIndexedMap(const Method* method,
+    const RegisterMap* pMap)
+{
+    int regWidth = dvmRegisterMapGetRegWidth(pMap);
+    int numEntries = dvmRegisterMapGetNumEntries(pMap);
+
+    assert(dvmRegisterMapGetFormat(pMap) == kRegMapFormatDifferential);
+
+    /* get the data size; we can check this at the end */
+    const u1* srcPtr = pMap->data;
+    int expectedSrcLen = readUnsignedLeb128(&srcPtr);
+    const u1* srcStart = srcPtr;
+
+    /* skip the 16-bit address flag; we don't store addresses that way */
+    int addr = *srcPtr++ & 0x7f;
+    const u1* initialBits = srcPtr;
+    srcPtr += regWidth;
+
+    int numCheckpoints = (numEntries + REGISTER_MAP_INDEX_INTERVAL - 1) /
+        REGISTER_MAP_INDEX_INTERVAL;
+    size_t size = sizeof(IndexedRegisterMap) +
+        numCheckpoints * sizeof(RegisterMapCheckpoint) +
+        (numCheckpoints + 1) * regWidth;
+    IndexedRegisterMap* pIndex = (IndexedRegisterMap*) calloc(1, size);
+    if (pIndex == NULL)
+        return NULL;
+
+    dvmRegisterMapSetFormat((RegisterMap*) pIndex, kRegMapFormatIndexed);
+    dvmRegisterMapSetOnHeap((RegisterMap*) pIndex, true);
+    dvmRegisterMapSetRegWidth((RegisterMap*) pIndex, regWidth);
+    dvmRegisterMapSetNumEntries((RegisterMap*) pIndex, numEntries);
+    pIndex->method = method;
+    pIndex->pSource = pMap;
+    pIndex->encodedData = srcPtr;
+    pIndex->size = size;
+    pIndex->numCheckpoints = numCheckpoints;
+    pIndex->checkpoints = (RegisterMapCheckpoint*) (pIndex + 1);
+    pIndex->checkpointBits = (u1*) (pIndex->checkpoints + numCheckpoints);
+    pIndex->lineBuf = pIndex->checkpointBits + numCheckpoints * regWidth;
+
+    /* use the line buffer as scratch space while we walk the entries */
+    u1* bits = pIndex->lineBuf;
+    memcpy(bits, initialBits, regWidth);
+
+    for (int entry = 0; entry < numEntries; entry++) {
+        if (entry != 0)
+            srcPtr = applyDiffEntry(srcPtr, &addr, bits, regWidth);
+
+        if ((entry % REGISTER_MAP_INDEX_INTERVAL) == 0) {
+            int idx = entry / REGISTER_MAP_INDEX_INTERVAL;
+            pIndex->checkpoints[idx].addr = addr;
+            pIndex->checkpoints[idx].srcOffset = srcPtr - pIndex->encodedData;
+            memcpy(pIndex->checkpointBits + idx * regWidth, bits, regWidth);
+        }
+    }
+
+    if (srcPtr - srcStart != expectedSrcLen) {
+        ALOGE("ERROR: consumed %d bytes, expected %d",
+            srcPtr - srcStart, expectedSrcLen);
+        free(pIndex);
+        return NULL;
+    }
+
+    return pIndex;
+}
+
+/*
+ * Find the line for "addr" in an indexed map.  The result points into the
+ * map's line buffer, and is overwritten by the next lookup.
+ */
+static const u1* getIndexedLine(const RegisterMap* pMap, int addr)
+{
+    IndexedRegisterMap* pIndex = (IndexedRegisterMap*) pMap;
+    const RegisterMapCheckpoint* checkpoints = pIndex->checkpoints;
+    int regWidth = pIndex->regWidth;
+
+    if (addr < checkpoints[0].addr)
+        return NULL;
+
+    /* find the last checkpoint at or before "addr" */
+    int lo = 0;
+    int hi = pIndex->numCheckpoints - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (checkpoints[mid].addr <= addr)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    u1* bits = pIndex->lineBuf;
+    memcpy(bits, pIndex->checkpointBits + lo * regWidth, regWidth);
+
+    int lineAddr = checkpoints[lo].addr;
+    if (lineAddr == addr)
+        return bits;
+
+    /* decode forward, stopping before the next checkpoint */
+    int numEntries = dvmRegisterMapGetNumEntries(pMap);
+    int remaining = MIN(REGISTER_MAP_INDEX_INTERVAL - 1,
+        numEntries - 1 - lo * REGISTER_MAP_INDEX_INTERVAL);
+    const u1* srcPtr = pIndex->encodedData + checkpoints[lo].srcOffset;
+    while (remaining-- > 0) {
+        srcPtr = applyDiffEntry(srcPtr, &lineAddr, bits, regWidth);
+        if (lineAddr >= addr)
+            return (lineAddr == addr) ? bits : NULL;
+    }
+
+    return NULL;
+}
+
+/*
+ * Find or create the indexed form of "pMap", which is the compressed map
+ * for "method".
+ */
+static const RegisterMap* getCachedMap(Method* method, const RegisterMap* pMap)
+{
+    RegisterMapCache* pCache = gDvm.registerMapCache;
+    u4 bucket = hashMethod(method);
+    IndexedRegisterMap* pIndex;
+
+    for (pIndex = pCache->buckets[bucket]; pIndex != NULL;
+        pIndex = pIndex->hashNext)
+    {
+        if (pIndex->method == method)
+            break;
+    }
+
+    if (pIndex != NULL) {
+        if (pIndex->pSource == pMap) {
+            pCache->hits++;
+            if (pCache->lruHead != pIndex) {
+                lruUnlink(pCache, pIndex);
+                lruPushFront(pCache, pIndex);
+            }
+            return (const RegisterMap*) pIndex;
+        }
+
+        /* method's map was replaced */
+        cacheRemove(pCache, pIndex);
+    }
+
+    pCache->misses++;
+    pIndex = buildIndexedMap(method, pMap);
+    if (pIndex == NULL) {
+        ALOGE("Map failed to index %s.%s",
+            method->clazz->descriptor, method->name);
+        return NULL;
+    }
+
+#ifdef REGISTER_MAP_STATS
+    /*
+     * Gather and display some stats.
+     */
+    {
+        MapStats* pStats = (MapStats*) gDvm.registerMapStats;
+        pStats->numExpandedMaps++;
+        pStats->totalExpandedMapSize += pIndex->size;
+        ALOGD("RMAP: count=%d size=%d",
+            pStats->numExpandedMaps, pStats->totalExpandedMapSize);
+    }
+#endif
+
+    IF_ALOGV() {
+        char* desc = dexProtoCopyMethodDescriptor(&method->prototype);
+        ALOGV("Indexing map -> %s.%s:%s (%zd bytes)",
+            method->clazz->descriptor, method->name, desc, pIndex->size);
+        free(desc);
+    }
+
+    pIndex->hashNext = pCache->buckets[bucket];
+    pCache->buckets[bucket] = pIndex;
+    lruPushFront(pCache, pIndex);
+    pCache->totalSize += pIndex->size;
+    pCache->numMaps++;
+
+    /* trim, but always keep the entry we're about to return */
+    while (pCache->totalSize > REGISTER_MAP_CACHE_MAX_BYTES &&
+        pCache->lruTail != pIndex)
+    {
+        cacheRemove(pCache, pCache->lruTail);
+        pCache->evictions++;
+    }
+
+    return (const RegisterMap*) pIndex;
+}
+
+/*
+ * Get a usable form of the register map associated with the method.
  *
  * If the map is already in one of the uncompressed formats, we return
- * immediately.  Otherwise, we expand the map and replace method's register
- * map pointer, freeing it if it was allocated on the heap.
+ * immediately.  Otherwise, we return an indexed form from the cache,
+ * creating it if necessary.  The method's map is left alone.
  *
  * NOTE: this function is not synchronized; external locking is mandatory
  * (unless we're in the zygote, where single-threaded access is guaranteed).
@@ -1005,7 +1384,6 @@ static int compareMaps(const RegisterMap* pMap1, const RegisterMap* pMap2)
 const RegisterMap* dvmGetExpandedRegisterMap0(Method* method)
 {
     const RegisterMap* curMap = method->registerMap;
-    RegisterMap* newMap;
 
     if (curMap == NULL)
         return NULL;
@@ -1025,7 +1403,7 @@ const RegisterMap* dvmGetExpandedRegisterMap0(Method* method)
     case kRegMapFormatCompact16:
         if (REGISTER_MAP_VERBOSE) {
             if (dvmRegisterMapGetOnHeap(curMap)) {
-                ALOGD("RegMap: already expanded: %s.%s",
+                ALOGD("RegMap: stored on heap: %s.%s",
                     method->clazz->descriptor, method->name);
             } else {
                 ALOGD("RegMap: stored w/o compression: %s.%s",
@@ -1034,49 +1412,88 @@ const RegisterMap* dvmGetExpandedRegisterMap0(Method* method)
         }
         return curMap;
     case kRegMapFormatDifferential:
-        newMap = uncompressMapDifferential(curMap);
-        break;
+        return getCachedMap(method, curMap);
     default:
         ALOGE("Unknown format %d in dvmGetExpandedRegisterMap", format);
         dvmAbort();
-        newMap = NULL;      // make gcc happy
-    }
-
-    if (newMap == NULL) {
-        ALOGE("Map failed to uncompress (fmt=%d) %s.%s",
-            format, method->clazz->descriptor, method->name);
         return NULL;
     }
+}
 
-#ifdef REGISTER_MAP_STATS
-    /*
-     * Gather and display some stats.
-     */
+/*
+ * Get the method's register map ready for the GC ahead of time.
+ *
+ * In the zygote a differential map is expanded and installed on the
+ * method, as dvmGetExpandedRegisterMap0() used to do on first use, so the
+ * uncompressed copy is shared with every app process instead of being
+ * rebuilt in each one.  Elsewhere the indexed form is just added to the
+ * cache.  Takes the heap lock, so don't call this from the GC.
+ */
+bool dvmPrepareRegisterMap(Method* method)
+{
+    bool result = false;
+
+    dvmLockHeap();
+
+    const RegisterMap* curMap = method->registerMap;
+    if (curMap != NULL && gDvm.zygote &&
+        dvmRegisterMapGetFormat(curMap) == kRegMapFormatDifferential)
     {
-        MapStats* pStats = (MapStats*) gDvm.registerMapStats;
-        pStats->numExpandedMaps++;
-        pStats->totalExpandedMapSize += computeRegisterMapSize(newMap);
-        ALOGD("RMAP: count=%d size=%d",
-            pStats->numExpandedMaps, pStats->totalExpandedMapSize);
+        RegisterMap* newMap = uncompressMapDifferential(curMap);
+        if (newMap != NULL) {
+            dvmRegisterMapCacheRemove(method);
+            dvmSetRegisterMap(method, newMap);
+            if (dvmRegisterMapGetOnHeap(curMap))
+                dvmFreeRegisterMap((RegisterMap*) curMap);
+            result = true;
+        }
+    } else {
+        result = (dvmGetExpandedRegisterMap(method) != NULL);
     }
-#endif
 
-    IF_ALOGV() {
-        char* desc = dexProtoCopyMethodDescriptor(&method->prototype);
-        ALOGV("Expanding map -> %s.%s:%s",
-            method->clazz->descriptor, method->name, desc);
-        free(desc);
+    dvmUnlockHeap();
+    return result;
+}
+
+/*
+ * Drop the cached form of the method's map, if any.
+ */
+void dvmRegisterMapCacheRemove(const Method* method)
+{
+    RegisterMapCache* pCache = gDvm.registerMapCache;
+    if (pCache == NULL)
+        return;
+
+    IndexedRegisterMap* pIndex;
+    for (pIndex = pCache->buckets[hashMethod(method)]; pIndex != NULL;
+        pIndex = pIndex->hashNext)
+    {
+        if (pIndex->method == method) {
+            cacheRemove(pCache, pIndex);
+            return;
+        }
     }
+}
 
-    /*
-     * Update method, and free compressed map if it was sitting on the heap.
-     */
-    dvmSetRegisterMap(method, newMap);
+/*
+ * Get the cache statistics.
+ */
+void dvmRegisterMapCacheGetStats(RegisterMapCacheStats* pStats, bool reset)
+{
+    RegisterMapCache* pCache = gDvm.registerMapCache;
+    if (pCache == NULL) {
+        memset(pStats, 0, sizeof(*pStats));
+        return;
+    }
 
-    if (dvmRegisterMapGetOnHeap(curMap))
-        dvmFreeRegisterMap((RegisterMap*) curMap);
+    pStats->hits = pCache->hits;
+    pStats->misses = pCache->misses;
+    pStats->evictions = pCache->evictions;
+    pStats->numMaps = pCache->numMaps;
+    pStats->totalSize = pCache->totalSize;
 
-    return newMap;
+    if (reset)
+        pCache->hits = pCache->misses = pCache->evictions = 0;
 }
 
 
@@ -1678,21 +2095,10 @@ static RegisterMap* compressMapDifferential(const RegisterMap* pMap,
     return pNewMap;
 }
 
-/*
- * Toggle the value of the "idx"th bit in "ptr".
- */
-static inline void toggleBit(u1* ptr, int idx)
-{
-    ptr[idx >> 3] ^= 1 << (idx & 0x07);
-}
-
 /*
  * Expand a compressed map to an uncompressed form.
  *
  * Returns a newly-allocated RegisterMap on success, or NULL on failure.
- *
- * TODO: consider using the linear allocator or a custom allocator with
- * LRU replacement for these instead of the native heap.
  */
 static RegisterMap* uncompressMapDifferential(const RegisterMap* pMap)
 {
@@ -1752,7 +2158,6 @@ static RegisterMap* uncompressMapDifferential(const RegisterMap* pMap)
 
     memcpy(dstPtr, srcPtr, regWidth);
 
-    int prevAddr = addr;
     const u1* prevBits = dstPtr;    /* point at uncompressed data */
 
     dstPtr += regWidth;
@@ -1763,51 +2168,16 @@ static RegisterMap* uncompressMapDifferential(const RegisterMap* pMap)
      */
     int entry;
     for (entry = 1; entry < numEntries; entry++) {
-        int addrDiff;
-        u1 key;
-
-        key = *srcPtr++;
-
-        /* get the address */
-        if ((key & 0x07) == 7) {
-            /* address diff follows in ULEB128 */
-            addrDiff = readUnsignedLeb128(&srcPtr);
-        } else {
-            addrDiff = (key & 0x07) +1;
-        }
+        /* reserve room for the address, then unpack the bits */
+        u1* addrPtr = dstPtr;
+        dstPtr += newAddrWidth;
+        memcpy(dstPtr, prevBits, regWidth);
+        srcPtr = applyDiffEntry(srcPtr, &addr, dstPtr, regWidth);
 
-        addr = prevAddr + addrDiff;
-        *dstPtr++ = addr & 0xff;
+        *addrPtr++ = addr & 0xff;
         if (newAddrWidth > 1)
-            *dstPtr++ = (u1) (addr >> 8);
+            *addrPtr = (u1) (addr >> 8);
 
-        /* unpack the bits */
-        if ((key & 0x08) != 0) {
-            int bitCount = (key >> 4);
-            if (bitCount == 0) {
-                /* no bits changed, just copy previous */
-                memcpy(dstPtr, prevBits, regWidth);
-            } else if (bitCount == 15) {
-                /* full copy of bit vector is present; ignore prevBits */
-                memcpy(dstPtr, srcPtr, regWidth);
-                srcPtr += regWidth;
-            } else {
-                /* copy previous bits and modify listed indices */
-                memcpy(dstPtr, prevBits, regWidth);
-                while (bitCount--) {
-                    int bitIndex = readUnsignedLeb128(&srcPtr);
-                    toggleBit(dstPtr, bitIndex);
-                }
-            }
-        } else {
-            /* copy previous bits and modify the specified one */
-            memcpy(dstPtr, prevBits, regWidth);
-
-            /* one bit, from 0-15 inclusive, was changed */
-            toggleBit(dstPtr, key >> 4);
-        }
-
-        prevAddr = addr;
         prevBits = dstPtr;
         dstPtr += regWidth;
     }
@@ -34,6 +34,8 @@ enum RegisterMapFormat {
     kRegMapFormatCompact8,      /* compact layout, 8-bit addresses */
     kRegMapFormatCompact16,     /* compact layout, 16-bit addresses */
     kRegMapFormatDifferential,  /* compressed, differential encoding */
+    kRegMapFormatIndexed,       /* differential plus line index; in-memory
+                                   only, see dvmGetExpandedRegisterMap */
 
     kRegMapFormatOnHeap = 0x80, /* bit flag, indicates allocation on heap */
 };
@@ -237,9 +239,10 @@ void dvmFreeRegisterMapBuilder(RegisterMapBuilder* pBuilder);
 RegisterMap* dvmGenerateRegisterMapV(VerifierData* vdata);
 
 /*
- * Get the expanded form of the register map associated with the specified
- * method.  May update method->registerMap, possibly freeing the previous
- * map.
+ * Get a form of the register map associated with the specified method
+ * that dvmRegisterMapGetLine() can use.  Compressed maps are indexed on
+ * demand and kept in a bounded LRU cache; the result is owned by the
+ * cache, and is only valid until the next call.
  *
  * Returns NULL on failure (e.g. unable to expand map).
  *
@@ -260,7 +263,38 @@ INLINE const RegisterMap* dvmGetExpandedRegisterMap(Method* method)
     }
 }
 
+/*
+ * Make sure the method's register map is ready for the GC, expanding it in
+ * place if we're the zygote.  Takes the heap lock.  Returns "false" if the
+ * method has no usable map.
+ */
+bool dvmPrepareRegisterMap(Method* method);
+
 /* dump stats gathered during register map creation process */
 void dvmRegisterMapDumpStats(void);
 
+/*
+ * Drop any cached form of the method's register map.  Call this before
+ * freeing or replacing method->registerMap.
+ */
+void dvmRegisterMapCacheRemove(const Method* method);
+
+/*
+ * Register map cache statistics.  "hits" and "misses" count lookups since
+ * the counters were last reset.
+ */
+struct RegisterMapCacheStats {
+    int     hits;
+    int     misses;
+    int     evictions;
+    int     numMaps;
+    size_t  totalSize;
+};
+
+/*
+ * Get the register map cache statistics, optionally resetting the lookup
+ * counters.  Call with the heap lock held.
+ */
+void dvmRegisterMapCacheGetStats(RegisterMapCacheStats* pStats, bool reset);
+
 #endif  // DALVIK_REGISTERMAP_H_
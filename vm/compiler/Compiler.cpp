@@ -20,6 +20,7 @@
 
 #include "Dalvik.h"
 #include "interp/Jit.h"
+#include "interp/JitProfile.h"
 #include "CompilerInternals.h"
 #ifdef ARCH_IA32
 #include "codegen/x86/Translator.h"
@@ -177,9 +178,44 @@ bool dvmCompilerSetupCodeCache(void)
              gDvmJit.codeCacheSize);
         return false;
     }
-    gDvmJit.codeCache = mmap(NULL, gDvmJit.codeCacheSize,
-                             PROT_READ | PROT_WRITE | PROT_EXEC,
-                             MAP_PRIVATE , fd, 0);
+    gDvmJit.codeCache = MAP_FAILED;
+    gDvmJit.codeCacheRWOffset = 0;
+#ifndef ARCH_IA32
+    /*
+     * Map the region twice: translations run from a read/execute view and
+     * the compiler writes through a read/write view of the same pages, so
+     * installing and chaining code never changes page protections.  This
+     * relies on the data cache not aliasing between the two views, which
+     * only ARMv7 guarantees.  The x86 code generator emits straight into
+     * the cache and keeps one mapping as well.
+     */
+    void *rwView = MAP_FAILED;
+    if (dvmCompilerInstructionSet() == DALVIK_JIT_THUMB2) {
+        rwView = mmap(NULL, gDvmJit.codeCacheSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+        if (rwView == MAP_FAILED) {
+            ALOGW("Could not dual-map the JIT code cache: %s",
+                  strerror(errno));
+        }
+    }
+    if (rwView != MAP_FAILED) {
+        gDvmJit.codeCache = mmap(NULL, gDvmJit.codeCacheSize,
+                                 PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        if (gDvmJit.codeCache == MAP_FAILED) {
+            ALOGW("Could not dual-map the JIT code cache: %s",
+                  strerror(errno));
+            munmap(rwView, gDvmJit.codeCacheSize);
+        } else {
+            gDvmJit.codeCacheRWOffset =
+                (intptr_t) rwView - (intptr_t) gDvmJit.codeCache;
+        }
+    }
+#endif
+    if (gDvmJit.codeCache == MAP_FAILED) {
+        gDvmJit.codeCache = mmap(NULL, gDvmJit.codeCacheSize,
+                                 PROT_READ | PROT_WRITE | PROT_EXEC,
+                                 MAP_PRIVATE , fd, 0);
+    }
     close(fd);
     if (gDvmJit.codeCache == MAP_FAILED) {
         ALOGE("Failed to mmap the JIT code cache of size %d: %s", gDvmJit.codeCacheSize, strerror(errno));
@@ -195,7 +231,7 @@ bool dvmCompilerSetupCodeCache(void)
     /* Copy the template code into the beginning of the code cache */
     int templateSize = (intptr_t) dvmCompilerTemplateEnd -
                        (intptr_t) dvmCompilerTemplateStart;
-    memcpy((void *) gDvmJit.codeCache,
+    memcpy(CODE_CACHE_RW(gDvmJit.codeCache),
            (void *) dvmCompilerTemplateStart,
            templateSize);
 
@@ -224,12 +260,15 @@ bool dvmCompilerSetupCodeCache(void)
     ALOGV("stream = %p after initJIT", stream);
 #endif
 
-    int result = mprotect(gDvmJit.codeCache, gDvmJit.codeCacheSize,
-                          PROTECT_CODE_CACHE_ATTRS);
+    /* The executable view of a dual-mapped cache is already read-only */
+    if (gDvmJit.codeCacheRWOffset == 0) {
+        int result = mprotect(gDvmJit.codeCache, gDvmJit.codeCacheSize,
+                              PROTECT_CODE_CACHE_ATTRS);
 
-    if (result == -1) {
-        ALOGE("Failed to remove the write permission for the code cache");
-        dvmAbort();
+        if (result == -1) {
+            ALOGE("Failed to remove the write permission for the code cache");
+            dvmAbort();
+        }
     }
 
     return true;
@@ -328,7 +367,8 @@ static void resetCodeCache(void)
      * Wipe out the code cache content to force immediate crashes if
      * stale JIT'ed code is invoked.
      */
-    dvmCompilerCacheClear((char *) gDvmJit.codeCache + gDvmJit.templateSize,
+    dvmCompilerCacheClear((char *) CODE_CACHE_RW(gDvmJit.codeCache) +
+                          gDvmJit.templateSize,
                           gDvmJit.codeCacheByteUsed - gDvmJit.templateSize);
 
     dvmCompilerCacheFlush((intptr_t) gDvmJit.codeCache,
@@ -347,16 +387,17 @@ static void resetCodeCache(void)
     gDvmJit.compilerWorkEnqueueIndex = gDvmJit.compilerWorkDequeueIndex = 0;
     gDvmJit.compilerQueueLength = 0;
 
-    /* Reset the IC patch work queue */
+    /* Reset the IC and chain patch work queues */
     dvmLockMutex(&gDvmJit.compilerICPatchLock);
     gDvmJit.compilerICPatchIndex = 0;
+    gDvmJit.chainPatchIndex = 0;
     dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
 
     /*
      * Reset the inflight compilation address (can only be done in safe points
      * or by the compiler thread when its thread state is RUNNING).
      */
-    gDvmJit.inflightBaseAddr = NULL;
+    memset(gDvmJit.inflightBaseAddr, 0, sizeof(gDvmJit.inflightBaseAddr));
 
     /* All clear now */
     gDvmJit.codeCacheFull = false;
@@ -384,6 +425,96 @@ void dvmCompilerPerformSafePointChecks(void)
     dvmCompilerPatchInlineCache();
 }
 
+/* Number of slots probed before giving up on a call site */
+#define CALLSITE_PROFILE_PROBES 8
+
+/*
+ * Find the profile entry for "dPC", claiming a free slot for it if "create"
+ * is set. Returns NULL if the site isn't profiled and no slot is available.
+ * Caller must hold compilerICPatchLock.
+ */
+static JitCallsiteProfile *findCallsiteProfile(const u2 *dPC, bool create)
+{
+    unsigned int mask = COMPILER_CALLSITE_PROFILE_SIZE - 1;
+    unsigned int idx = (((uintptr_t) dPC) >> 1) & mask;
+    int i;
+
+    for (i = 0; i < CALLSITE_PROFILE_PROBES; i++) {
+        JitCallsiteProfile *profile =
+            &gDvmJit.callsiteProfiles[(idx + i) & mask];
+        if (profile->dPC == dPC) {
+            return profile;
+        }
+        if (profile->dPC == NULL) {
+            if (!create) return NULL;
+            memset(profile, 0, sizeof(*profile));
+            profile->dPC = dPC;
+            return profile;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Note that "clazz" was seen at the virtual or interface call site "dPC"
+ * and resolved to "method". Called on every rechain of the predicted
+ * chaining cell of the site. Returns true if the site has seen more than
+ * JIT_MAX_RECEIVER_CLASSES classes, in which case it is not worth
+ * repatching the cell any more.
+ */
+bool dvmJitRecordReceiverClass(const u2 *dPC, const ClassObject *clazz,
+                               const Method *method)
+{
+    bool megamorphic = false;
+    int i;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    JitCallsiteProfile *profile = findCallsiteProfile(dPC, true);
+    if (profile != NULL) {
+        if (profile->numClasses < 0) {
+            megamorphic = true;
+        } else {
+            for (i = 0; i < profile->numClasses; i++) {
+                if (profile->clazz[i] == clazz) {
+                    profile->count[i]++;
+                    break;
+                }
+            }
+            if (i == profile->numClasses) {
+                if (i == JIT_MAX_RECEIVER_CLASSES) {
+                    profile->numClasses = -1;
+                    megamorphic = true;
+                } else {
+                    profile->clazz[i] = clazz;
+                    profile->method[i] = method;
+                    profile->count[i] = 1;
+                    profile->numClasses++;
+                }
+            }
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+    return megamorphic;
+}
+
+/*
+ * Copy out the receiver profile of call site "dPC". Returns false if nothing
+ * has been recorded for it.
+ */
+bool dvmJitGetCallsiteProfile(const u2 *dPC, JitCallsiteProfile *profile)
+{
+    bool found = false;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    JitCallsiteProfile *entry = findCallsiteProfile(dPC, false);
+    if (entry != NULL) {
+        *profile = *entry;
+        found = true;
+    }
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+    return found;
+}
+
 static bool compilerThreadStartup(void)
 {
     JitEntry *pJitTable = NULL;
@@ -404,7 +535,7 @@ static bool compilerThreadStartup(void)
     }
 
     /* Allocate the initial arena block */
-    if (dvmCompilerHeapInit() == false) {
+    if (dvmCompilerHeapInit(0) == false) {
         goto fail;
     }
 
@@ -454,10 +585,10 @@ static bool compilerThreadStartup(void)
     }
     memset(pJitProfTable, gDvmJit.threshold, JIT_PROF_SIZE);
     for (i=0; i < gDvmJit.jitTableSize; i++) {
-       pJitTable[i].u.info.chain = gDvmJit.jitTableSize;
+       pJitTable[i].u.info.chain = JIT_CHAIN_END;
     }
-    /* Is chain field wide enough for termination pattern? */
-    assert(pJitTable[0].u.info.chain == gDvmJit.jitTableSize);
+    /* Is chain field wide enough to index the whole table? */
+    assert(gDvmJit.jitTableSize < JIT_CHAIN_END);
 
     /* Allocate the trace profiling structure */
     pJitTraceProfCounters = (JitTraceProfCounters*)
@@ -485,6 +616,9 @@ static bool compilerThreadStartup(void)
     dvmJitUpdateThreadStateAll();
     dvmUnlockMutex(&gDvmJit.tableLock);
 
+    /* Pre-arm the trace heads that were hot in earlier runs */
+    dvmJitProfileSeedAll();
+
     /* Signal running threads to refresh their cached pJitTable pointers */
     dvmSuspendAllThreads(SUSPEND_FOR_REFRESH);
     dvmResumeAllThreads(SUSPEND_FOR_REFRESH);
@@ -595,58 +729,14 @@ fail:
 
 }
 
-static void *compilerThreadStart(void *arg)
+/*
+ * Main loop of a compiler worker: take work orders off the shared queue
+ * until the compiler is halted.  Each worker compiles into its own arena;
+ * installing the result in the code cache and the JitTable is serialized
+ * by compilerLock and codeCacheProtectionLock.
+ */
+static void compilerWorkerLoop(int workerId)
 {
-    dvmChangeStatus(NULL, THREAD_VMWAIT);
-
-    /*
-     * If we're not running stand-alone, wait a little before
-     * recieving translation requests on the assumption that process start
-     * up code isn't worth compiling.  We'll resume when the framework
-     * signals us that the first screen draw has happened, or the timer
-     * below expires (to catch daemons).
-     *
-     * There is a theoretical race between the callback to
-     * VMRuntime.startJitCompiation and when the compiler thread reaches this
-     * point. In case the callback happens earlier, in order not to permanently
-     * hold the system_server (which is not using the timed wait) in
-     * interpreter-only mode we bypass the delay here.
-     */
-    if (gDvmJit.runningInAndroidFramework &&
-        !gDvmJit.alreadyEnabledViaFramework) {
-        /*
-         * If the current VM instance is the system server (detected by having
-         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
-         * conditional variable to determine whether to start the JIT or not.
-         * If the system server detects that the whole system is booted in
-         * safe mode, the conditional variable will never be signaled and the
-         * system server will remain in the interpreter-only mode. All
-         * subsequent apps will be started with the --enable-safemode flag
-         * explicitly appended.
-         */
-        if (gDvm.systemServerPid == 0) {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
-                              &gDvmJit.compilerLock);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-            ALOGD("JIT started for system_server");
-        } else {
-            dvmLockMutex(&gDvmJit.compilerLock);
-            /*
-             * TUNING: experiment with the delay & perhaps make it
-             * target-specific
-             */
-            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
-                                 &gDvmJit.compilerLock, 3000, 0);
-            dvmUnlockMutex(&gDvmJit.compilerLock);
-        }
-        if (gDvmJit.haltCompilerThread) {
-             return NULL;
-        }
-    }
-
-    compilerThreadStartup();
-
     dvmLockMutex(&gDvmJit.compilerLock);
     /*
      * Since the compiler thread will not touch any objects on the heap once
@@ -658,6 +748,13 @@ static void *compilerThreadStart(void *arg)
             int cc;
             cc = pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
             assert(cc == 0);
+            /* Idle - a good time to update the persistent profiles */
+            if (workerId == 0 && dvmJitProfileSaveNeeded()) {
+                dvmUnlockMutex(&gDvmJit.compilerLock);
+                dvmJitProfileSaveAll();
+                dvmLockMutex(&gDvmJit.compilerLock);
+                continue;
+            }
             pthread_cond_wait(&gDvmJit.compilerQueueActivity,
                               &gDvmJit.compilerLock);
             continue;
@@ -721,6 +818,11 @@ static void *compilerThreadStart(void *arg)
                                               work.result.profileCodeSize);
                         }
                         dvmUnlockMutex(&gDvmJit.compilerLock);
+                        /*
+                         * Chains to the new code are likely to follow -
+                         * install whatever has been batched so far.
+                         */
+                        dvmCompilerFlushChainPatches();
                     }
                     dvmCompilerArenaReset();
                 }
@@ -734,6 +836,97 @@ static void *compilerThreadStart(void *arg)
     }
     pthread_cond_signal(&gDvmJit.compilerQueueEmpty);
     dvmUnlockMutex(&gDvmJit.compilerLock);
+}
+
+static void *compilerWorkerStart(void *arg)
+{
+    int workerId = (int) (intptr_t) arg;
+
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+    if (dvmCompilerHeapInit(workerId)) {
+        compilerWorkerLoop(workerId);
+    }
+
+    dvmChangeStatus(NULL, THREAD_RUNNING);
+    return NULL;
+}
+
+/*
+ * Launch the additional compiler workers.  Called by the first worker once
+ * the code cache and the JitTable have been set up.
+ */
+static void startCompilerWorkers(void)
+{
+    char threadName[16];
+    int i;
+
+    for (i = 1; i < gDvmJit.numCompilerThreads; i++) {
+        snprintf(threadName, sizeof(threadName), "Compiler %d", i);
+        if (!dvmCreateInternalThread(&gDvmJit.compilerHandle[i], threadName,
+                                     compilerWorkerStart,
+                                     (void *) (intptr_t) i)) {
+            ALOGW("Failed to start compiler worker %d", i);
+            break;
+        }
+    }
+}
+
+static void *compilerThreadStart(void *arg)
+{
+    dvmChangeStatus(NULL, THREAD_VMWAIT);
+
+    /*
+     * If we're not running stand-alone, wait a little before
+     * recieving translation requests on the assumption that process start
+     * up code isn't worth compiling.  We'll resume when the framework
+     * signals us that the first screen draw has happened, or the timer
+     * below expires (to catch daemons).
+     *
+     * There is a theoretical race between the callback to
+     * VMRuntime.startJitCompiation and when the compiler thread reaches this
+     * point. In case the callback happens earlier, in order not to permanently
+     * hold the system_server (which is not using the timed wait) in
+     * interpreter-only mode we bypass the delay here.
+     */
+    if (gDvmJit.runningInAndroidFramework &&
+        !gDvmJit.alreadyEnabledViaFramework) {
+        /*
+         * If the current VM instance is the system server (detected by having
+         * 0 in gDvm.systemServerPid), we will use the indefinite wait on the
+         * conditional variable to determine whether to start the JIT or not.
+         * If the system server detects that the whole system is booted in
+         * safe mode, the conditional variable will never be signaled and the
+         * system server will remain in the interpreter-only mode. All
+         * subsequent apps will be started with the --enable-safemode flag
+         * explicitly appended.
+         */
+        if (gDvm.systemServerPid == 0) {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            pthread_cond_wait(&gDvmJit.compilerQueueActivity,
+                              &gDvmJit.compilerLock);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+            ALOGD("JIT started for system_server");
+        } else {
+            dvmLockMutex(&gDvmJit.compilerLock);
+            /*
+             * TUNING: experiment with the delay & perhaps make it
+             * target-specific
+             */
+            dvmRelativeCondWait(&gDvmJit.compilerQueueActivity,
+                                 &gDvmJit.compilerLock, 3000, 0);
+            dvmUnlockMutex(&gDvmJit.compilerLock);
+        }
+        if (gDvmJit.haltCompilerThread) {
+             return NULL;
+        }
+    }
+
+    if (compilerThreadStartup()) {
+        /* The shared state is ready - bring up the other workers */
+        startCompilerWorkers();
+        compilerWorkerLoop(0);
+    }
 
     /*
      * As part of detaching the thread we need to call into Java code to update
@@ -762,18 +955,39 @@ bool dvmCompilerStartup(void)
     gDvmJit.compilerQueueLength = 0;
     dvmUnlockMutex(&gDvmJit.compilerLock);
 
+    /*
+     * The x86 code generator keeps its working state in globals, and the
+     * blocking mode expects the queue to drain only when the requested
+     * translation is done, so both are limited to a single worker.
+     */
+#if defined(ARCH_IA32)
+    gDvmJit.numCompilerThreads = 1;
+#endif
+    if (gDvmJit.blockingMode || gDvmJit.numCompilerThreads < 1) {
+        gDvmJit.numCompilerThreads = 1;
+    } else if (gDvmJit.numCompilerThreads > COMPILER_MAX_THREADS) {
+        gDvmJit.numCompilerThreads = COMPILER_MAX_THREADS;
+    }
+
+    /* Each worker finds its arena through this key */
+    if (pthread_key_create(&gDvmJit.compilerWorkerKey, NULL) != 0) {
+        ALOGE("Unable to create the compiler worker key");
+        return false;
+    }
+
     /*
      * Defer rest of initialization until we're sure JIT'ng makes sense. Launch
-     * the compiler thread, which will do the real initialization if and
-     * when it is signalled to do so.
+     * the first compiler thread, which will do the real initialization if and
+     * when it is signalled to do so and then start the remaining workers.
      */
-    return dvmCreateInternalThread(&gDvmJit.compilerHandle, "Compiler",
+    return dvmCreateInternalThread(&gDvmJit.compilerHandle[0], "Compiler",
                                    compilerThreadStart, NULL);
 }
 
 void dvmCompilerShutdown(void)
 {
     void *threadReturn;
+    int i;
 
     /* Disable new translation requests */
     gDvmJit.pProfTable = NULL;
@@ -787,20 +1001,31 @@ void dvmCompilerShutdown(void)
           sleep(5);
     }
 
-    if (gDvmJit.compilerHandle) {
+    if (gDvmJit.compilerHandle[0]) {
 
         gDvmJit.haltCompilerThread = true;
 
         dvmLockMutex(&gDvmJit.compilerLock);
-        pthread_cond_signal(&gDvmJit.compilerQueueActivity);
+        pthread_cond_broadcast(&gDvmJit.compilerQueueActivity);
         dvmUnlockMutex(&gDvmJit.compilerLock);
 
-        if (pthread_join(gDvmJit.compilerHandle, &threadReturn) != 0)
-            ALOGW("Compiler thread join failed");
-        else if (gDvm.verboseShutdown)
-            ALOGD("Compiler thread has shut down");
+        /*
+         * The first worker starts the others, so their handles are only
+         * stable once it has exited.
+         */
+        for (i = 0; i < COMPILER_MAX_THREADS; i++) {
+            if (!gDvmJit.compilerHandle[i])
+                continue;
+            if (pthread_join(gDvmJit.compilerHandle[i], &threadReturn) != 0)
+                ALOGW("Compiler thread %d join failed", i);
+            else if (gDvm.verboseShutdown)
+                ALOGD("Compiler thread %d has shut down", i);
+        }
     }
 
+    /* Record what got hot in this run */
+    dvmJitProfileSaveAll();
+
     /* Break loops within the translation cache */
     dvmJitUnchainAll();
 
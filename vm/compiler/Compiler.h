@@ -27,7 +27,18 @@
 
 #define COMPILER_WORK_QUEUE_SIZE        100
 #define COMPILER_IC_PATCH_QUEUE_SIZE    64
+#define COMPILER_CHAIN_PATCH_QUEUE_SIZE 16
+/* Chain patches closer together than this are flushed as one range */
+#define COMPILER_CHAIN_PATCH_FLUSH_SPAN 4096
 #define COMPILER_PC_OFFSET_SIZE         100
+#define COMPILER_CALLSITE_PROFILE_SIZE  512     /* Has to be power of 2 */
+#define COMPILER_MAX_THREADS            8
+
+/* Receiver classes remembered per call site before it is megamorphic */
+#define JIT_MAX_RECEIVER_CLASSES        4
+
+/* JitTable doublings, one retired table each, before it hits its limit */
+#define JIT_TABLE_MAX_RETIRED           16
 
 /* Architectural-independent parameters for predicted chains */
 #define PREDICTED_CHAIN_CLAZZ_INIT       0
@@ -48,21 +59,36 @@
 #define PROTECT_CODE_CACHE_ATTRS       (PROT_READ | PROT_EXEC)
 #define UNPROTECT_CODE_CACHE_ATTRS     (PROT_READ | PROT_EXEC | PROT_WRITE)
 
-/* Acquire the lock before removing PROT_WRITE from the specified mem region */
+/*
+ * Writable alias of "addr", an address in the executable view of the code
+ * cache.  When the cache is not dual-mapped this is "addr" itself.
+ */
+#define CODE_CACHE_RW(addr)                                                    \
+    ((void *) ((char *) (addr) + gDvmJit.codeCacheRWOffset))
+
+/*
+ * Acquire the lock before removing PROT_WRITE from the specified mem region.
+ * A dual-mapped cache is written through CODE_CACHE_RW and keeps its
+ * protections, so only the lock is taken.
+ */
 #define UNPROTECT_CODE_CACHE(addr, size)                                       \
     {                                                                          \
         dvmLockMutex(&gDvmJit.codeCacheProtectionLock);                        \
-        mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),       \
-                 (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),        \
-                 (UNPROTECT_CODE_CACHE_ATTRS));                                \
+        if (gDvmJit.codeCacheRWOffset == 0) {                                  \
+            mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),   \
+                     (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),    \
+                     (UNPROTECT_CODE_CACHE_ATTRS));                            \
+        }                                                                      \
     }
 
 /* Add the PROT_WRITE to the specified memory region then release the lock */
 #define PROTECT_CODE_CACHE(addr, size)                                         \
     {                                                                          \
-        mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),       \
-                 (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),        \
-                 (PROTECT_CODE_CACHE_ATTRS));                                  \
+        if (gDvmJit.codeCacheRWOffset == 0) {                                  \
+            mprotect((void *) (((intptr_t) (addr)) & ~gDvmJit.pageSizeMask),   \
+                     (size) + (((intptr_t) (addr)) & gDvmJit.pageSizeMask),    \
+                     (PROTECT_CODE_CACHE_ATTRS));                              \
+        }                                                                      \
         dvmUnlockMutex(&gDvmJit.codeCacheProtectionLock);                      \
     }
 
@@ -128,6 +154,25 @@ typedef struct ICPatchWorkOrder {
     u4 serialNumber;                    /* Serial # (for verification only) */
 } ICPatchWorkOrder;
 
+/* Work order for a chaining branch deferred by dvmJitChain */
+typedef struct ChainPatchWorkOrder {
+    u4 *branchAddr;                     /* Chaining cell to be patched */
+    u4 newInst;                         /* Branch to install */
+} ChainPatchWorkOrder;
+
+/*
+ * Receiver classes seen at a virtual or interface call site. An entry is
+ * added each time the predicted chaining cell of the site is rechained, so
+ * the counts are in units of rechains rather than calls.
+ */
+typedef struct JitCallsiteProfile {
+    const u2 *dPC;                      /* Call site, NULL if slot is free */
+    int numClasses;                     /* -1 once the site is megamorphic */
+    const ClassObject *clazz[JIT_MAX_RECEIVER_CLASSES];
+    const Method *method[JIT_MAX_RECEIVER_CLASSES];
+    u4 count[JIT_MAX_RECEIVER_CLASSES];
+} JitCallsiteProfile;
+
 /*
  * Trace description as will appear in the translation cache.  Note
  * flexible array at end, as these will be of variable size.  To
@@ -162,9 +207,11 @@ typedef enum JitMethodAttributes {
 /* Vectors to provide optimization hints */
 typedef enum JitOptimizationHints {
     kJitOptNoLoop = 0,          // Disable loop formation/optimization
+    kJitOptNoPromotion,         // Disable loop register promotion
 } JitOptimizationHints;
 
 #define JIT_OPT_NO_LOOP         (1 << kJitOptNoLoop)
+#define JIT_OPT_NO_PROMOTION    (1 << kJitOptNoPromotion)
 
 /* Customized node traversal orders for different needs */
 typedef enum DataFlowAnalysisMode {
@@ -211,13 +258,17 @@ void dvmJitUnchainAll(void);
 void dvmJitScanAllClassPointers(void (*callback)(void *ptr));
 void dvmCompilerSortAndPrintTraceProfiles(void);
 void dvmCompilerPerformSafePointChecks(void);
+bool dvmJitRecordReceiverClass(const u2 *dPC, const ClassObject *clazz,
+                               const Method *method);
+bool dvmJitGetCallsiteProfile(const u2 *dPC, JitCallsiteProfile *profile);
 void dvmCompilerInlineMIR(struct CompilationUnit *cUnit,
                           JitTranslationInfo *info);
 void dvmInitializeSSAConversion(struct CompilationUnit *cUnit);
 int dvmConvertSSARegToDalvik(const struct CompilationUnit *cUnit, int ssaReg);
-bool dvmCompilerLoopOpt(struct CompilationUnit *cUnit);
+void dvmCompilerLoopOpt(struct CompilationUnit *cUnit);
 void dvmCompilerInsertBackwardChaining(struct CompilationUnit *cUnit);
 void dvmCompilerNonLoopAnalysis(struct CompilationUnit *cUnit);
+void dvmCompilerGlobalValueNumbering(struct CompilationUnit *cUnit);
 bool dvmCompilerFindLocalLiveIn(struct CompilationUnit *cUnit,
                                 struct BasicBlock *bb);
 bool dvmCompilerDoSSAConversion(struct CompilationUnit *cUnit,
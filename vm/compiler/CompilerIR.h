@@ -94,6 +94,10 @@ enum ExtendedMIROpcode {
     kMirOpLowerBound,
     kMirOpPunt,
     kMirOpCheckInlinePrediction,        // Gen checks for predicted inlining
+    kMirOpLoopRegLoad,                  // Load promoted loop registers
+    kMirOpLoopRegStore,                 // Write back promoted loop registers
+    kMirOpNullCheck,                    // Null check hoisted out of a loop
+    kMirOpVectorLoop,                   // SIMD pre-loop for a counted loop
     kMirOpLast,
 };
 
@@ -124,6 +128,7 @@ typedef struct CallsiteInfo {
     Object *classLoader;
     const Method *method;
     LIR *misPredBranchOver;
+    struct CallsiteInfo *prevGuard;     // Previous class guard at the site
 } CallsiteInfo;
 
 typedef struct MIR {
@@ -273,7 +278,7 @@ typedef struct CompilationUnit {
     BasicBlock *exitBlock;
     BasicBlock *puntBlock;              // punting to interp for exceptions
     BasicBlock *backChainBlock;         // for loop-trace
-    BasicBlock *curBlock;
+    BasicBlock *curBlock;               // block being lowered to LIR
     BasicBlock *nextCodegenBlock;       // for extended trace codegen
     GrowableList dfsOrder;
     GrowableList domPostOrderTraversal;
@@ -285,6 +290,7 @@ typedef struct CompilationUnit {
     bool printSSANames;
     void *blockLabelList;
     bool quitLoopMode;                  // cold path/complex bytecode
+    bool promotionFailed;               // promoted reg needed by codegen
     void *labelList;
     bool setCCode;                      // gen instruction that sets ccodes
                                         // the flag must be set before calling
@@ -307,6 +313,8 @@ void dvmCompilerPrependMIR(BasicBlock *bb, MIR *mir);
 
 void dvmCompilerInsertMIRAfter(BasicBlock *bb, MIR *currentMIR, MIR *newMIR);
 
+void dvmCompilerRemoveMIR(BasicBlock *bb, MIR *mir);
+
 void dvmCompilerAppendLIR(CompilationUnit *cUnit, LIR *lir);
 
 void dvmCompilerInsertLIRBefore(LIR *currentLIR, LIR *newLIR);
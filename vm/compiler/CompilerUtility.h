@@ -22,9 +22,6 @@
 /* Each arena page has some overhead, so take a few bytes off 8k */
 #define ARENA_DEFAULT_SIZE 8100
 
-/* Allocate the initial memory block for arena-based allocation */
-bool dvmCompilerHeapInit(void);
-
 typedef struct ArenaMemBlock {
     size_t blockSize;
     size_t bytesAllocated;
@@ -32,6 +29,26 @@ typedef struct ArenaMemBlock {
     char ptr[0];
 } ArenaMemBlock;
 
+/*
+ * Private state of one compiler worker thread.  Each worker allocates from
+ * its own arena so that several compilations can be in progress at once.
+ */
+typedef struct CompilerWorker {
+    int id;                             // Index into gDvmJit.compilerHandle
+    ArenaMemBlock *arenaHead;
+    ArenaMemBlock *currentArena;
+    int numArenaBlocks;
+} CompilerWorker;
+
+/*
+ * Allocate the initial memory block for arena-based allocation and bind it
+ * to the calling thread as compiler worker "workerId".
+ */
+bool dvmCompilerHeapInit(int workerId);
+
+/* Return the worker id of the calling compiler thread */
+int dvmCompilerWorkerId(void);
+
 void *dvmCompilerNew(size_t size, bool zero);
 
 void dvmCompilerArenaReset(void);
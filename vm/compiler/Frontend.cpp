@@ -281,6 +281,9 @@ CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
     CompilerMethodStats dummyMethodEntry; // For hash table lookup
     CompilerMethodStats *realMethodEntry; // For hash table storage
 
+    /* The table is shared by all compiler workers */
+    dvmHashTableLock(gDvmJit.methodStatsTable);
+
     /* For lookup only */
     dummyMethodEntry.method = method;
     realMethodEntry = (CompilerMethodStats *)
@@ -302,6 +305,8 @@ CompilerMethodStats *dvmCompilerAnalyzeMethodBody(const Method *method,
                            true);
     }
 
+    dvmHashTableUnlock(gDvmJit.methodStatsTable);
+
     /* This method is invoked as a callee and has been analyzed - just return */
     if ((isCallee == true) && (realMethodEntry->attributes & METHOD_IS_CALLEE))
         return realMethodEntry;
@@ -1314,6 +1319,9 @@ bool dvmCompileMethod(const Method *method, JitTranslationInfo *info)
     /* Perform SSA transformation for the whole method */
     dvmCompilerMethodSSATransformation(&cUnit);
 
+    /* Remove checks and loads made redundant by earlier ones */
+    dvmCompilerGlobalValueNumbering(&cUnit);
+
 #ifndef ARCH_IA32
     dvmCompilerInitializeRegAlloc(&cUnit);  // Needs to happen after SSA naming
 
@@ -1574,6 +1582,9 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
 
     dvmCompilerLoopOpt(cUnit);
 
+    /* Remove checks and loads made redundant by earlier ones */
+    dvmCompilerGlobalValueNumbering(cUnit);
+
     /*
      * Change the backward branch to the backward chaining cell after dataflow
      * analsys/optimizations are done.
@@ -1589,6 +1600,11 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
     /* Allocate Registers using simple local allocation scheme */
     dvmCompilerLocalRegAlloc(cUnit);
 
+    /* Keep the hottest Dalvik registers in physical registers */
+    if ((optHints & JIT_OPT_NO_PROMOTION) == 0) {
+        dvmCompilerLoopRegAlloc(cUnit);
+    }
+
     dvmCompilerDumpRegLocationInfo(cUnit);
 
     /* Convert MIR to LIR, etc. */
@@ -1604,6 +1620,17 @@ static bool compileLoop(CompilationUnit *cUnit, unsigned int startOffset,
         goto bail;
     }
 
+    /* Codegen needed a promoted register - retry with everything in temps */
+    if (cUnit->promotionFailed) {
+        if (cUnit->printMe || gDvmJit.receivedSIGUSR2) {
+            ALOGD("Loop trace @ offset %04x retried without promotion",
+                 cUnit->entryBlock->startOffset);
+        }
+        dvmCompilerArenaReset();
+        return dvmCompileTrace(desc, numMaxInsts, info, bailPtr,
+                               optHints | JIT_OPT_NO_PROMOTION);
+    }
+
     /* Convert LIR into machine code. Loop for recoverable retries */
     do {
         dvmCompilerAssembleLIR(cUnit, info);
@@ -1691,7 +1718,8 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
     const u2 *startCodePtr = codePtr;
     BasicBlock *curBB, *entryCodeBB;
     int numBlocks = 0;
-    static int compilationId;
+    static volatile int32_t compilationId;
+    int traceId;
     CompilationUnit cUnit;
     GrowableList *blockList;
 #if defined(WITH_JIT_TUNING)
@@ -1713,7 +1741,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
         return false;
     }
 
-    compilationId++;
+    traceId = android_atomic_inc(&compilationId) + 1;
     memset(&cUnit, 0, sizeof(CompilationUnit));
 
 #if defined(WITH_JIT_TUNING)
@@ -2126,7 +2154,7 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
         char* signature =
             dexProtoCopyMethodDescriptor(&desc->method->prototype);
         ALOGD("TRACEINFO (%d): 0x%08x %s%s.%s %#x %d of %d, %d blocks",
-            compilationId,
+            traceId,
             (intptr_t) desc->method->insns,
             desc->method->clazz->descriptor,
             desc->method->name,
@@ -2155,6 +2183,9 @@ bool dvmCompileTrace(JitTraceDescription *desc, int numMaxInsts,
 
     dvmCompilerNonLoopAnalysis(&cUnit);
 
+    /* Remove checks and loads made redundant by earlier ones */
+    dvmCompilerGlobalValueNumbering(&cUnit);
+
 #ifndef ARCH_IA32
     dvmCompilerInitializeRegAlloc(&cUnit);  // Needs to happen after SSA naming
 #endif
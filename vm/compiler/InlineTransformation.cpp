@@ -17,6 +17,7 @@
 #include "Dalvik.h"
 #include "Dataflow.h"
 #include "libdex/DexOpcodes.h"
+#include "interp/JitProfile.h"
 
 /* Convert the reg id from the callee to the original id passed by the caller */
 static inline u4 convertRegId(const DecodedInstruction *invoke,
@@ -34,16 +35,19 @@ static inline u4 convertRegId(const DecodedInstruction *invoke,
     }
 }
 
-static bool inlineGetter(CompilationUnit *cUnit,
-                         const Method *calleeMethod,
-                         MIR *invokeMIR,
-                         BasicBlock *invokeBB,
-                         bool isPredicted,
-                         bool isRange)
+/*
+ * Build the MIR for the body of getter "calleeMethod" with its registers
+ * mapped to the arguments of "invokeMIR". The result goes to the register
+ * of the move-result following the invoke. Returns NULL if the getter
+ * can't be inlined at this call site.
+ */
+static MIR *buildGetterMIR(const Method *calleeMethod,
+                           MIR *invokeMIR,
+                           BasicBlock *invokeBB,
+                           bool isRange)
 {
     BasicBlock *moveResultBB = invokeBB->fallThrough;
     MIR *moveResultMIR = moveResultBB->firstMIRInsn;
-    MIR *newGetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     DecodedInstruction getterInsn;
 
     /*
@@ -56,7 +60,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
     dexDecodeInstruction(calleeMethod->insns, &getterInsn);
 
     if (!dvmCompilerCanIncludeThisInstruction(calleeMethod, &getterInsn))
-        return false;
+        return NULL;
 
     /*
      * Some getters (especially invoked through interface) are not followed
@@ -66,7 +70,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
         (moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT &&
          moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT_OBJECT &&
          moveResultMIR->dalvikInsn.opcode != OP_MOVE_RESULT_WIDE)) {
-        return false;
+        return NULL;
     }
 
     int dfFlags = dvmGetDexOptAttributes(&getterInsn);
@@ -90,6 +94,7 @@ static bool inlineGetter(CompilationUnit *cUnit,
     getterInsn.vA = moveResultMIR->dalvikInsn.vA;
 
     /* Now setup the Dalvik instruction with converted src/dst registers */
+    MIR *newGetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     newGetterMIR->dalvikInsn = getterInsn;
 
     newGetterMIR->width = dexGetWidthFromOpcode(getterInsn.opcode);
@@ -104,44 +109,18 @@ static bool inlineGetter(CompilationUnit *cUnit,
 
     newGetterMIR->meta.calleeMethod = calleeMethod;
 
-    dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newGetterMIR);
-
-    if (isPredicted) {
-        MIR *invokeMIRSlow = (MIR *)dvmCompilerNew(sizeof(MIR), true);
-        *invokeMIRSlow = *invokeMIR;
-        invokeMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
-
-        /* Use vC to denote the first argument (ie this) */
-        if (!isRange) {
-            invokeMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
-        }
-
-        moveResultMIR->OptimizationFlags |= MIR_INLINED_PRED;
-
-        dvmCompilerInsertMIRAfter(invokeBB, newGetterMIR, invokeMIRSlow);
-        invokeMIRSlow->OptimizationFlags |= MIR_INLINED_PRED;
-#if defined(WITH_JIT_TUNING)
-        gDvmJit.invokePolyGetterInlined++;
-#endif
-    } else {
-        invokeMIR->OptimizationFlags |= MIR_INLINED;
-        moveResultMIR->OptimizationFlags |= MIR_INLINED;
-#if defined(WITH_JIT_TUNING)
-        gDvmJit.invokeMonoGetterInlined++;
-#endif
-    }
-
-    return true;
+    return newGetterMIR;
 }
 
-static bool inlineSetter(CompilationUnit *cUnit,
-                         const Method *calleeMethod,
-                         MIR *invokeMIR,
-                         BasicBlock *invokeBB,
-                         bool isPredicted,
-                         bool isRange)
+/*
+ * Build the MIR for the body of setter "calleeMethod" with its registers
+ * mapped to the arguments of "invokeMIR". Returns NULL if the setter can't
+ * be inlined.
+ */
+static MIR *buildSetterMIR(const Method *calleeMethod,
+                           MIR *invokeMIR,
+                           bool isRange)
 {
-    MIR *newSetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     DecodedInstruction setterInsn;
 
     /*
@@ -154,7 +133,7 @@ static bool inlineSetter(CompilationUnit *cUnit,
     dexDecodeInstruction(calleeMethod->insns, &setterInsn);
 
     if (!dvmCompilerCanIncludeThisInstruction(calleeMethod, &setterInsn))
-        return false;
+        return NULL;
 
     int dfFlags = dvmGetDexOptAttributes(&setterInsn);
 
@@ -176,6 +155,7 @@ static bool inlineSetter(CompilationUnit *cUnit,
     }
 
     /* Now setup the Dalvik instruction with converted src/dst registers */
+    MIR *newSetterMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
     newSetterMIR->dalvikInsn = setterInsn;
 
     newSetterMIR->width = dexGetWidthFromOpcode(setterInsn.opcode);
@@ -190,6 +170,64 @@ static bool inlineSetter(CompilationUnit *cUnit,
 
     newSetterMIR->meta.calleeMethod = calleeMethod;
 
+    return newSetterMIR;
+}
+
+static bool inlineGetter(CompilationUnit *cUnit,
+                         const Method *calleeMethod,
+                         MIR *invokeMIR,
+                         BasicBlock *invokeBB,
+                         bool isPredicted,
+                         bool isRange)
+{
+    MIR *newGetterMIR = buildGetterMIR(calleeMethod, invokeMIR, invokeBB,
+                                       isRange);
+    if (newGetterMIR == NULL)
+        return false;
+
+    MIR *moveResultMIR = invokeBB->fallThrough->firstMIRInsn;
+
+    dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newGetterMIR);
+
+    if (isPredicted) {
+        MIR *invokeMIRSlow = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+        *invokeMIRSlow = *invokeMIR;
+        invokeMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
+
+        /* Use vC to denote the first argument (ie this) */
+        if (!isRange) {
+            invokeMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
+        }
+
+        moveResultMIR->OptimizationFlags |= MIR_INLINED_PRED;
+
+        dvmCompilerInsertMIRAfter(invokeBB, newGetterMIR, invokeMIRSlow);
+        invokeMIRSlow->OptimizationFlags |= MIR_INLINED_PRED;
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokePolyGetterInlined++;
+#endif
+    } else {
+        invokeMIR->OptimizationFlags |= MIR_INLINED;
+        moveResultMIR->OptimizationFlags |= MIR_INLINED;
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokeMonoGetterInlined++;
+#endif
+    }
+
+    return true;
+}
+
+static bool inlineSetter(CompilationUnit *cUnit,
+                         const Method *calleeMethod,
+                         MIR *invokeMIR,
+                         BasicBlock *invokeBB,
+                         bool isPredicted,
+                         bool isRange)
+{
+    MIR *newSetterMIR = buildSetterMIR(calleeMethod, invokeMIR, isRange);
+    if (newSetterMIR == NULL)
+        return false;
+
     dvmCompilerInsertMIRAfter(invokeBB, invokeMIR, newSetterMIR);
 
     if (isPredicted) {
@@ -284,6 +322,129 @@ static bool inlineEmptyVirtualCallee(CompilationUnit *cUnit,
     return true;
 }
 
+/*
+ * Inline the callees of a polymorphic call site, each under a guard on its
+ * receiver class. The classes recorded in "profile" are guarded in order of
+ * how often they were seen, then the class the trace was built with. The
+ * original invoke is kept for any other class.
+ */
+static bool inlinePolymorphicCallsite(CompilationUnit *cUnit,
+                                      MIR *invokeMIR,
+                                      BasicBlock *invokeBB,
+                                      const JitCallsiteProfile *profile,
+                                      bool isRange)
+{
+    CallsiteInfo *traceInfo = invokeMIR->meta.callsiteInfo;
+    CallsiteInfo *guards[JIT_MAX_RECEIVER_CLASSES];
+    MIR *bodies[JIT_MAX_RECEIVER_CLASSES];
+    bool picked[JIT_MAX_RECEIVER_CLASSES];
+    bool hasGetter = false;
+    int numGuards = 0;
+    int i;
+
+    memset(picked, 0, sizeof(picked));
+
+    /* Leave the last guard for the class the trace was built with */
+    while (numGuards < JIT_MAX_RECEIVER_CLASSES - 1) {
+        int best = -1;
+        for (i = 0; i < profile->numClasses; i++) {
+            if (!picked[i] &&
+                (best == -1 || profile->count[i] > profile->count[best])) {
+                best = i;
+            }
+        }
+        if (best == -1) break;
+        picked[best] = true;
+
+        const ClassObject *clazz = profile->clazz[best];
+        if (clazz->classLoader == traceInfo->classLoader &&
+            !strcmp(clazz->descriptor, traceInfo->classDescriptor)) {
+            continue;
+        }
+        CallsiteInfo *callsiteInfo =
+            (CallsiteInfo *)dvmCompilerNew(sizeof(CallsiteInfo), true);
+        callsiteInfo->classDescriptor = clazz->descriptor;
+        callsiteInfo->classLoader = clazz->classLoader;
+        callsiteInfo->method = profile->method[best];
+        guards[numGuards++] = callsiteInfo;
+    }
+    guards[numGuards++] = traceInfo;
+
+    if (numGuards < 2)
+        return false;
+
+    /* Every callee has to be inlinable, or the site is left alone */
+    for (i = 0; i < numGuards; i++) {
+        const Method *calleeMethod = guards[i]->method;
+
+        if (dvmIsNativeMethod(calleeMethod))
+            return false;
+
+        CompilerMethodStats *methodStats =
+            dvmCompilerAnalyzeMethodBody(calleeMethod, true);
+
+        if (methodStats->attributes & METHOD_IS_EMPTY) {
+            bodies[i] = NULL;
+        } else if (methodStats->attributes & METHOD_IS_GETTER) {
+            bodies[i] = buildGetterMIR(calleeMethod, invokeMIR, invokeBB,
+                                       isRange);
+            if (bodies[i] == NULL)
+                return false;
+            hasGetter = true;
+        } else if (methodStats->attributes & METHOD_IS_SETTER) {
+            bodies[i] = buildSetterMIR(calleeMethod, invokeMIR, isRange);
+            if (bodies[i] == NULL)
+                return false;
+        } else {
+            return false;
+        }
+    }
+
+    /*
+     * The invoke becomes the first guard and each further guard is a copy
+     * of it. A guard that fails lands on the next one, and the last one
+     * lands on the slow invoke.
+     */
+    MIR *invokeMIRSlow = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+    *invokeMIRSlow = *invokeMIR;
+    invokeMIR->dalvikInsn.opcode = (Opcode)kMirOpCheckInlinePrediction;
+
+    /* Use vC to denote the first argument (ie this) */
+    if (!isRange) {
+        invokeMIR->dalvikInsn.vC = invokeMIRSlow->dalvikInsn.arg[0];
+    }
+
+    MIR *lastMIR = NULL;
+    for (i = 0; i < numGuards; i++) {
+        MIR *checkMIR = invokeMIR;
+        if (i > 0) {
+            checkMIR = (MIR *)dvmCompilerNew(sizeof(MIR), true);
+            *checkMIR = *invokeMIR;
+            dvmCompilerInsertMIRAfter(invokeBB, lastMIR, checkMIR);
+            guards[i]->prevGuard = guards[i - 1];
+        }
+        checkMIR->meta.callsiteInfo = guards[i];
+        lastMIR = checkMIR;
+
+        if (bodies[i] != NULL) {
+            dvmCompilerInsertMIRAfter(invokeBB, lastMIR, bodies[i]);
+            lastMIR = bodies[i];
+        }
+    }
+
+    dvmCompilerInsertMIRAfter(invokeBB, lastMIR, invokeMIRSlow);
+    invokeMIRSlow->OptimizationFlags |= MIR_INLINED_PRED;
+
+    if (hasGetter) {
+        invokeBB->fallThrough->firstMIRInsn->OptimizationFlags |=
+            MIR_INLINED_PRED;
+    }
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.invokeMultiGuardInlined++;
+#endif
+    return true;
+}
+
 static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
                                      const Method *calleeMethod,
                                      MIR *invokeMIR,
@@ -296,6 +457,27 @@ static bool tryInlineVirtualCallsite(CompilationUnit *cUnit,
     /* Not a Java method */
     if (dvmIsNativeMethod(calleeMethod)) return false;
 
+    /*
+     * Receiver classes are only recorded by the backends that chain
+     * predicted cells through dvmJitRecordReceiverClass, so elsewhere the
+     * site always looks monomorphic.  Until this run has seen the site
+     * rechain, fall back on what an earlier run saved.
+     */
+    const u2 *callsitePC = cUnit->method->insns + invokeMIR->offset;
+    JitCallsiteProfile profile;
+    if (dvmJitGetCallsiteProfile(callsitePC, &profile) ||
+        dvmJitProfileGetReceivers(cUnit->method, callsitePC, calleeMethod,
+                                  &profile)) {
+        /* Leave megamorphic sites to the vtable */
+        if (profile.numClasses < 0) return false;
+
+        if (profile.numClasses > 1 &&
+            inlinePolymorphicCallsite(cUnit, invokeMIR, invokeBB, &profile,
+                                      isRange)) {
+            return true;
+        }
+    }
+
     CompilerMethodStats *methodStats =
         dvmCompilerAnalyzeMethodBody(calleeMethod, true);
 
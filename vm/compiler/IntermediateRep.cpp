@@ -75,6 +75,22 @@ void dvmCompilerInsertMIRAfter(BasicBlock *bb, MIR *currentMIR, MIR *newMIR)
     }
 }
 
+/* Unlink an MIR instruction from its basic block */
+void dvmCompilerRemoveMIR(BasicBlock *bb, MIR *mir)
+{
+    if (mir->prev) {
+        mir->prev->next = mir->next;
+    } else {
+        bb->firstMIRInsn = mir->next;
+    }
+    if (mir->next) {
+        mir->next->prev = mir->prev;
+    } else {
+        bb->lastMIRInsn = mir->prev;
+    }
+    mir->prev = mir->next = NULL;
+}
+
 /*
  * Append an LIR instruction to the LIR list maintained by a compilation
  * unit
@@ -522,6 +522,883 @@ static void genHoistedChecks(CompilationUnit *cUnit)
     }
 }
 
+/*
+ * Bookkeeping for loop-invariant code motion.  The first group of fields
+ * summarizes what the loop body writes.
+ */
+typedef struct LoopCodeMotionInfo {
+    int *defCount;                      // defs of each Dalvik reg, incl. phis
+    bool hasMemoryBarrier;              // invoke, monitor, allocation, etc
+    GrowableList instFieldStores;       // byte offsets written by iput
+    GrowableList staticFieldStores;     // StaticField pointers written by sput
+    BitVector *hoistedDefV;             // SSA names defined by moved MIRs
+    BitVector *nullCheckedV;            // Dalvik regs with a hoisted null check
+    GrowableList hoistedMIRs;           // MIRs for the entry block, in order
+} LoopCodeMotionInfo;
+
+static Field *getResolvedField(const CompilationUnit *cUnit, const MIR *mir,
+                               u4 fieldIdx)
+{
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) ?
+        mir->meta.calleeMethod : cUnit->method;
+    return method->clazz->pDvmDex->pResFields[fieldIdx];
+}
+
+/*
+ * Return the byte offset of the instance field accessed by "mir", or -1 if
+ * the field is unresolved or may be volatile.
+ */
+static int getInstFieldOffset(const CompilationUnit *cUnit, const MIR *mir)
+{
+    switch (mir->dalvikInsn.opcode) {
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+#if ANDROID_SMP != 0
+            return mir->dalvikInsn.vC;
+#else
+            /* Volatile fields are quickened too on non-SMP systems */
+            return -1;
+#endif
+        default: {
+            Field *field = getResolvedField(cUnit, mir, mir->dalvikInsn.vC);
+            if (field == NULL || dvmIsVolatileField(field)) return -1;
+            return ((InstField *) field)->byteOffset;
+        }
+    }
+}
+
+/*
+ * Return the static field accessed by "mir", or NULL if it is unresolved or
+ * volatile.
+ */
+static StaticField *getStaticField(const CompilationUnit *cUnit,
+                                   const MIR *mir)
+{
+    Field *field = getResolvedField(cUnit, mir, mir->dalvikInsn.vB);
+    if (field == NULL || dvmIsVolatileField(field)) return NULL;
+    return (StaticField *) field;
+}
+
+static bool isInGrowableList(const GrowableList *list, intptr_t elem)
+{
+    unsigned int i;
+    for (i = 0; i < list->numUsed; i++) {
+        if (list->elemList[i] == elem) return true;
+    }
+    return false;
+}
+
+/* Record the register defs and memory writes of the whole loop body */
+static void collectLoopSideEffects(CompilationUnit *cUnit,
+                                   LoopCodeMotionInfo *info)
+{
+    GrowableListIterator iterator;
+
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->blockType != kDalvikByteCode || bb->hidden) continue;
+
+        MIR *mir;
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            Opcode opcode = mir->dalvikInsn.opcode;
+            int i;
+
+            if (mir->ssaRep) {
+                for (i = 0; i < mir->ssaRep->numDefs; i++) {
+                    int vReg = DECODE_REG(
+                        dvmConvertSSARegToDalvik(cUnit,
+                                                 mir->ssaRep->defs[i]));
+                    info->defCount[vReg]++;
+                }
+            }
+            if ((int) opcode >= (int) kMirOpFirst) continue;
+
+            if (dexGetFlagsFromOpcode(opcode) & kInstrInvoke) {
+                info->hasMemoryBarrier = true;
+                continue;
+            }
+
+            switch (opcode) {
+                case OP_EXECUTE_INLINE:
+                case OP_EXECUTE_INLINE_RANGE:
+                case OP_INVOKE_OBJECT_INIT_RANGE:
+                case OP_MONITOR_ENTER:
+                case OP_MONITOR_EXIT:
+                /* May run a static initializer */
+                case OP_NEW_INSTANCE:
+                case OP_IPUT_VOLATILE:
+                case OP_IPUT_WIDE_VOLATILE:
+                case OP_IPUT_OBJECT_VOLATILE:
+                case OP_SPUT_VOLATILE:
+                case OP_SPUT_WIDE_VOLATILE:
+                case OP_SPUT_OBJECT_VOLATILE:
+                    info->hasMemoryBarrier = true;
+                    break;
+                case OP_IPUT:
+                case OP_IPUT_WIDE:
+                case OP_IPUT_OBJECT:
+                case OP_IPUT_BOOLEAN:
+                case OP_IPUT_BYTE:
+                case OP_IPUT_CHAR:
+                case OP_IPUT_SHORT:
+                case OP_IPUT_QUICK:
+                case OP_IPUT_WIDE_QUICK:
+                case OP_IPUT_OBJECT_QUICK: {
+                    int offset = getInstFieldOffset(cUnit, mir);
+                    if (offset < 0) {
+                        info->hasMemoryBarrier = true;
+                    } else {
+                        dvmInsertGrowableList(&info->instFieldStores, offset);
+                    }
+                    break;
+                }
+                case OP_SPUT:
+                case OP_SPUT_WIDE:
+                case OP_SPUT_OBJECT:
+                case OP_SPUT_BOOLEAN:
+                case OP_SPUT_BYTE:
+                case OP_SPUT_CHAR:
+                case OP_SPUT_SHORT: {
+                    StaticField *field = getStaticField(cUnit, mir);
+                    if (field == NULL) {
+                        info->hasMemoryBarrier = true;
+                    } else {
+                        dvmInsertGrowableList(&info->staticFieldStores,
+                                              (intptr_t) field);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+/*
+ * Returns true if "mir" can transfer control out of the loop body: a
+ * branch, an invoke, or anything that may throw and punt to the
+ * interpreter.  Array accesses whose checks were hoisted into the entry
+ * block can't, nor can static field loads and constant pool entries,
+ * which are resolved at compile time or the loop isn't compiled at all.
+ */
+static bool mayLeaveLoop(const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    int flags = dexGetFlagsFromOpcode(opcode);
+
+    if (flags & (kInstrCanBranch | kInstrCanSwitch | kInstrCanReturn |
+                 kInstrInvoke)) {
+        return true;
+    }
+    if ((flags & kInstrCanThrow) == 0) return false;
+
+    switch (opcode) {
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+        case OP_SGET:
+        case OP_SGET_WIDE:
+        case OP_SGET_OBJECT:
+        case OP_SGET_BOOLEAN:
+        case OP_SGET_BYTE:
+        case OP_SGET_CHAR:
+        case OP_SGET_SHORT:
+            return false;
+        /* Can still throw ArrayStoreException */
+        case OP_APUT_OBJECT:
+            return true;
+        default:
+            break;
+    }
+
+    const int checks = MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK;
+    return !((dvmCompilerDataFlowAttributes[opcode] & DF_HAS_NR_CHECKS) &&
+             (mir->OptimizationFlags & checks) == checks);
+}
+
+/* Is the value of "ssaReg" the same on every iteration? */
+static bool isInvariantUse(CompilationUnit *cUnit,
+                           const LoopCodeMotionInfo *info, int ssaReg)
+{
+    return DECODE_SUB(dvmConvertSSARegToDalvik(cUnit, ssaReg)) == 0 ||
+           dvmIsBitSet(info->hoistedDefV, ssaReg);
+}
+
+/*
+ * Returns true if "mir" computes the same value on every iteration and has
+ * no side effects beyond writing its destination.
+ */
+static bool isLoopInvariant(CompilationUnit *cUnit,
+                            const LoopCodeMotionInfo *info, const MIR *mir)
+{
+    Opcode opcode = mir->dalvikInsn.opcode;
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int i;
+
+    if ((int) opcode >= (int) kMirOpFirst || ssaRep == NULL ||
+        ssaRep->numDefs == 0) {
+        return false;
+    }
+
+    /* The moved def has to be the only one its register sees in the loop */
+    for (i = 0; i < ssaRep->numDefs; i++) {
+        int vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit,
+                                                       ssaRep->defs[i]));
+        if (info->defCount[vReg] != 1) return false;
+    }
+    for (i = 0; i < ssaRep->numUses; i++) {
+        if (!isInvariantUse(cUnit, info, ssaRep->uses[i])) return false;
+    }
+
+    switch (opcode) {
+        /* Not a function of the operands */
+        case OP_MOVE_RESULT:
+        case OP_MOVE_RESULT_WIDE:
+        case OP_MOVE_RESULT_OBJECT:
+        case OP_MOVE_EXCEPTION:
+            return false;
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+            return true;
+        case OP_IGET:
+        case OP_IGET_WIDE:
+        case OP_IGET_OBJECT:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK: {
+            int offset = getInstFieldOffset(cUnit, mir);
+            return offset >= 0 && !info->hasMemoryBarrier &&
+                   !isInGrowableList(&info->instFieldStores, offset);
+        }
+        case OP_SGET:
+        case OP_SGET_WIDE:
+        case OP_SGET_OBJECT:
+        case OP_SGET_BOOLEAN:
+        case OP_SGET_BYTE:
+        case OP_SGET_CHAR:
+        case OP_SGET_SHORT: {
+            StaticField *field = getStaticField(cUnit, mir);
+            return field != NULL && !info->hasMemoryBarrier &&
+                   !isInGrowableList(&info->staticFieldStores,
+                                     (intptr_t) field);
+        }
+        default:
+            break;
+    }
+
+    return dexGetFlagsFromOpcode(opcode) == kInstrCanContinue;
+}
+
+static SSARepresentation *newSSARep(int numUses, int numDefs)
+{
+    SSARepresentation *ssaRep = (SSARepresentation *)
+        dvmCompilerNew(sizeof(SSARepresentation), true);
+
+    ssaRep->numUses = numUses;
+    ssaRep->uses = (int *) dvmCompilerNew(sizeof(int) * numUses, false);
+    ssaRep->fpUse = (bool *) dvmCompilerNew(sizeof(bool) * numUses, true);
+    ssaRep->wideUse = (bool *) dvmCompilerNew(sizeof(bool) * numUses, true);
+    ssaRep->numDefs = numDefs;
+    ssaRep->defs = (int *) dvmCompilerNew(sizeof(int) * numDefs, false);
+    ssaRep->fpDef = (bool *) dvmCompilerNew(sizeof(bool) * numDefs, true);
+    ssaRep->wideDef = (bool *) dvmCompilerNew(sizeof(bool) * numDefs, true);
+    return ssaRep;
+}
+
+/* Return the basic induction variable whose phi defines "ssaReg", if any */
+static InductionVariableInfo *getBasicIV(CompilationUnit *cUnit, int ssaReg)
+{
+    GrowableList *ivList = cUnit->loopAnalysis->ivList;
+    unsigned int i;
+
+    for (i = 0; i < ivList->numUsed; i++) {
+        InductionVariableInfo *ivInfo =
+            GET_ELEM_N(ivList, InductionVariableInfo*, i);
+        if (ivInfo->ssaReg == ssaReg && ivInfo->basicSSAReg == ssaReg) {
+            return ivInfo;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Turn "mir" into "vA = vA + step" (or "- step" if "negate" is set), where
+ * the step is the literal "step" or, if "stepSSAReg" is valid, that register
+ * added or subtracted depending on the sign of "step".  vA keeps the SSA
+ * name of the original def on both sides - it is no longer strictly SSA,
+ * but the code generator only cares about the frame slot.
+ */
+static void makeStepUpdate(CompilationUnit *cUnit, MIR *mir, int stepSSAReg,
+                           int step, bool negate)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int ssaReg = mir->ssaRep->defs[0];
+
+    dInsn->vB = dInsn->vA;
+    if (stepSSAReg == INVALID_SREG) {
+        dInsn->opcode = OP_ADD_INT_LIT16;
+        dInsn->vC = negate ? -step : step;
+        mir->ssaRep = newSSARep(1, 1);
+    } else {
+        dInsn->opcode = ((step > 0) != negate) ? OP_ADD_INT : OP_SUB_INT;
+        dInsn->vC = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, stepSSAReg));
+        mir->ssaRep = newSSARep(2, 1);
+        mir->ssaRep->uses[1] = stepSSAReg;
+    }
+    mir->ssaRep->uses[0] = ssaReg;
+    mir->ssaRep->defs[0] = ssaReg;
+}
+
+/*
+ * Induction variable strength reduction.  "vX = biv * k" in the loop
+ * header, where biv is the value of a basic induction variable at the top
+ * of the iteration, becomes "vX = vX + k * inc", and vX is seeded in the
+ * entry block with "biv * k - k * inc".  This is the shape of the scaled
+ * indices ("row * width", "i << 2") used for array addressing.
+ *
+ * k is a constant, or - for a +/-1 induction variable - any loop invariant
+ * register, so the step is either a 16-bit literal or that register.
+ */
+static bool reduceStrength(CompilationUnit *cUnit, LoopCodeMotionInfo *info,
+                           MIR *mir)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    SSARepresentation *ssaRep = mir->ssaRep;
+    InductionVariableInfo *ivInfo;
+    int bivUseIdx = 0;
+    int stepSSAReg = INVALID_SREG;
+    s8 k;
+
+    switch (dInsn->opcode) {
+        case OP_MUL_INT_LIT8:
+        case OP_MUL_INT_LIT16:
+            k = (int) dInsn->vC;
+            break;
+        case OP_SHL_INT_LIT8:
+            k = (int) (1u << (dInsn->vC & 0x1f));
+            break;
+        case OP_MUL_INT: {
+            if (getBasicIV(cUnit, ssaRep->uses[1]) != NULL) {
+                bivUseIdx = 1;
+            }
+            /* The seed reads it in the entry block */
+            int other = ssaRep->uses[1 - bivUseIdx];
+            if (!isInvariantUse(cUnit, info, other)) return false;
+            if (dvmIsBitSet(cUnit->isConstantV, other)) {
+                k = cUnit->constantValues[other];
+            } else {
+                stepSSAReg = other;
+                k = 1;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    ivInfo = getBasicIV(cUnit, ssaRep->uses[bivUseIdx]);
+    if (ivInfo == NULL) return false;
+
+    int vReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaRep->defs[0]));
+    if (info->defCount[vReg] != 1) return false;
+
+    s8 step = k * ivInfo->inc;
+    if (stepSSAReg != INVALID_SREG) {
+        if (ivInfo->inc != 1 && ivInfo->inc != -1) return false;
+    } else if (step == 0 || step > 32767 || step < -32767) {
+        return false;
+    }
+
+    /* Seed: the original computation on the incoming value of the biv */
+    MIR *seedMIR = (MIR *) dvmCompilerNew(sizeof(MIR), false);
+    *seedMIR = *mir;
+    seedMIR->ssaRep = newSSARep(ssaRep->numUses, 1);
+    seedMIR->ssaRep->uses[0] = ssaRep->uses[0];
+    if (ssaRep->numUses > 1) {
+        seedMIR->ssaRep->uses[1] = ssaRep->uses[1];
+    }
+    seedMIR->ssaRep->uses[bivUseIdx] = DECODE_REG(
+        dvmConvertSSARegToDalvik(cUnit, ssaRep->uses[bivUseIdx]));
+    seedMIR->ssaRep->defs[0] = ssaRep->defs[0];
+    dvmInsertGrowableList(&info->hoistedMIRs, (intptr_t) seedMIR);
+
+    /* Back off one step so the first iteration lands on the seed */
+    MIR *adjustMIR = (MIR *) dvmCompilerNew(sizeof(MIR), false);
+    *adjustMIR = *mir;
+    makeStepUpdate(cUnit, adjustMIR, stepSSAReg, (int) step, true);
+    dvmInsertGrowableList(&info->hoistedMIRs, (intptr_t) adjustMIR);
+
+    makeStepUpdate(cUnit, mir, stepSSAReg, (int) step, false);
+    return true;
+}
+
+/*
+ * Loop-invariant code motion.  Instructions in the loop header whose
+ * operands don't change in the loop are moved into the entry block and
+ * executed once per loop entry.  Besides moves, constants and arithmetic
+ * this covers field loads that no store in the loop can alias.  Static
+ * loads come for free: a static field is only entered in pResFields after
+ * its class has been initialized, so the compiled sget needs no class-init
+ * check and is as invariant as the field itself.
+ *
+ * A moved def must be the only def of its Dalvik register in the loop, so
+ * the incoming value is never read, and nothing ahead of it in the header
+ * may leave the loop, since the incoming value would still be visible
+ * there.  Together these make the register dead at the loop head, which is
+ * why the null checks for moved field loads can punt to the loop head PC
+ * after the entry block has already written some registers.
+ */
+static void doLoopInvariantCodeMotion(CompilationUnit *cUnit)
+{
+    BasicBlock *entry = cUnit->entryBlock;
+    BasicBlock *loopHead = entry->fallThrough;
+    LoopCodeMotionInfo info;
+    MIR *mir;
+    MIR *nextMIR;
+    unsigned int i;
+
+    memset(&info, 0, sizeof(info));
+    info.defCount = (int *)
+        dvmCompilerNew(sizeof(int) * cUnit->numDalvikRegisters, true);
+    dvmInitGrowableList(&info.instFieldStores, 4);
+    dvmInitGrowableList(&info.staticFieldStores, 4);
+    dvmInitGrowableList(&info.hoistedMIRs, 4);
+    info.hoistedDefV = dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+    info.nullCheckedV =
+        dvmCompilerAllocBitVector(cUnit->numDalvikRegisters, false);
+
+    collectLoopSideEffects(cUnit, &info);
+
+    for (mir = loopHead->firstMIRInsn; mir; mir = nextMIR) {
+        nextMIR = mir->next;
+
+        if ((int) mir->dalvikInsn.opcode >= (int) kMirOpFirst) continue;
+
+        if (isLoopInvariant(cUnit, &info, mir)) {
+            int dfAttributes =
+                dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+
+            /* Instance field loads need their object checked up front */
+            if ((dfAttributes & (DF_IS_GETTER | DF_UB)) ==
+                (DF_IS_GETTER | DF_UB)) {
+                int objReg = DECODE_REG(
+                    dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->uses[0]));
+                if (!dvmIsBitSet(info.nullCheckedV, objReg)) {
+                    MIR *nullCheckMIR =
+                        (MIR *) dvmCompilerNew(sizeof(MIR), true);
+                    nullCheckMIR->dalvikInsn.opcode =
+                        (Opcode) kMirOpNullCheck;
+                    nullCheckMIR->dalvikInsn.vA = objReg;
+                    nullCheckMIR->offset = mir->offset;
+                    dvmInsertGrowableList(&info.hoistedMIRs,
+                                          (intptr_t) nullCheckMIR);
+                    dvmCompilerSetBit(info.nullCheckedV, objReg);
+                }
+            }
+
+            for (i = 0; i < (unsigned int) mir->ssaRep->numDefs; i++) {
+                int vReg = DECODE_REG(dvmConvertSSARegToDalvik(
+                    cUnit, mir->ssaRep->defs[i]));
+                dvmCompilerSetBit(info.hoistedDefV, mir->ssaRep->defs[i]);
+                /* A new value - any earlier null check no longer holds */
+                dvmCompilerClearBit(info.nullCheckedV, vReg);
+            }
+            dvmCompilerRemoveMIR(loopHead, mir);
+            dvmInsertGrowableList(&info.hoistedMIRs, (intptr_t) mir);
+            dvmCompilerDumpMIRInCodeMotion(cUnit, mir);
+            continue;
+        }
+
+        if (reduceStrength(cUnit, &info, mir)) {
+            dvmCompilerDumpMIRInCodeMotion(cUnit, mir);
+            continue;
+        }
+
+        if (mayLeaveLoop(mir)) break;
+    }
+
+    GrowableList *hoistedMIRs = &info.hoistedMIRs;
+    if (hoistedMIRs->numUsed == 0) return;
+
+    for (i = 0; i < hoistedMIRs->numUsed; i++) {
+        dvmCompilerAppendMIR(entry, GET_ELEM_N(hoistedMIRs, MIR*, i));
+    }
+    /* Have the entry block branch over to the body and to the PCR cell */
+    cUnit->hasHoistedChecks = true;
+}
+
+#if defined(ARCH_IA32) && !defined(WITH_SELF_VERIFICATION)
+/*
+ * Vectorization of simple counted loops.  The loop has to be a single block
+ * of the form
+ *
+ *   <phis>
+ *   <body>
+ *   add-int/lit8 vI, vI, 1
+ *   if-lt vI, vN, <loop head>
+ *
+ * where every array access is indexed by the phi value of vI and has its
+ * checks hoisted into the entry block.  Iteration "i" then only touches
+ * element "i" of each array, so four consecutive iterations can run in the
+ * four lanes of a vector.  The vector loop always leaves at least one
+ * iteration to the scalar loop, which recomputes every temporary and
+ * finishes the remaining elements.
+ */
+
+/* Map 2addr and literal forms to the 23x opcode, or OP_NOP if unsupported */
+static Opcode getVectorAluOpcode(Opcode opcode)
+{
+    switch (opcode) {
+        case OP_ADD_INT:
+        case OP_ADD_INT_2ADDR:
+        case OP_ADD_INT_LIT16:
+        case OP_ADD_INT_LIT8:
+            return OP_ADD_INT;
+        case OP_SUB_INT:
+        case OP_SUB_INT_2ADDR:
+        case OP_RSUB_INT:
+        case OP_RSUB_INT_LIT8:
+            return OP_SUB_INT;
+        case OP_AND_INT:
+        case OP_AND_INT_2ADDR:
+        case OP_AND_INT_LIT16:
+        case OP_AND_INT_LIT8:
+            return OP_AND_INT;
+        case OP_OR_INT:
+        case OP_OR_INT_2ADDR:
+        case OP_OR_INT_LIT16:
+        case OP_OR_INT_LIT8:
+            return OP_OR_INT;
+        case OP_XOR_INT:
+        case OP_XOR_INT_2ADDR:
+        case OP_XOR_INT_LIT16:
+        case OP_XOR_INT_LIT8:
+            return OP_XOR_INT;
+        case OP_ADD_FLOAT:
+        case OP_ADD_FLOAT_2ADDR:
+            return OP_ADD_FLOAT;
+        case OP_SUB_FLOAT:
+        case OP_SUB_FLOAT_2ADDR:
+            return OP_SUB_FLOAT;
+        case OP_MUL_FLOAT:
+        case OP_MUL_FLOAT_2ADDR:
+            return OP_MUL_FLOAT;
+        case OP_DIV_FLOAT:
+        case OP_DIV_FLOAT_2ADDR:
+            return OP_DIV_FLOAT;
+        default:
+            return OP_NOP;
+    }
+}
+
+/* Find or allocate a slot; returns -1 if the registers are exhausted */
+static int getVectorSlot(VectorLoopInfo *info, VectorSlotKind kind, int value)
+{
+    int i;
+
+    if (kind != kVectorSlotTemp) {
+        for (i = 0; i < info->numSlots; i++) {
+            if (info->slots[i].kind == kind && info->slots[i].value == value) {
+                return i;
+            }
+        }
+    }
+    if (info->numSlots == MAX_VECTOR_SLOTS) return -1;
+    VectorSlot *slot = &info->slots[info->numSlots];
+    slot->kind = kind;
+    slot->value = value;
+    slot->reduceOp = OP_NOP;
+    return info->numSlots++;
+}
+
+/*
+ * Return the slot holding the value of "ssaReg" in each lane: a temporary
+ * computed earlier in the body, a constant, or a register that isn't
+ * written in the loop.  Returns -1 for anything else, such as the
+ * induction variable or a value carried over from the previous iteration.
+ */
+static int getVectorOperand(CompilationUnit *cUnit, VectorLoopInfo *info,
+                            const int *slotMap, int ssaReg)
+{
+    if (slotMap[ssaReg] >= 0) return slotMap[ssaReg];
+    if (dvmIsBitSet(cUnit->isConstantV, ssaReg)) {
+        return getVectorSlot(info, kVectorSlotConst,
+                             cUnit->constantValues[ssaReg]);
+    }
+    int dalvikReg = dvmConvertSSARegToDalvik(cUnit, ssaReg);
+    if (DECODE_SUB(dalvikReg) == 0) {
+        return getVectorSlot(info, kVectorSlotInvariant,
+                             DECODE_REG(dalvikReg));
+    }
+    return -1;
+}
+
+/* Return the index of the array in "arrayRegs", or -1 if out of registers */
+static int getVectorArray(VectorLoopInfo *info, int arrayReg)
+{
+    int i;
+
+    for (i = 0; i < info->numArrays; i++) {
+        if (info->arrayRegs[i] == arrayReg) return i;
+    }
+    if (info->numArrays == MAX_VECTOR_ARRAYS) return -1;
+    info->arrayRegs[info->numArrays] = arrayReg;
+    return info->numArrays++;
+}
+
+/* Were the null and range checks on "arraySSAReg" hoisted out of the loop? */
+static bool isHoistedArrayAccess(CompilationUnit *cUnit, const MIR *mir,
+                                 int arraySSAReg)
+{
+    GrowableList *arrayAccessInfo = cUnit->loopAnalysis->arrayAccessInfo;
+    const int checks = MIR_IGNORE_NULL_CHECK | MIR_IGNORE_RANGE_CHECK;
+    unsigned int i;
+
+    if ((mir->OptimizationFlags & checks) != checks) return false;
+    for (i = 0; i < arrayAccessInfo->numUsed; i++) {
+        ArrayAccessInfo *access =
+            GET_ELEM_N(arrayAccessInfo, ArrayAccessInfo*, i);
+        if (access->arrayReg == arraySSAReg) return true;
+    }
+    return false;
+}
+
+/*
+ * If "phiDef" is an accumulator updated only by "mir", turn "mir" into a
+ * lane-wise reduction.  The accumulator is combined with the value of the
+ * other operand ("otherSlot") in each lane and the lanes are folded back
+ * into the Dalvik register after the vector loop.
+ */
+static bool addVectorReduction(CompilationUnit *cUnit, VectorLoopInfo *info,
+                               const int *useCount, MIR *mir, Opcode opcode,
+                               int phiDef, int otherSlot, VectorOp *op)
+{
+    int def = mir->ssaRep->defs[0];
+    int dalvikReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, def));
+
+    /* Integer add and the bitwise operators can be reassociated */
+    if (opcode == OP_SUB_INT || opcode == OP_ADD_FLOAT ||
+        opcode == OP_SUB_FLOAT || opcode == OP_MUL_FLOAT ||
+        opcode == OP_DIV_FLOAT) {
+        return false;
+    }
+    /* The new value may only flow back into the phi */
+    if (otherSlot < 0 || useCount[phiDef] != 1 || useCount[def] != 1 ||
+        DECODE_REG(dvmConvertSSARegToDalvik(cUnit, phiDef)) != dalvikReg) {
+        return false;
+    }
+    int slot = getVectorSlot(info, kVectorSlotReduction, dalvikReg);
+    if (slot < 0) return false;
+    info->slots[slot].reduceOp = opcode;
+    op->opcode = opcode;
+    op->dest = slot;
+    op->src1 = slot;
+    op->src2 = otherSlot;
+    return true;
+}
+
+/*
+ * Build the vector plan for the loop body and append a kMirOpVectorLoop to
+ * the entry block.  Bails out quietly on anything that doesn't fit.
+ */
+static void genVectorLoop(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    BasicBlock *entry = cUnit->entryBlock;
+    BasicBlock *loopBody = entry->fallThrough;
+    MIR *branch = loopBody->lastMIRInsn;
+    MIR *mir;
+    int i;
+
+    if (!loopAnalysis->isCountUpLoop || !loopAnalysis->bodyIsClean ||
+        loopAnalysis->loopBranchOpcode != OP_IF_GE) {
+        return;
+    }
+    /* Single-block loop ending in the loop back branch */
+    if (loopBody->taken != loopBody && loopBody->fallThrough != loopBody) {
+        return;
+    }
+    if (branch == NULL || branch->ssaRep == NULL ||
+        branch->ssaRep->numUses != 2) {
+        return;
+    }
+    int endSSAReg = branch->ssaRep->uses[0] == loopAnalysis->ssaBIV ?
+        branch->ssaRep->uses[1] : branch->ssaRep->uses[0];
+    if (DECODE_SUB(dvmConvertSSARegToDalvik(cUnit, endSSAReg)) != 0) return;
+
+    InductionVariableInfo *biv = NULL;
+    for (i = 0; i < (int) loopAnalysis->ivList->numUsed; i++) {
+        InductionVariableInfo *ivInfo =
+            GET_ELEM_N(loopAnalysis->ivList, InductionVariableInfo*, i);
+        if (ivInfo->ssaReg == ivInfo->basicSSAReg) {
+            biv = ivInfo;
+            break;
+        }
+    }
+    if (biv == NULL || biv->inc != 1) return;
+
+    int *useCount = (int *) dvmCompilerNew(sizeof(int) * cUnit->numSSARegs,
+                                           true);
+    int *slotMap = (int *) dvmCompilerNew(sizeof(int) * cUnit->numSSARegs,
+                                          false);
+    BitVector *phiDefV = dvmCompilerAllocBitVector(cUnit->numSSARegs, false);
+    int numMIRs = 0;
+
+    for (i = 0; i < cUnit->numSSARegs; i++) {
+        slotMap[i] = -1;
+    }
+    for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
+        if (mir->ssaRep == NULL) return;
+        for (i = 0; i < mir->ssaRep->numUses; i++) {
+            useCount[mir->ssaRep->uses[i]]++;
+        }
+        if ((int) mir->dalvikInsn.opcode == (int) kMirOpPhi) {
+            dvmCompilerSetBit(phiDefV, mir->ssaRep->defs[0]);
+        }
+        numMIRs++;
+    }
+
+    VectorLoopInfo *info =
+        (VectorLoopInfo *) dvmCompilerNew(sizeof(VectorLoopInfo), true);
+    info->ivReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit,
+                                                      biv->basicSSAReg));
+    info->endReg = DECODE_REG(dvmConvertSSARegToDalvik(cUnit, endSSAReg));
+    info->ops = (VectorOp *) dvmCompilerNew(sizeof(VectorOp) * numMIRs, true);
+
+    for (mir = loopBody->firstMIRInsn; mir; mir = mir->next) {
+        DecodedInstruction *dInsn = &mir->dalvikInsn;
+        SSARepresentation *ssaRep = mir->ssaRep;
+        Opcode opcode = dInsn->opcode;
+        int dfAttributes = dvmCompilerDataFlowAttributes[opcode];
+        VectorOp *op = &info->ops[info->numOps];
+
+        if ((int) opcode == (int) kMirOpPhi) continue;
+        if ((int) opcode >= (int) kMirOpFirst) return;
+        if (mir == branch || opcode == OP_NOP) continue;
+        /* The induction variable update */
+        if (ssaRep->numDefs == 1 && ssaRep->defs[0] == loopAnalysis->ssaBIV) {
+            continue;
+        }
+        /* Picked up through the constant table when used */
+        if ((dfAttributes & DF_SETS_CONST) && (dfAttributes & DF_DA)) {
+            continue;
+        }
+
+        switch (opcode) {
+            case OP_MOVE:
+            case OP_MOVE_FROM16:
+            case OP_MOVE_16: {
+                int src = getVectorOperand(cUnit, info, slotMap,
+                                           ssaRep->uses[0]);
+                if (src < 0) return;
+                slotMap[ssaRep->defs[0]] = src;
+                continue;
+            }
+            case OP_AGET: {
+                int array = getVectorArray(info, dInsn->vB);
+                if (ssaRep->uses[1] != biv->basicSSAReg ||
+                    !isHoistedArrayAccess(cUnit, mir, ssaRep->uses[0]) ||
+                    array < 0) {
+                    return;
+                }
+                op->opcode = OP_AGET;
+                op->array = array;
+                op->dest = getVectorSlot(info, kVectorSlotTemp, 0);
+                if (op->dest < 0) return;
+                slotMap[ssaRep->defs[0]] = op->dest;
+                break;
+            }
+            case OP_APUT: {
+                int array = getVectorArray(info, dInsn->vB);
+                if (ssaRep->uses[2] != biv->basicSSAReg ||
+                    !isHoistedArrayAccess(cUnit, mir, ssaRep->uses[1]) ||
+                    array < 0) {
+                    return;
+                }
+                op->opcode = OP_APUT;
+                op->array = array;
+                op->src1 = getVectorOperand(cUnit, info, slotMap,
+                                            ssaRep->uses[0]);
+                if (op->src1 < 0) return;
+                break;
+            }
+            default: {
+                Opcode aluOpcode = getVectorAluOpcode(opcode);
+                if (aluOpcode == OP_NOP) return;
+
+                int src1Reg = ssaRep->uses[0];
+                int src2Reg = ssaRep->numUses > 1 ? ssaRep->uses[1] : -1;
+                int src1;
+                int src2;
+
+                /* Reductions: "vS = vS op x" on a loop-carried vS */
+                if (dvmIsBitSet(phiDefV, src1Reg) ||
+                    (src2Reg >= 0 && dvmIsBitSet(phiDefV, src2Reg))) {
+                    int phiDef = dvmIsBitSet(phiDefV, src1Reg) ?
+                        src1Reg : src2Reg;
+                    int other;
+                    if (src2Reg < 0) {
+                        other = getVectorSlot(info, kVectorSlotConst,
+                                              dInsn->vC);
+                    } else {
+                        other = getVectorOperand(cUnit, info, slotMap,
+                            phiDef == src1Reg ? src2Reg : src1Reg);
+                    }
+                    if (opcode == OP_RSUB_INT || opcode == OP_RSUB_INT_LIT8 ||
+                        !addVectorReduction(cUnit, info, useCount, mir,
+                                            aluOpcode, phiDef, other, op)) {
+                        return;
+                    }
+                    break;
+                }
+
+                src1 = getVectorOperand(cUnit, info, slotMap, src1Reg);
+                if (src2Reg >= 0) {
+                    src2 = getVectorOperand(cUnit, info, slotMap, src2Reg);
+                } else {
+                    src2 = getVectorSlot(info, kVectorSlotConst, dInsn->vC);
+                }
+                /* rsub computes "literal - vB" */
+                if (opcode == OP_RSUB_INT || opcode == OP_RSUB_INT_LIT8) {
+                    int tmp = src1;
+                    src1 = src2;
+                    src2 = tmp;
+                }
+                op->opcode = aluOpcode;
+                op->src1 = src1;
+                op->src2 = src2;
+                op->dest = getVectorSlot(info, kVectorSlotTemp, 0);
+                if (src1 < 0 || src2 < 0 || op->dest < 0) return;
+                slotMap[ssaRep->defs[0]] = op->dest;
+                break;
+            }
+        }
+        info->numOps++;
+    }
+
+    if (info->numArrays == 0) return;
+
+    loopAnalysis->vectorLoop = info;
+    MIR *vectorMIR = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+    vectorMIR->dalvikInsn.opcode = (Opcode) kMirOpVectorLoop;
+    vectorMIR->dalvikInsn.vA = info->ivReg;
+    vectorMIR->dalvikInsn.vB = info->endReg;
+    dvmCompilerAppendMIR(entry, vectorMIR);
+}
+#endif
+
 void resetBlockEdges(BasicBlock *bb)
 {
     bb->taken = NULL;
@@ -735,10 +1612,10 @@ __attribute__((weak)) void dvmCompilerDumpHoistedChecks(CompilationUnit *cUnit)
 }
 
 /*
- * Main entry point to do loop optimization.
- * Return false if sanity checks for loop formation/optimization failed.
+ * Main entry point to do loop optimization.  Checks are only hoisted for
+ * simple counted loops, but every loop gets the other passes.
  */
-bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
+void dvmCompilerLoopOpt(CompilationUnit *cUnit)
 {
     LoopAnalysis *loopAnalysis =
         (LoopAnalysis *)dvmCompilerNew(sizeof(LoopAnalysis), true);
@@ -769,22 +1646,37 @@ bool dvmCompilerLoopOpt(CompilationUnit *cUnit)
     dvmCompilerDumpIVList(cUnit);
 
     /* Only optimize array accesses for simple counted loop for now */
-    if (!isSimpleCountedLoop(cUnit))
-        return false;
+    if (isSimpleCountedLoop(cUnit)) {
+        loopAnalysis->arrayAccessInfo =
+            (GrowableList *)dvmCompilerNew(sizeof(GrowableList), true);
+        dvmInitGrowableList(loopAnalysis->arrayAccessInfo, 4);
+        loopAnalysis->bodyIsClean = doLoopBodyCodeMotion(cUnit);
+        DEBUG_LOOP(dumpHoistedChecks(cUnit);)
 
-    loopAnalysis->arrayAccessInfo =
-        (GrowableList *)dvmCompilerNew(sizeof(GrowableList), true);
-    dvmInitGrowableList(loopAnalysis->arrayAccessInfo, 4);
-    loopAnalysis->bodyIsClean = doLoopBodyCodeMotion(cUnit);
-    DEBUG_LOOP(dumpHoistedChecks(cUnit);)
+        /*
+         * Convert the array access information into extended MIR code in
+         * the loop header.
+         */
+        genHoistedChecks(cUnit);
+        dvmCompilerDumpHoistedChecks(cUnit);
+
+#if defined(ARCH_IA32) && !defined(WITH_SELF_VERIFICATION)
+        if (!(gDvmJit.disableOpt & (1 << kLoopVectorization))) {
+            genVectorLoop(cUnit);
+        }
+#endif
+    }
 
     /*
-     * Convert the array access information into extended MIR code in the loop
-     * header.
+     * Moved code goes after the hoisted checks.  The IA32 backend only
+     * handles extended MIRs in the entry block, and self-verification may
+     * single-step any instruction, which doesn't work from there.
      */
-    genHoistedChecks(cUnit);
-    dvmCompilerDumpHoistedChecks(cUnit);
-    return true;
+#if !defined(ARCH_IA32) && !defined(WITH_SELF_VERIFICATION)
+    if (!(gDvmJit.disableOpt & (1 << kLoopCodeMotion))) {
+        doLoopInvariantCodeMotion(cUnit);
+    }
+#endif
 }
 
 /*
@@ -20,6 +20,60 @@
 #include "Dalvik.h"
 #include "CompilerInternals.h"
 
+/* A Dalvik register kept in a physical register for the whole loop */
+typedef struct LoopPromotion {
+    int vReg;                           // Dalvik register
+    int physReg;                        // its home inside the loop
+    bool isDefined;                     // written in the loop body
+} LoopPromotion;
+
+/*
+ * A counted loop over 32-bit array elements can run four iterations at a
+ * time with SIMD instructions.  The plan below describes the body in terms
+ * of vector slots - one per machine vector register - and is consumed by
+ * the kMirOpVectorLoop extended MIR in the loop entry block.
+ */
+#define MAX_VECTOR_SLOTS        8       // XMM registers on IA32
+#define MAX_VECTOR_ARRAYS       3       // arrays kept in core registers
+#define VECTOR_LANES            4       // 32-bit lanes per vector
+
+typedef enum VectorSlotKind {
+    kVectorSlotTemp,                    // computed in the loop body
+    kVectorSlotInvariant,               // Dalvik register in every lane
+    kVectorSlotConst,                   // constant in every lane
+    kVectorSlotReduction,               // partial results of a reduction
+} VectorSlotKind;
+
+typedef struct VectorSlot {
+    VectorSlotKind kind;
+    int value;                          // Dalvik register or constant
+    Opcode reduceOp;                    // OP_ADD_INT etc for reductions
+} VectorSlot;
+
+/*
+ * One operation of the vectorized body.  Arithmetic is always in the
+ * three-operand form: dest = src1 op src2.  Array accesses use the basic
+ * induction variable as the index.
+ */
+typedef struct VectorOp {
+    Opcode opcode;                      // OP_AGET, OP_APUT, or a 23x ALU op
+    int dest;                           // slot written
+    int src1;                           // slot read
+    int src2;                           // second slot read by ALU ops
+    int array;                          // index into arrayRegs
+} VectorOp;
+
+typedef struct VectorLoopInfo {
+    int ivReg;                          // Dalvik register of the BIV
+    int endReg;                         // Dalvik register of the loop limit
+    int numSlots;
+    VectorSlot slots[MAX_VECTOR_SLOTS];
+    int numArrays;
+    int arrayRegs[MAX_VECTOR_ARRAYS];   // Dalvik registers of the arrays
+    int numOps;
+    VectorOp *ops;
+} VectorLoopInfo;
+
 typedef struct LoopAnalysis {
     BitVector *isIndVarV;               // length == numSSAReg
     GrowableList *ivList;               // induction variables
@@ -33,6 +87,10 @@ typedef struct LoopAnalysis {
     LIR *branchToPCR;                   // branch over to the PCR cell
     bool bodyIsClean;                   // loop body cannot throw any exceptions
     bool branchesAdded;                 // Body and PCR branch added to LIR output
+    int numPromotions;                  // Dalvik regs kept in registers
+    LoopPromotion *promotions;
+    int firstPromotedPCR;               // first PCR cell needing write-back
+    VectorLoopInfo *vectorLoop;         // SIMD plan for the body, if any
 } LoopAnalysis;
 
 bool dvmCompilerFilterLoopBlocks(CompilationUnit *cUnit);
@@ -17,6 +17,10 @@
 #include "Dalvik.h"
 #include "CompilerInternals.h"
 #include "Dataflow.h"
+#include "Loop.h"
+
+/* Upper bound on the number of Dalvik registers promoted in a loop */
+#define MAX_LOOP_PROMOTIONS 4
 
 /*
  * Quick & dirty - make FP usage sticky.  This is strictly a hint - local
@@ -83,3 +87,263 @@ void dvmCompilerLocalRegAlloc(CompilationUnit *cUnit)
                 DECODE_REG(dvmConvertSSARegToDalvik(cUnit, loc[i].sRegLow));
     }
 }
+
+/* Dalvik register behind an SSA name */
+static inline int ssaToVReg(CompilationUnit *cUnit, int ssaReg)
+{
+    return DECODE_REG(dvmConvertSSARegToDalvik(cUnit, ssaReg));
+}
+
+/* Wide operands need register pairs - leave their halves in the frame */
+static void excludeWideOperands(CompilationUnit *cUnit, MIR *mir,
+                                BitVector *excludedV)
+{
+    static const int useAttrs[3][2] = {
+        {DF_UA, DF_UA_WIDE}, {DF_UB, DF_UB_WIDE}, {DF_UC, DF_UC_WIDE},
+    };
+    SSARepresentation *ssaRep = mir->ssaRep;
+    int attrs = dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+    int *uses = ssaRep->uses;
+    int *defs = ssaRep->defs;
+    int useIdx = 0;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (attrs & useAttrs[i][0]) {
+            useIdx++;
+        } else if ((attrs & useAttrs[i][1]) &&
+                   useIdx + 1 < ssaRep->numUses) {
+            dvmCompilerSetBit(excludedV, ssaToVReg(cUnit, uses[useIdx]));
+            dvmCompilerSetBit(excludedV, ssaToVReg(cUnit, uses[useIdx + 1]));
+            useIdx += 2;
+        }
+    }
+    if ((attrs & DF_DA_WIDE) && ssaRep->numDefs == 2) {
+        dvmCompilerSetBit(excludedV, ssaToVReg(cUnit, defs[0]));
+        dvmCompilerSetBit(excludedV, ssaToVReg(cUnit, defs[1]));
+    }
+}
+
+/*
+ * Count the references to each Dalvik register in the loop body.  Returns
+ * false if the body contains something that needs every register (ie an
+ * invoke or a return), in which case nothing is worth promoting.
+ */
+static bool countLoopReferences(CompilationUnit *cUnit, int *weights,
+                                BitVector *definedV, BitVector *excludedV)
+{
+    GrowableListIterator iterator;
+
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->blockType != kDalvikByteCode || bb->hidden) continue;
+
+        MIR *mir;
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            int opcode = mir->dalvikInsn.opcode;
+            SSARepresentation *ssaRep = mir->ssaRep;
+            int i;
+
+            if (opcode >= kMirOpFirst) {
+                if (opcode != kMirOpPhi) return false;
+                continue;
+            }
+            if (dexGetFlagsFromOpcode((Opcode) opcode) &
+                (kInstrInvoke | kInstrCanReturn)) {
+                return false;
+            }
+            if (ssaRep == NULL) continue;
+
+            excludeWideOperands(cUnit, mir, excludedV);
+            for (i = 0; i < ssaRep->numUses; i++) {
+                int vReg = ssaToVReg(cUnit, ssaRep->uses[i]);
+                weights[vReg]++;
+                if (cUnit->regLocation[ssaRep->uses[i]].fp) {
+                    dvmCompilerSetBit(excludedV, vReg);
+                }
+            }
+            for (i = 0; i < ssaRep->numDefs; i++) {
+                int vReg = ssaToVReg(cUnit, ssaRep->defs[i]);
+                weights[vReg]++;
+                dvmCompilerSetBit(definedV, vReg);
+                if (cUnit->regLocation[ssaRep->defs[i]].fp) {
+                    dvmCompilerSetBit(excludedV, vReg);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * In profiling mode dvmCompilerLoopOpt() sends the back edge through the
+ * backward chaining cell so every iteration is counted.  That re-enters
+ * the trace through the entry block, which would write the promoted
+ * registers back and load them again on each trip.  Point the edge at the
+ * loop body instead, as in the normal mode, and give up the per-iteration
+ * count for promoted loops.  The branch still gets its suspend poll since
+ * the body starts at the same offset as the cell.
+ */
+static void bypassBackChainCell(CompilationUnit *cUnit)
+{
+    BasicBlock *backChainBB = cUnit->backChainBlock;
+    BasicBlock *firstBB = cUnit->entryBlock->fallThrough;
+    GrowableListIterator iterator;
+
+    dvmGrowableListIteratorInit(&cUnit->blockList, &iterator);
+    while (true) {
+        BasicBlock *bb = (BasicBlock *) dvmGrowableListIteratorNext(&iterator);
+        if (bb == NULL) break;
+        if (bb->blockType != kDalvikByteCode || bb->hidden) continue;
+
+        /* firstBB never lost the back edge as a predecessor */
+        if (bb->taken == backChainBB) bb->taken = firstBB;
+        if (bb->fallThrough == backChainBB) bb->fallThrough = firstBB;
+    }
+}
+
+/*
+ * Send the loop exit edge from "bb" to "target" through a block that
+ * writes the promoted registers back to the frame.  Exits to the same
+ * chaining cell share the write-back block.
+ */
+static BasicBlock *routeExitThroughWriteBack(CompilationUnit *cUnit,
+                                             BasicBlock *bb,
+                                             BasicBlock *target,
+                                             BasicBlock **writeBackBlocks)
+{
+    if (target == NULL || target->blockType == kDalvikByteCode)
+        return target;
+
+    BasicBlock *writeBackBB = writeBackBlocks[target->id];
+    if (writeBackBB == NULL) {
+        writeBackBB = dvmCompilerNewBB(kDalvikByteCode, cUnit->numBlocks++);
+        writeBackBB->startOffset = target->startOffset;
+        writeBackBB->fallThrough = target;
+        writeBackBB->needFallThroughBranch = true;
+        dvmInsertGrowableList(&cUnit->blockList, (intptr_t) writeBackBB);
+
+        MIR *storeMIR = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+        storeMIR->dalvikInsn.opcode = (Opcode) kMirOpLoopRegStore;
+        storeMIR->offset = target->startOffset;
+        dvmCompilerAppendMIR(writeBackBB, storeMIR);
+
+        dvmCompilerSetBit(target->predecessors, writeBackBB->id);
+        writeBackBlocks[target->id] = writeBackBB;
+    }
+    dvmCompilerClearBit(target->predecessors, bb->id);
+    dvmCompilerSetBit(writeBackBB->predecessors, bb->id);
+    return writeBackBB;
+}
+
+static void insertWriteBackBlocks(CompilationUnit *cUnit)
+{
+    /* Blocks added here are past numBlocks and won't be visited */
+    int numBlocks = cUnit->numBlocks;
+    BasicBlock **writeBackBlocks =
+        (BasicBlock **) dvmCompilerNew(sizeof(BasicBlock *) * numBlocks, true);
+    int i;
+
+    for (i = 0; i < numBlocks; i++) {
+        BasicBlock *bb =
+            (BasicBlock *) dvmGrowableListGetElement(&cUnit->blockList, i);
+        if (bb->blockType != kDalvikByteCode || bb->hidden) continue;
+        bb->taken = routeExitThroughWriteBack(cUnit, bb, bb->taken,
+                                              writeBackBlocks);
+        bb->fallThrough = routeExitThroughWriteBack(cUnit, bb,
+                                                    bb->fallThrough,
+                                                    writeBackBlocks);
+    }
+}
+
+/*
+ * Register promotion for loop traces.  The local allocator forgets every
+ * temp at block boundaries and writes each def straight back to the
+ * frame, so a loop pays for its induction variables and invariants with a
+ * load or store on every iteration.  Here the most heavily referenced
+ * narrow, non-FP Dalvik registers get a physical register of their own:
+ * they are loaded once in the entry block, stay in the register across
+ * the whole body, and are only written back on the exits - the chaining
+ * cell edges, which get a write-back block inserted below, and the PC
+ * reconstruction cells, which the code generator handles.
+ *
+ * Since a promoted value holds its register from the loop entry to every
+ * exit, all the live intervals span the loop and interfere with each
+ * other, so the linear scan reduces to keeping the heaviest intervals and
+ * leaving the rest in the frame.
+ *
+ * Must run after dvmCompilerLocalRegAlloc().  If the code generator later
+ * needs one of the registers for something else it sets
+ * cUnit->promotionFailed, and the loop is recompiled without promotion.
+ */
+void dvmCompilerLoopRegAlloc(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    int physRegs[MAX_LOOP_PROMOTIONS];
+    int numPhysRegs;
+    int numRegs = cUnit->numDalvikRegisters;
+    int numPromotions = 0;
+    int i;
+
+#if defined(WITH_SELF_VERIFICATION)
+    /* The shadow frame has to be up to date at every instruction */
+    return;
+#endif
+
+    if (cUnit->jitMode != kJitLoop || loopAnalysis == NULL ||
+        (gDvmJit.disableOpt & (1 << kLoopRegPromotion))) {
+        return;
+    }
+
+    numPhysRegs = dvmCompilerGetLoopPromotionRegs(physRegs,
+                                                  MAX_LOOP_PROMOTIONS);
+    if (numPhysRegs == 0) return;
+
+    int *weights = (int *) dvmCompilerNew(sizeof(int) * numRegs, true);
+    BitVector *definedV = dvmCompilerAllocBitVector(numRegs, false);
+    BitVector *excludedV = dvmCompilerAllocBitVector(numRegs, false);
+
+    if (!countLoopReferences(cUnit, weights, definedV, excludedV)) return;
+
+    LoopPromotion *promotions = (LoopPromotion *)
+        dvmCompilerNew(sizeof(LoopPromotion) * numPhysRegs, true);
+    while (numPromotions < numPhysRegs) {
+        int best = -1;
+        for (i = 0; i < numRegs; i++) {
+            if (weights[i] == 0 || dvmIsBitSet(excludedV, i)) continue;
+            if (best < 0 || weights[i] > weights[best]) best = i;
+        }
+        if (best < 0) break;
+        promotions[numPromotions].vReg = best;
+        promotions[numPromotions].physReg = physRegs[numPromotions];
+        promotions[numPromotions].isDefined = dvmIsBitSet(definedV, best);
+        if (cUnit->printMe) {
+            ALOGD("Loop @ %04x: v%d (%d refs) promoted to r%d",
+                  cUnit->entryBlock->startOffset, best, weights[best],
+                  physRegs[numPromotions]);
+        }
+        weights[best] = 0;
+        numPromotions++;
+    }
+    if (numPromotions == 0) return;
+
+    loopAnalysis->numPromotions = numPromotions;
+    loopAnalysis->promotions = promotions;
+
+    /* Load them after the hoisted checks, which still read the frame */
+    MIR *loadMIR = (MIR *) dvmCompilerNew(sizeof(MIR), true);
+    loadMIR->dalvikInsn.opcode = (Opcode) kMirOpLoopRegLoad;
+    loadMIR->offset = cUnit->entryBlock->startOffset;
+    dvmCompilerAppendMIR(cUnit->entryBlock, loadMIR);
+
+    bypassBackChainCell(cUnit);
+
+    for (i = 0; i < numPromotions; i++) {
+        if (promotions[i].isDefined) {
+            insertWriteBackBlocks(cUnit);
+            break;
+        }
+    }
+}
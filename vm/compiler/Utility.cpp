@@ -17,38 +17,59 @@
 #include "Dalvik.h"
 #include "CompilerInternals.h"
 
-static ArenaMemBlock *arenaHead, *currentArena;
-static int numArenaBlocks;
+/* Return the arena state of the calling compiler worker */
+static inline CompilerWorker *getWorker(void)
+{
+    return (CompilerWorker *) pthread_getspecific(gDvmJit.compilerWorkerKey);
+}
 
 /* Allocate the initial memory block for arena-based allocation */
-bool dvmCompilerHeapInit(void)
+bool dvmCompilerHeapInit(int workerId)
 {
-    assert(arenaHead == NULL);
-    arenaHead =
+    CompilerWorker *worker;
+
+    assert(getWorker() == NULL);
+    worker = (CompilerWorker *) calloc(1, sizeof(CompilerWorker));
+    if (worker == NULL) {
+        ALOGE("No memory left to create compiler worker state");
+        return false;
+    }
+    worker->arenaHead =
         (ArenaMemBlock *) malloc(sizeof(ArenaMemBlock) + ARENA_DEFAULT_SIZE);
-    if (arenaHead == NULL) {
+    if (worker->arenaHead == NULL) {
         ALOGE("No memory left to create compiler heap memory");
+        free(worker);
         return false;
     }
-    arenaHead->blockSize = ARENA_DEFAULT_SIZE;
-    currentArena = arenaHead;
-    currentArena->bytesAllocated = 0;
-    currentArena->next = NULL;
-    numArenaBlocks = 1;
+    worker->id = workerId;
+    worker->arenaHead->blockSize = ARENA_DEFAULT_SIZE;
+    worker->currentArena = worker->arenaHead;
+    worker->currentArena->bytesAllocated = 0;
+    worker->currentArena->next = NULL;
+    worker->numArenaBlocks = 1;
+    pthread_setspecific(gDvmJit.compilerWorkerKey, worker);
 
     return true;
 }
 
+int dvmCompilerWorkerId(void)
+{
+    return getWorker()->id;
+}
+
 /* Arena-based malloc for compilation tasks */
 void * dvmCompilerNew(size_t size, bool zero)
 {
+    CompilerWorker *worker = getWorker();
+
     size = (size + 3) & ~3;
 retry:
     /* Normal case - space is available in the current page */
-    if (size + currentArena->bytesAllocated <= currentArena->blockSize) {
+    if (size + worker->currentArena->bytesAllocated <=
+        worker->currentArena->blockSize) {
         void *ptr;
-        ptr = &currentArena->ptr[currentArena->bytesAllocated];
-        currentArena->bytesAllocated += size;
+        ptr = &worker->currentArena->ptr[worker->currentArena->bytesAllocated];
+        worker->currentArena->bytesAllocated += size;
         if (zero) {
             memset(ptr, 0, size);
         }
@@ -58,8 +79,8 @@ retry:
          * See if there are previously allocated arena blocks before the last
          * reset
          */
-        if (currentArena->next) {
-            currentArena = currentArena->next;
+        if (worker->currentArena->next) {
+            worker->currentArena = worker->currentArena->next;
             goto retry;
         }
 
@@ -75,11 +96,12 @@ retry:
         newArena->blockSize = blockSize;
         newArena->bytesAllocated = 0;
         newArena->next = NULL;
-        currentArena->next = newArena;
-        currentArena = newArena;
-        numArenaBlocks++;
-        if (numArenaBlocks > 10)
-            ALOGI("Total arena pages for JIT: %d", numArenaBlocks);
+        worker->currentArena->next = newArena;
+        worker->currentArena = newArena;
+        worker->numArenaBlocks++;
+        if (worker->numArenaBlocks > 10)
+            ALOGI("Total arena pages for JIT worker %d: %d", worker->id,
+                  worker->numArenaBlocks);
         goto retry;
     }
     /* Should not reach here */
@@ -89,12 +111,13 @@ retry:
 /* Reclaim all the arena blocks allocated so far */
 void dvmCompilerArenaReset(void)
 {
+    CompilerWorker *worker = getWorker();
     ArenaMemBlock *block;
 
-    for (block = arenaHead; block; block = block->next) {
+    for (block = worker->arenaHead; block; block = block->next) {
         block->bytesAllocated = 0;
     }
-    currentArena = arenaHead;
+    worker->currentArena = worker->arenaHead;
 }
 
 /* Growable List initialization */
@@ -248,6 +271,9 @@ void dvmCompilerDumpStats(void)
          numArenaBlocks, ARENA_DEFAULT_SIZE);
     ALOGD("Compiler work queue length is %d/%d", gDvmJit.compilerQueueLength,
          gDvmJit.compilerMaxQueued);
+    ALOGD("GVN removed %d null checks, %d range checks, %d field loads",
+         gDvmJit.numNullChecksEliminated, gDvmJit.numRangeChecksEliminated,
+         gDvmJit.numLoadsEliminated);
     dvmJitStats();
     dvmCompilerArchDump();
     if (gDvmJit.methodStatsTable) {
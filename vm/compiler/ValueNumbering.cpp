@@ -0,0 +1,989 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Global value numbering and redundant check / load elimination.
+ *
+ * Blocks are visited in reverse post-order.  Each Dalvik register holds a
+ * value number, and a small set of facts is known about value numbers at
+ * every point: which references are non-null, which (array, index) pairs
+ * have passed a bounds check, and which field loads are still available
+ * in a register.  A block starts with the facts common to all of its
+ * forward predecessors, so a check performed on every path into a block
+ * makes later checks on the same value unnecessary.
+ *
+ * Loop headers don't wait for their back edges.  Instead every register
+ * written somewhere in the compilation unit gets a new value number there
+ * and the field facts are dropped, which keeps whatever was established
+ * before the loop for values that can't change inside it.
+ */
+
+#include "Dalvik.h"
+#include "Dataflow.h"
+#include "CompilerInternals.h"
+#include "codegen/Optimizer.h"
+
+/* Value number of a register we know nothing about */
+#define VN_UNKNOWN 0
+
+typedef enum VNFactKind {
+    kVNNonNull,                 // "obj" is not null
+    kVNRangeChecked,            // "key" is a valid index into array "obj"
+    kVNInstField,               // field at offset "key" of "obj" is "value"
+    kVNStaticField,             // static field "key" is "value"
+} VNFactKind;
+
+typedef struct VNFact {
+    VNFactKind kind;
+    int obj;
+    intptr_t key;
+    bool wide;
+    int value[2];               // value number(s) of the field contents
+    int holder;                 // Dalvik register the value was seen in
+    int holderSSA[2];           // SSA name(s) of the value in "holder"
+} VNFact;
+
+/* Value numbers and facts at one point in the code */
+typedef struct VNState {
+    int *regVN;
+    GrowableList facts;
+} VNState;
+
+/* A pure expression and the value number computed for it */
+typedef struct VNExpr {
+    int opcode;
+    int operands[3];
+    int vn;
+} VNExpr;
+
+typedef struct ValueNumberingInfo {
+    CompilationUnit *cUnit;
+    int numRegs;
+    int nextVN;
+    GrowableList exprs;
+    GrowableList postOrder;
+    BitVector *defRegs;         // registers written anywhere in the unit
+    bool *visited;
+    bool *unknownEntry;         // entered by an edge we can't see through
+    VNState **outState;
+    int numNullChecks;
+    int numRangeChecks;
+    int numLoads;
+} ValueNumberingInfo;
+
+static int newValueNumber(ValueNumberingInfo *info)
+{
+    return info->nextVN++;
+}
+
+static int getVN(ValueNumberingInfo *info, VNState *state, int reg)
+{
+    return (reg < info->numRegs) ? state->regVN[reg] : VN_UNKNOWN;
+}
+
+static void setVN(ValueNumberingInfo *info, VNState *state, int reg, int vn)
+{
+    if (reg < info->numRegs) {
+        state->regVN[reg] = vn;
+    }
+}
+
+/* Return the value number of "opcode" applied to "operands" */
+static int lookupExpr(ValueNumberingInfo *info, int opcode, int op0, int op1,
+                      int op2)
+{
+    unsigned int i;
+
+    for (i = 0; i < info->exprs.numUsed; i++) {
+        VNExpr *expr = (VNExpr *) info->exprs.elemList[i];
+        if (expr->opcode == opcode && expr->operands[0] == op0 &&
+            expr->operands[1] == op1 && expr->operands[2] == op2) {
+            return expr->vn;
+        }
+    }
+
+    VNExpr *expr = (VNExpr *) dvmCompilerNew(sizeof(VNExpr), false);
+    expr->opcode = opcode;
+    expr->operands[0] = op0;
+    expr->operands[1] = op1;
+    expr->operands[2] = op2;
+    expr->vn = newValueNumber(info);
+    dvmInsertGrowableList(&info->exprs, (intptr_t) expr);
+    return expr->vn;
+}
+
+static VNState *newState(ValueNumberingInfo *info)
+{
+    VNState *state = (VNState *) dvmCompilerNew(sizeof(VNState), false);
+
+    state->regVN = (int *) dvmCompilerNew(sizeof(int) * info->numRegs, false);
+    dvmInitGrowableList(&state->facts, 4);
+    return state;
+}
+
+static VNState *copyState(ValueNumberingInfo *info, const VNState *src)
+{
+    VNState *state = newState(info);
+    unsigned int i;
+
+    memcpy(state->regVN, src->regVN, sizeof(int) * info->numRegs);
+    for (i = 0; i < src->facts.numUsed; i++) {
+        dvmInsertGrowableList(&state->facts, src->facts.elemList[i]);
+    }
+    return state;
+}
+
+/* State at the start of the unit, or after an edge we can't analyze */
+static VNState *newInitialState(ValueNumberingInfo *info)
+{
+    VNState *state = newState(info);
+    int i;
+
+    for (i = 0; i < info->numRegs; i++) {
+        state->regVN[i] = newValueNumber(info);
+    }
+    return state;
+}
+
+static VNFact *findFact(VNState *state, VNFactKind kind, int obj,
+                        intptr_t key)
+{
+    unsigned int i;
+
+    for (i = 0; i < state->facts.numUsed; i++) {
+        VNFact *fact = (VNFact *) state->facts.elemList[i];
+        if (fact->kind == kind && fact->obj == obj && fact->key == key) {
+            return fact;
+        }
+    }
+    return NULL;
+}
+
+static bool sameFact(const VNFact *a, const VNFact *b)
+{
+    if (a == b) return true;
+    if (a->kind != b->kind || a->obj != b->obj || a->key != b->key) {
+        return false;
+    }
+    if (a->kind != kVNInstField && a->kind != kVNStaticField) return true;
+    /*
+     * A load turned into a move reads "holderSSA", so it must name the
+     * same definition on every path.  Equal value numbers aren't enough:
+     * the same constant stored on two paths has two SSA names, and the
+     * pruned phis give us nothing to merge them with.
+     */
+    return a->wide == b->wide && a->holder == b->holder &&
+           a->value[0] == b->value[0] &&
+           a->holderSSA[0] == b->holderSSA[0] &&
+           (!a->wide || (a->value[1] == b->value[1] &&
+                         a->holderSSA[1] == b->holderSSA[1]));
+}
+
+static void addCheckFact(VNState *state, VNFactKind kind, int obj,
+                         intptr_t key)
+{
+    if (obj == VN_UNKNOWN || findFact(state, kind, obj, key) != NULL) return;
+
+    VNFact *fact = (VNFact *) dvmCompilerNew(sizeof(VNFact), true);
+    fact->kind = kind;
+    fact->obj = obj;
+    fact->key = key;
+    dvmInsertGrowableList(&state->facts, (intptr_t) fact);
+}
+
+static bool hasCheckFact(VNState *state, VNFactKind kind, int obj,
+                         intptr_t key)
+{
+    return obj != VN_UNKNOWN && findFact(state, kind, obj, key) != NULL;
+}
+
+/*
+ * Forget loaded field values.  A "key" of -1 forgets everything of that
+ * kind; otherwise only instance fields overlapping [key, key + size) or the
+ * given static field are dropped.
+ */
+static void killFieldFacts(VNState *state, VNFactKind kind, intptr_t key,
+                           int size)
+{
+    unsigned int i, j = 0;
+
+    for (i = 0; i < state->facts.numUsed; i++) {
+        VNFact *fact = (VNFact *) state->facts.elemList[i];
+        bool kill = false;
+        if (fact->kind == kind) {
+            if (key == -1) {
+                kill = true;
+            } else if (kind == kVNStaticField) {
+                kill = (fact->key == key);
+            } else {
+                int factSize = fact->wide ? 8 : 4;
+                kill = fact->key < key + size && key < fact->key + factSize;
+            }
+        }
+        if (!kill) {
+            state->facts.elemList[j++] = (intptr_t) fact;
+        }
+    }
+    state->facts.numUsed = j;
+}
+
+static void killAllFieldFacts(VNState *state)
+{
+    killFieldFacts(state, kVNInstField, -1, 0);
+    killFieldFacts(state, kVNStaticField, -1, 0);
+}
+
+/*
+ * Remember that "reg" (and "reg + 1" if wide) now holds the contents of a
+ * field.
+ */
+static void addFieldFact(ValueNumberingInfo *info, VNState *state,
+                         VNFactKind kind, int obj, intptr_t key, bool wide,
+                         int reg, const int *ssaNames)
+{
+    if (kind == kVNInstField && obj == VN_UNKNOWN) return;
+    if (reg + (wide ? 1 : 0) >= info->numRegs) return;
+
+    VNFact *fact = (VNFact *) dvmCompilerNew(sizeof(VNFact), true);
+    fact->kind = kind;
+    fact->obj = obj;
+    fact->key = key;
+    fact->wide = wide;
+    fact->holder = reg;
+    fact->value[0] = state->regVN[reg];
+    fact->holderSSA[0] = ssaNames[0];
+    if (wide) {
+        fact->value[1] = state->regVN[reg + 1];
+        fact->holderSSA[1] = ssaNames[1];
+    }
+    dvmInsertGrowableList(&state->facts, (intptr_t) fact);
+}
+
+/* Return the field fact for "key" if its holder still has the value */
+static VNFact *findFieldValue(ValueNumberingInfo *info, VNState *state,
+                              VNFactKind kind, int obj, intptr_t key,
+                              bool wide)
+{
+    if (kind == kVNInstField && obj == VN_UNKNOWN) return NULL;
+
+    VNFact *fact = findFact(state, kind, obj, key);
+    if (fact == NULL || fact->wide != wide) return NULL;
+    if (getVN(info, state, fact->holder) != fact->value[0]) return NULL;
+    if (wide && getVN(info, state, fact->holder + 1) != fact->value[1]) {
+        return NULL;
+    }
+    return fact;
+}
+
+static Field *getResolvedField(const CompilationUnit *cUnit, const MIR *mir,
+                               u4 fieldIdx)
+{
+    const Method *method = (mir->OptimizationFlags & MIR_CALLEE) ?
+        mir->meta.calleeMethod : cUnit->method;
+    return method->clazz->pDvmDex->pResFields[fieldIdx];
+}
+
+/*
+ * Return the byte offset of the instance field accessed by "mir", or -1 if
+ * the field is unresolved or may be volatile.
+ */
+static int getInstFieldOffset(const CompilationUnit *cUnit, const MIR *mir)
+{
+    switch (mir->dalvikInsn.opcode) {
+        case OP_IGET_QUICK:
+        case OP_IGET_WIDE_QUICK:
+        case OP_IGET_OBJECT_QUICK:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_WIDE_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+#if ANDROID_SMP != 0
+            return mir->dalvikInsn.vC;
+#else
+            /* Volatile fields are quickened too on non-SMP systems */
+            return -1;
+#endif
+        default: {
+            Field *field = getResolvedField(cUnit, mir, mir->dalvikInsn.vC);
+            if (field == NULL || dvmIsVolatileField(field)) return -1;
+            return ((InstField *) field)->byteOffset;
+        }
+    }
+}
+
+/*
+ * Return the static field accessed by "mir", or NULL if it is unresolved or
+ * volatile.
+ */
+static StaticField *getStaticField(const CompilationUnit *cUnit,
+                                   const MIR *mir)
+{
+    Field *field = getResolvedField(cUnit, mir, mir->dalvikInsn.vB);
+    if (field == NULL || dvmIsVolatileField(field)) return NULL;
+    return (StaticField *) field;
+}
+
+/* Give the registers defined by "mir" fresh value numbers */
+static void defineFresh(ValueNumberingInfo *info, VNState *state, MIR *mir)
+{
+    int dfAttributes = dvmCompilerDataFlowAttributes[mir->dalvikInsn.opcode];
+
+    if (dfAttributes & DF_DA) {
+        setVN(info, state, mir->dalvikInsn.vA, newValueNumber(info));
+    } else if (dfAttributes & DF_DA_WIDE) {
+        setVN(info, state, mir->dalvikInsn.vA, newValueNumber(info));
+        setVN(info, state, mir->dalvikInsn.vA + 1, newValueNumber(info));
+    }
+}
+
+/* Drop the null check of the object in "objReg" if it is known non-null */
+static void checkObject(ValueNumberingInfo *info, VNState *state, MIR *mir,
+                        int objReg)
+{
+    int objVN = getVN(info, state, objReg);
+
+    if (hasCheckFact(state, kVNNonNull, objVN, 0) &&
+        !(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        mir->OptimizationFlags |= MIR_IGNORE_NULL_CHECK;
+        info->numNullChecks++;
+    }
+    addCheckFact(state, kVNNonNull, objVN, 0);
+}
+
+/*
+ * Turn a field load into a move from the register that already holds the
+ * value.
+ */
+static void convertToMove(MIR *mir, const VNFact *fact, bool isObject)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    SSARepresentation *oldRep = mir->ssaRep;
+    int numRegs = fact->wide ? 2 : 1;
+    int i;
+
+    dInsn->opcode = fact->wide ? OP_MOVE_WIDE :
+                    (isObject ? OP_MOVE_OBJECT : OP_MOVE);
+    dInsn->vB = fact->holder;
+    dInsn->vC = 0;
+
+    SSARepresentation *ssaRep = (SSARepresentation *)
+        dvmCompilerNew(sizeof(SSARepresentation), true);
+    ssaRep->numUses = numRegs;
+    ssaRep->uses = (int *) dvmCompilerNew(sizeof(int) * numRegs, false);
+    ssaRep->fpUse = (bool *) dvmCompilerNew(sizeof(bool) * numRegs, true);
+    ssaRep->wideUse = (bool *) dvmCompilerNew(sizeof(bool) * numRegs, true);
+    for (i = 0; i < numRegs; i++) {
+        ssaRep->uses[i] = fact->holderSSA[i];
+        ssaRep->fpUse[i] = oldRep->fpDef ? oldRep->fpDef[i] : false;
+        ssaRep->wideUse[i] = fact->wide;
+    }
+    ssaRep->numDefs = oldRep->numDefs;
+    ssaRep->defs = oldRep->defs;
+    ssaRep->fpDef = oldRep->fpDef;
+    ssaRep->wideDef = oldRep->wideDef;
+    mir->ssaRep = ssaRep;
+}
+
+static void handleInstGet(ValueNumberingInfo *info, VNState *state, MIR *mir,
+                          bool wide, bool isObject)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int objVN = getVN(info, state, dInsn->vB);
+    int offset = getInstFieldOffset(info->cUnit, mir);
+
+    if (offset < 0) {
+        checkObject(info, state, mir, dInsn->vB);
+        killAllFieldFacts(state);
+        defineFresh(info, state, mir);
+        return;
+    }
+
+    VNFact *fact = findFieldValue(info, state, kVNInstField, objVN, offset,
+                                  wide);
+    if (fact != NULL && mir->ssaRep != NULL) {
+        convertToMove(mir, fact, isObject);
+        info->numLoads++;
+        setVN(info, state, dInsn->vA, fact->value[0]);
+        if (wide) {
+            setVN(info, state, dInsn->vA + 1, fact->value[1]);
+        }
+        return;
+    }
+
+    checkObject(info, state, mir, dInsn->vB);
+    defineFresh(info, state, mir);
+    if (mir->ssaRep != NULL) {
+        addFieldFact(info, state, kVNInstField, objVN, offset, wide,
+                     dInsn->vA, mir->ssaRep->defs);
+    }
+}
+
+/*
+ * "fullWidth" is false for the byte/char/short/boolean stores, which
+ * truncate the value so it can't be forwarded to a later load.
+ */
+static void handleInstPut(ValueNumberingInfo *info, VNState *state, MIR *mir,
+                          bool wide, bool fullWidth)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int objVN = getVN(info, state, dInsn->vB);
+    int offset = getInstFieldOffset(info->cUnit, mir);
+
+    checkObject(info, state, mir, dInsn->vB);
+    if (offset < 0) {
+        killAllFieldFacts(state);
+        return;
+    }
+    killFieldFacts(state, kVNInstField, offset, wide ? 8 : 4);
+    if (fullWidth && mir->ssaRep != NULL) {
+        addFieldFact(info, state, kVNInstField, objVN, offset, wide,
+                     dInsn->vA, mir->ssaRep->uses);
+    }
+}
+
+static void handleStaticGet(ValueNumberingInfo *info, VNState *state,
+                            MIR *mir, bool wide, bool isObject)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    StaticField *field = getStaticField(info->cUnit, mir);
+
+    if (field == NULL) {
+        killAllFieldFacts(state);
+        defineFresh(info, state, mir);
+        return;
+    }
+
+    VNFact *fact = findFieldValue(info, state, kVNStaticField, VN_UNKNOWN,
+                                  (intptr_t) field, wide);
+    if (fact != NULL && mir->ssaRep != NULL) {
+        convertToMove(mir, fact, isObject);
+        info->numLoads++;
+        setVN(info, state, dInsn->vA, fact->value[0]);
+        if (wide) {
+            setVN(info, state, dInsn->vA + 1, fact->value[1]);
+        }
+        return;
+    }
+
+    defineFresh(info, state, mir);
+    if (mir->ssaRep != NULL) {
+        addFieldFact(info, state, kVNStaticField, VN_UNKNOWN,
+                     (intptr_t) field, wide, dInsn->vA, mir->ssaRep->defs);
+    }
+}
+
+static void handleStaticPut(ValueNumberingInfo *info, VNState *state,
+                            MIR *mir, bool wide, bool fullWidth)
+{
+    StaticField *field = getStaticField(info->cUnit, mir);
+
+    if (field == NULL) {
+        killAllFieldFacts(state);
+        return;
+    }
+    killFieldFacts(state, kVNStaticField, (intptr_t) field, 0);
+    if (fullWidth && mir->ssaRep != NULL) {
+        addFieldFact(info, state, kVNStaticField, VN_UNKNOWN,
+                     (intptr_t) field, wide, mir->dalvikInsn.vA,
+                     mir->ssaRep->uses);
+    }
+}
+
+/* aget/aput: vB is the array and vC the index */
+static void handleArrayAccess(ValueNumberingInfo *info, VNState *state,
+                              MIR *mir)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int arrayVN = getVN(info, state, dInsn->vB);
+    int indexVN = getVN(info, state, dInsn->vC);
+
+    checkObject(info, state, mir, dInsn->vB);
+    if (indexVN != VN_UNKNOWN &&
+        hasCheckFact(state, kVNRangeChecked, arrayVN, indexVN) &&
+        !(mir->OptimizationFlags & MIR_IGNORE_RANGE_CHECK)) {
+        mir->OptimizationFlags |= MIR_IGNORE_RANGE_CHECK;
+        info->numRangeChecks++;
+    }
+    if (indexVN != VN_UNKNOWN) {
+        addCheckFact(state, kVNRangeChecked, arrayVN, indexVN);
+    }
+}
+
+/* Return the value of a non-wide constant load */
+static bool getConstant(const DecodedInstruction *dInsn, int *value)
+{
+    switch (dInsn->opcode) {
+        case OP_CONST_4:
+        case OP_CONST_16:
+        case OP_CONST:
+            *value = dInsn->vB;
+            return true;
+        case OP_CONST_HIGH16:
+            *value = dInsn->vB << 16;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Number the result of an instruction without side effects */
+static void handleDefinition(ValueNumberingInfo *info, VNState *state,
+                             MIR *mir)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+    int dfAttributes = dvmCompilerDataFlowAttributes[dInsn->opcode];
+    int flags = dexGetFlagsFromOpcode(dInsn->opcode);
+    int value;
+
+    if (!(dfAttributes & DF_HAS_DEFS)) return;
+
+    if (dfAttributes & DF_IS_MOVE) {
+        setVN(info, state, dInsn->vA, getVN(info, state, dInsn->vB));
+        if (dfAttributes & DF_DA_WIDE) {
+            setVN(info, state, dInsn->vA + 1,
+                  getVN(info, state, dInsn->vB + 1));
+        }
+        return;
+    }
+
+    if (getConstant(dInsn, &value)) {
+        setVN(info, state, dInsn->vA, lookupExpr(info, OP_CONST, value, 0, 0));
+        return;
+    }
+
+    /* Narrow arithmetic, logic and conversions */
+    if (flags == kInstrCanContinue && (dfAttributes & DF_HAS_USES) &&
+        !(dfAttributes & (DF_DA_WIDE | DF_UA_WIDE | DF_UB_WIDE |
+                          DF_UC_WIDE))) {
+        InstructionFormat format = dexGetFormatFromOpcode(dInsn->opcode);
+        bool known = true;
+        int op0 = 0, op1 = 0, op2 = 0;
+        if (dfAttributes & DF_UA) {
+            op0 = getVN(info, state, dInsn->vA);
+            known &= (op0 != VN_UNKNOWN);
+        }
+        if (dfAttributes & DF_UB) {
+            op1 = getVN(info, state, dInsn->vB);
+            known &= (op1 != VN_UNKNOWN);
+        }
+        if (dfAttributes & DF_UC) {
+            op2 = getVN(info, state, dInsn->vC);
+            known &= (op2 != VN_UNKNOWN);
+        } else if (format == kFmt22b || format == kFmt22s) {
+            /* Literal operand */
+            op2 = dInsn->vC;
+        }
+        if (known) {
+            setVN(info, state, dInsn->vA,
+                  lookupExpr(info, dInsn->opcode, op0, op1, op2));
+            return;
+        }
+    }
+
+    defineFresh(info, state, mir);
+}
+
+static void handleExtendedMIR(ValueNumberingInfo *info, VNState *state,
+                              MIR *mir)
+{
+    switch ((ExtendedMIROpcode) mir->dalvikInsn.opcode) {
+        case kMirOpNullNRangeUpCheck:
+        case kMirOpNullNRangeDownCheck:
+        case kMirOpNullCheck:
+            /* The hoisting code stores the Dalvik register in vA */
+            addCheckFact(state, kVNNonNull,
+                         getVN(info, state, mir->dalvikInsn.vA), 0);
+            break;
+        case kMirOpCheckInlinePrediction:
+            /* Not rewritten by the SSA conversion - vC is a Dalvik register */
+            addCheckFact(state, kVNNonNull,
+                         getVN(info, state, mir->dalvikInsn.vC), 0);
+            break;
+        default:
+            /* Phi nodes are covered by merging the predecessor states */
+            break;
+    }
+}
+
+static void processMIR(ValueNumberingInfo *info, VNState *state, MIR *mir)
+{
+    DecodedInstruction *dInsn = &mir->dalvikInsn;
+
+    if ((int) dInsn->opcode >= kMirOpFirst) {
+        handleExtendedMIR(info, state, mir);
+        return;
+    }
+
+    switch (dInsn->opcode) {
+        case OP_IGET:
+        case OP_IGET_BOOLEAN:
+        case OP_IGET_BYTE:
+        case OP_IGET_CHAR:
+        case OP_IGET_SHORT:
+        case OP_IGET_QUICK:
+            handleInstGet(info, state, mir, false, false);
+            break;
+        case OP_IGET_OBJECT:
+        case OP_IGET_OBJECT_QUICK:
+            handleInstGet(info, state, mir, false, true);
+            break;
+        case OP_IGET_WIDE:
+        case OP_IGET_WIDE_QUICK:
+            handleInstGet(info, state, mir, true, false);
+            break;
+        case OP_IPUT:
+        case OP_IPUT_OBJECT:
+        case OP_IPUT_QUICK:
+        case OP_IPUT_OBJECT_QUICK:
+            handleInstPut(info, state, mir, false, true);
+            break;
+        case OP_IPUT_BOOLEAN:
+        case OP_IPUT_BYTE:
+        case OP_IPUT_CHAR:
+        case OP_IPUT_SHORT:
+            handleInstPut(info, state, mir, false, false);
+            break;
+        case OP_IPUT_WIDE:
+        case OP_IPUT_WIDE_QUICK:
+            handleInstPut(info, state, mir, true, true);
+            break;
+        case OP_IGET_VOLATILE:
+        case OP_IGET_OBJECT_VOLATILE:
+        case OP_IGET_WIDE_VOLATILE:
+            checkObject(info, state, mir, dInsn->vB);
+            killAllFieldFacts(state);
+            defineFresh(info, state, mir);
+            break;
+        case OP_IPUT_VOLATILE:
+        case OP_IPUT_OBJECT_VOLATILE:
+        case OP_IPUT_WIDE_VOLATILE:
+            checkObject(info, state, mir, dInsn->vB);
+            killAllFieldFacts(state);
+            break;
+        case OP_SGET:
+        case OP_SGET_BOOLEAN:
+        case OP_SGET_BYTE:
+        case OP_SGET_CHAR:
+        case OP_SGET_SHORT:
+            handleStaticGet(info, state, mir, false, false);
+            break;
+        case OP_SGET_OBJECT:
+            handleStaticGet(info, state, mir, false, true);
+            break;
+        case OP_SGET_WIDE:
+            handleStaticGet(info, state, mir, true, false);
+            break;
+        case OP_SPUT:
+        case OP_SPUT_OBJECT:
+            handleStaticPut(info, state, mir, false, true);
+            break;
+        case OP_SPUT_BOOLEAN:
+        case OP_SPUT_BYTE:
+        case OP_SPUT_CHAR:
+        case OP_SPUT_SHORT:
+            handleStaticPut(info, state, mir, false, false);
+            break;
+        case OP_SPUT_WIDE:
+            handleStaticPut(info, state, mir, true, true);
+            break;
+        case OP_SGET_VOLATILE:
+        case OP_SGET_OBJECT_VOLATILE:
+        case OP_SGET_WIDE_VOLATILE:
+        case OP_SPUT_VOLATILE:
+        case OP_SPUT_OBJECT_VOLATILE:
+        case OP_SPUT_WIDE_VOLATILE:
+        case OP_MONITOR_ENTER:
+        case OP_MONITOR_EXIT:
+        case OP_RETURN_VOID_BARRIER:
+            killAllFieldFacts(state);
+            defineFresh(info, state, mir);
+            break;
+        case OP_AGET:
+        case OP_AGET_WIDE:
+        case OP_AGET_OBJECT:
+        case OP_AGET_BOOLEAN:
+        case OP_AGET_BYTE:
+        case OP_AGET_CHAR:
+        case OP_AGET_SHORT:
+            handleArrayAccess(info, state, mir);
+            defineFresh(info, state, mir);
+            break;
+        case OP_APUT:
+        case OP_APUT_WIDE:
+        case OP_APUT_OBJECT:
+        case OP_APUT_BOOLEAN:
+        case OP_APUT_BYTE:
+        case OP_APUT_CHAR:
+        case OP_APUT_SHORT:
+            handleArrayAccess(info, state, mir);
+            break;
+        case OP_ARRAY_LENGTH: {
+            /* The length of an array never changes */
+            int arrayVN = getVN(info, state, dInsn->vB);
+            checkObject(info, state, mir, dInsn->vB);
+            setVN(info, state, dInsn->vA, arrayVN == VN_UNKNOWN ?
+                  newValueNumber(info) :
+                  lookupExpr(info, OP_ARRAY_LENGTH, arrayVN, 0, 0));
+            break;
+        }
+        case OP_NEW_INSTANCE:
+        case OP_NEW_ARRAY:
+        case OP_CONST_STRING:
+        case OP_CONST_STRING_JUMBO:
+        case OP_CONST_CLASS:
+            defineFresh(info, state, mir);
+            addCheckFact(state, kVNNonNull,
+                         getVN(info, state, dInsn->vA), 0);
+            break;
+        default:
+            /* Fully inlined invokes don't call anything */
+            if ((dexGetFlagsFromOpcode(dInsn->opcode) & kInstrInvoke) &&
+                !(mir->OptimizationFlags & MIR_INLINED)) {
+                killAllFieldFacts(state);
+            }
+            if (dInsn->opcode == OP_EXECUTE_INLINE ||
+                dInsn->opcode == OP_EXECUTE_INLINE_RANGE ||
+                dInsn->opcode == OP_INVOKE_OBJECT_INIT_RANGE) {
+                killAllFieldFacts(state);
+            }
+            handleDefinition(info, state, mir);
+            break;
+    }
+}
+
+/*
+ * Return true if "pred" reaches "bb" through a loop back edge, ie. if "bb"
+ * dominates "pred".  Loop traces are natural loops by construction.
+ */
+static bool isBackEdge(const CompilationUnit *cUnit, const BasicBlock *pred,
+                       const BasicBlock *bb)
+{
+    if (cUnit->jitMode == kJitLoop) return true;
+    if (cUnit->jitMode == kJitMethod && pred->dominators != NULL) {
+        return dvmIsBitSet(pred->dominators, bb->id);
+    }
+    return false;
+}
+
+/* Combine the states at the end of the predecessors of "bb" */
+static VNState *mergePredecessors(ValueNumberingInfo *info, BasicBlock *bb)
+{
+    CompilationUnit *cUnit = info->cUnit;
+    int numPreds = 0;
+    bool hasBackEdge = false;
+    int i;
+
+    if (info->unknownEntry[bb->id] || bb->predecessors == NULL) {
+        return newInitialState(info);
+    }
+
+    VNState **preds = (VNState **) dvmCompilerNew(sizeof(VNState *) *
+        dvmCountSetBits(bb->predecessors), false);
+
+    BitVectorIterator bvIterator;
+    dvmBitVectorIteratorInit(bb->predecessors, &bvIterator);
+    while (true) {
+        int predId = dvmBitVectorIteratorNext(&bvIterator);
+        if (predId == -1) break;
+        BasicBlock *predBB = (BasicBlock *)
+            dvmGrowableListGetElement(&cUnit->blockList, predId);
+        /* Unreachable */
+        if (!info->visited[predId]) continue;
+        if (info->outState[predId] == NULL) {
+            if (!isBackEdge(cUnit, predBB, bb)) {
+                return newInitialState(info);
+            }
+            hasBackEdge = true;
+            continue;
+        }
+        preds[numPreds++] = info->outState[predId];
+    }
+
+    if (numPreds == 0) {
+        return newInitialState(info);
+    }
+
+    VNState *state = newState(info);
+    for (i = 0; i < info->numRegs; i++) {
+        int vn = preds[0]->regVN[i];
+        int j;
+        for (j = 1; j < numPreds; j++) {
+            if (preds[j]->regVN[i] != vn) {
+                vn = newValueNumber(info);
+                break;
+            }
+        }
+        if (hasBackEdge && dvmIsBitSet(info->defRegs, i)) {
+            vn = newValueNumber(info);
+        }
+        state->regVN[i] = vn;
+    }
+
+    unsigned int idx;
+    for (idx = 0; idx < preds[0]->facts.numUsed; idx++) {
+        VNFact *fact = (VNFact *) preds[0]->facts.elemList[idx];
+        bool isField = fact->kind == kVNInstField ||
+                       fact->kind == kVNStaticField;
+        bool common = !(isField && hasBackEdge);
+        int j;
+        for (j = 1; j < numPreds && common; j++) {
+            VNFact *other = findFact(preds[j], fact->kind, fact->obj,
+                                     fact->key);
+            common = (other != NULL && sameFact(fact, other));
+        }
+        if (common) {
+            dvmInsertGrowableList(&state->facts, (intptr_t) fact);
+        }
+    }
+    return state;
+}
+
+static void addSuccessor(ValueNumberingInfo *info, BasicBlock *bb,
+                         BasicBlock *succ, bool isCatch);
+
+/* Record the blocks reachable from "bb" in post-order */
+static void recordPostOrder(ValueNumberingInfo *info, BasicBlock *bb)
+{
+    info->visited[bb->id] = true;
+
+    if (bb->taken) addSuccessor(info, bb, bb->taken, false);
+    if (bb->fallThrough) addSuccessor(info, bb, bb->fallThrough, false);
+    if (bb->successorBlockList.blockListType != kNotUsed) {
+        GrowableListIterator iterator;
+        dvmGrowableListIteratorInit(&bb->successorBlockList.blocks,
+                                    &iterator);
+        while (true) {
+            SuccessorBlockInfo *successorBlockInfo =
+                (SuccessorBlockInfo *) dvmGrowableListIteratorNext(&iterator);
+            if (successorBlockInfo == NULL) break;
+            addSuccessor(info, bb, successorBlockInfo->block,
+                         bb->successorBlockList.blockListType == kCatch);
+        }
+    }
+    dvmInsertGrowableList(&info->postOrder, (intptr_t) bb);
+}
+
+/*
+ * Exception edges leave from the middle of a block, and an edge missing
+ * from the predecessor set can't be merged - start over at such blocks.
+ */
+static void addSuccessor(ValueNumberingInfo *info, BasicBlock *bb,
+                         BasicBlock *succ, bool isCatch)
+{
+    if (isCatch || succ->predecessors == NULL ||
+        !dvmIsBitSet(succ->predecessors, bb->id)) {
+        info->unknownEntry[succ->id] = true;
+    }
+    if (!info->visited[succ->id]) {
+        recordPostOrder(info, succ);
+    }
+}
+
+/* Note every register that is written somewhere in the unit */
+static void findDefinedRegisters(ValueNumberingInfo *info)
+{
+    CompilationUnit *cUnit = info->cUnit;
+    unsigned int i;
+
+    for (i = 0; i < info->postOrder.numUsed; i++) {
+        BasicBlock *bb = (BasicBlock *) info->postOrder.elemList[i];
+        MIR *mir;
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            if (mir->ssaRep == NULL) continue;
+            int j;
+            for (j = 0; j < mir->ssaRep->numDefs; j++) {
+                int reg = DECODE_REG(
+                    dvmConvertSSARegToDalvik(cUnit, mir->ssaRep->defs[j]));
+                if (reg < info->numRegs) {
+                    dvmCompilerSetBit(info->defRegs, reg);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Remove null checks, array bounds checks and field loads that are
+ * repeated on every path through the compilation unit.  Needs the SSA
+ * representation, and has to run before register allocation.
+ */
+void dvmCompilerGlobalValueNumbering(CompilationUnit *cUnit)
+{
+    if (gDvmJit.disableOpt & (1 << kGlobalValueNumbering)) return;
+    if (cUnit->numDalvikRegisters == 0) return;
+
+    int numBlocks = cUnit->blockList.numUsed;
+    ValueNumberingInfo info;
+    int i;
+
+    memset(&info, 0, sizeof(info));
+    info.cUnit = cUnit;
+    info.numRegs = cUnit->numDalvikRegisters;
+    info.nextVN = VN_UNKNOWN + 1;
+    dvmInitGrowableList(&info.exprs, 16);
+    dvmInitGrowableList(&info.postOrder, numBlocks);
+    info.defRegs = dvmCompilerAllocBitVector(info.numRegs, false);
+    info.visited = (bool *) dvmCompilerNew(sizeof(bool) * numBlocks, true);
+    info.unknownEntry =
+        (bool *) dvmCompilerNew(sizeof(bool) * numBlocks, true);
+    info.outState =
+        (VNState **) dvmCompilerNew(sizeof(VNState *) * numBlocks, true);
+
+    recordPostOrder(&info, cUnit->entryBlock);
+    findDefinedRegisters(&info);
+
+    for (i = info.postOrder.numUsed - 1; i >= 0; i--) {
+        BasicBlock *bb = (BasicBlock *) info.postOrder.elemList[i];
+        VNState *state = mergePredecessors(&info, bb);
+        VNState *guardState = NULL;
+        MIR *mir;
+
+        for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
+            /*
+             * The bodies inlined under class guards are alternatives, and the
+             * slow invoke runs when none of them did. Each one starts from
+             * the state right after the first guard.
+             */
+            if ((int) mir->dalvikInsn.opcode == kMirOpCheckInlinePrediction) {
+                if (guardState != NULL) {
+                    state = copyState(&info, guardState);
+                }
+                processMIR(&info, state, mir);
+                if (guardState == NULL) {
+                    guardState = copyState(&info, state);
+                }
+                continue;
+            }
+            if (guardState != NULL &&
+                (mir->OptimizationFlags & MIR_INLINED_PRED)) {
+                state = copyState(&info, guardState);
+                guardState = NULL;
+            }
+            processMIR(&info, state, mir);
+        }
+        info.outState[bb->id] = state;
+    }
+
+    /* Several compiler threads may be finishing a unit at once */
+    android_atomic_add(info.numNullChecks, &gDvmJit.numNullChecksEliminated);
+    android_atomic_add(info.numRangeChecks,
+                       &gDvmJit.numRangeChecksEliminated);
+    android_atomic_add(info.numLoads, &gDvmJit.numLoadsEliminated);
+
+    if (cUnit->printMe) {
+        ALOGD("GVN: removed %d null checks, %d range checks, %d loads",
+              info.numNullChecks, info.numRangeChecks, info.numLoads);
+    }
+}
@@ -180,7 +180,9 @@ static void storeValue(CompilationUnit *cUnit, RegLocation rlDest,
         dvmCompilerClobber(cUnit, rlDest.lowReg);
     } else {
         dvmCompilerResetDefLoc(cUnit, rlDest);
-        if (dvmCompilerLiveOut(cUnit, rlDest.sRegLow)) {
+        /* Promoted values are written back on the loop exits */
+        if (dvmCompilerLiveOut(cUnit, rlDest.sRegLow) &&
+            !dvmCompilerIsPinned(cUnit, rlDest.lowReg)) {
             defStart = (LIR *)cUnit->lastLIRInsn;
             int vReg = dvmCompilerS2VReg(cUnit, rlDest.sRegLow);
             storeBaseDisp(cUnit, rFP, vReg << 2, rlDest.lowReg, kWord);
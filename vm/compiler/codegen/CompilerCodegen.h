@@ -54,9 +54,18 @@ void dvmCompilerCodegenDump(CompilationUnit *cUnit);
 /* Implemented in the codegen/<target>/Assembler.c */
 void dvmCompilerPatchInlineCache(void);
 
+/* Implemented in the codegen/<target>/Assembler.c */
+void dvmCompilerFlushChainPatches(void);
+
 /* Implemented in codegen/<target>/Ralloc.c */
 void dvmCompilerLocalRegAlloc(CompilationUnit *cUnit);
 
+/* Keep the hottest Dalvik registers of a loop in physical registers */
+void dvmCompilerLoopRegAlloc(CompilationUnit *cUnit);
+
+/* Implemented in codegen/<target>/<isa>/Ralloc.c */
+int dvmCompilerGetLoopPromotionRegs(int *regs, int maxRegs);
+
 /* Implemented in codegen/<target>/Thumb<version>Util.c */
 void dvmCompilerInitializeRegAlloc(CompilationUnit *cUnit);
 
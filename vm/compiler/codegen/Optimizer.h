@@ -33,6 +33,10 @@ enum optControlVector {
 #ifndef WITH_QC_PERF
     kShiftArithmetic,
 #endif
+    kLoopRegPromotion,
+    kLoopCodeMotion,
+    kGlobalValueNumbering,
+    kLoopVectorization,
 };
 
 /* Forward declarations */
@@ -187,6 +187,11 @@ extern int dvmCompilerAllocFreeTemp(CompilationUnit *cUnit);
  */
 extern void dvmCompilerLockTemp(CompilationUnit *cUnit, int reg);
 
+/* Reserve a register as the loop-long home of a promoted Dalvik reg */
+extern void dvmCompilerPinReg(CompilationUnit *cUnit, int reg);
+
+extern bool dvmCompilerIsPinned(CompilationUnit *cUnit, int reg);
+
 extern RegLocation dvmCompilerWideToNarrow(CompilationUnit *cUnit,
                                            RegLocation rl);
 
@@ -65,6 +65,7 @@ extern void dvmCompilerInitPool(RegisterInfo *regs, int *regNums, int num)
         regs[i].live = false;
         regs[i].dirty = false;
         regs[i].sReg = INVALID_SREG;
+        regs[i].pinned = false;
     }
 }
 
@@ -73,9 +74,10 @@ static void dumpRegPool(RegisterInfo *p, int numRegs)
     int i;
     ALOGE("================================================");
     for (i=0; i < numRegs; i++ ){
-        ALOGE("R[%d]: U:%d, P:%d, part:%d, LV:%d, D:%d, SR:%d, ST:%x, EN:%x",
-           p[i].reg, p[i].inUse, p[i].pair, p[i].partner, p[i].live,
-           p[i].dirty, p[i].sReg,(int)p[i].defStart, (int)p[i].defEnd);
+        ALOGE("R[%d]: U:%d, P:%d, part:%d, LV:%d, D:%d, SR:%d, ST:%x, EN:%x, "
+              "PN:%d", p[i].reg, p[i].inUse, p[i].pair, p[i].partner,
+              p[i].live, p[i].dirty, p[i].sReg, (int)p[i].defStart,
+              (int)p[i].defEnd, p[i].pinned);
     }
     ALOGE("================================================");
 }
@@ -139,6 +141,10 @@ static bool clobberRegBody(CompilationUnit *cUnit, RegisterInfo *p,
     int i;
     for (i=0; i< numTemps; i++) {
         if (p[i].reg == reg) {
+            /* The promoted value is about to be overwritten */
+            if (p[i].pinned) {
+                cUnit->promotionFailed = true;
+            }
             if (p[i].live && p[i].dirty) {
                 if (p[i].pair) {
                     dvmCompilerFlushRegWide(cUnit, p[i].reg, p[i].partner);
@@ -171,11 +177,16 @@ void dvmCompilerClobber(CompilationUnit *cUnit, int reg)
     }
 }
 
-static void clobberSRegBody(RegisterInfo *p, int numTemps, int sReg)
+static void clobberSRegBody(CompilationUnit *cUnit, RegisterInfo *p,
+                            int numTemps, int sReg)
 {
     int i;
     for (i=0; i< numTemps; i++) {
         if (p[i].sReg == sReg) {
+            /* Another register is taking over a promoted value */
+            if (p[i].pinned && p[i].live) {
+                cUnit->promotionFailed = true;
+            }
             p[i].live = false;
             p[i].defStart = NULL;
             p[i].defEnd = NULL;
@@ -186,10 +197,10 @@ static void clobberSRegBody(RegisterInfo *p, int numTemps, int sReg)
 /* Clobber any temp associated with an sReg.  Could be in either class */
 extern void dvmCompilerClobberSReg(CompilationUnit *cUnit, int sReg)
 {
-    clobberSRegBody(cUnit->regPool->coreTemps, cUnit->regPool->numCoreTemps,
-                    sReg);
-    clobberSRegBody(cUnit->regPool->FPTemps, cUnit->regPool->numFPTemps,
-                    sReg);
+    clobberSRegBody(cUnit, cUnit->regPool->coreTemps,
+                    cUnit->regPool->numCoreTemps, sReg);
+    clobberSRegBody(cUnit, cUnit->regPool->FPTemps,
+                    cUnit->regPool->numFPTemps, sReg);
 }
 
 static int allocTempBody(CompilationUnit *cUnit, RegisterInfo *p, int numTemps,
@@ -200,7 +211,7 @@ static int allocTempBody(CompilationUnit *cUnit, RegisterInfo *p, int numTemps,
     for (i=0; i< numTemps; i++) {
         if (next >= numTemps)
             next = 0;
-        if (!p[next].inUse && !p[next].live) {
+        if (!p[next].inUse && !p[next].live && !p[next].pinned) {
             dvmCompilerClobber(cUnit, p[next].reg);
             p[next].inUse = true;
             p[next].pair = false;
@@ -213,7 +224,7 @@ static int allocTempBody(CompilationUnit *cUnit, RegisterInfo *p, int numTemps,
     for (i=0; i< numTemps; i++) {
         if (next >= numTemps)
             next = 0;
-        if (!p[next].inUse) {
+        if (!p[next].inUse && !p[next].pinned) {
             dvmCompilerClobber(cUnit, p[next].reg);
             p[next].inUse = true;
             p[next].pair = false;
@@ -416,6 +427,9 @@ extern void dvmCompilerLockTemp(CompilationUnit *cUnit, int reg)
     int i;
     for (i=0; i< numTemps; i++) {
         if (p[i].reg == reg) {
+            if (p[i].pinned) {
+                cUnit->promotionFailed = true;
+            }
             p[i].inUse = true;
             p[i].live = false;
             return;
@@ -556,11 +570,21 @@ extern void dvmCompilerResetDefTracking(CompilationUnit *cUnit)
     }
 }
 
+/*
+ * Forget the contents of all temps.  Registers holding promoted values
+ * keep them, but whether the frame is up to date depends on how we got
+ * here, so they are treated as dirty.
+ */
 extern void dvmCompilerClobberAllRegs(CompilationUnit *cUnit)
 {
     int i;
     for (i=0; i< cUnit->regPool->numCoreTemps; i++) {
-        dvmCompilerClobber(cUnit, cUnit->regPool->coreTemps[i].reg);
+        RegisterInfo *info = &cUnit->regPool->coreTemps[i];
+        if (info->pinned) {
+            info->dirty = info->live;
+            continue;
+        }
+        dvmCompilerClobber(cUnit, info->reg);
     }
     for (i=0; i< cUnit->regPool->numFPTemps; i++) {
         dvmCompilerClobber(cUnit, cUnit->regPool->FPTemps[i].reg);
@@ -656,6 +680,26 @@ extern void dvmCompilerMarkInUse(CompilationUnit *cUnit, int reg)
           info->inUse = true;
 }
 
+/*
+ * Make "reg" the home of a Dalvik register promoted by
+ * dvmCompilerLoopRegAlloc().  It leaves the temp pool for the rest of the
+ * compilation, and its liveness survives block boundaries.  Any later
+ * attempt to clobber or lock it sets cUnit->promotionFailed.
+ */
+extern void dvmCompilerPinReg(CompilationUnit *cUnit, int reg)
+{
+    dvmCompilerClobber(cUnit, reg);
+    RegisterInfo *info = getRegInfo(cUnit, reg);
+    info->pinned = true;
+    info->inUse = false;
+}
+
+extern bool dvmCompilerIsPinned(CompilationUnit *cUnit, int reg)
+{
+    RegisterInfo *info = dvmCompilerIsTemp(cUnit, reg);
+    return info != NULL && info->pinned;
+}
+
 static void copyRegInfo(CompilationUnit *cUnit, int newReg, int oldReg)
 {
     RegisterInfo *newInfo = getRegInfo(cUnit, newReg);
@@ -807,8 +851,11 @@ extern RegLocation dvmCompilerEvalLoc(CompilationUnit *cUnit, RegLocation loc,
             /* Wrong register class.  Realloc, copy and transfer ownership */
             newReg = dvmCompilerAllocTypedTemp(cUnit, loc.fp, regClass);
             dvmCompilerRegCopy(cUnit, newReg, loc.lowReg);
-            copyRegInfo(cUnit, newReg, loc.lowReg);
-            dvmCompilerClobber(cUnit, loc.lowReg);
+            /* A promoted value stays put - hand out an anonymous copy */
+            if (!getRegInfo(cUnit, loc.lowReg)->pinned) {
+                copyRegInfo(cUnit, newReg, loc.lowReg);
+                dvmCompilerClobber(cUnit, loc.lowReg);
+            }
             loc.lowReg = newReg;
         }
         return loc;
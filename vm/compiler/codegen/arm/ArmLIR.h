@@ -109,6 +109,7 @@ typedef struct RegisterInfo {
     int sReg;                   // Name of live value
     struct LIR *defStart;       // Starting inst in last def sequence
     struct LIR *defEnd;         // Ending inst in last def sequence
+    bool pinned;                // Home of a promoted Dalvik reg
 } RegisterInfo;
 
 typedef struct RegisterPool {
@@ -909,7 +909,8 @@ ArmEncodingMap EncodingMap[kArmLast] = {
 /* Write the numbers in the constant and class pool to the output stream */
 static void installLiteralPools(CompilationUnit *cUnit)
 {
-    int *dataPtr = (int *) ((char *) cUnit->baseAddr + cUnit->dataOffset);
+    int *dataPtr = (int *) CODE_CACHE_RW((char *) cUnit->baseAddr +
+                                         cUnit->dataOffset);
     /* Install number of class pointer literals */
     *dataPtr++ = cUnit->numClassPointers;
     ArmLIR *dataLIR = (ArmLIR *) cUnit->classPointerList;
@@ -1394,6 +1395,7 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
     int descSize = (cUnit->jitMode == kJitMethod) ?
         0 : getTraceDescriptionSize(cUnit->traceDesc);
     int chainingCellGap = 0;
+    intptr_t startAddr;
 
     info->instructionSet = cUnit->instructionSet;
 
@@ -1461,12 +1463,6 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 
     cUnit->totalSize = offset;
 
-    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheSize) {
-        gDvmJit.codeCacheFull = true;
-        info->discardResult = true;
-        return;
-    }
-
     /* Allocate enough space for the code block */
     cUnit->codeBuffer = (unsigned char *)dvmCompilerNew(chainCellOffset, true);
     if (cUnit->codeBuffer == NULL) {
@@ -1475,12 +1471,20 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         return;
     }
 
+reassemble:
+    startAddr = (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
+    if (startAddr + cUnit->totalSize >
+        (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheSize) {
+        gDvmJit.codeCacheFull = true;
+        info->discardResult = true;
+        return;
+    }
+
     /*
      * Attempt to assemble the trace.  Note that assembleInstructions
      * may rewrite the code sequence and request a retry.
      */
-    cUnit->assemblerStatus = assembleInstructions(cUnit,
-          (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed);
+    cUnit->assemblerStatus = assembleInstructions(cUnit, startAddr);
 
     switch(cUnit->assemblerStatus) {
         case kSuccess:
@@ -1530,13 +1534,24 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         return;
     }
 
+    /*
+     * Another compiler worker may have installed its code since the trace
+     * was assembled.  Calls into the templates are PC-relative, so assemble
+     * again against the new end of the code cache.
+     */
+    if (startAddr !=
+        (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed) {
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        goto reassemble;
+    }
+
     cUnit->baseAddr = (char *) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
     gDvmJit.codeCacheByteUsed += offset;
 
     UNPROTECT_CODE_CACHE(cUnit->baseAddr, offset);
 
     /* Install the code block */
-    memcpy((char*)cUnit->baseAddr, cUnit->codeBuffer, chainCellOffset);
+    memcpy(CODE_CACHE_RW(cUnit->baseAddr), cUnit->codeBuffer, chainCellOffset);
     gDvmJit.numCompilations++;
 
     if (cUnit->jitMode != kJitMethod) {
@@ -1551,11 +1566,11 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         assert((cUnit->chainingCellExtraSize & 0x3) ==0);
         chainCellCounts.extraSize = cUnit->chainingCellExtraSize >> 2;
 
-        memcpy((char*)cUnit->baseAddr + chainCellOffset, &chainCellCounts,
-               sizeof(chainCellCounts));
+        memcpy((char*) CODE_CACHE_RW(cUnit->baseAddr) + chainCellOffset,
+               &chainCellCounts, sizeof(chainCellCounts));
 
         /* Install the trace description */
-        memcpy((char*) cUnit->baseAddr + chainCellOffset +
+        memcpy((char*) CODE_CACHE_RW(cUnit->baseAddr) + chainCellOffset +
                        sizeof(chainCellCounts),
                cUnit->traceDesc, descSize);
     }
@@ -1609,6 +1624,74 @@ static u4 assembleChainingBranch(int branchOffset, bool thumbTarget)
     return thumb2<<16 | thumb1;
 }
 
+/*
+ * Install the chaining branches queued by dvmJitChain, flushing the I/D
+ * cache once for the whole batch when the cells are close together.
+ * Caller must hold compilerICPatchLock.
+ */
+static void installChainPatches(void)
+{
+    int i;
+    u4 *minAddr, *maxAddr;
+
+    /* Nothing to be done */
+    if (gDvmJit.chainPatchIndex == 0) return;
+
+    /* Same conditions as dvmJitChain - they may have changed since */
+    if ((gDvmJit.pProfTable == NULL) || (gDvm.sumThreadSuspendCount != 0) ||
+        gDvmJit.codeCacheFull) {
+        gDvmJit.chainPatchIndex = 0;
+        return;
+    }
+
+    UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+
+    /* Initialize the min/max address range */
+    minAddr = (u4 *) ((char *) gDvmJit.codeCache + gDvmJit.codeCacheSize);
+    maxAddr = (u4 *) gDvmJit.codeCache;
+
+    for (i = 0; i < gDvmJit.chainPatchIndex; i++) {
+        u4 *branchAddr = gDvmJit.chainPatchQueue[i].branchAddr;
+
+        *(u4 *) CODE_CACHE_RW(branchAddr) = gDvmJit.chainPatchQueue[i].newInst;
+        minAddr = (branchAddr < minAddr) ? branchAddr : minAddr;
+        maxAddr = (branchAddr > maxAddr) ? branchAddr : maxAddr;
+    }
+
+    /* Then synchronize the I/D cache */
+    if ((char *) (maxAddr + 1) - (char *) minAddr <=
+        COMPILER_CHAIN_PATCH_FLUSH_SPAN) {
+        dvmCompilerCacheFlush((long) minAddr, (long) (maxAddr + 1), 0);
+    } else {
+        for (i = 0; i < gDvmJit.chainPatchIndex; i++) {
+            u4 *branchAddr = gDvmJit.chainPatchQueue[i].branchAddr;
+            dvmCompilerCacheFlush((long) branchAddr, (long) (branchAddr + 1),
+                                  0);
+        }
+    }
+    UPDATE_CODE_CACHE_PATCHES();
+
+    PROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
+
+    gDvmJit.translationChains += gDvmJit.chainPatchIndex;
+    gDvmJit.chainPatchIndex = 0;
+    gDvmJit.hasNewChain = true;
+#if defined(WITH_JIT_TUNING)
+    gDvmJit.chainPatchFlushes++;
+#endif
+}
+
+/* Install any chaining branches still waiting for a batch */
+void dvmCompilerFlushChainPatches(void)
+{
+    /* Nothing to be done */
+    if (gDvmJit.chainPatchIndex == 0) return;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    installChainPatches();
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+}
+
 /*
  * Perform translation chain operation.
  * For ARM, we'll use a pair of thumb instructions to generate
@@ -1621,6 +1704,11 @@ static u4 assembleChainingBranch(int branchOffset, bool thumbTarget)
  * 22-bit branch offset.
  * If the target is nearby, use a single-instruction bl.
  * If one or more threads is suspended, don't chain.
+ *
+ * The branch is not written right away but queued, and the queue is
+ * installed as one batch when it fills up, when a queued cell is hit
+ * again, or after the next compilation.  Until then the cell keeps going
+ * through the slower unchained path.
  */
 void* dvmJitChain(void* tgtAddr, u4* branchAddr)
 {
@@ -1628,6 +1716,8 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
     int branchOffset = (int) tgtAddr - baseAddr;
     u4 newInst;
     bool thumbTarget;
+    bool flush;
+    int i;
 
     /*
      * Only chain translations when there is no urge to ask all threads to
@@ -1637,8 +1727,6 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
         (gDvmJit.codeCacheFull == false)) {
         assert((branchOffset >= -(1<<22)) && (branchOffset <= ((1<<22)-2)));
 
-        gDvmJit.translationChains++;
-
         COMPILER_TRACE_CHAINING(
             ALOGD("Jit Runtime: chaining %#x to %#x",
                  (int) branchAddr, (int) tgtAddr & -2));
@@ -1662,15 +1750,27 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
         assert( ((*branchAddr >> 16) == getSkeleton(kThumbOrr)) ||
                 ((*branchAddr >> 16) == (newInst >> 16)));
 
-        UNPROTECT_CODE_CACHE(branchAddr, sizeof(*branchAddr));
+        dvmLockMutex(&gDvmJit.compilerICPatchLock);
 
-        *branchAddr = newInst;
-        dvmCompilerCacheFlush((long)branchAddr, (long)branchAddr + 4, 0);
-        UPDATE_CODE_CACHE_PATCHES();
-
-        PROTECT_CODE_CACHE(branchAddr, sizeof(*branchAddr));
+        /* A queued cell that is hit again is hot - don't hold it back */
+        flush = false;
+        for (i = 0; i < gDvmJit.chainPatchIndex; i++) {
+            if (gDvmJit.chainPatchQueue[i].branchAddr == branchAddr) {
+                flush = true;
+                break;
+            }
+        }
+        if (!flush) {
+            i = gDvmJit.chainPatchIndex++;
+            gDvmJit.chainPatchQueue[i].branchAddr = branchAddr;
+            gDvmJit.chainPatchQueue[i].newInst = newInst;
+            flush = gDvmJit.chainPatchIndex == COMPILER_CHAIN_PATCH_QUEUE_SIZE;
+        }
+        if (flush) {
+            installChainPatches();
+        }
 
-        gDvmJit.hasNewChain = true;
+        dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
     }
 
     return tgtAddr;
@@ -1684,6 +1784,9 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
 static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
                                     PredictedChainingCell *newContent)
 {
+    PredictedChainingCell *cellRW =
+        (PredictedChainingCell *) CODE_CACHE_RW(cellAddr);
+
     /*
      * Make sure only one thread gets here since updating the cell (ie fast
      * path and queueing the request (ie the queued path) have to be done
@@ -1697,14 +1800,14 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
 
         UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
 
-        cellAddr->method = newContent->method;
-        cellAddr->branch = newContent->branch;
+        cellRW->method = newContent->method;
+        cellRW->branch = newContent->branch;
         /*
          * The update order matters - make sure clazz is updated last since it
          * will bring the uninitialized chaining cell to life.
          */
         android_atomic_release_store((int32_t)newContent->clazz,
-            (volatile int32_t *)(void *)&cellAddr->clazz);
+            (volatile int32_t *)(void *)&cellRW->clazz);
         dvmCompilerCacheFlush((intptr_t) cellAddr, (intptr_t) (cellAddr+1), 0);
         UPDATE_CODE_CACHE_PATCHES();
 
@@ -1718,7 +1821,7 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
         /* Not proven to be frequent yet - build up the filter cache */
         UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
 
-        cellAddr->stagedClazz = newContent->clazz;
+        cellRW->stagedClazz = newContent->clazz;
 
         UPDATE_CODE_CACHE_PATCHES();
         PROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
@@ -1733,7 +1836,7 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
     } else if (cellAddr->method == newContent->method) {
         UNPROTECT_CODE_CACHE(cellAddr, sizeof(*cellAddr));
 
-        cellAddr->clazz = newContent->clazz;
+        cellRW->clazz = newContent->clazz;
         /* No need to flush the cache here since the branch is not patched */
         UPDATE_CODE_CACHE_PATCHES();
 
@@ -1774,21 +1877,25 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
  * This method is called from the invoke templates for virtual and interface
  * methods to speculatively setup a chain to the callee. The templates are
  * written in assembly and have setup method, cell, and clazz at r0, r2, and
- * r3 respectively, so there is a unused argument in the list. Upon return one
- * of the following three results may happen:
+ * r3 respectively, and the call site passes its Dalvik PC in r1. The receiver
+ * class is first recorded in the call site profile. Upon return one of the
+ * following results may happen:
  *   1) Chain is not setup because the callee is native. Reset the rechain
  *      count to a big number so that it will take a long time before the next
  *      rechain attempt to happen.
  *   2) Chain is not setup because the callee has not been created yet. Reset
  *      the rechain count to a small number and retry in the near future.
- *   3) Enqueue the new content for the chaining cell which will be appled in
+ *   3) Chain is not setup because the site is megamorphic. The cell keeps
+ *      its current content and the misses go through the vtable.
+ *   4) Enqueue the new content for the chaining cell which will be appled in
  *      next safe point.
  */
 const Method *dvmJitToPatchPredictedChain(const Method *method,
-                                          Thread *self,
+                                          const u2 *dPC,
                                           PredictedChainingCell *cell,
                                           const ClassObject *clazz)
 {
+    Thread *self = dvmThreadSelf();
     int newRechainCount = PREDICTED_CHAIN_COUNTER_RECHAIN;
 #if defined(WITH_SELF_VERIFICATION)
     newRechainCount = PREDICTED_CHAIN_COUNTER_AVOID;
@@ -1804,12 +1911,26 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
          * trigger immediate patching and will continue to fail to match with
          * a real clazz pointer.
          */
-        cell->clazz = (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ;
+        ((PredictedChainingCell *) CODE_CACHE_RW(cell))->clazz =
+            (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ;
 
         UPDATE_CODE_CACHE_PATCHES();
         PROTECT_CODE_CACHE(cell, sizeof(*cell));
         goto done;
     }
+
+    /*
+     * The site has seen too many receiver classes for any one of them to
+     * stay in the cell for long. Leave the cell alone and let the misses go
+     * through the vtable, rather than queueing a patch on every rechain.
+     */
+    if (dvmJitRecordReceiverClass(dPC, clazz, method)) {
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokeMegamorphic++;
+#endif
+        goto done;
+    }
+
     tgtAddr = (int) dvmJitGetTraceAddr(method->insns);
 
     /*
@@ -1899,7 +2020,7 @@ void dvmCompilerPatchInlineCache(void)
                  cellContent->method->name));
 
         /* Patch the chaining cell */
-        *cellAddr = *cellContent;
+        *(PredictedChainingCell *) CODE_CACHE_RW(cellAddr) = *cellContent;
         minAddr = (cellAddr < minAddr) ? cellAddr : minAddr;
         maxAddr = (cellAddr > maxAddr) ? cellAddr : maxAddr;
     }
@@ -1962,10 +2083,11 @@ static u4* unchainSingle(JitEntry *trace)
                     newInst = *pChainCells;
                     newInst &= 0xFFFF0000;
                     newInst |= getSkeleton(kThumbBUncond); /* b offset is 0 */
-                    *pChainCells = newInst;
+                    *(u4 *) CODE_CACHE_RW(pChainCells) = newInst;
                     break;
                 case kChainingCellInvokePredicted:
-                    predChainCell = (PredictedChainingCell *) pChainCells;
+                    predChainCell =
+                        (PredictedChainingCell *) CODE_CACHE_RW(pChainCells);
                     /*
                      * There could be a race on another mutator thread to use
                      * this particular predicted cell and the check has passed
@@ -1992,6 +2114,12 @@ void dvmJitUnchainAll()
 {
     u4* lowAddress = NULL;
     u4* highAddress = NULL;
+
+    /* Drop the chains that have not been installed yet */
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    gDvmJit.chainPatchIndex = 0;
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+
     if (gDvmJit.pJitEntryTable != NULL) {
         COMPILER_TRACE_CHAINING(LOGD("Jit Runtime: unchaining all"));
         dvmLockMutex(&gDvmJit.tableLock);
@@ -2248,7 +2376,7 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
                 if (cell->clazz != NULL &&
                     cell->clazz !=
                       (ClassObject *) PREDICTED_CHAIN_FAKE_CLAZZ) {
-                    callback(&cell->clazz);
+                    callback(CODE_CACHE_RW(&cell->clazz));
                 }
                 pChainCells += CHAIN_CELL_PREDICTED_SIZE >> 2;
             }
@@ -2261,7 +2389,7 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
     int *classPointerP = (int *) ((char *) desc + descSize);
     int numClassPointers = *classPointerP++;
     for (; numClassPointers; numClassPointers--, classPointerP++) {
-        callback(classPointerP);
+        callback(CODE_CACHE_RW(classPointerP));
     }
 }
 
@@ -2272,12 +2400,16 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
  */
 void dvmJitScanAllClassPointers(void (*callback)(void *))
 {
+    int i;
+
     UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
 
-    /* Handle the inflight compilation first */
-    if (gDvmJit.inflightBaseAddr)
-        findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr,
-                                     callback);
+    /* Handle the inflight compilations first */
+    for (i = 0; i < COMPILER_MAX_THREADS; i++) {
+        if (gDvmJit.inflightBaseAddr[i])
+            findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr[i],
+                                         callback);
+    }
 
     if (gDvmJit.pJitEntryTable != NULL) {
         unsigned int traceIdx;
@@ -2321,7 +2453,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * thread if there is a pending request before the state is actually
      * changed to RUNNING.
      */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_RUNNING);
+    dvmChangeStatus(dvmThreadSelf(), THREAD_RUNNING);
 
     /*
      * Unprotecting the code cache will need to acquire the code cache
@@ -2342,7 +2474,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
         ClassObject *clazz = dvmFindClassNoInit(
             callsiteInfo->classDescriptor, callsiteInfo->classLoader);
         assert(!strcmp(clazz->descriptor, callsiteInfo->classDescriptor));
-        *classPointerP++ = (intptr_t) clazz;
+        *(intptr_t *) CODE_CACHE_RW(classPointerP++) = (intptr_t) clazz;
     }
 
     /*
@@ -2351,7 +2483,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * in the JIT table, its content can be patched if class objects are
      * moved.
      */
-    gDvmJit.inflightBaseAddr = base;
+    gDvmJit.inflightBaseAddr[dvmCompilerWorkerId()] = base;
 
 #if defined(WITH_JIT_TUNING)
     u8 blockTime = dvmGetRelativeTimeUsec() - startTime;
@@ -2365,7 +2497,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
     PROTECT_CODE_CACHE(startClassPointerP, numClassPointers * sizeof(intptr_t));
 
     /* Change the thread state back to VMWAIT */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_VMWAIT);
+    dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
 }
 
 #if defined(WITH_SELF_VERIFICATION)
@@ -316,8 +316,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -345,8 +347,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -370,8 +374,10 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
@@ -396,8 +402,10 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, kISHST);
@@ -1303,10 +1311,11 @@ static void genInvokeVirtualCommon(CompilationUnit *cUnit, MIR *mir,
 
     LOAD_FUNC_ADDR(cUnit, r7, (int) dvmJitToPatchPredictedChain);
 
-    genRegCopy(cUnit, r1, r6SELF);
+    genRegCopy(cUnit, r1, r4PC);
 
     /*
      * r0 = calleeMethod
+     * r1 = dPC
      * r2 = &predictedChainingCell
      * r3 = class
      *
@@ -2120,8 +2129,10 @@ static bool handleFmt12x(CompilationUnit *cUnit, MIR *mir)
         case OP_ARRAY_LENGTH: {
             int lenOffset = OFFSETOF_MEMBER(ArrayObject, length);
             rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
-            genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
-                         mir->offset, NULL);
+            if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+                genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
+                             mir->offset, NULL);
+            }
             rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
             loadWordDisp(cUnit, rlSrc.lowReg, lenOffset,
                          rlResult.lowReg);
@@ -2937,22 +2948,25 @@ static u8 findSparseSwitchIndex(const u2* switchData, int testVal, uintptr_t pc)
     assert(((u4)entries & 0x3) == 0);
 
     /*
-     * Run through the list of keys, which are guaranteed to
-     * be sorted low-to-high.
-     *
-     * Most tables have 3-4 entries.  Few have more than 10.  A binary
-     * search here is probably not useful.
+     * Binary-search the keys, which are guaranteed to be sorted
+     * low-to-high.  Most tables only have a few entries, but the ones
+     * generated for protocol decoders can have hundreds.
      */
-    for (i = 0; i < size; i++) {
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi) {
+        i = (lo + hi) >> 1;
         int k = keys[i];
-        if (k == testVal) {
+        if (k < testVal) {
+            lo = i + 1;
+        } else if (k > testVal) {
+            hi = i - 1;
+        } else {
             /* MAX_CHAINED_SWITCH_CASES + 1 is the start of the overflow case */
             int jumpIndex = (i < MAX_CHAINED_SWITCH_CASES) ?
                            i : MAX_CHAINED_SWITCH_CASES + 1;
             chainingPC += jumpIndex * CHAIN_CELL_NORMAL_SIZE;
             return (((u8) entries[i]) << 32) | (u8) chainingPC;
-        } else if (k > testVal) {
-            break;
         }
     }
     return chainingPC + MIN(size, MAX_CHAINED_SWITCH_CASES) *
@@ -3022,7 +3036,8 @@ static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
  * genValidationForPredictedInline function. The function here takes care the
  * branch over at 0x4858de78 and the misprediction target at 0x4858de7a.
  */
-static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
+static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit,
+                                               CallsiteInfo *callsiteInfo,
                                                BasicBlock *bb,
                                                ArmLIR *labelList)
 {
@@ -3045,7 +3060,7 @@ static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
     ArmLIR *target = newLIR0(cUnit, kArmPseudoTargetLabel);
     target->defMask = ENCODE_ALL;
     /* Hook up the target to the verification branch */
-    mir->meta.callsiteInfo->misPredBranchOver->target = (LIR *) target;
+    callsiteInfo->misPredBranchOver->target = (LIR *) target;
 }
 
 static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
@@ -3081,7 +3096,9 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_VIRTUAL)
@@ -3258,7 +3275,9 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_INTERFACE)
@@ -3361,12 +3380,13 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
 
             LOAD_FUNC_ADDR(cUnit, r7, (int) dvmJitToPatchPredictedChain);
 
-            genRegCopy(cUnit, r1, r6SELF);
+            genRegCopy(cUnit, r1, r4PC);
             genRegCopy(cUnit, r2, r9);
             genRegCopy(cUnit, r3, r10);
 
             /*
              * r0 = calleeMethod
+             * r1 = dPC
              * r2 = &predictedChainingCell
              * r3 = class
              *
@@ -3434,7 +3454,9 @@ static bool handleFmt35ms_3rms(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_VIRTUAL_QUICK)
@@ -3968,6 +3990,40 @@ static void handlePCReconstructionExtended(CompilationUnit *cUnit)
     }
 }
 
+/*
+ * Load the Dalvik registers promoted by dvmCompilerLoopRegAlloc() into
+ * their registers.  From here on the registers are the home locations, so
+ * the PC reconstruction cells created afterwards write them back.
+ */
+static void genLoopRegLoad(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    int i;
+
+    for (i = 0; i < loopAnalysis->numPromotions; i++) {
+        LoopPromotion *promotion = &loopAnalysis->promotions[i];
+        dvmCompilerPinReg(cUnit, promotion->physReg);
+        loadWordDisp(cUnit, rFP, promotion->vReg << 2, promotion->physReg);
+        dvmCompilerMarkLive(cUnit, promotion->physReg, promotion->vReg);
+    }
+    loopAnalysis->firstPromotedPCR = cUnit->pcReconstructionList.numUsed;
+}
+
+/* Store the promoted registers the loop body may have changed */
+static void genLoopRegWriteBack(CompilationUnit *cUnit)
+{
+    LoopAnalysis *loopAnalysis = cUnit->loopAnalysis;
+    int i;
+
+    for (i = 0; i < loopAnalysis->numPromotions; i++) {
+        LoopPromotion *promotion = &loopAnalysis->promotions[i];
+        if (promotion->isDefined) {
+            storeWordDisp(cUnit, rFP, promotion->vReg << 2,
+                          promotion->physReg);
+        }
+    }
+}
+
 /* Load the Dalvik PC into r0 and jump to the specified target */
 static void handlePCReconstruction(CompilationUnit *cUnit,
                                    ArmLIR *targetLabel)
@@ -3990,6 +4046,11 @@ static void handlePCReconstruction(CompilationUnit *cUnit,
 
     for (i = 0; i < numElems; i++) {
         dvmCompilerAppendLIR(cUnit, (LIR *) pcrLabel[i]);
+        /* Cells in the loop body punt with promoted values in registers */
+        if (cUnit->jitMode == kJitLoop &&
+            i >= cUnit->loopAnalysis->firstPromotedPCR) {
+            genLoopRegWriteBack(cUnit);
+        }
         /* r0 = dalvik PC */
         loadConstant(cUnit, r0, pcrLabel[i]->operands[0]);
         genUnconditionalBranch(cUnit, targetLabel);
@@ -4003,6 +4064,10 @@ static const char *extendedMIROpNames[kMirOpLast - kMirOpFirst] = {
     "kMirOpLowerBound",
     "kMirOpPunt",
     "kMirOpCheckInlinePrediction",
+    "kMirOpLoopRegLoad",
+    "kMirOpLoopRegStore",
+    "kMirOpNullCheck",
+    "kMirOpVectorLoop",
 };
 
 
@@ -4144,6 +4209,25 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
                    (ArmLIR *) cUnit->loopAnalysis->branchToPCR);
 }
 
+/*
+ * vA = objReg;
+ *
+ * Null check for an object whose field loads were hoisted into the loop
+ * entry block.  Punt to the loop head so the interpreter raises the
+ * exception at the original instruction.
+ */
+static void genHoistedNullCheck(CompilationUnit *cUnit, MIR *mir)
+{
+    RegLocation rlObj = cUnit->regLocation[mir->dalvikInsn.vA];
+
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+    if (!dvmIsBitSet(cUnit->regPool->nullCheckedRegs, mir->dalvikInsn.vA)) {
+        dvmSetBit(cUnit->regPool->nullCheckedRegs, mir->dalvikInsn.vA);
+        genRegImmCheck(cUnit, kArmCondEq, rlObj.lowReg, 0, 0,
+                       (ArmLIR *) cUnit->loopAnalysis->branchToPCR);
+    }
+}
+
 /*
  * vC = this
  *
@@ -4233,6 +4317,16 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
     CallsiteInfo *callsiteInfo = mir->meta.callsiteInfo;
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
+    /*
+     * At a polymorphic site each further guard is where the previous one
+     * lands when its class doesn't match.
+     */
+    if (callsiteInfo->prevGuard) {
+        genLandingPadForMispredictedCallee(cUnit, callsiteInfo->prevGuard,
+                                           cUnit->curBlock,
+                                           (ArmLIR *) cUnit->labelList);
+    }
+
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
     int regPredictedClass = dvmCompilerAllocTemp(cUnit);
     loadClassPointer(cUnit, regPredictedClass, (int) callsiteInfo);
@@ -4284,6 +4378,18 @@ static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
             genValidationForPredictedInline(cUnit, mir);
             break;
         }
+        case kMirOpNullCheck: {
+            genHoistedNullCheck(cUnit, mir);
+            break;
+        }
+        case kMirOpLoopRegLoad: {
+            genLoopRegLoad(cUnit);
+            break;
+        }
+        case kMirOpLoopRegStore: {
+            genLoopRegWriteBack(cUnit);
+            break;
+        }
         default:
             break;
     }
@@ -4515,6 +4621,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
             bb = nextBB;
             bb->visited = true;
             cUnit->nextCodegenBlock = NULL;
+            cUnit->curBlock = bb;
 
             for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
 
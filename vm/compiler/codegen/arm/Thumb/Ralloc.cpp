@@ -42,3 +42,9 @@ int dvmCompilerAllocTypedTemp(CompilationUnit *cUnit, bool fpHint, int regClass)
 {
     return dvmCompilerAllocTemp(cUnit);
 }
+
+/* Only r0-r7 are cheap to use in Thumb - no loop register promotion */
+int dvmCompilerGetLoopPromotionRegs(int *regs, int maxRegs)
+{
+    return 0;
+}
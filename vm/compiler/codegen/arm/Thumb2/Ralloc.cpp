@@ -61,3 +61,22 @@ int dvmCompilerAllocTypedTemp(CompilationUnit *cUnit, bool fpHint,
         return dvmCompilerAllocTempFloat(cUnit);
     return dvmCompilerAllocTemp(cUnit);
 }
+
+/*
+ * Registers that can be the home of a promoted Dalvik register for a whole
+ * loop.  r8 and r10 survive calls to C helpers, and are only claimed by
+ * the invoke and template sequences.
+ */
+int dvmCompilerGetLoopPromotionRegs(int *regs, int maxRegs)
+{
+    static const int promotionRegs[] = {r8, r10};
+    int num = sizeof(promotionRegs) / sizeof(promotionRegs[0]);
+    int i;
+
+    if (num > maxRegs)
+        num = maxRegs;
+    for (i = 0; i < num; i++) {
+        regs[i] = promotionRegs[i];
+    }
+    return num;
+}
@@ -749,6 +749,7 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
     int descSize = (cUnit->jitMode == kJitMethod) ?
         0 : getTraceDescriptionSize(cUnit->traceDesc);
     int chainingCellGap = 0;
+    intptr_t startAddr;
 
     info->instructionSet = cUnit->instructionSet;
 
@@ -807,12 +808,6 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
 
     cUnit->totalSize = offset;
 
-    if (gDvmJit.codeCacheByteUsed + cUnit->totalSize > gDvmJit.codeCacheSize) {
-        gDvmJit.codeCacheFull = true;
-        info->discardResult = true;
-        return;
-    }
-
     /* Allocate enough space for the code block */
     cUnit->codeBuffer = (unsigned char *)dvmCompilerNew(chainCellOffset, true);
     if (cUnit->codeBuffer == NULL) {
@@ -821,12 +816,20 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         return;
     }
 
+reassemble:
+    startAddr = (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
+    if (startAddr + cUnit->totalSize >
+        (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheSize) {
+        gDvmJit.codeCacheFull = true;
+        info->discardResult = true;
+        return;
+    }
+
     /*
      * Attempt to assemble the trace.  Note that assembleInstructions
      * may rewrite the code sequence and request a retry.
      */
-    cUnit->assemblerStatus = assembleInstructions(cUnit,
-          (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed);
+    cUnit->assemblerStatus = assembleInstructions(cUnit, startAddr);
 
     switch(cUnit->assemblerStatus) {
         case kSuccess:
@@ -876,6 +879,17 @@ void dvmCompilerAssembleLIR(CompilationUnit *cUnit, JitTranslationInfo *info)
         return;
     }
 
+    /*
+     * Another compiler worker may have installed its code since the trace
+     * was assembled.  Jumps into the templates are encoded against the
+     * code address, so assemble again at the new end of the code cache.
+     */
+    if (startAddr !=
+        (intptr_t) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed) {
+        dvmUnlockMutex(&gDvmJit.compilerLock);
+        goto reassemble;
+    }
+
     cUnit->baseAddr = (char *) gDvmJit.codeCache + gDvmJit.codeCacheByteUsed;
     gDvmJit.codeCacheByteUsed += offset;
 
@@ -980,6 +994,14 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
     return tgtAddr;
 }
 
+/*
+ * The chaining branches are written right away by dvmJitChain on MIPS, so
+ * there is never a batch waiting to be installed.
+ */
+void dvmCompilerFlushChainPatches(void)
+{
+}
+
 #if !defined(WITH_SELF_VERIFICATION)
 /*
  * Attempt to enqueue a work order to patch an inline cache for a predicted
@@ -1079,14 +1101,17 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
  * This method is called from the invoke templates for virtual and interface
  * methods to speculatively setup a chain to the callee. The templates are
  * written in assembly and have setup method, cell, and clazz at r0, r2, and
- * r3 respectively, so there is a unused argument in the list. Upon return one
- * of the following three results may happen:
+ * r3 respectively, and the call site passes its Dalvik PC in r1. The receiver
+ * class is first recorded in the call site profile. Upon return one of the
+ * following results may happen:
  *   1) Chain is not setup because the callee is native. Reset the rechain
  *      count to a big number so that it will take a long time before the next
  *      rechain attempt to happen.
  *   2) Chain is not setup because the callee has not been created yet. Reset
  *      the rechain count to a small number and retry in the near future.
- *   3) Ask all other threads to stop before patching this chaining cell.
+ *   3) Chain is not setup because the site is megamorphic. The cell keeps
+ *      its current content and the misses go through the vtable.
+ *   4) Ask all other threads to stop before patching this chaining cell.
  *      This is required because another thread may have passed the class check
  *      but hasn't reached the chaining cell yet to follow the chain. If we
  *      patch the content before halting the other thread, there could be a
@@ -1094,10 +1119,11 @@ static void inlineCachePatchEnqueue(PredictedChainingCell *cellAddr,
  *      but wrong chain to invoke a different method.
  */
 const Method *dvmJitToPatchPredictedChain(const Method *method,
-                                          Thread *self,
+                                          const u2 *dPC,
                                           PredictedChainingCell *cell,
                                           const ClassObject *clazz)
 {
+    Thread *self = dvmThreadSelf();
     int newRechainCount = PREDICTED_CHAIN_COUNTER_RECHAIN;
 #if defined(WITH_SELF_VERIFICATION)
     newRechainCount = PREDICTED_CHAIN_COUNTER_AVOID;
@@ -1120,6 +1146,18 @@ const Method *dvmJitToPatchPredictedChain(const Method *method,
         goto done;
     }
 
+    /*
+     * The site has seen too many receiver classes for any one of them to
+     * stay in the cell for long. Leave the cell alone and let the misses go
+     * through the vtable, rather than queueing a patch on every rechain.
+     */
+    if (dvmJitRecordReceiverClass(dPC, clazz, method)) {
+#if defined(WITH_JIT_TUNING)
+        gDvmJit.invokeMegamorphic++;
+#endif
+        goto done;
+    }
+
     tgtAddr = (int) dvmJitGetTraceAddr(method->insns);
     baseAddr = (int) cell + 4;   // PC is cur_addr + 4
 
@@ -1605,12 +1643,16 @@ static void findClassPointersSingleTrace(char *base, void (*callback)(void *))
  */
 void dvmJitScanAllClassPointers(void (*callback)(void *))
 {
+    int i;
+
     UNPROTECT_CODE_CACHE(gDvmJit.codeCache, gDvmJit.codeCacheByteUsed);
 
-    /* Handle the inflight compilation first */
-    if (gDvmJit.inflightBaseAddr)
-        findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr,
-                                     callback);
+    /* Handle the inflight compilations first */
+    for (i = 0; i < COMPILER_MAX_THREADS; i++) {
+        if (gDvmJit.inflightBaseAddr[i])
+            findClassPointersSingleTrace((char *) gDvmJit.inflightBaseAddr[i],
+                                         callback);
+    }
 
     if (gDvmJit.pJitEntryTable != NULL) {
         unsigned int traceIdx;
@@ -1653,7 +1695,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * thread if there is a pending request before the state is actually
      * changed to RUNNING.
      */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_RUNNING);
+    dvmChangeStatus(dvmThreadSelf(), THREAD_RUNNING);
 
     /*
      * Unprotecting the code cache will need to acquire the code cache
@@ -1683,7 +1725,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
      * in the JIT table, its content can be patched if class objects are
      * moved.
      */
-    gDvmJit.inflightBaseAddr = base;
+    gDvmJit.inflightBaseAddr[dvmCompilerWorkerId()] = base;
 
 #if defined(WITH_JIT_TUNING)
     u8 blockTime = dvmGetRelativeTimeUsec() - startTime;
@@ -1697,7 +1739,7 @@ void dvmJitInstallClassObjectPointers(CompilationUnit *cUnit, char *codeAddress)
     PROTECT_CODE_CACHE(startClassPointerP, numClassPointers * sizeof(intptr_t));
 
     /* Change the thread state back to VMWAIT */
-    dvmChangeStatus(gDvmJit.compilerThread, THREAD_VMWAIT);
+    dvmChangeStatus(dvmThreadSelf(), THREAD_VMWAIT);
 }
 
 #if defined(WITH_SELF_VERIFICATION)
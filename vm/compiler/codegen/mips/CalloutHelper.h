@@ -79,7 +79,7 @@ bool dvmInterpHandleFillArrayData(ArrayObject* arrayObject,// OP_FILL_ARRAY_DATA
 
 /* Originally declared in compiler/codegen/mips/Assemble.c */
 const Method *dvmJitToPatchPredictedChain(const Method *method,
-                                          Thread *self,
+                                          const u2 *dPC,
                                           PredictedChainingCell *cell,
                                           const ClassObject *clazz);
 
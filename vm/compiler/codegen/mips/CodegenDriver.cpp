@@ -374,8 +374,10 @@ static void genIGetWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
 
     assert(rlDest.wide);
 
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kAnyReg, true);
 
@@ -395,8 +397,10 @@ static void genIPutWide(CompilationUnit *cUnit, MIR *mir, int fieldOffset)
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     int regPtr;
     rlSrc = loadValueWide(cUnit, rlSrc, kAnyReg);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
     regPtr = dvmCompilerAllocTemp(cUnit);
     opRegRegImm(cUnit, kOpAdd, regPtr, rlObj.lowReg, fieldOffset);
 
@@ -420,8 +424,10 @@ static void genIGet(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlDest = dvmCompilerGetDest(cUnit, mir, 0);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlResult = dvmCompilerEvalLoc(cUnit, rlDest, regClass, true);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     HEAP_ACCESS_SHADOW(true);
     loadBaseDisp(cUnit, mir, rlObj.lowReg, fieldOffset, rlResult.lowReg,
@@ -446,8 +452,10 @@ static void genIPut(CompilationUnit *cUnit, MIR *mir, OpSize size,
     RegLocation rlObj = dvmCompilerGetSrc(cUnit, mir, 1);
     rlObj = loadValue(cUnit, rlObj, kCoreReg);
     rlSrc = loadValue(cUnit, rlSrc, regClass);
-    genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
-                 NULL);/* null object? */
+    if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+        genNullCheck(cUnit, rlObj.sRegLow, rlObj.lowReg, mir->offset,
+                     NULL);/* null object? */
+    }
 
     if (isVolatile) {
         dvmCompilerGenMemBarrier(cUnit, 0);
@@ -1318,10 +1326,11 @@ static void genInvokeVirtualCommon(CompilationUnit *cUnit, MIR *mir,
 
     LOAD_FUNC_ADDR(cUnit, r_T9, (int) dvmJitToPatchPredictedChain);
 
-    genRegCopy(cUnit, r_A1, rSELF);
+    genRegCopy(cUnit, r_A1, r4PC);
 
     /*
      * r_A0 = calleeMethod
+     * r_A1 = dPC
      * r_A2 = &predictedChainingCell
      * r_A3 = class
      *
@@ -2113,8 +2122,10 @@ static bool handleFmt12x(CompilationUnit *cUnit, MIR *mir)
         case OP_ARRAY_LENGTH: {
             int lenOffset = OFFSETOF_MEMBER(ArrayObject, length);
             rlSrc = loadValue(cUnit, rlSrc, kCoreReg);
-            genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
-                         mir->offset, NULL);
+            if (!(mir->OptimizationFlags & MIR_IGNORE_NULL_CHECK)) {
+                genNullCheck(cUnit, rlSrc.sRegLow, rlSrc.lowReg,
+                             mir->offset, NULL);
+            }
             rlResult = dvmCompilerEvalLoc(cUnit, rlDest, kCoreReg, true);
             loadWordDisp(cUnit, rlSrc.lowReg, lenOffset,
                          rlResult.lowReg);
@@ -2957,31 +2968,33 @@ static u8 findSparseSwitchIndex(const u2* switchData, int testVal)
     assert(((u4)entries & 0x3) == 0);
 
     /*
-     * Run through the list of keys, which are guaranteed to
-     * be sorted low-to-high.
-     *
-     * Most tables have 3-4 entries.  Few have more than 10.  A binary
-     * search here is probably not useful.
+     * Binary-search the keys, which are guaranteed to be sorted
+     * low-to-high.  Most tables only have a few entries, but the ones
+     * generated for protocol decoders can have hundreds.
      */
-    for (i = 0; i < size; i++) {
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi) {
+        i = (lo + hi) >> 1;
 #ifdef HAVE_LITTLE_ENDIAN
         int k = keys[i];
-        if (k == testVal) {
-            /* MAX_CHAINED_SWITCH_CASES + 1 is the start of the overflow case */
-            int jumpIndex = (i < MAX_CHAINED_SWITCH_CASES) ?
-                           i : MAX_CHAINED_SWITCH_CASES + 1;
-            return (((u8) entries[i]) << 32) | (u8) (jumpIndex * CHAIN_CELL_NORMAL_SIZE + 20);
 #else
         int k = (unsigned int)keys[i] >> 16 | keys[i] << 16;
-        if (k == testVal) {
+#endif
+        if (k < testVal) {
+            lo = i + 1;
+        } else if (k > testVal) {
+            hi = i - 1;
+        } else {
             /* MAX_CHAINED_SWITCH_CASES + 1 is the start of the overflow case */
             int jumpIndex = (i < MAX_CHAINED_SWITCH_CASES) ?
                            i : MAX_CHAINED_SWITCH_CASES + 1;
+#ifdef HAVE_LITTLE_ENDIAN
+            return (((u8) entries[i]) << 32) | (u8) (jumpIndex * CHAIN_CELL_NORMAL_SIZE + 20);
+#else
             int temp = (unsigned int)entries[i] >> 16 | entries[i] << 16;
             return (((u8) temp) << 32) | (u8) (jumpIndex * CHAIN_CELL_NORMAL_SIZE + 20);
 #endif
-        } else if (k > testVal) {
-            break;
         }
     }
     return MIN(size, MAX_CHAINED_SWITCH_CASES) * CHAIN_CELL_NORMAL_SIZE + 20;
@@ -3054,7 +3067,8 @@ static bool handleFmt31t(CompilationUnit *cUnit, MIR *mir)
  * genValidationForPredictedInline function. The function here takes care the
  * branch over at 0x4858de78 and the misprediction target at 0x4858de7a.
  */
-static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
+static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit,
+                                               CallsiteInfo *callsiteInfo,
                                                BasicBlock *bb,
                                                MipsLIR *labelList)
 {
@@ -3077,7 +3091,7 @@ static void genLandingPadForMispredictedCallee(CompilationUnit *cUnit, MIR *mir,
     MipsLIR *target = newLIR0(cUnit, kMipsPseudoTargetLabel);
     target->defMask = ENCODE_ALL;
     /* Hook up the target to the verification branch */
-    mir->meta.callsiteInfo->misPredBranchOver->target = (LIR *) target;
+    callsiteInfo->misPredBranchOver->target = (LIR *) target;
 }
 
 static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
@@ -3113,7 +3127,9 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_VIRTUAL)
@@ -3321,7 +3337,9 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_INTERFACE)
@@ -3428,12 +3446,13 @@ static bool handleFmt35c_3rc(CompilationUnit *cUnit, MIR *mir,
 
             LOAD_FUNC_ADDR(cUnit, r_T9, (int) dvmJitToPatchPredictedChain);
 
-            genRegCopy(cUnit, r_A1, rSELF);
+            genRegCopy(cUnit, r_A1, r4PC);
             genRegCopy(cUnit, r_A2, r_S6);
             genRegCopy(cUnit, r_A3, r_S7);
 
             /*
              * r_A0 = calleeMethod
+             * r_A1 = dPC
              * r_A2 = &predictedChainingCell
              * r_A3 = class
              *
@@ -3506,7 +3525,9 @@ static bool handleFmt35ms_3rms(CompilationUnit *cUnit, MIR *mir,
              * mispredicted case.
              */
             if (mir->meta.callsiteInfo->misPredBranchOver) {
-                genLandingPadForMispredictedCallee(cUnit, mir, bb, labelList);
+                genLandingPadForMispredictedCallee(cUnit,
+                                                   mir->meta.callsiteInfo,
+                                                   bb, labelList);
             }
 
             if (mir->dalvikInsn.opcode == OP_INVOKE_VIRTUAL_QUICK)
@@ -3967,6 +3988,10 @@ static const char *extendedMIROpNames[kMirOpLast - kMirOpFirst] = {
     "kMirOpLowerBound",
     "kMirOpPunt",
     "kMirOpCheckInlinePrediction",
+    "kMirOpLoopRegLoad",
+    "kMirOpLoopRegStore",
+    "kMirOpNullCheck",
+    "kMirOpVectorLoop",
 };
 
 /*
@@ -4078,6 +4103,25 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
                    (MipsLIR *) cUnit->loopAnalysis->branchToPCR);
 }
 
+/*
+ * vA = objReg;
+ *
+ * Null check for an object whose field loads were hoisted into the loop
+ * entry block.  Punt to the loop head so the interpreter raises the
+ * exception at the original instruction.
+ */
+static void genHoistedNullCheck(CompilationUnit *cUnit, MIR *mir)
+{
+    RegLocation rlObj = cUnit->regLocation[mir->dalvikInsn.vA];
+
+    rlObj = loadValue(cUnit, rlObj, kCoreReg);
+    if (!dvmIsBitSet(cUnit->regPool->nullCheckedRegs, mir->dalvikInsn.vA)) {
+        dvmSetBit(cUnit->regPool->nullCheckedRegs, mir->dalvikInsn.vA);
+        genRegImmCheck(cUnit, kMipsCondEq, rlObj.lowReg, 0, 0,
+                       (MipsLIR *) cUnit->loopAnalysis->branchToPCR);
+    }
+}
+
 /*
  * vC = this
  *
@@ -4184,6 +4228,16 @@ static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
     CallsiteInfo *callsiteInfo = mir->meta.callsiteInfo;
     RegLocation rlThis = cUnit->regLocation[mir->dalvikInsn.vC];
 
+    /*
+     * At a polymorphic site each further guard is where the previous one
+     * lands when its class doesn't match.
+     */
+    if (callsiteInfo->prevGuard) {
+        genLandingPadForMispredictedCallee(cUnit, callsiteInfo->prevGuard,
+                                           cUnit->curBlock,
+                                           (MipsLIR *) cUnit->labelList);
+    }
+
     rlThis = loadValue(cUnit, rlThis, kCoreReg);
     int regPredictedClass = dvmCompilerAllocTemp(cUnit);
     loadClassPointer(cUnit, regPredictedClass, (int) callsiteInfo);
@@ -4235,6 +4289,10 @@ static void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
             genValidationForPredictedInline(cUnit, mir);
             break;
         }
+        case kMirOpNullCheck: {
+            genHoistedNullCheck(cUnit, mir);
+            break;
+        }
         default:
             break;
     }
@@ -4446,6 +4504,7 @@ void dvmCompilerMIR2LIR(CompilationUnit *cUnit)
             bb = nextBB;
             bb->visited = true;
             cUnit->nextCodegenBlock = NULL;
+            cUnit->curBlock = bb;
 
             for (mir = bb->firstMIRInsn; mir; mir = mir->next) {
 
@@ -58,3 +58,9 @@ int dvmCompilerAllocTypedTemp(CompilationUnit *cUnit, bool fpHint, int regClass)
 #endif
     return dvmCompilerAllocTemp(cUnit);
 }
+
+/* Loop register promotion is not supported yet */
+int dvmCompilerGetLoopPromotionRegs(int *regs, int maxRegs)
+{
+    return 0;
+}
@@ -18,6 +18,7 @@
 #include "libdex/DexOpcodes.h"
 #include "compiler/Compiler.h"
 #include "compiler/CompilerIR.h"
+#include "compiler/Loop.h"
 #include "interp/Jit.h"
 #include "libdex/DexFile.h"
 #include "Lower.h"
@@ -53,6 +54,12 @@ void *dvmCompilerGetInterpretTemplate()
       return NULL;
 }
 
+/* Loops are register allocated by the IA32 backend itself */
+int dvmCompilerGetLoopPromotionRegs(int *regs, int maxRegs)
+{
+    return 0;
+}
+
 /* Track the number of times that the code cache is patched */
 #if defined(WITH_JIT_TUNING)
 #define UPDATE_CODE_CACHE_PATCHES()    (gDvmJit.codeCachePatches++)
@@ -872,6 +879,166 @@ static void genHoistedLowerBoundCheck(CompilationUnit *cUnit, MIR *mir)
 }
 #undef P_GPR_1
 
+/*
+ * Registers used by the SIMD pre-loop.  Slot N of the vector plan lives in
+ * XMM N, and the arrays are kept in the remaining core registers.
+ */
+#define P_GPR_IDX PhysicalReg_EAX
+#define P_SCRATCH PhysicalReg_EDX
+static const int vectorArrayRegs[MAX_VECTOR_ARRAYS] = {
+    PhysicalReg_EBX, PhysicalReg_ECX, PhysicalReg_ESI
+};
+
+static ALU_Opcode getVectorAluOpcode(Opcode opcode)
+{
+    switch (opcode) {
+        case OP_ADD_INT:
+        case OP_ADD_FLOAT:
+            return add_opc;
+        case OP_SUB_INT:
+        case OP_SUB_FLOAT:
+            return sub_opc;
+        case OP_MUL_FLOAT:
+            return mul_opc;
+        case OP_DIV_FLOAT:
+            return div_opc;
+        case OP_AND_INT:
+            return and_opc;
+        case OP_OR_INT:
+            return or_opc;
+        case OP_XOR_INT:
+            return xor_opc;
+        default:
+            ALOGE("Jit: bad vector opcode %d", opcode);
+            dvmAbort();
+            return add_opc;
+    }
+}
+
+/*
+ * SIMD pre-loop for a counted loop, planned by genVectorLoop in Loop.cpp.
+ * It runs four iterations at a time while i + 4 < n, so the scalar loop
+ * always gets the last one to four, then writes back the induction
+ * variable and folds the partial results of each reduction into its
+ * Dalvik register.  The scalar loop starts from there and recomputes all
+ * temporaries.  A pending suspend request ends the pre-loop early; the
+ * scalar loop's backward branch then polls as usual.
+ *
+ * This runs in O0 mode, where the scaled-index helpers ignore the
+ * displacement, so the array registers point at the contents instead.
+ */
+static void genVectorLoop(CompilationUnit *cUnit, MIR *mir)
+{
+    VectorLoopInfo *info = cUnit->loopAnalysis->vectorLoop;
+    const int scratchBytes = VECTOR_LANES * 4;
+    int i, lane;
+
+    /* Skip it unless i + 4 < n */
+    get_virtual_reg(info->ivReg, OpndSize_32, P_GPR_IDX, true);
+    load_effective_addr(VECTOR_LANES, P_GPR_IDX, true, P_SCRATCH, true);
+    compare_VR_reg(OpndSize_32, info->endReg, P_SCRATCH, true);
+    conditional_jump(Condition_GE, ".vector_loop_done", true);
+
+    for (i = 0; i < info->numArrays; i++) {
+        get_virtual_reg(info->arrayRegs[i], OpndSize_32, vectorArrayRegs[i],
+                        true);
+        load_effective_addr(offArrayObject_contents, vectorArrayRegs[i], true,
+                            vectorArrayRegs[i], true);
+    }
+
+    /* Fill every lane of the invariant slots through the native stack */
+    load_effective_addr(-scratchBytes, PhysicalReg_ESP, true,
+                        PhysicalReg_ESP, true);
+    for (i = 0; i < info->numSlots; i++) {
+        VectorSlot *slot = &info->slots[i];
+        if (slot->kind == kVectorSlotTemp) continue;
+        if (slot->kind == kVectorSlotInvariant) {
+            get_virtual_reg(slot->value, OpndSize_32, P_SCRATCH, true);
+            for (lane = 0; lane < VECTOR_LANES; lane++) {
+                move_reg_to_mem(OpndSize_32, P_SCRATCH, true, lane * 4,
+                                PhysicalReg_ESP, true);
+            }
+        } else {
+            int value = slot->value;
+            /* Reductions start from the identity of their operator */
+            if (slot->kind == kVectorSlotReduction) {
+                value = slot->reduceOp == OP_AND_INT ? -1 : 0;
+            }
+            for (lane = 0; lane < VECTOR_LANES; lane++) {
+                move_imm_to_mem(OpndSize_32, value, lane * 4,
+                                PhysicalReg_ESP, true);
+            }
+        }
+        move_dq_mem_to_reg(0, PhysicalReg_ESP, true, PhysicalReg_XMM0 + i,
+                           true);
+    }
+
+    insertLabel(".vector_loop", true);
+    for (i = 0; i < info->numOps; i++) {
+        VectorOp *op = &info->ops[i];
+        int dest = PhysicalReg_XMM0 + op->dest;
+        int src1 = PhysicalReg_XMM0 + op->src1;
+        int src2 = PhysicalReg_XMM0 + op->src2;
+
+        switch (op->opcode) {
+            case OP_AGET:
+                move_dq_mem_scale_to_reg(vectorArrayRegs[op->array], true,
+                    P_GPR_IDX, true, 4, dest, true);
+                break;
+            case OP_APUT:
+                move_dq_reg_to_mem_scale(src1, true,
+                    vectorArrayRegs[op->array], true, P_GPR_IDX, true, 4);
+                break;
+            default: {
+                ALU_Opcode opc = getVectorAluOpcode(op->opcode);
+                bool isFloat = op->opcode == OP_ADD_FLOAT ||
+                               op->opcode == OP_SUB_FLOAT ||
+                               op->opcode == OP_MUL_FLOAT ||
+                               op->opcode == OP_DIV_FLOAT;
+                if (dest != src1) {
+                    move_dq_reg_to_reg(src1, true, dest, true);
+                }
+                if (isFloat) {
+                    alu_ps_binary_reg_reg(opc, src2, true, dest, true);
+                } else {
+                    alu_pi_binary_reg_reg(opc, src2, true, dest, true);
+                }
+                break;
+            }
+        }
+    }
+    alu_binary_imm_reg(OpndSize_32, add_opc, VECTOR_LANES, P_GPR_IDX, true);
+    get_self_pointer(P_SCRATCH, true);
+    compare_imm_mem(OpndSize_32, 0, offsetof(Thread, suspendCount), P_SCRATCH,
+                    true);
+    conditional_jump(Condition_NE, ".vector_loop_exit", true);
+    load_effective_addr(VECTOR_LANES, P_GPR_IDX, true, P_SCRATCH, true);
+    compare_VR_reg(OpndSize_32, info->endReg, P_SCRATCH, true);
+    conditional_jump(Condition_L, ".vector_loop", true);
+
+    insertLabel(".vector_loop_exit", true);
+    set_virtual_reg(info->ivReg, OpndSize_32, P_GPR_IDX, true);
+    for (i = 0; i < info->numSlots; i++) {
+        VectorSlot *slot = &info->slots[i];
+        if (slot->kind != kVectorSlotReduction) continue;
+        ALU_Opcode opc = getVectorAluOpcode(slot->reduceOp);
+        move_dq_reg_to_mem(PhysicalReg_XMM0 + i, true, 0, PhysicalReg_ESP,
+                           true);
+        get_virtual_reg(slot->value, OpndSize_32, P_SCRATCH, true);
+        for (lane = 0; lane < VECTOR_LANES; lane++) {
+            alu_binary_mem_reg(OpndSize_32, opc, lane * 4, PhysicalReg_ESP,
+                               true, P_SCRATCH, true);
+        }
+        set_virtual_reg(slot->value, OpndSize_32, P_SCRATCH, true);
+    }
+    load_effective_addr(scratchBytes, PhysicalReg_ESP, true,
+                        PhysicalReg_ESP, true);
+    insertLabel(".vector_loop_done", true);
+    freeShortMap();
+}
+#undef P_GPR_IDX
+#undef P_SCRATCH
+
 #ifdef WITH_JIT_INLINING
 static void genValidationForPredictedInline(CompilationUnit *cUnit, MIR *mir)
 {
@@ -922,6 +1089,10 @@ void handleExtendedMIR(CompilationUnit *cUnit, MIR *mir)
         case kMirOpPunt: {
             break;
         }
+        case kMirOpVectorLoop: {
+            genVectorLoop(cUnit, mir);
+            break;
+        }
 #ifdef WITH_JIT_INLINING
         case kMirOpCheckInlinePrediction: { //handled in ncg_o1_data.c
             genValidationForPredictedInline(cUnit, mir);
@@ -1491,6 +1662,14 @@ void* dvmJitChain(void* tgtAddr, u4* branchAddr)
     return tgtAddr;
 }
 
+/*
+ * The chaining branches are written right away by dvmJitChain on x86, so
+ * there is never a batch waiting to be installed.
+ */
+void dvmCompilerFlushChainPatches(void)
+{
+}
+
 /*
  * Accept the work and start compiling.  Returns true if compilation
  * is attempted.
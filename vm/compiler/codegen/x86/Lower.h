@@ -673,6 +673,17 @@ void move_sd_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
                          int reg, bool isPhysical);
 void move_sd_reg_to_mem(LowOp* op, int reg, bool isPhysical,
                          int disp, int base_reg, bool isBasePhysical);
+void move_dq_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
+                         int reg, bool isPhysical);
+void move_dq_reg_to_mem(int reg, bool isPhysical,
+                         int disp, int base_reg, bool isBasePhysical);
+void move_dq_reg_to_reg(int reg, bool isPhysical,
+                         int reg2, bool isPhysical2);
+void move_dq_mem_scale_to_reg(int base_reg, bool isBasePhysical,
+                int index_reg, bool isIndexPhysical, int scale,
+                int reg, bool isPhysical);
+void move_dq_reg_to_mem_scale(int reg, bool isPhysical,
+                int base_reg, bool isBasePhysical, int index_reg, bool isIndexPhysical, int scale);
 
 void conditional_jump(ConditionCode cc, const char* target, bool isShortTerm);
 void unconditional_jump(const char* target, bool isShortTerm);
@@ -708,6 +719,10 @@ void alu_ss_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
                             int reg2, bool isPhysical2);
 void alu_sd_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
                             int reg2, bool isPhysical2);
+void alu_pi_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
+                            int reg2, bool isPhysical2);
+void alu_ps_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
+                            int reg2, bool isPhysical2);
 
 void push_mem_to_stack(OpndSize size, int disp, int base_reg, bool isBasePhysical);
 void push_reg_to_stack(OpndSize size, int reg, bool isPhysical);
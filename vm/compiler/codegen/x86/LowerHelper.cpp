@@ -102,6 +102,26 @@ const  Mnemonic map_of_64_opcode_2_mnemonic[] = {
     Mnemonic_Null,  Mnemonic_Null,  Mnemonic_PANDN,
     Mnemonic_Null
 };
+//!mnemonic for SSE packed 32-bit integer
+const  Mnemonic map_of_pi_opcode_2_mnemonic[] = {
+    Mnemonic_PADDD, Mnemonic_POR,   Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_PAND,  Mnemonic_PSUBD, Mnemonic_PXOR,  Mnemonic_Null,
+    Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null
+};
+//!mnemonic for SSE packed single precision
+const  Mnemonic map_of_ps_opcode_2_mnemonic[] = {
+    Mnemonic_ADDPS,  Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_SUBPS, Mnemonic_XORPS, Mnemonic_Null,
+    Mnemonic_MULPS,  Mnemonic_Null,  Mnemonic_DIVPS, Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,  Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null,   Mnemonic_Null,  Mnemonic_Null,
+    Mnemonic_Null
+};
 
 ////////////////////////////////////////////////
 //!update fields of LowOpndReg
@@ -1412,6 +1432,22 @@ void alu_sd_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
     Mnemonic m = map_of_sse_opcode_2_mnemonic[opc];
     dump_reg_reg(m, ATOM_NORMAL_ALU, OpndSize_64, reg, isPhysical, reg2, isPhysical2, LowOpndRegType_xmm);
 }
+//!SSE packed 32-bit integer ALU
+
+//!
+void alu_pi_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
+                int reg2, bool isPhysical2) {
+    Mnemonic m = map_of_pi_opcode_2_mnemonic[opc];
+    dump_reg_reg(m, ATOM_NORMAL_ALU, OpndSize_64, reg, isPhysical, reg2, isPhysical2, LowOpndRegType_xmm);
+}
+//!SSE packed single precision ALU
+
+//!
+void alu_ps_binary_reg_reg(ALU_Opcode opc, int reg, bool isPhysical,
+                int reg2, bool isPhysical2) {
+    Mnemonic m = map_of_ps_opcode_2_mnemonic[opc];
+    dump_reg_reg(m, ATOM_NORMAL_ALU, OpndSize_64, reg, isPhysical, reg2, isPhysical2, LowOpndRegType_xmm);
+}
 //!push reg to native stack
 
 //!
@@ -1679,6 +1715,47 @@ void move_ss_reg_to_mem(LowOp* op, int reg, bool isPhysical,
                          int disp, int base_reg, bool isBasePhysical) {
     dump_reg_mem(Mnemonic_MOVSS, ATOM_NORMAL, OpndSize_32, reg, isPhysical, disp, base_reg, isBasePhysical, MemoryAccess_Unknown, -1, LowOpndRegType_xmm);
 }
+//!movdqu from memory to reg
+
+//!
+void move_dq_mem_to_reg(int disp, int base_reg, bool isBasePhysical,
+                         int reg, bool isPhysical) {
+    dump_mem_reg(Mnemonic_MOVDQU, ATOM_NORMAL, OpndSize_64, disp, base_reg, isBasePhysical, MemoryAccess_Unknown, -1, reg, isPhysical, LowOpndRegType_xmm);
+}
+//!movdqu from reg to memory
+
+//!
+void move_dq_reg_to_mem(int reg, bool isPhysical,
+                         int disp, int base_reg, bool isBasePhysical) {
+    dump_reg_mem(Mnemonic_MOVDQU, ATOM_NORMAL, OpndSize_64, reg, isPhysical,
+                        disp, base_reg, isBasePhysical,
+                        MemoryAccess_Unknown, -1, LowOpndRegType_xmm);
+}
+//!movdqu from reg to reg
+
+//!
+void move_dq_reg_to_reg(int reg, bool isPhysical,
+                         int reg2, bool isPhysical2) {
+    dump_reg_reg(Mnemonic_MOVDQU, ATOM_NORMAL, OpndSize_64, reg, isPhysical, reg2, isPhysical2, LowOpndRegType_xmm);
+}
+//!movdqu from array elements to reg
+
+//!
+void move_dq_mem_scale_to_reg(int base_reg, bool isBasePhysical,
+                int index_reg, bool isIndexPhysical, int scale,
+                int reg, bool isPhysical) {
+    dump_mem_scale_reg(Mnemonic_MOVDQU, OpndSize_64, base_reg, isBasePhysical, 0/*disp*/, index_reg, isIndexPhysical, scale,
+                              reg, isPhysical, LowOpndRegType_xmm);
+}
+//!movdqu from reg to array elements
+
+//!
+void move_dq_reg_to_mem_scale(int reg, bool isPhysical,
+                int base_reg, bool isBasePhysical, int index_reg, bool isIndexPhysical, int scale) {
+    dump_reg_mem_scale(Mnemonic_MOVDQU, OpndSize_64, reg, isPhysical,
+                              base_reg, isBasePhysical, 0/*disp*/, index_reg, isIndexPhysical, scale,
+                              LowOpndRegType_xmm);
+}
 //!movsd from memory to reg
 
 //!
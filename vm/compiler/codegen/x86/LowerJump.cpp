@@ -476,6 +476,7 @@ int getRelativeOffset(const char* target, bool isShortTerm, JmpCall_type type, b
                !strcmp(target, ".new_array_done") ||
                !strcmp(target, ".fill_array_data_done") ||
                !strcmp(target, ".inlined_string_compare_done") ||
+               !strcmp(target, ".vector_loop_done") ||
                !strncmp(target, "after_exception", 15)) {
 #ifdef SUPPORT_IMM_16
                 *immSize = OpndSize_16;
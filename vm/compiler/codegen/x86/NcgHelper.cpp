@@ -58,6 +58,26 @@ s4 dvmJitHandlePackedSwitch(const s4* entries, s4 firstKey, u2 size, s4 testVal)
     return 2*s4FromSwitchData(&entries[testVal - firstKey]); //convert from u2 to byte
 
 }
+/*
+ * Binary-search the sorted key list of a sparse switch.  Returns the index
+ * of "testVal", or -1 if it isn't in the table.
+ */
+static int findSparseSwitchKey(const s4* keys, u2 size, s4 testVal)
+{
+    int lo = 0;
+    int hi = size - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        s4 k = s4FromSwitchData(&keys[mid]);
+        if (k < testVal)
+            lo = mid + 1;
+        else if (k > testVal)
+            hi = mid - 1;
+        else
+            return mid;
+    }
+    return -1;
+}
 /*
  * Find the matching case.  Returns the offset to the handler instructions.
  *
@@ -68,16 +88,11 @@ s4 dvmNcgHandleSparseSwitch(const s4* keys, u2 size, s4 testVal)
 {
     const int kInstrLen = 4; //CHECK
     const s4* entries = keys + size;
-    int i;
-    for (i = 0; i < size; i++) {
-        s4 k = s4FromSwitchData(&keys[i]);
-        if (k == testVal) {
-            LOGVV("Value %d found in entry %d (goto 0x%02x)",
-                testVal, i, s4FromSwitchData(&entries[i]));
-            return s4FromSwitchData(&entries[i]);
-        } else if (k > testVal) {
-            break;
-        }
+    int i = findSparseSwitchKey(keys, size, testVal);
+    if (i >= 0) {
+        LOGVV("Value %d found in entry %d (goto 0x%02x)",
+            testVal, i, s4FromSwitchData(&entries[i]));
+        return s4FromSwitchData(&entries[i]);
     }
 
     LOGVV("Value %d not found in switch", testVal);
@@ -87,16 +102,11 @@ s4 dvmNcgHandleSparseSwitch(const s4* keys, u2 size, s4 testVal)
 s4 dvmJitHandleSparseSwitch(const s4* keys, u2 size, s4 testVal)
 {
     const s4* entries = keys + size;
-    int i;
-    for (i = 0; i < size; i++) {
-        s4 k = s4FromSwitchData(&keys[i]);
-        if (k == testVal) {
-            LOGVV("Value %d found in entry %d (goto 0x%02x)",
-                testVal, i, s4FromSwitchData(&entries[i]));
-            return 2*s4FromSwitchData(&entries[i]); //convert from u2 to byte
-        } else if (k > testVal) {
-            break;
-        }
+    int i = findSparseSwitchKey(keys, size, testVal);
+    if (i >= 0) {
+        LOGVV("Value %d found in entry %d (goto 0x%02x)",
+            testVal, i, s4FromSwitchData(&entries[i]));
+        return 2*s4FromSwitchData(&entries[i]); //convert from u2 to byte
     }
 
     LOGVV("Value %d not found in switch", testVal);
@@ -267,6 +267,9 @@ Mnemonic_PANDN,
 Mnemonic_PSLLQ,
 Mnemonic_PSRLQ,
 Mnemonic_PXOR,                          // Logical Exclusive OR
+Mnemonic_MOVDQU,                        // Move Unaligned Double Quadword
+Mnemonic_PADDD,                         // Add Packed Doubleword Integers
+Mnemonic_PSUBD,                         // Subtract Packed Doubleword Integers
 Mnemonic_POP,                           // Pop a Value from the Stack
 Mnemonic_POPFD,                         // Pop a Value of EFLAGS register from the Stack
 Mnemonic_PUSH,                          // Push Word or Doubleword Onto the Stack
@@ -317,6 +320,10 @@ Mnemonic_XOR,                           // Logical Exclusive OR
 //
 Mnemonic_XORPD,                         // Bitwise Logical XOR for Double-Precision Floating-Point Values
 Mnemonic_XORPS,                         // Bitwise Logical XOR for Single-Precision Floating-Point Values
+Mnemonic_ADDPS,                         // Add Packed Single-Precision Floating-Point Values
+Mnemonic_SUBPS,                         // Subtract Packed Single-Precision Floating-Point Values
+Mnemonic_MULPS,                         // Multiply Packed Single-Precision Floating-Point Values
+Mnemonic_DIVPS,                         // Divide Packed Single-Precision Floating-Point Values
 
 Mnemonic_CVTDQ2PD,                      // Convert Packed Doubleword Integers to Packed Double-Precision Floating-Point Values
 Mnemonic_CVTTPD2DQ,                     // Convert with Truncation Packed Double-Precision Floating-Point Values to Packed Doubleword Integers
@@ -84,30 +84,80 @@ struct Breakpoint {
     u2*         addr;                   /* absolute memory address */
     u1          originalOpcode;         /* original 8-bit opcode value */
     int         setCount;               /* #of times this breakpoint was set */
+
+    Breakpoint* hashNext;               /* next in address hash chain */
+    Breakpoint* methodNext;             /* next breakpoint in same method */
+};
+
+/*
+ * All of the breakpoints in one method.  These are hashed by class, so
+ * that flushing a class only has to look at one chain.
+ */
+struct BreakpointMethod {
+    Method*     method;
+    Breakpoint* breakpoints;            /* list of breakpoints in method */
+    BreakpointMethod* hashNext;         /* next in class hash chain */
 };
 
 /*
  * Set of breakpoints.
+ *
+ * Breakpoints are found by address through "addrTable", which is what
+ * the interpreter needs when it hits one.  The debugger adds and removes
+ * them by method, and flushes them by class, through "methodTable".  Both
+ * are chained hash tables whose size is a power of two; they grow as
+ * the number of entries increases and are never shrunk.
  */
 struct BreakpointSet {
     /* grab lock before reading or writing anything else in here */
     pthread_mutex_t lock;
 
-    /* vector of breakpoint structures */
-    int         alloc;
-    int         count;
-    Breakpoint* breakpoints;
+    /* thread holding the lock for a batch update, or NULL; read and
+       written with atomic ops since other threads check it unlocked */
+    Thread* volatile batchOwner;
+
+    int         count;                  /* #of Breakpoint entries */
+    int         addrTableSize;
+    Breakpoint** addrTable;
+
+    int         methodCount;            /* #of BreakpointMethod entries */
+    int         methodTableSize;
+    BreakpointMethod** methodTable;
 };
 
+#define kBreakpointInitialTableSize 64
+
+/*
+ * Hash a pointer into a table of "tableSize" entries.  Bytecode addresses
+ * are 2-byte aligned and ClassObjects are 8-byte aligned, so we mix the
+ * bits rather than just masking off the low ones.
+ */
+static inline u4 breakpointHash(const void* ptr, int tableSize)
+{
+    return (((u4)(uintptr_t) ptr * 2654435761u) >> 16) & (tableSize - 1);
+}
+
 /*
  * Initialize a BreakpointSet.  Initially empty.
  */
 static BreakpointSet* dvmBreakpointSetAlloc()
 {
     BreakpointSet* pSet = (BreakpointSet*) calloc(1, sizeof(*pSet));
+    if (pSet == NULL)
+        return NULL;
 
     dvmInitMutex(&pSet->lock);
-    /* leave the rest zeroed -- will alloc on first use */
+
+    pSet->addrTableSize = kBreakpointInitialTableSize;
+    pSet->addrTable = (Breakpoint**)
+        calloc(pSet->addrTableSize, sizeof(Breakpoint*));
+    pSet->methodTableSize = kBreakpointInitialTableSize;
+    pSet->methodTable = (BreakpointMethod**)
+        calloc(pSet->methodTableSize, sizeof(BreakpointMethod*));
+    if (pSet->addrTable == NULL || pSet->methodTable == NULL) {
+        dvmBreakpointSetFree(pSet);
+        return NULL;
+    }
 
     return pSet;
 }
@@ -120,10 +170,40 @@ static void dvmBreakpointSetFree(BreakpointSet* pSet)
     if (pSet == NULL)
         return;
 
-    free(pSet->breakpoints);
+    if (pSet->methodTable != NULL) {
+        for (int i = 0; i < pSet->methodTableSize; i++) {
+            BreakpointMethod* pMethod = pSet->methodTable[i];
+            while (pMethod != NULL) {
+                BreakpointMethod* pNextMethod = pMethod->hashNext;
+                Breakpoint* pBreak = pMethod->breakpoints;
+                while (pBreak != NULL) {
+                    Breakpoint* pNextBreak = pBreak->methodNext;
+                    free(pBreak);
+                    pBreak = pNextBreak;
+                }
+                free(pMethod);
+                pMethod = pNextMethod;
+            }
+        }
+    }
+
+    free(pSet->addrTable);
+    free(pSet->methodTable);
     free(pSet);
 }
 
+/*
+ * Returns "true" if "self" holds the breakpoint set lock for a batch
+ * update.  Other threads may be setting or clearing batchOwner while we
+ * look, but never to "self", so the answer is stable for the caller.
+ */
+static inline bool isBatchOwner(BreakpointSet* pSet, Thread* self)
+{
+    Thread* owner = (Thread*) android_atomic_acquire_load(
+        (volatile int32_t*)(void*) &pSet->batchOwner);
+    return owner == self;
+}
+
 /*
  * Lock the breakpoint set.
  *
@@ -131,11 +211,17 @@ static void dvmBreakpointSetFree(BreakpointSet* pSet)
  * contention, because nothing in here can block.  However, it's possible
  * that the bytecode-updater code could become fancier in the future, so
  * we do the trylock dance as a bit of future-proofing.
+ *
+ * If the current thread already holds the lock for a batch update, this
+ * does nothing.
  */
 static void dvmBreakpointSetLock(BreakpointSet* pSet)
 {
+    Thread* self = dvmThreadSelf();
+    if (isBatchOwner(pSet, self))
+        return;
+
     if (dvmTryLockMutex(&pSet->lock) != 0) {
-        Thread* self = dvmThreadSelf();
         ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
         dvmLockMutex(&pSet->lock);
         dvmChangeStatus(self, oldStatus);
@@ -147,6 +233,9 @@ static void dvmBreakpointSetLock(BreakpointSet* pSet)
  */
 static void dvmBreakpointSetUnlock(BreakpointSet* pSet)
 {
+    if (isBatchOwner(pSet, dvmThreadSelf()))
+        return;
+
     dvmUnlockMutex(&pSet->lock);
 }
 
@@ -158,24 +247,154 @@ static int dvmBreakpointSetCount(const BreakpointSet* pSet)
     return pSet->count;
 }
 
+/*
+ * Double the size of the address table.  If we can't get the memory we
+ * just keep going with longer chains.
+ */
+static void growAddrTable(BreakpointSet* pSet)
+{
+    int newSize = pSet->addrTableSize * 2;
+    Breakpoint** newTable =
+        (Breakpoint**) calloc(newSize, sizeof(Breakpoint*));
+    if (newTable == NULL)
+        return;
+
+    ALOGV("+++ increasing breakpoint address table size to %d", newSize);
+
+    for (int i = 0; i < pSet->addrTableSize; i++) {
+        Breakpoint* pBreak = pSet->addrTable[i];
+        while (pBreak != NULL) {
+            Breakpoint* pNext = pBreak->hashNext;
+            u4 hash = breakpointHash(pBreak->addr, newSize);
+            pBreak->hashNext = newTable[hash];
+            newTable[hash] = pBreak;
+            pBreak = pNext;
+        }
+    }
+
+    free(pSet->addrTable);
+    pSet->addrTable = newTable;
+    pSet->addrTableSize = newSize;
+}
+
+/*
+ * Double the size of the method table.
+ */
+static void growMethodTable(BreakpointSet* pSet)
+{
+    int newSize = pSet->methodTableSize * 2;
+    BreakpointMethod** newTable =
+        (BreakpointMethod**) calloc(newSize, sizeof(BreakpointMethod*));
+    if (newTable == NULL)
+        return;
+
+    ALOGV("+++ increasing breakpoint method table size to %d", newSize);
+
+    for (int i = 0; i < pSet->methodTableSize; i++) {
+        BreakpointMethod* pMethod = pSet->methodTable[i];
+        while (pMethod != NULL) {
+            BreakpointMethod* pNext = pMethod->hashNext;
+            u4 hash = breakpointHash(pMethod->method->clazz, newSize);
+            pMethod->hashNext = newTable[hash];
+            newTable[hash] = pMethod;
+            pMethod = pNext;
+        }
+    }
+
+    free(pSet->methodTable);
+    pSet->methodTable = newTable;
+    pSet->methodTableSize = newSize;
+}
+
 /*
  * See if we already have an entry for this address.
  *
  * The BreakpointSet's lock must be acquired before calling here.
  *
- * Returns the index of the breakpoint entry, or -1 if not found.
+ * Returns the breakpoint entry, or NULL if not found.
  */
-static int dvmBreakpointSetFind(const BreakpointSet* pSet, const u2* addr)
+static Breakpoint* dvmBreakpointSetFind(const BreakpointSet* pSet,
+    const u2* addr)
 {
-    int i;
-
-    for (i = 0; i < pSet->count; i++) {
-        Breakpoint* pBreak = &pSet->breakpoints[i];
+    Breakpoint* pBreak = pSet->addrTable[breakpointHash(addr,
+        pSet->addrTableSize)];
+    while (pBreak != NULL) {
         if (pBreak->addr == addr)
-            return i;
+            return pBreak;
+        pBreak = pBreak->hashNext;
     }
 
-    return -1;
+    return NULL;
+}
+
+/*
+ * Find the per-method entry for "method", optionally creating it.
+ *
+ * The BreakpointSet's lock must be acquired before calling here.
+ */
+static BreakpointMethod* findBreakpointMethod(BreakpointSet* pSet,
+    Method* method, bool create)
+{
+    BreakpointMethod** ppChain = &pSet->methodTable[breakpointHash(
+        method->clazz, pSet->methodTableSize)];
+    for (BreakpointMethod* pMethod = *ppChain; pMethod != NULL;
+        pMethod = pMethod->hashNext)
+    {
+        if (pMethod->method == method)
+            return pMethod;
+    }
+
+    if (!create)
+        return NULL;
+
+    BreakpointMethod* pMethod =
+        (BreakpointMethod*) calloc(1, sizeof(BreakpointMethod));
+    if (pMethod == NULL)
+        return NULL;
+    pMethod->method = method;
+    pMethod->hashNext = *ppChain;
+    *ppChain = pMethod;
+
+    if (++pSet->methodCount > pSet->methodTableSize)
+        growMethodTable(pSet);
+    return pMethod;
+}
+
+/*
+ * Unlink "pBreak" from the address table and from its method's list, and
+ * free it.  The method entry is discarded when it becomes empty.
+ *
+ * The BreakpointSet's lock must be acquired before calling here.
+ */
+static void discardBreakpoint(BreakpointSet* pSet, Breakpoint* pBreak)
+{
+    Breakpoint** ppBreak = &pSet->addrTable[breakpointHash(pBreak->addr,
+        pSet->addrTableSize)];
+    while (*ppBreak != pBreak)
+        ppBreak = &(*ppBreak)->hashNext;
+    *ppBreak = pBreak->hashNext;
+
+    BreakpointMethod* pMethod =
+        findBreakpointMethod(pSet, pBreak->method, false);
+    assert(pMethod != NULL);
+    ppBreak = &pMethod->breakpoints;
+    while (*ppBreak != pBreak)
+        ppBreak = &(*ppBreak)->methodNext;
+    *ppBreak = pBreak->methodNext;
+
+    if (pMethod->breakpoints == NULL) {
+        BreakpointMethod** ppMethod = &pSet->methodTable[breakpointHash(
+            pMethod->method->clazz, pSet->methodTableSize)];
+        while (*ppMethod != pMethod)
+            ppMethod = &(*ppMethod)->hashNext;
+        *ppMethod = pMethod->hashNext;
+        free(pMethod);
+        pSet->methodCount--;
+    }
+
+    pBreak->addr = (u2*) 0xdecadead;    // debug
+    free(pBreak);
+    pSet->count--;
 }
 
 /*
@@ -188,11 +407,11 @@ static int dvmBreakpointSetFind(const BreakpointSet* pSet, const u2* addr)
 static bool dvmBreakpointSetOriginalOpcode(const BreakpointSet* pSet,
     const u2* addr, u1* pOrig)
 {
-    int idx = dvmBreakpointSetFind(pSet, addr);
-    if (idx < 0)
+    const Breakpoint* pBreak = dvmBreakpointSetFind(pSet, addr);
+    if (pBreak == NULL)
         return false;
 
-    *pOrig = pSet->breakpoints[idx].originalOpcode;
+    *pOrig = pBreak->originalOpcode;
     return true;
 }
 
@@ -233,33 +452,32 @@ static bool instructionIsMagicNop(const u2* addr)
 static bool dvmBreakpointSetAdd(BreakpointSet* pSet, Method* method,
     unsigned int instrOffset)
 {
-    const int kBreakpointGrowth = 10;
     const u2* addr = method->insns + instrOffset;
-    int idx = dvmBreakpointSetFind(pSet, addr);
-    Breakpoint* pBreak;
-
-    if (idx < 0) {
-        if (pSet->count == pSet->alloc) {
-            int newSize = pSet->alloc + kBreakpointGrowth;
-            Breakpoint* newVec;
-
-            ALOGV("+++ increasing breakpoint set size to %d", newSize);
-
-            /* pSet->breakpoints will be NULL on first entry */
-            newVec = (Breakpoint*)realloc(pSet->breakpoints, newSize * sizeof(Breakpoint));
-            if (newVec == NULL)
-                return false;
-
-            pSet->breakpoints = newVec;
-            pSet->alloc = newSize;
+    Breakpoint* pBreak = dvmBreakpointSetFind(pSet, addr);
+
+    if (pBreak == NULL) {
+        BreakpointMethod* pMethod = findBreakpointMethod(pSet, method, true);
+        if (pMethod == NULL)
+            return false;
+        pBreak = (Breakpoint*) malloc(sizeof(Breakpoint));
+        if (pBreak == NULL) {
+            /* leave the (possibly empty) method entry; it's harmless */
+            return false;
         }
 
-        pBreak = &pSet->breakpoints[pSet->count++];
         pBreak->method = method;
         pBreak->addr = (u2*)addr;
         pBreak->originalOpcode = *(u1*)addr;
         pBreak->setCount = 1;
 
+        u4 hash = breakpointHash(addr, pSet->addrTableSize);
+        pBreak->hashNext = pSet->addrTable[hash];
+        pSet->addrTable[hash] = pBreak;
+        pBreak->methodNext = pMethod->breakpoints;
+        pMethod->breakpoints = pBreak;
+        if (++pSet->count > pSet->addrTableSize)
+            growAddrTable(pSet);
+
         /*
          * Change the opcode.  We must ensure that the BreakpointSet
          * updates happen before we change the opcode.
@@ -294,7 +512,6 @@ static bool dvmBreakpointSetAdd(BreakpointSet* pSet, Method* method,
         /*
          * Breakpoint already exists, just increase the count.
          */
-        pBreak = &pSet->breakpoints[idx];
         pBreak->setCount++;
     }
 
@@ -312,9 +529,9 @@ static void dvmBreakpointSetRemove(BreakpointSet* pSet, Method* method,
     unsigned int instrOffset)
 {
     const u2* addr = method->insns + instrOffset;
-    int idx = dvmBreakpointSetFind(pSet, addr);
+    Breakpoint* pBreak = dvmBreakpointSetFind(pSet, addr);
 
-    if (idx < 0) {
+    if (pBreak == NULL) {
         /* breakpoint not found in set -- unexpected */
         if (*(u1*)addr == OP_BREAKPOINT) {
             ALOGE("Unable to restore breakpoint opcode (%s.%s +%#x)",
@@ -325,7 +542,6 @@ static void dvmBreakpointSetRemove(BreakpointSet* pSet, Method* method,
                 method->clazz->descriptor, method->name, instrOffset);
         }
     } else {
-        Breakpoint* pBreak = &pSet->breakpoints[idx];
         if (pBreak->setCount == 1) {
             /*
              * Must restore opcode before removing set entry.
@@ -339,13 +555,7 @@ static void dvmBreakpointSetRemove(BreakpointSet* pSet, Method* method,
                 pBreak->originalOpcode);
             ANDROID_MEMBAR_FULL();
 
-            if (idx != pSet->count-1) {
-                /* shift down */
-                memmove(&pSet->breakpoints[idx], &pSet->breakpoints[idx+1],
-                    (pSet->count-1 - idx) * sizeof(pSet->breakpoints[0]));
-            }
-            pSet->count--;
-            pSet->breakpoints[pSet->count].addr = (u2*) 0xdecadead; // debug
+            discardBreakpoint(pSet, pBreak);
         } else {
             pBreak->setCount--;
             assert(pBreak->setCount > 0);
@@ -363,15 +573,21 @@ static void dvmBreakpointSetRemove(BreakpointSet* pSet, Method* method,
  */
 static void dvmBreakpointSetFlush(BreakpointSet* pSet, ClassObject* clazz)
 {
-    int i;
-    for (i = 0; i < pSet->count; i++) {
-        Breakpoint* pBreak = &pSet->breakpoints[i];
-        if (pBreak->method->clazz == clazz) {
-            /*
-             * The breakpoint is associated with a method in this class.
-             * It might already be there or it might not; either way,
-             * flush it out.
-             */
+    BreakpointMethod* pMethod =
+        pSet->methodTable[breakpointHash(clazz, pSet->methodTableSize)];
+    for ( ; pMethod != NULL; pMethod = pMethod->hashNext) {
+        if (pMethod->method->clazz != clazz)
+            continue;
+
+        /*
+         * The breakpoints are associated with a method in this class.
+         * They might already be there or they might not; either way,
+         * flush them out.
+         */
+        Breakpoint* pBreak;
+        for (pBreak = pMethod->breakpoints; pBreak != NULL;
+            pBreak = pBreak->methodNext)
+        {
             ALOGV("Flushing breakpoint at %p for %s",
                 pBreak->addr, clazz->descriptor);
             if (instructionIsMagicNop(pBreak->addr)) {
@@ -442,6 +658,36 @@ void dvmClearBreakAddr(Method* method, unsigned int instrOffset)
     dvmBreakpointSetUnlock(pSet);
 }
 
+/*
+ * Hold the breakpoint set lock across a series of dvmAddBreakAddr() and
+ * dvmClearBreakAddr() calls made by the current thread.  This is used
+ * when the debugger adds or removes a lot of events at once.
+ *
+ * Threads that hit a breakpoint while this is held will wait in
+ * dvmGetOriginalOpcode(), so keep the batch short and don't do anything
+ * that could block on another thread.
+ */
+void dvmBreakpointBatchBegin()
+{
+    BreakpointSet* pSet = gDvm.breakpointSet;
+    dvmBreakpointSetLock(pSet);
+    assert(pSet->batchOwner == NULL);
+    android_atomic_release_store((int32_t) dvmThreadSelf(),
+        (volatile int32_t*)(void*) &pSet->batchOwner);
+}
+
+/*
+ * Release the lock taken by dvmBreakpointBatchBegin().
+ */
+void dvmBreakpointBatchEnd()
+{
+    BreakpointSet* pSet = gDvm.breakpointSet;
+    assert(isBatchOwner(pSet, dvmThreadSelf()));
+    android_atomic_release_store(0,
+        (volatile int32_t*)(void*) &pSet->batchOwner);
+    dvmBreakpointSetUnlock(pSet);
+}
+
 /*
  * Get the original opcode from under a breakpoint.
  *
@@ -1239,6 +1485,10 @@ Method* dvmInterpFindInterfaceMethod(ClassObject* thisClass, u4 methodIdx,
     /* make sure absMethod->methodIndex means what we think it means */
     assert(dvmIsAbstractMethod(absMethod));
 
+    methodToCall = dvmItableLookup(thisClass, absMethod);
+    if (methodToCall != NULL)
+        return methodToCall;
+
     /*
      * Run through the "this" object's iftable.  Find the entry for
      * absMethod's class, then use absMethod->methodIndex to find
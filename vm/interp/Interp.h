@@ -61,6 +61,8 @@ void dvmInitInterpreterState(Thread* self);
 void dvmInitBreakpoints();
 void dvmAddBreakAddr(Method* method, unsigned int instrOffset);
 void dvmClearBreakAddr(Method* method, unsigned int instrOffset);
+void dvmBreakpointBatchBegin();
+void dvmBreakpointBatchEnd();
 bool dvmAddSingleStep(Thread* thread, int size, int depth);
 void dvmClearSingleStep(Thread* thread);
 
@@ -21,10 +21,12 @@
 
 #include "Dalvik.h"
 #include "Jit.h"
+#include "JitProfile.h"
 
 #include "libdex/DexOpcodes.h"
 #include <unistd.h>
 #include <pthread.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <signal.h>
 #include "compiler/Compiler.h"
@@ -465,6 +467,19 @@ void dvmBumpPunt(int from)
 }
 #endif
 
+/*
+ * Snapshot the JitTable for a lock-free walk.  A resize publishes the new
+ * table before the new mask, so loading the mask first guarantees that the
+ * table is at least as large as the mask implies.  A table that has just
+ * been replaced stays valid (if stale) until the next reset.
+ */
+static inline JitEntry *jitTableSnapshot(u4 *mask)
+{
+    *mask = (u4) android_atomic_acquire_load(
+        (volatile int32_t *)(void *)&gDvmJit.jitTableMask);
+    return gDvmJit.pJitEntryTable;
+}
+
 /* Dumps debugging & tuning stats to the log */
 void dvmJitStats()
 {
@@ -473,28 +488,52 @@ void dvmJitStats()
     int not_hit;
     int chains;
     int stubs;
+    int probes;
+    int maxProbe;
     if (gDvmJit.pJitEntryTable) {
-        for (i=0, stubs=chains=hit=not_hit=0;
-             i < (int) gDvmJit.jitTableSize;
+        u4 mask;
+        JitEntry *table = jitTableSnapshot(&mask);
+        int size = (int) mask + 1;
+        for (i=0, stubs=chains=hit=not_hit=probes=maxProbe=0;
+             i < size;
              i++) {
-            if (gDvmJit.pJitEntryTable[i].dPC != 0) {
+            const u2* dPC = table[i].dPC;
+            if (dPC != 0) {
                 hit++;
-                if (gDvmJit.pJitEntryTable[i].codeAddress ==
+                if (table[i].codeAddress ==
                       dvmCompilerGetInterpretTemplate())
                     stubs++;
+                /* Slots visited by a lookup that ends here */
+                u4 idx = dvmJitHashMask(dPC, mask);
+                int len = 1;
+                while (idx != (u4) i &&
+                       table[idx].u.info.chain != JIT_CHAIN_END) {
+                    idx = table[idx].u.info.chain;
+                    len++;
+                }
+                probes += len;
+                if (len > maxProbe)
+                    maxProbe = len;
             } else
                 not_hit++;
-            if (gDvmJit.pJitEntryTable[i].u.info.chain != gDvmJit.jitTableSize)
+            if (table[i].u.info.chain != JIT_CHAIN_END)
                 chains++;
         }
         ALOGD("JIT: table size is %d, entries used is %d",
-             gDvmJit.jitTableSize,  gDvmJit.jitTableEntriesUsed);
+             size,  gDvmJit.jitTableEntriesUsed);
+        ALOGD("JIT: table load %d%%, probe length avg %d.%02d max %d, "
+             "%d resizes",
+             hit * 100 / size,
+             hit == 0 ? 0 : probes / hit,
+             hit == 0 ? 0 : (probes * 100 / hit) % 100,
+             maxProbe, gDvmJit.jitTableResizes);
         ALOGD("JIT: %d traces, %d slots, %d chains, %d thresh, %s",
              hit, not_hit + hit, chains, gDvmJit.threshold,
              gDvmJit.blockingMode ? "Blocking" : "Non-blocking");
 
 #if defined(WITH_JIT_TUNING)
-        ALOGD("JIT: Code cache patches: %d", gDvmJit.codeCachePatches);
+        ALOGD("JIT: Code cache patches: %d, %d chain batches",
+             gDvmJit.codeCachePatches, gDvmJit.chainPatchFlushes);
 
         ALOGD("JIT: Lookups: %d hits, %d misses; %d normal, %d punt",
              gDvmJit.addrLookupsFound, gDvmJit.addrLookupsNotFound,
@@ -520,6 +559,8 @@ void dvmJitStats()
         ALOGD("JIT: Inline: %d mgetter, %d msetter, %d pgetter, %d psetter",
              gDvmJit.invokeMonoGetterInlined, gDvmJit.invokeMonoSetterInlined,
              gDvmJit.invokePolyGetterInlined, gDvmJit.invokePolySetterInlined);
+        ALOGD("JIT: Polymorphic: %d multi-guard sites, %d megamorphic rechains",
+             gDvmJit.invokeMultiGuardInlined, gDvmJit.invokeMegamorphic);
         ALOGD("JIT: Total compilation time: %llu ms", gDvmJit.jitTime / 1000);
         ALOGD("JIT: Avg unit compilation time: %llu us",
              gDvmJit.numCompilations == 0 ? 0 :
@@ -555,106 +596,209 @@ void dvmJitEndTraceSelect(Thread* self, const u2* dPC)
 }
 
 /*
- * Find an entry in the JitTable, creating if necessary.
- * Returns null if table is full.
+ * JitTable writers - inserts and code address updates - bracket their
+ * work with enterTableWriter/leaveTableWriter so that a resize can tell
+ * when the old table has gone quiet.  A writer that finds a resize in
+ * progress backs off until the larger table has been published.  Writers
+ * never block or reach a safe point inside the bracket.
  */
-static JitEntry *lookupAndAdd(const u2* dPC, bool callerLocked,
-                              bool isMethodEntry)
+static void enterTableWriter()
 {
-    u4 chainEndMarker = gDvmJit.jitTableSize;
-    u4 idx = dvmJitHash(dPC);
+    while (true) {
+        android_atomic_inc(&gDvmJit.jitTableWriters);
+        ANDROID_MEMBAR_FULL();
+        if (gDvmJit.jitTableResizing == 0)
+            return;
+        android_atomic_dec(&gDvmJit.jitTableWriters);
+        while (gDvmJit.jitTableResizing != 0)
+            sched_yield();
+    }
+}
 
-    /*
-     * Walk the bucket chain to find an exact match for our PC and trace/method
-     * type
-     */
-    while ((gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) &&
-           ((gDvmJit.pJitEntryTable[idx].dPC != dPC) ||
-            (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry !=
-             isMethodEntry))) {
-        idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
+static void leaveTableWriter()
+{
+    ANDROID_MEMBAR_FULL();
+    android_atomic_dec(&gDvmJit.jitTableWriters);
+}
+
+/*
+ * Hold off new JitTable writers and wait for the ones in flight to
+ * finish.  Compiler workers run in THREAD_VMWAIT, so suspending all
+ * threads doesn't stop them; this does.  Caller must hold tableLock.
+ */
+static void blockTableWriters()
+{
+    android_atomic_release_store(1, &gDvmJit.jitTableResizing);
+    ANDROID_MEMBAR_FULL();
+    while (android_atomic_acquire_load(&gDvmJit.jitTableWriters) != 0) {
+        sched_yield();
     }
+}
 
-    if (gDvmJit.pJitEntryTable[idx].dPC != dPC ||
-        gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry != isMethodEntry) {
-        /*
-         * No match.  Aquire jitTableLock and find the last
-         * slot in the chain. Possibly continue the chain walk in case
-         * some other thread allocated the slot we were looking
-         * at previuosly (perhaps even the dPC we're trying to enter).
-         */
-        if (!callerLocked)
-            dvmLockMutex(&gDvmJit.tableLock);
-        /*
-         * At this point, if .dPC is NULL, then the slot we're
-         * looking at is the target slot from the primary hash
-         * (the simple, and common case).  Otherwise we're going
-         * to have to find a free slot and chain it.
-         */
-        ANDROID_MEMBAR_FULL(); /* Make sure we reload [].dPC after lock */
-        if (gDvmJit.pJitEntryTable[idx].dPC != NULL) {
-            u4 prev;
-            while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-                if (gDvmJit.pJitEntryTable[idx].dPC == dPC &&
-                    gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
-                        isMethodEntry) {
-                    /* Another thread got there first for this dPC */
-                    if (!callerLocked)
-                        dvmUnlockMutex(&gDvmJit.tableLock);
-                    return &gDvmJit.pJitEntryTable[idx];
-                }
-                idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
-            }
-            /* Here, idx should be pointing to the last cell of an
-             * active chain whose last member contains a valid dPC */
-            assert(gDvmJit.pJitEntryTable[idx].dPC != NULL);
-            /* Linear walk to find a free cell and add it to the end */
-            prev = idx;
-            while (true) {
-                idx++;
-                if (idx == chainEndMarker)
-                    idx = 0;  /* Wraparound */
-                if ((gDvmJit.pJitEntryTable[idx].dPC == NULL) ||
-                    (idx == prev))
-                    break;
-            }
-            if (idx != prev) {
-                JitEntryInfoUnion oldValue;
-                JitEntryInfoUnion newValue;
-                /*
-                 * Although we hold the lock so that noone else will
-                 * be trying to update a chain field, the other fields
-                 * packed into the word may be in use by other threads.
-                 */
-                do {
-                    oldValue = gDvmJit.pJitEntryTable[prev].u;
-                    newValue = oldValue;
-                    newValue.info.chain = idx;
-                } while (android_atomic_release_cas(oldValue.infoWord,
-                        newValue.infoWord,
-                        &gDvmJit.pJitEntryTable[prev].u.infoWord) != 0);
+static void unblockTableWriters()
+{
+    android_atomic_release_store(0, &gDvmJit.jitTableResizing);
+}
+
+/*
+ * Return the Dalvik PC of an in-use slot.  A slot is claimed before its
+ * PC is stored, so an inserter walking the chain may briefly have to wait
+ * for the PC to show up.  An overflow claim that loses the race for the
+ * chain tail is released without ever getting a PC; in that case the
+ * slot is free again and we return NULL so the caller can claim it.
+ * Slots reached through a chain link are always published, so only a
+ * primary slot can come back NULL.
+ */
+static const u2* waitForEntryPC(JitEntry *entry)
+{
+    const u2* pc;
+    while ((pc = (const u2*) android_atomic_acquire_load(
+                (volatile int32_t *)(void *)&entry->dPC)) == NULL) {
+        JitEntryInfoUnion curValue;
+        curValue.infoWord = android_atomic_acquire_load(&entry->u.infoWord);
+        if (!curValue.info.inUse)
+            return NULL;
+        sched_yield();
+    }
+    return pc;
+}
+
+/*
+ * Try to claim a free slot with a CAS on its info word.  Fills in
+ * "oldValue" with the free state so that an unlinked claim can be undone.
+ */
+static bool claimEntry(JitEntry *entry, bool isMethodEntry,
+                       JitEntryInfoUnion *oldValue)
+{
+    JitEntryInfoUnion newValue;
+
+    *oldValue = entry->u;
+    if (oldValue->info.inUse)
+        return false;
+    newValue = *oldValue;
+    newValue.info.inUse = true;
+    newValue.info.isMethodEntry = isMethodEntry;
+    return android_atomic_acquire_cas(oldValue->infoWord, newValue.infoWord,
+                                      &entry->u.infoWord) == 0;
+}
+
+/* Make a claimed slot live by storing its PC */
+static void publishEntry(JitEntry *entry, const u2* dPC)
+{
+    /* for simulator mode, we need to initialized codeAddress to null */
+    entry->codeAddress = NULL;
+    android_atomic_release_store((int32_t)dPC,
+         (volatile int32_t *)(void *)&entry->dPC);
+}
+
+/*
+ * Find the entry for "dPC" in "table", adding one if necessary.  Lock
+ * free: the primary slot is claimed directly, and an overflow slot is
+ * claimed, then linked to the tail of the chain with a CAS, then
+ * published.  If another thread extends the chain first, the claim is
+ * undone and the walk resumes from the old tail, so racing inserts of
+ * the same PC end up sharing one entry.  An undone claim may be the
+ * primary slot of another inserter, which then sees it go free and
+ * retries the claim.  Returns NULL if the table is full.  The caller must
+ * be a table writer (or own "table" outright).
+ */
+static JitEntry *insertEntry(JitEntry *table, u4 mask, const u2* dPC,
+                             bool isMethodEntry, bool *added)
+{
+    JitEntryInfoUnion freeValue;
+    u4 idx = dvmJitHashMask(dPC, mask);
+
+    *added = false;
+    do {
+        if (claimEntry(&table[idx], isMethodEntry, &freeValue)) {
+            publishEntry(&table[idx], dPC);
+            *added = true;
+            return &table[idx];
+        }
+    } while (waitForEntryPC(&table[idx]) == NULL);
+
+    while (true) {
+        /* Walk to the end of the chain looking for an exact match */
+        while (true) {
+            if (waitForEntryPC(&table[idx]) == dPC &&
+                table[idx].u.info.isMethodEntry == isMethodEntry) {
+                return &table[idx];
             }
+            if (table[idx].u.info.chain == JIT_CHAIN_END)
+                break;
+            idx = table[idx].u.info.chain;
         }
-        if (gDvmJit.pJitEntryTable[idx].dPC == NULL) {
-            gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry = isMethodEntry;
-            /*
-             * Initialize codeAddress and allocate the slot.  Must
-             * happen in this order (since dPC is set, the entry is live.
-             */
-            android_atomic_release_store((int32_t)dPC,
-                 (volatile int32_t *)(void *)&gDvmJit.pJitEntryTable[idx].dPC);
-            /* for simulator mode, we need to initialized codeAddress to null */
-            gDvmJit.pJitEntryTable[idx].codeAddress = NULL;
-            gDvmJit.pJitEntryTable[idx].dPC = dPC;
-            gDvmJit.jitTableEntriesUsed++;
-        } else {
-            /* Table is full */
-            idx = chainEndMarker;
+
+        /* Linear walk to find a free cell */
+        u4 prev = idx;
+        u4 freeIdx = prev;
+        do {
+            freeIdx = (freeIdx + 1) & mask;
+            if (freeIdx == prev)
+                return NULL;    /* Table is full */
+        } while (!claimEntry(&table[freeIdx], isMethodEntry, &freeValue));
+
+        /*
+         * Link it at the tail.  Other fields packed into the tail's info
+         * word may change under us, so only give up if the chain does.
+         */
+        JitEntryInfoUnion oldValue;
+        JitEntryInfoUnion newValue;
+        bool linked = false;
+        do {
+            oldValue = table[prev].u;
+            if (oldValue.info.chain != JIT_CHAIN_END)
+                break;
+            newValue = oldValue;
+            newValue.info.chain = freeIdx;
+            linked = android_atomic_release_cas(oldValue.infoWord,
+                         newValue.infoWord, &table[prev].u.infoWord) == 0;
+        } while (!linked);
+
+        if (linked) {
+            publishEntry(&table[freeIdx], dPC);
+            *added = true;
+            return &table[freeIdx];
         }
-        if (!callerLocked)
-            dvmUnlockMutex(&gDvmJit.tableLock);
+
+        /* Lost the race for the tail - release the cell and keep walking */
+        android_atomic_release_store(freeValue.infoWord,
+                                     &table[freeIdx].u.infoWord);
+        idx = table[prev].u.info.chain;
     }
-    return (idx == chainEndMarker) ? NULL : &gDvmJit.pJitEntryTable[idx];
+}
+
+/*
+ * Add an entry for "dPC" to the current JitTable.  Caller must be a table
+ * writer.  Returns null if table is full.
+ */
+static JitEntry *addEntry(const u2* dPC, bool isMethodEntry)
+{
+    bool added;
+    JitEntry *entry = insertEntry(gDvmJit.pJitEntryTable,
+                                  gDvmJit.jitTableMask, dPC, isMethodEntry,
+                                  &added);
+    if (added) {
+        android_atomic_inc(
+            (volatile int32_t *)(void *)&gDvmJit.jitTableEntriesUsed);
+    }
+    return entry;
+}
+
+/*
+ * Find an entry in the JitTable, creating if necessary.
+ * Returns null if table is full.
+ */
+static JitEntry *lookupAndAdd(const u2* dPC, bool isMethodEntry)
+{
+    JitEntry *entry = dvmJitFindEntry(dPC, isMethodEntry);
+
+    if (entry == NULL) {
+        enterTableWriter();
+        entry = addEntry(dPC, isMethodEntry);
+        leaveTableWriter();
+    }
+    return entry;
 }
 
 /* Dump a trace description */
@@ -1000,20 +1144,20 @@ void dvmCheckJit(const u2* pc, Thread* self)
 
 JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry)
 {
-    int idx = dvmJitHash(pc);
+    u4 mask;
+    JitEntry *table = jitTableSnapshot(&mask);
+    u4 idx = dvmJitHashMask(pc, mask);
 
     /* Expect a high hit rate on 1st shot */
-    if ((gDvmJit.pJitEntryTable[idx].dPC == pc) &&
-        (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry == isMethodEntry))
-        return &gDvmJit.pJitEntryTable[idx];
+    if ((table[idx].dPC == pc) &&
+        (table[idx].u.info.isMethodEntry == isMethodEntry))
+        return &table[idx];
     else {
-        int chainEndMarker = gDvmJit.jitTableSize;
-        while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-            idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
-            if ((gDvmJit.pJitEntryTable[idx].dPC == pc) &&
-                (gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
-                isMethodEntry))
-                return &gDvmJit.pJitEntryTable[idx];
+        while (table[idx].u.info.chain != JIT_CHAIN_END) {
+            idx = table[idx].u.info.chain;
+            if ((table[idx].dPC == pc) &&
+                (table[idx].u.info.isMethodEntry == isMethodEntry))
+                return &table[idx];
         }
     }
     return NULL;
@@ -1025,33 +1169,31 @@ JitEntry *dvmJitFindEntry(const u2* pc, bool isMethodEntry)
  */
 void* getCodeAddrCommon(const u2* dPC, bool methodEntry)
 {
-    int idx = dvmJitHash(dPC);
-    const u2* pc = gDvmJit.pJitEntryTable[idx].dPC;
+    u4 mask;
+    JitEntry *table = jitTableSnapshot(&mask);
+    u4 idx = dvmJitHashMask(dPC, mask);
+    const u2* pc = table[idx].dPC;
     if (pc != NULL) {
         bool hideTranslation = dvmJitHideTranslation();
         if (pc == dPC &&
-            gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry == methodEntry) {
+            table[idx].u.info.isMethodEntry == methodEntry) {
             int offset = (gDvmJit.profileMode >= kTraceProfilingContinuous) ?
-                 0 : gDvmJit.pJitEntryTable[idx].u.info.profileOffset;
-            intptr_t codeAddress =
-                (intptr_t)gDvmJit.pJitEntryTable[idx].codeAddress;
+                 0 : table[idx].u.info.profileOffset;
+            intptr_t codeAddress = (intptr_t)table[idx].codeAddress;
 #if defined(WITH_JIT_TUNING)
             gDvmJit.addrLookupsFound++;
 #endif
             return hideTranslation || !codeAddress ?  NULL :
                   (void *)(codeAddress + offset);
         } else {
-            int chainEndMarker = gDvmJit.jitTableSize;
-            while (gDvmJit.pJitEntryTable[idx].u.info.chain != chainEndMarker) {
-                idx = gDvmJit.pJitEntryTable[idx].u.info.chain;
-                if (gDvmJit.pJitEntryTable[idx].dPC == dPC &&
-                    gDvmJit.pJitEntryTable[idx].u.info.isMethodEntry ==
-                        methodEntry) {
+            while (table[idx].u.info.chain != JIT_CHAIN_END) {
+                idx = table[idx].u.info.chain;
+                if (table[idx].dPC == dPC &&
+                    table[idx].u.info.isMethodEntry == methodEntry) {
                     int offset = (gDvmJit.profileMode >=
                         kTraceProfilingContinuous) ? 0 :
-                        gDvmJit.pJitEntryTable[idx].u.info.profileOffset;
-                    intptr_t codeAddress =
-                        (intptr_t)gDvmJit.pJitEntryTable[idx].codeAddress;
+                        table[idx].u.info.profileOffset;
+                    intptr_t codeAddress = (intptr_t)table[idx].codeAddress;
 #if defined(WITH_JIT_TUNING)
                     gDvmJit.addrLookupsFound++;
 #endif
@@ -1126,12 +1268,17 @@ void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
     /*
      * Get the JitTable slot for this dPC (or create one if JitTable
      * has been reset between the time the trace was requested and
-     * now.
+     * now.  Hold off resizes so the update isn't lost in a table that
+     * is being replaced.
      */
+    enterTableWriter();
     JitEntry *jitEntry = isMethodEntry ?
-        lookupAndAdd(dPC, false /* caller holds tableLock */, isMethodEntry) :
-                     dvmJitFindEntry(dPC, isMethodEntry);
+        addEntry(dPC, isMethodEntry) : dvmJitFindEntry(dPC, isMethodEntry);
     assert(jitEntry);
+    if (jitEntry == NULL) {
+        leaveTableWriter();
+        return;
+    }
     /* Note: order of update is important */
     do {
         oldValue = jitEntry->u;
@@ -1143,6 +1290,7 @@ void dvmJitSetCodeAddr(const u2* dPC, void *nPC, JitInstructionSetType set,
              oldValue.infoWord, newValue.infoWord,
              &jitEntry->u.infoWord) != 0);
     jitEntry->codeAddress = nPC;
+    leaveTableWriter();
 }
 
 /*
@@ -1213,6 +1361,12 @@ void dvmJitCheckTraceRequest(Thread* self)
     /* Check if the JIT request can be handled now */
     if ((gDvmJit.pJitEntryTable != NULL) &&
         ((self->interpBreak.ctl.breakFlags & kInterpSingleStep) == 0)){
+        /* Trace heads that were hot in an earlier run skip the filter */
+        if (self->jitState == kJitTSelectRequest &&
+            dvmJitProfileIsHot(self->interpSave.method, self->interpSave.pc)) {
+            self->jitState = kJitTSelectRequestHot;
+        }
+
         /* Bypass the filter for hot trace requests or during stress mode */
         if (self->jitState == kJitTSelectRequest &&
             gDvmJit.threshold > 6) {
@@ -1251,7 +1405,6 @@ void dvmJitCheckTraceRequest(Thread* self)
                self->jitState = kJitDone;
             } else {
                 JitEntry *slot = lookupAndAdd(self->interpSave.pc,
-                                              false /* lock */,
                                               false /* method entry */);
                 if (slot == NULL) {
                     /*
@@ -1305,29 +1458,23 @@ void dvmJitCheckTraceRequest(Thread* self)
 
 /*
  * Resizes the JitTable.  Must be a power of 2, and returns true on failure.
- * Stops all threads, and thus is a heavyweight operation. May only be called
- * by the compiler thread.
+ * The world keeps running: lookups continue lock-free against the old
+ * table, and inserts back off for the duration of the copy.  May only be
+ * called by a compiler worker.
  */
 bool dvmJitResizeJitTable( unsigned int size )
 {
     JitEntry *pNewTable;
     JitEntry *pOldTable;
-    JitEntry tempEntry;
     unsigned int oldSize;
+    unsigned int used;
     unsigned int i;
 
     assert(gDvmJit.pJitEntryTable != NULL);
     assert(size && !(size & (size - 1)));   /* Is power of 2? */
 
-    ALOGI("Jit: resizing JitTable from %d to %d", gDvmJit.jitTableSize, size);
-
-    if (size <= gDvmJit.jitTableSize) {
-        return true;
-    }
-
     /* Make sure requested size is compatible with chain field width */
-    tempEntry.u.info.chain = size;
-    if (tempEntry.u.info.chain != size) {
+    if (size >= JIT_CHAIN_END) {
         ALOGD("Jit: JitTable request of %d too big", size);
         return true;
     }
@@ -1337,47 +1484,69 @@ bool dvmJitResizeJitTable( unsigned int size )
         return true;
     }
     for (i=0; i< size; i++) {
-        pNewTable[i].u.info.chain = size;  /* Initialize chain termination */
+        pNewTable[i].u.info.chain = JIT_CHAIN_END;
+    }
+
+    dvmLockMutex(&gDvmJit.tableLock);
+
+    /* Another compiler worker may have grown the table in the meantime */
+    if (size <= gDvmJit.jitTableSize ||
+        gDvmJit.numRetiredJitTables == JIT_TABLE_MAX_RETIRED) {
+        bool fail = size > gDvmJit.jitTableSize;
+        dvmUnlockMutex(&gDvmJit.tableLock);
+        free(pNewTable);
+        return fail;
     }
 
-    /* Stop all other interpreting/jit'ng threads */
-    dvmSuspendAllThreads(SUSPEND_FOR_TBL_RESIZE);
+    ALOGI("Jit: resizing JitTable from %d to %d", gDvmJit.jitTableSize, size);
+
+    blockTableWriters();
 
     pOldTable = gDvmJit.pJitEntryTable;
     oldSize = gDvmJit.jitTableSize;
-
-    dvmLockMutex(&gDvmJit.tableLock);
-    gDvmJit.pJitEntryTable = pNewTable;
-    gDvmJit.jitTableSize = size;
-    gDvmJit.jitTableMask = size - 1;
-    gDvmJit.jitTableEntriesUsed = 0;
+    used = 0;
 
     for (i=0; i < oldSize; i++) {
         if (pOldTable[i].dPC) {
             JitEntry *p;
             u2 chain;
-            p = lookupAndAdd(pOldTable[i].dPC, true /* holds tableLock*/,
-                             pOldTable[i].u.info.isMethodEntry);
+            bool added;
+            p = insertEntry(pNewTable, size - 1, pOldTable[i].dPC,
+                            pOldTable[i].u.info.isMethodEntry, &added);
+            assert(p != NULL && added);
             p->codeAddress = pOldTable[i].codeAddress;
             /* We need to preserve the new chain field, but copy the rest */
             chain = p->u.info.chain;
             p->u = pOldTable[i].u;
             p->u.info.chain = chain;
+            used++;
         }
     }
 
-    dvmUnlockMutex(&gDvmJit.tableLock);
-
-    free(pOldTable);
+    /*
+     * Publish the table before the mask (see jitTableSnapshot), then let
+     * the writers back in.
+     */
+    android_atomic_release_store((int32_t) pNewTable,
+        (volatile int32_t *)(void *)&gDvmJit.pJitEntryTable);
+    gDvmJit.jitTableSize = size;
+    gDvmJit.jitTableEntriesUsed = used;
+    android_atomic_release_store(size - 1,
+        (volatile int32_t *)(void *)&gDvmJit.jitTableMask);
+    gDvmJit.retiredJitTables[gDvmJit.numRetiredJitTables++] = pOldTable;
+    gDvmJit.jitTableResizes++;
+    unblockTableWriters();
 
-    /* Restart the world */
-    dvmResumeAllThreads(SUSPEND_FOR_TBL_RESIZE);
+    dvmUnlockMutex(&gDvmJit.tableLock);
 
     return false;
 }
 
 /*
- * Reset the JitTable to the initial clean state.
+ * Reset the JitTable to the initial clean state.  The mutators are
+ * suspended, but other compiler workers may still be installing code, so
+ * writers are held off while the table is cleared.  Retired tables are
+ * left alone since a worker may still be reading one.
  */
 void dvmJitResetTable()
 {
@@ -1386,6 +1555,7 @@ void dvmJitResetTable()
     unsigned int i;
 
     dvmLockMutex(&gDvmJit.tableLock);
+    blockTableWriters();
 
     /* Note: If need to preserve any existing counts. Do so here. */
     if (gDvmJit.pJitTraceProfCounters) {
@@ -1399,9 +1569,11 @@ void dvmJitResetTable()
 
     memset((void *) jitEntry, 0, sizeof(JitEntry) * size);
     for (i=0; i< size; i++) {
-        jitEntry[i].u.info.chain = size;  /* Initialize chain termination */
+        jitEntry[i].u.info.chain = JIT_CHAIN_END;
     }
     gDvmJit.jitTableEntriesUsed = 0;
+
+    unblockTableWriters();
     dvmUnlockMutex(&gDvmJit.tableLock);
 }
 
@@ -95,6 +95,14 @@ static inline u4 dvmJitHash( const u2* p ) {
     return dvmJitHashMask( p, gDvmJit.jitTableMask );
 }
 
+/*
+ * Trace-head counter index for a Dalvik PC.  Must match the hash used by
+ * common_updateProfile in the mterp footers.
+ */
+static inline u4 dvmJitProfTableIndex( const u2* p ) {
+    return (((u4)p>>12)^(u4)p) & (JIT_PROF_SIZE - 1);
+}
+
 /*
  * The width of the chain field in JitEntryInfo sets the upper
  * bound on the number of translations.  Be careful if changing
@@ -104,6 +112,14 @@ static inline u4 dvmJitHash( const u2* p ) {
 #define JIT_ENTRY_CHAIN_WIDTH 2
 #define JIT_MAX_ENTRIES (1 << (JIT_ENTRY_CHAIN_WIDTH * 8))
 
+/*
+ * Chain field value marking the end of a bucket chain.  It does not
+ * depend on the table size so that lock-free readers can keep walking a
+ * table that has just been replaced by a larger one.  Table sizes must
+ * stay below it.
+ */
+#define JIT_CHAIN_END (JIT_MAX_ENTRIES - 1)
+
 /*
  * The trace profiling counters are allocated in blocks and individual
  * counters must not move so long as any referencing trace exists.
@@ -130,7 +146,8 @@ struct JitEntryInfo {
     unsigned int           profileEnabled:1;
     JitInstructionSetType  instructionSet:3;
     unsigned int           profileOffset:5;
-    unsigned int           unused:5;
+    unsigned int           inUse:1;       /* Slot claimed by an inserter */
+    unsigned int           unused:4;
     u2                     chain;                 /* Index of next in chain */
 };
 
@@ -0,0 +1,694 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifdef WITH_JIT
+
+/*
+ * Persistent JIT profile.  See JitProfile.h.
+ *
+ * File format (native byte order, the file never leaves the device):
+ *
+ *   u1[4]  magic "jpf\n"
+ *   u4     version
+ *   u4     checksum of the DEX data the offsets refer to
+ *   u4     number of trace heads
+ *   u4     number of receiver records
+ *   u4[]   trace heads, sorted: byte offset from the start of the DEX data
+ *   u4[2]  receiver records, sorted: byte offset of a virtual or interface
+ *          call site, and the type index of a receiver class defined in
+ *          the same DEX (kJitProfileMegamorphic if the site had too many)
+ *
+ * Offsets are only meaningful for the exact DEX they were recorded
+ * against, so a checksum mismatch just discards the file.
+ */
+#include "Dalvik.h"
+#include "interp/Jit.h"
+#include "interp/JitProfile.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const u1 kJitProfileMagic[4] = { 'j', 'p', 'f', '\n' };
+#define kJitProfileVersion      2
+#define kJitProfileSuffix       ".jitprof"
+
+/* upper bounds on entries per file, so a bad file can't hurt us */
+#define kJitProfileMaxEntries   8192
+#define kJitProfileMaxReceivers 2048
+
+/* receiver type index for a call site that went megamorphic */
+#define kJitProfileMegamorphic  0xffffffff
+
+/* # of new translations between saves */
+#define kJitProfileSaveInterval 64
+
+struct JitProfileHeader {
+    u1  magic[4];
+    u4  version;
+    u4  checksum;
+    u4  numEntries;
+    u4  numReceivers;
+};
+
+struct JitProfileReceiver {
+    u4  pcOffset;
+    u4  typeIdx;
+};
+
+/*
+ * Profile attached to one DvmDex.  "keys" and "receivers" are what we read
+ * at startup and are never modified, so lookups don't need a lock.  The
+ * "saved" copies track what the file holds now, and are only touched with
+ * profileCacheLock held.
+ */
+struct JitProfile {
+    DvmDex*     pDvmDex;
+    char*       fileName;
+    u4*         keys;
+    size_t      numKeys;
+    JitProfileReceiver* receivers;
+    size_t      numReceivers;
+    u4*         savedKeys;
+    size_t      numSaved;
+    JitProfileReceiver* savedReceivers;
+    size_t      numSavedReceivers;
+    bool        writeFailed;
+    JitProfile* next;
+};
+
+/*
+ * Number of profiles we can still write.  Guarded by profileCacheLock, but
+ * read without it by dvmJitProfileSaveNeeded().
+ */
+static int gNumWritableProfiles;
+
+static int compareKeys(const void* a, const void* b)
+{
+    u4 keyA = *(const u4*) a;
+    u4 keyB = *(const u4*) b;
+    return (keyA < keyB) ? -1 : (keyA > keyB) ? 1 : 0;
+}
+
+static int compareReceivers(const void* a, const void* b)
+{
+    const JitProfileReceiver* recA = (const JitProfileReceiver*) a;
+    const JitProfileReceiver* recB = (const JitProfileReceiver*) b;
+    if (recA->pcOffset != recB->pcOffset)
+        return (recA->pcOffset < recB->pcOffset) ? -1 : 1;
+    return (recA->typeIdx < recB->typeIdx) ? -1 :
+        (recA->typeIdx > recB->typeIdx) ? 1 : 0;
+}
+
+/*
+ * Sort "keys" and squeeze out duplicates.  Returns the new count.
+ */
+static size_t sortUnique(u4* keys, size_t count)
+{
+    if (count == 0)
+        return 0;
+
+    qsort(keys, count, sizeof(u4), compareKeys);
+
+    size_t out = 1;
+    for (size_t i = 1; i < count; i++) {
+        if (keys[i] != keys[out - 1])
+            keys[out++] = keys[i];
+    }
+    return out;
+}
+
+/*
+ * Sort "recs" and squeeze out duplicates.  A call site with more classes
+ * than the inline cache can hold collapses to a single megamorphic record,
+ * which sorts last for its site.  Returns the new count.
+ */
+static size_t sortUniqueReceivers(JitProfileReceiver* recs, size_t count)
+{
+    qsort(recs, count, sizeof(JitProfileReceiver), compareReceivers);
+
+    size_t out = 0;
+    size_t i = 0;
+    while (i < count) {
+        size_t first = out;
+        u4 pcOffset = recs[i].pcOffset;
+        for (; i < count && recs[i].pcOffset == pcOffset; i++) {
+            if (out == first || recs[i].typeIdx != recs[out - 1].typeIdx)
+                recs[out++] = recs[i];
+        }
+        if (recs[out - 1].typeIdx == kJitProfileMegamorphic ||
+            out - first > JIT_MAX_RECEIVER_CLASSES)
+        {
+            recs[first].typeIdx = kJitProfileMegamorphic;
+            out = first + 1;
+        }
+    }
+    return out;
+}
+
+/*
+ * Read and validate a profile file into "prof".  Leaves it empty if there
+ * isn't one or it doesn't belong to this DEX.
+ */
+static void readProfile(JitProfile* prof)
+{
+    JitProfileHeader header;
+    const DvmDex* pDvmDex = prof->pDvmDex;
+    u4* keys = NULL;
+    JitProfileReceiver* recs = NULL;
+    u4 fileSize = pDvmDex->pHeader->fileSize;
+    u4 typeIdsSize = pDvmDex->pHeader->typeIdsSize;
+
+    FILE* fp = fopen(prof->fileName, "r");
+    if (fp == NULL)
+        return;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, kJitProfileMagic, sizeof(header.magic)) != 0 ||
+        header.version != kJitProfileVersion ||
+        header.checksum != pDvmDex->pHeader->checksum ||
+        (header.numEntries == 0 && header.numReceivers == 0) ||
+        header.numEntries > kJitProfileMaxEntries ||
+        header.numReceivers > kJitProfileMaxReceivers)
+    {
+        ALOGV("JIT profile %s is stale or damaged", prof->fileName);
+        goto bail;
+    }
+
+    keys = (u4*) malloc(header.numEntries * sizeof(u4));
+    recs = (JitProfileReceiver*)
+        malloc(header.numReceivers * sizeof(JitProfileReceiver));
+    if ((header.numEntries != 0 && keys == NULL) ||
+        (header.numReceivers != 0 && recs == NULL))
+    {
+        goto fail;
+    }
+    if (fread(keys, sizeof(u4), header.numEntries, fp) != header.numEntries ||
+        fread(recs, sizeof(JitProfileReceiver), header.numReceivers, fp) !=
+            header.numReceivers)
+    {
+        goto fail;
+    }
+
+    for (u4 i = 0; i < header.numEntries; i++) {
+        if ((keys[i] & 1) != 0 || keys[i] >= fileSize ||
+            (i > 0 && keys[i] <= keys[i - 1]))
+        {
+            ALOGW("JIT profile %s has a bad entry, ignoring", prof->fileName);
+            goto fail;
+        }
+    }
+    for (u4 i = 0; i < header.numReceivers; i++) {
+        if ((recs[i].pcOffset & 1) != 0 || recs[i].pcOffset >= fileSize ||
+            (recs[i].typeIdx >= typeIdsSize &&
+             recs[i].typeIdx != kJitProfileMegamorphic) ||
+            (i > 0 && compareReceivers(&recs[i - 1], &recs[i]) >= 0))
+        {
+            ALOGW("JIT profile %s has a bad receiver, ignoring",
+                prof->fileName);
+            goto fail;
+        }
+    }
+
+    prof->keys = keys;
+    prof->numKeys = header.numEntries;
+    prof->receivers = recs;
+    prof->numReceivers = header.numReceivers;
+    goto bail;
+
+fail:
+    free(keys);
+    free(recs);
+bail:
+    fclose(fp);
+}
+
+/*
+ * Write "keys" and "recs" out.  We write to a uniquely named temp file and
+ * rename it, so a process killed halfway through doesn't leave a truncated
+ * profile behind, and processes saving the same profile at the same time
+ * don't write into each other's temp file.
+ */
+static bool writeProfile(const JitProfile* prof, const u4* keys,
+    size_t count, const JitProfileReceiver* recs, size_t numRecs)
+{
+    size_t nameLen = strlen(prof->fileName) + sizeof(".XXXXXX");
+    char* tmpName = (char*) malloc(nameLen);
+    if (tmpName == NULL)
+        return false;
+    snprintf(tmpName, nameLen, "%s.XXXXXX", prof->fileName);
+
+    JitProfileHeader header;
+    memcpy(header.magic, kJitProfileMagic, sizeof(kJitProfileMagic));
+    header.version = kJitProfileVersion;
+    header.checksum = prof->pDvmDex->pHeader->checksum;
+    header.numEntries = count;
+    header.numReceivers = numRecs;
+
+    bool result = false;
+    int fd = mkstemp(tmpName);
+    if (fd < 0) {
+        free(tmpName);
+        return false;
+    }
+    /* readable by the other processes that map the same odex */
+    fchmod(fd, 0644);
+
+    FILE* fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        close(fd);
+    } else {
+        result = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                 fwrite(keys, sizeof(u4), count, fp) == count &&
+                 fwrite(recs, sizeof(JitProfileReceiver), numRecs, fp) ==
+                    numRecs;
+        if (fclose(fp) != 0)
+            result = false;
+        if (result && rename(tmpName, prof->fileName) != 0)
+            result = false;
+    }
+    if (!result)
+        unlink(tmpName);
+
+    free(tmpName);
+    return result;
+}
+
+/*
+ * Returns "true" if we can create files in the directory holding "fileName".
+ * App processes normally can't write to the dalvik-cache, and there's no
+ * point finding that out again on every save.
+ */
+static bool canWriteProfile(const char* fileName)
+{
+    const char* lastSlash = strrchr(fileName, '/');
+    if (lastSlash == NULL)
+        return access(".", W_OK) == 0;
+
+    char* dirName = strndup(fileName, lastSlash - fileName + 1);
+    if (dirName == NULL)
+        return false;
+    bool result = access(dirName, W_OK) == 0;
+    free(dirName);
+    return result;
+}
+
+/*
+ * Set the trace-head counters for every PC in "prof" to trip on the next
+ * execution.  Racing with the interpreter is harmless; the worst case is
+ * one extra round of warm-up.
+ */
+static void seedProfile(const JitProfile* prof, unsigned char* pProfTable)
+{
+    const u1* baseAddr = prof->pDvmDex->pDexFile->baseAddr;
+
+    for (size_t i = 0; i < prof->numKeys; i++) {
+        const u2* pc = (const u2*) (baseAddr + prof->keys[i]);
+        pProfTable[dvmJitProfTableIndex(pc)] = 1;
+    }
+}
+
+/* See documentation comment in header. */
+bool dvmJitProfileStartup()
+{
+    dvmInitMutex(&gDvmJit.profileCacheLock);
+    return true;
+}
+
+/* See documentation comment in header. */
+void dvmJitProfileOpen(DvmDex* pDvmDex, const char* cacheFileName)
+{
+    if (!gDvmJit.profileCacheEnabled || gDvm.optimizing ||
+        gDvm.executionMode != kExecutionModeJit || cacheFileName == NULL)
+    {
+        return;
+    }
+
+    JitProfile* prof = (JitProfile*) calloc(1, sizeof(JitProfile));
+    if (prof == NULL)
+        return;
+    size_t nameLen = strlen(cacheFileName) + sizeof(kJitProfileSuffix);
+    prof->fileName = (char*) malloc(nameLen);
+    if (prof->fileName == NULL) {
+        free(prof);
+        return;
+    }
+    snprintf(prof->fileName, nameLen, "%s%s", cacheFileName,
+        kJitProfileSuffix);
+    prof->pDvmDex = pDvmDex;
+    readProfile(prof);
+    if (prof->keys != NULL || prof->receivers != NULL) {
+        ALOGV("JIT profile: %zd entries, %zd receivers from %s",
+            prof->numKeys, prof->numReceivers, prof->fileName);
+    }
+    prof->writeFailed = !canWriteProfile(prof->fileName);
+
+    dvmLockMutex(&gDvmJit.profileCacheLock);
+    pDvmDex->pJitProfile = prof;
+    prof->next = gDvmJit.profileCache;
+    gDvmJit.profileCache = prof;
+    if (!prof->writeFailed)
+        gNumWritableProfiles++;
+
+    /* JIT already running?  Then seed now. */
+    if (gDvmJit.pProfTableCopy != NULL && prof->keys != NULL)
+        seedProfile(prof, gDvmJit.pProfTableCopy);
+    dvmUnlockMutex(&gDvmJit.profileCacheLock);
+}
+
+/* See documentation comment in header. */
+void dvmJitProfileClose(DvmDex* pDvmDex)
+{
+    JitProfile* prof = pDvmDex->pJitProfile;
+    if (prof == NULL)
+        return;
+
+    dvmLockMutex(&gDvmJit.profileCacheLock);
+    JitProfile** pPrev = &gDvmJit.profileCache;
+    while (*pPrev != NULL && *pPrev != prof)
+        pPrev = &(*pPrev)->next;
+    if (*pPrev != NULL)
+        *pPrev = prof->next;
+    pDvmDex->pJitProfile = NULL;
+    if (!prof->writeFailed)
+        gNumWritableProfiles--;
+    dvmUnlockMutex(&gDvmJit.profileCacheLock);
+
+    free(prof->fileName);
+    free(prof->keys);
+    free(prof->receivers);
+    free(prof->savedKeys);
+    free(prof->savedReceivers);
+    free(prof);
+}
+
+/* See documentation comment in header. */
+void dvmJitProfileSeedAll()
+{
+    if (gDvmJit.pProfTableCopy == NULL)
+        return;
+
+    int numSeeded = 0;
+    dvmLockMutex(&gDvmJit.profileCacheLock);
+    for (JitProfile* prof = gDvmJit.profileCache; prof != NULL;
+         prof = prof->next)
+    {
+        seedProfile(prof, gDvmJit.pProfTableCopy);
+        numSeeded += prof->numKeys;
+    }
+    dvmUnlockMutex(&gDvmJit.profileCacheLock);
+
+    if (numSeeded != 0)
+        ALOGD("JIT profile: seeded %d entries", numSeeded);
+}
+
+/* See documentation comment in header. */
+bool dvmJitProfileIsHot(const Method* method, const u2* pc)
+{
+    const DvmDex* pDvmDex = method->clazz->pDvmDex;
+    if (pDvmDex == NULL || pDvmDex->pJitProfile == NULL)
+        return false;
+
+    const JitProfile* prof = pDvmDex->pJitProfile;
+    u4 key = (const u1*) pc - pDvmDex->pDexFile->baseAddr;
+    int lo = 0;
+    int hi = (int) prof->numKeys - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) >> 1;
+        if (prof->keys[mid] < key)
+            lo = mid + 1;
+        else if (prof->keys[mid] > key)
+            hi = mid - 1;
+        else
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Find the method "clazz" runs for a call that reached "callee" when it
+ * was profiled.  The vtable slot of the profiled callee is tried first;
+ * interface call sites may need a scan.
+ */
+static const Method* findReceiverMethod(const ClassObject* clazz,
+    const Method* callee)
+{
+    int slot = callee->methodIndex;
+    if (slot < clazz->vtableCount &&
+        dvmCompareMethodNamesAndProtos(clazz->vtable[slot], callee) == 0)
+    {
+        return clazz->vtable[slot];
+    }
+    for (int i = 0; i < clazz->vtableCount; i++) {
+        if (dvmCompareMethodNamesAndProtos(clazz->vtable[i], callee) == 0)
+            return clazz->vtable[i];
+    }
+    return NULL;
+}
+
+/* See documentation comment in header. */
+bool dvmJitProfileGetReceivers(const Method* method, const u2* pc,
+    const Method* callee, JitCallsiteProfile* profile)
+{
+    DvmDex* pDvmDex = method->clazz->pDvmDex;
+    if (pDvmDex == NULL || pDvmDex->pJitProfile == NULL)
+        return false;
+
+    const JitProfile* prof = pDvmDex->pJitProfile;
+    u4 pcOffset = (const u1*) pc - pDvmDex->pDexFile->baseAddr;
+
+    /* first record for the call site */
+    size_t lo = 0;
+    size_t hi = prof->numReceivers;
+    while (lo < hi) {
+        size_t mid = (lo + hi) >> 1;
+        if (prof->receivers[mid].pcOffset < pcOffset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == prof->numReceivers || prof->receivers[lo].pcOffset != pcOffset)
+        return false;
+
+    memset(profile, 0, sizeof(*profile));
+    profile->dPC = pc;
+    for (size_t i = lo;
+         i < prof->numReceivers && prof->receivers[i].pcOffset == pcOffset;
+         i++)
+    {
+        u4 typeIdx = prof->receivers[i].typeIdx;
+        if (typeIdx == kJitProfileMegamorphic) {
+            profile->numClasses = -1;
+            return true;
+        }
+
+        /* Only classes this run has already resolved; we can't load any */
+        ClassObject* clazz = dvmDexGetResolvedClass(pDvmDex, typeIdx);
+        if (clazz == NULL || profile->numClasses == JIT_MAX_RECEIVER_CLASSES)
+            continue;
+        const Method* target = findReceiverMethod(clazz, callee);
+        if (target == NULL)
+            continue;
+        profile->clazz[profile->numClasses] = clazz;
+        profile->method[profile->numClasses] = target;
+        profile->count[profile->numClasses] = 1;
+        profile->numClasses++;
+    }
+    return profile->numClasses != 0;
+}
+
+/* See documentation comment in header. */
+bool dvmJitProfileSaveNeeded()
+{
+    if (gNumWritableProfiles == 0)
+        return false;
+
+    /* the code cache was reset since the last save */
+    if (gDvmJit.numCompilations < gDvmJit.profileCacheSaveCount)
+        gDvmJit.profileCacheSaveCount = gDvmJit.numCompilations;
+
+    return gDvmJit.numCompilations - gDvmJit.profileCacheSaveCount >=
+        kJitProfileSaveInterval;
+}
+
+/*
+ * Collect the offsets of everything in the JitTable that falls within
+ * "prof"'s DEX and has real code.
+ */
+static size_t collectKeys(const JitProfile* prof, u4* keys, size_t maxKeys)
+{
+    const u1* baseAddr = prof->pDvmDex->pDexFile->baseAddr;
+    u4 fileSize = prof->pDvmDex->pHeader->fileSize;
+    void* interpTemplate = dvmCompilerGetInterpretTemplate();
+    size_t count = 0;
+
+    dvmLockMutex(&gDvmJit.tableLock);
+    for (unsigned int i = 0; i < gDvmJit.jitTableSize && count < maxKeys;
+         i++)
+    {
+        const JitEntry* entry = &gDvmJit.pJitEntryTable[i];
+        const u1* pc = (const u1*) entry->dPC;
+        if (pc == NULL || pc < baseAddr || pc >= baseAddr + fileSize ||
+            entry->u.info.isMethodEntry ||
+            entry->codeAddress == NULL ||
+            entry->codeAddress == interpTemplate)
+        {
+            continue;
+        }
+        keys[count++] = pc - baseAddr;
+    }
+    dvmUnlockMutex(&gDvmJit.tableLock);
+
+    return count;
+}
+
+/*
+ * Collect the receiver classes recorded at call sites in "prof"'s DEX.
+ * Classes defined elsewhere can't be named by a type index of this DEX
+ * and are left out.
+ */
+static size_t collectReceivers(const JitProfile* prof,
+    JitProfileReceiver* recs, size_t maxRecs)
+{
+    const DvmDex* pDvmDex = prof->pDvmDex;
+    const u1* baseAddr = pDvmDex->pDexFile->baseAddr;
+    u4 fileSize = pDvmDex->pHeader->fileSize;
+    size_t count = 0;
+
+    dvmLockMutex(&gDvmJit.compilerICPatchLock);
+    for (int i = 0; i < COMPILER_CALLSITE_PROFILE_SIZE; i++) {
+        const JitCallsiteProfile* site = &gDvmJit.callsiteProfiles[i];
+        const u1* pc = (const u1*) site->dPC;
+        if (pc == NULL || pc < baseAddr || pc >= baseAddr + fileSize)
+            continue;
+
+        u4 pcOffset = pc - baseAddr;
+        if (site->numClasses < 0) {
+            if (count == maxRecs)
+                break;
+            recs[count].pcOffset = pcOffset;
+            recs[count].typeIdx = kJitProfileMegamorphic;
+            count++;
+            continue;
+        }
+        for (int j = 0; j < site->numClasses && count < maxRecs; j++) {
+            const ClassObject* clazz = site->clazz[j];
+            if (clazz->pDvmDex != pDvmDex)
+                continue;
+            const DexClassDef* pClassDef =
+                dexFindClass(pDvmDex->pDexFile, clazz->descriptor);
+            if (pClassDef == NULL)
+                continue;
+            recs[count].pcOffset = pcOffset;
+            recs[count].typeIdx = pClassDef->classIdx;
+            count++;
+        }
+    }
+    dvmUnlockMutex(&gDvmJit.compilerICPatchLock);
+
+    return count;
+}
+
+/*
+ * Merge what's hot now with what was hot in earlier runs, and write the
+ * result if it differs from what's on disk.  If both don't fit, the
+ * current run wins.
+ */
+static void saveProfile(JitProfile* prof)
+{
+    u4* keys = (u4*) malloc(kJitProfileMaxEntries * sizeof(u4));
+    JitProfileReceiver* recs = (JitProfileReceiver*)
+        malloc(kJitProfileMaxReceivers * sizeof(JitProfileReceiver));
+    if (keys == NULL || recs == NULL) {
+        free(keys);
+        free(recs);
+        return;
+    }
+
+    size_t count = collectKeys(prof, keys, kJitProfileMaxEntries);
+    size_t numRecs = collectReceivers(prof, recs, kJitProfileMaxReceivers);
+    if (count == 0 && numRecs == 0) {
+        free(keys);
+        free(recs);
+        return;
+    }
+    count = sortUnique(keys, count);
+    if (count + prof->numKeys <= kJitProfileMaxEntries) {
+        memcpy(keys + count, prof->keys, prof->numKeys * sizeof(u4));
+        count = sortUnique(keys, count + prof->numKeys);
+    }
+    numRecs = sortUniqueReceivers(recs, numRecs);
+    if (numRecs + prof->numReceivers <= kJitProfileMaxReceivers) {
+        memcpy(recs + numRecs, prof->receivers,
+            prof->numReceivers * sizeof(JitProfileReceiver));
+        numRecs = sortUniqueReceivers(recs, numRecs + prof->numReceivers);
+    }
+
+    /* until we've written it, the file holds what we read at startup */
+    const u4* savedKeys = prof->savedKeys;
+    size_t numSaved = prof->numSaved;
+    const JitProfileReceiver* savedRecs = prof->savedReceivers;
+    size_t numSavedRecs = prof->numSavedReceivers;
+    if (savedKeys == NULL) {
+        savedKeys = prof->keys;
+        numSaved = prof->numKeys;
+        savedRecs = prof->receivers;
+        numSavedRecs = prof->numReceivers;
+    }
+    if (count == numSaved && numRecs == numSavedRecs &&
+        memcmp(keys, savedKeys, count * sizeof(u4)) == 0 &&
+        memcmp(recs, savedRecs, numRecs * sizeof(JitProfileReceiver)) == 0)
+    {
+        free(keys);
+        free(recs);
+        return;
+    }
+
+    if (writeProfile(prof, keys, count, recs, numRecs)) {
+        ALOGV("JIT profile: wrote %zd entries, %zd receivers to %s",
+            count, numRecs, prof->fileName);
+        free(prof->savedKeys);
+        free(prof->savedReceivers);
+        prof->savedKeys = keys;
+        prof->numSaved = count;
+        prof->savedReceivers = recs;
+        prof->numSavedReceivers = numRecs;
+    } else {
+        ALOGD("JIT profile: unable to write %s", prof->fileName);
+        prof->writeFailed = true;
+        gNumWritableProfiles--;
+        free(keys);
+        free(recs);
+    }
+}
+
+/* See documentation comment in header. */
+void dvmJitProfileSaveAll()
+{
+    if (gDvmJit.pJitEntryTable == NULL)
+        return;
+
+    dvmLockMutex(&gDvmJit.profileCacheLock);
+    gDvmJit.profileCacheSaveCount = gDvmJit.numCompilations;
+    for (JitProfile* prof = gDvmJit.profileCache; prof != NULL;
+         prof = prof->next)
+    {
+        if (!prof->writeFailed)
+            saveProfile(prof);
+    }
+    dvmUnlockMutex(&gDvmJit.profileCacheLock);
+}
+
+#endif /* WITH_JIT */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Persistent JIT profile ("profile cache").
+ *
+ * The set of Dalvik PCs that ended up with a trace translation is saved
+ * next to the optimized DEX file, as byte offsets from the start of the
+ * DEX data, along with the receiver classes seen at virtual and interface
+ * call sites.  When the same optimized DEX is mapped by a later process,
+ * the offsets are turned back into PCs and used to pre-arm the trace-head
+ * counters, so that known-hot code is sent to the compiler on first
+ * execution instead of after the usual warm-up.  The receivers stand in
+ * for the inline cache profile until the new run has built its own.
+ */
+#ifndef DALVIK_INTERP_JITPROFILE_H_
+#define DALVIK_INTERP_JITPROFILE_H_
+
+struct DvmDex;
+struct JitCallsiteProfile;
+struct Method;
+
+/*
+ * Set up the profile cache.  The boot class path is opened well before
+ * the JIT starts, so this has to happen early.
+ */
+bool dvmJitProfileStartup(void);
+
+/*
+ * Read the profile that goes with "cacheFileName", if any, and attach it
+ * to "pDvmDex".  Does nothing unless the JIT is enabled.
+ */
+void dvmJitProfileOpen(DvmDex* pDvmDex, const char* cacheFileName);
+
+/*
+ * Detach and free the profile for a DEX file that's going away.
+ */
+void dvmJitProfileClose(DvmDex* pDvmDex);
+
+/*
+ * Arm the trace-head counters for every PC in every loaded profile.
+ * Called once the JIT's profile table exists.
+ */
+void dvmJitProfileSeedAll(void);
+
+/*
+ * Returns "true" if the trace head "pc" in "method" was hot in an earlier
+ * run.
+ */
+bool dvmJitProfileIsHot(const Method* method, const u2* pc);
+
+/*
+ * Fill in "profile" with the receiver classes an earlier run saw at the
+ * call site "pc" in "method", which then reached "callee".  Only classes
+ * that are already resolved in this run are returned.  Returns "false" if
+ * nothing usable was saved for the site.
+ */
+bool dvmJitProfileGetReceivers(const Method* method, const u2* pc,
+    const Method* callee, JitCallsiteProfile* profile);
+
+/*
+ * Returns "true" if enough has been compiled since the last save to make
+ * writing the profiles worthwhile.
+ */
+bool dvmJitProfileSaveNeeded(void);
+
+/*
+ * Merge the current JitTable contents into each loaded profile and write
+ * out the ones that changed.  Must be called from the first compiler
+ * worker or after the workers have stopped.
+ */
+void dvmJitProfileSaveAll(void);
+
+#endif  // DALVIK_INTERP_JITPROFILE_H_
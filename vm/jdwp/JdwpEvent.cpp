@@ -103,6 +103,7 @@ don't allow anyone else to interfere with us.
 struct ModBasket {
     const JdwpLocation* pLoc;           /* LocationOnly */
     const char*         className;      /* ClassMatch/ClassExclude */
+    int                 classNameLen;   /* strlen(className), or -1 */
     ObjectId            threadId;       /* ThreadOnly */
     RefTypeId           classId;        /* ClassOnly */
     RefTypeId           excepClassId;   /* ExceptionOnly */
@@ -176,6 +177,114 @@ static void dumpEvent(const JdwpEvent* pEvent)
     }
 }
 
+/*
+ * Hash a location into the eventsByLocation table.  The class ID is
+ * implied by the method ID, so we don't bother with it.
+ */
+static inline u4 locationHash(const JdwpLocation* pLoc)
+{
+    u4 key = pLoc->methodId ^ (u4) pLoc->idx;
+    return ((key * 2654435761u) >> 16) & (kJdwpLocationBuckets - 1);
+}
+
+/*
+ * Hash a class name into the eventsByClass table.
+ */
+static inline u4 classNameHash(const char* name)
+{
+    u4 hash = 1;
+    while (*name != '\0')
+        hash = hash * 31 + *name++;
+    return hash & (kJdwpClassBuckets - 1);
+}
+
+/*
+ * Work out what sort of ClassMatch or ClassExclude pattern we have, so
+ * we don't need to re-examine it every time an event is posted.
+ */
+static void compilePattern(JdwpEventMod* pMod)
+{
+    const char* pattern = pMod->classMatch.classPattern;
+    int patLen = strlen(pattern);
+
+    if (patLen > 0 && pattern[0] == '*') {
+        pMod->classMatch.patternKind = kPatternSuffix;
+        pMod->classMatch.patternLen = patLen - 1;
+    } else if (patLen > 0 && pattern[patLen-1] == '*') {
+        pMod->classMatch.patternKind = kPatternPrefix;
+        pMod->classMatch.patternLen = patLen - 1;
+    } else {
+        pMod->classMatch.patternKind = kPatternExact;
+        pMod->classMatch.patternLen = patLen;
+    }
+}
+
+/*
+ * Pick the index chain for an event.
+ *
+ * An event with a LocationOnly mod can only match at that location, and
+ * one with an exact ClassMatch can only match that class, so we file
+ * them under the location or class.  Everything else is filed by kind.
+ *
+ * Count mods are decremented for every event of the right kind that
+ * reaches them, so we can't use a mod that comes after a Count mod to
+ * rule out an event.
+ */
+static JdwpEvent** chooseIndexChain(JdwpState* state, const JdwpEvent* pEvent)
+{
+    for (int i = 0; i < pEvent->modCount; i++) {
+        const JdwpEventMod* pMod = &pEvent->mods[i];
+        if (pMod->modKind == MK_COUNT)
+            break;
+        if (pMod->modKind == MK_LOCATION_ONLY) {
+            return &state->eventsByLocation[
+                locationHash(&pMod->locationOnly.loc)];
+        }
+        if (pMod->modKind == MK_CLASS_MATCH &&
+            pMod->classMatch.patternKind == kPatternExact)
+        {
+            return &state->eventsByClass[
+                classNameHash(pMod->classMatch.classPattern)];
+        }
+    }
+
+    return &state->eventsByKind[pEvent->eventKind &
+        (kJdwpEventKindBuckets - 1)];
+}
+
+/*
+ * Add an event to the appropriate index chain.
+ */
+static void addToIndex(JdwpState* state, JdwpEvent* pEvent)
+{
+    JdwpEvent** pHead = chooseIndexChain(state, pEvent);
+
+    pEvent->indexHead = pHead;
+    pEvent->indexPrev = NULL;
+    pEvent->indexNext = *pHead;
+    if (*pHead != NULL)
+        (*pHead)->indexPrev = pEvent;
+    *pHead = pEvent;
+}
+
+/*
+ * Remove an event from its index chain.
+ */
+static void removeFromIndex(JdwpEvent* pEvent)
+{
+    if (pEvent->indexPrev == NULL) {
+        assert(*pEvent->indexHead == pEvent);
+        *pEvent->indexHead = pEvent->indexNext;
+    } else {
+        pEvent->indexPrev->indexNext = pEvent->indexNext;
+    }
+    if (pEvent->indexNext != NULL)
+        pEvent->indexNext->indexPrev = pEvent->indexPrev;
+
+    pEvent->indexPrev = pEvent->indexNext = NULL;
+    pEvent->indexHead = NULL;
+}
+
 /*
  * Add an event to the list.  Ordering is not important.
  *
@@ -209,6 +318,10 @@ JdwpError dvmJdwpRegisterEvent(JdwpState* state, JdwpEvent* pEvent)
         } else if (pMod->modKind == MK_FIELD_ONLY) {
             /* should be for EK_FIELD_ACCESS or EK_FIELD_MODIFICATION */
             dumpEvent(pEvent);  /* TODO - need for field watches */
+        } else if (pMod->modKind == MK_CLASS_MATCH ||
+                   pMod->modKind == MK_CLASS_EXCLUDE)
+        {
+            compilePattern(&pEvent->mods[i]);
         }
     }
 
@@ -221,6 +334,7 @@ JdwpError dvmJdwpRegisterEvent(JdwpState* state, JdwpEvent* pEvent)
     }
     state->eventList = pEvent;
     state->numEvents++;
+    addToIndex(state, pEvent);
 
     unlockEventMutex(state);
 
@@ -251,6 +365,7 @@ static void unregisterEvent(JdwpState* state, JdwpEvent* pEvent)
         pEvent->next = NULL;
     }
     pEvent->prev = NULL;
+    removeFromIndex(pEvent);
 
     /*
      * Unhook us from the interpreter, if necessary.
@@ -306,6 +421,9 @@ void dvmJdwpUnregisterAll(JdwpState* state)
 {
     lockEventMutex(state);
 
+    /* there may be thousands of breakpoints; don't lock for each one */
+    dvmDbgBeginLocationBatch();
+
     JdwpEvent* pEvent = state->eventList;
     while (pEvent != NULL) {
         JdwpEvent* pNextEvent = pEvent->next;
@@ -315,6 +433,8 @@ void dvmJdwpUnregisterAll(JdwpState* state)
         pEvent = pNextEvent;
     }
 
+    dvmDbgEndLocationBatch();
+
     state->eventList = NULL;
 
     unlockEventMutex(state);
@@ -349,6 +469,7 @@ void dvmJdwpEventFree(JdwpEvent* pEvent)
     /* make sure it was removed from the list */
     assert(pEvent->prev == NULL);
     assert(pEvent->next == NULL);
+    assert(pEvent->indexHead == NULL);
     /* want to assert state->eventList != pEvent */
 
     /*
@@ -369,19 +490,37 @@ void dvmJdwpEventFree(JdwpEvent* pEvent)
 }
 
 /*
- * Allocate storage for matching events.  To keep things simple we
- * use an array with enough storage for the entire list.
+ * Get storage for matching events.  To keep things simple we use an
+ * array with enough storage for the entire list.
+ *
+ * Since the eventLock is held until the match list is cleaned up, only
+ * one list can be in use at a time, so we keep a single array around
+ * and grow it as needed.
  *
  * The state->eventLock should be held before calling.
  */
 static JdwpEvent** allocMatchList(JdwpState* state)
 {
-    return (JdwpEvent**) malloc(sizeof(JdwpEvent*) * state->numEvents);
+    if (state->matchListPoolSize < state->numEvents) {
+        int newSize = state->matchListPoolSize * 2;
+        if (newSize < state->numEvents)
+            newSize = state->numEvents;
+        JdwpEvent** newPool = (JdwpEvent**)
+            realloc(state->matchListPool, sizeof(JdwpEvent*) * newSize);
+        if (newPool == NULL) {
+            ALOGE("Unable to grow JDWP match list to %d entries", newSize);
+            dvmAbort();
+        }
+        state->matchListPool = newPool;
+        state->matchListPoolSize = newSize;
+    }
+
+    return state->matchListPool;
 }
 
 /*
  * Run through the list and remove any entries with an expired "count" mod
- * from the event list, then free the match list.
+ * from the event list.  The match list itself stays in the pool.
  */
 static void cleanupMatchList(JdwpState* state, JdwpEvent** matchList,
     int matchCount)
@@ -404,34 +543,36 @@ static void cleanupMatchList(JdwpState* state, JdwpEvent** matchList,
 
         ppEvent++;
     }
-
-    free(matchList);
 }
 
 /*
- * Match a string against a "restricted regular expression", which is just
- * a string that may start or end with '*' (e.g. "*.Foo" or "java.*").
+ * Match a class name against a "restricted regular expression", which is
+ * just a string that may start or end with '*' (e.g. "*.Foo" or "java.*").
+ * The pattern was examined by compilePattern() when the event was
+ * registered.
  *
  * ("Restricted name globbing" might have been a better term.)
  */
-static bool patternMatch(const char* pattern, const char* target)
+static bool patternMatch(const JdwpEventMod* pMod, ModBasket* basket)
 {
-    int patLen = strlen(pattern);
+    const char* pattern = pMod->classMatch.classPattern;
+    int patLen = pMod->classMatch.patternLen;
 
-    if (pattern[0] == '*') {
-        int targetLen = strlen(target);
-        patLen--;
-        // TODO: remove printf when we find a test case to verify this
-        ALOGE(">>> comparing '%s' to '%s'",
-            pattern+1, target + (targetLen-patLen));
-
-        if (targetLen < patLen)
-            return false;
-        return strcmp(pattern+1, target + (targetLen-patLen)) == 0;
-    } else if (pattern[patLen-1] == '*') {
-        return strncmp(pattern, target, patLen-1) == 0;
-    } else {
-        return strcmp(pattern, target) == 0;
+    switch (pMod->classMatch.patternKind) {
+    case kPatternSuffix:
+        {
+            if (basket->classNameLen < 0)
+                basket->classNameLen = strlen(basket->className);
+            int targetLen = basket->classNameLen;
+            if (targetLen < patLen)
+                return false;
+            return memcmp(pattern+1, basket->className + (targetLen-patLen),
+                patLen) == 0;
+        }
+    case kPatternPrefix:
+        return strncmp(pattern, basket->className, patLen) == 0;
+    default:
+        return strcmp(pattern, basket->className) == 0;
     }
 }
 
@@ -480,13 +621,11 @@ static bool modsMatch(JdwpState* state, JdwpEvent* pEvent, ModBasket* basket)
                 return false;
             break;
         case MK_CLASS_MATCH:
-            if (!patternMatch(pMod->classMatch.classPattern,
-                    basket->className))
+            if (!patternMatch(pMod, basket))
                 return false;
             break;
         case MK_CLASS_EXCLUDE:
-            if (patternMatch(pMod->classMatch.classPattern,
-                    basket->className))
+            if (patternMatch(pMod, basket))
                 return false;
             break;
         case MK_LOCATION_ONLY:
@@ -525,10 +664,35 @@ static bool modsMatch(JdwpState* state, JdwpEvent* pEvent, ModBasket* basket)
     return true;
 }
 
+/*
+ * Check the events on one index chain.  Returns the updated match list
+ * pointer.
+ */
+static JdwpEvent** matchIndexChain(JdwpState* state, JdwpEvent* pEvent,
+    JdwpEventKind eventKind, ModBasket* basket, JdwpEvent** matchList,
+    int* pMatchCount)
+{
+    while (pEvent != NULL) {
+        if (pEvent->eventKind == eventKind && modsMatch(state, pEvent, basket))
+        {
+            *matchList++ = pEvent;
+            (*pMatchCount)++;
+        }
+
+        pEvent = pEvent->indexNext;
+    }
+
+    return matchList;
+}
+
 /*
  * Find all events of type "eventKind" with mods that match up with the
  * rest of the arguments.
  *
+ * Rather than walking the full event list, we only look at the events
+ * filed under this location, this class name, and this event kind.  The
+ * others can't match (see chooseIndexChain()).
+ *
  * Found events are appended to "matchList", and "*pMatchCount" is advanced,
  * so this may be called multiple times for grouped events.
  *
@@ -541,16 +705,19 @@ static void findMatchingEvents(JdwpState* state, JdwpEventKind eventKind,
     /* start after the existing entries */
     matchList += *pMatchCount;
 
-    JdwpEvent* pEvent = state->eventList;
-    while (pEvent != NULL) {
-        if (pEvent->eventKind == eventKind && modsMatch(state, pEvent, basket))
-        {
-            *matchList++ = pEvent;
-            (*pMatchCount)++;
-        }
-
-        pEvent = pEvent->next;
+    if (basket->pLoc != NULL) {
+        matchList = matchIndexChain(state,
+            state->eventsByLocation[locationHash(basket->pLoc)],
+            eventKind, basket, matchList, pMatchCount);
     }
+    if (basket->className != NULL) {
+        matchList = matchIndexChain(state,
+            state->eventsByClass[classNameHash(basket->className)],
+            eventKind, basket, matchList, pMatchCount);
+    }
+    matchIndexChain(state,
+        state->eventsByKind[eventKind & (kJdwpEventKindBuckets - 1)],
+        eventKind, basket, matchList, pMatchCount);
 }
 
 /*
@@ -814,6 +981,7 @@ bool dvmJdwpPostLocationEvent(JdwpState* state, const JdwpLocation* pLoc,
     char* nameAlloc = NULL;
 
     memset(&basket, 0, sizeof(basket));
+    basket.classNameLen = -1;
     basket.pLoc = pLoc;
     basket.classId = pLoc->classId;
     basket.thisPtr = thisPtr;
@@ -932,6 +1100,7 @@ bool dvmJdwpPostThreadChange(JdwpState* state, ObjectId threadId, bool start)
 
     ModBasket basket;
     memset(&basket, 0, sizeof(basket));
+    basket.classNameLen = -1;
     basket.threadId = threadId;
 
     /* don't allow the list to be updated while we scan it */
@@ -1027,6 +1196,7 @@ bool dvmJdwpPostException(JdwpState* state, const JdwpLocation* pThrowLoc,
     char* nameAlloc = NULL;
 
     memset(&basket, 0, sizeof(basket));
+    basket.classNameLen = -1;
     basket.pLoc = pThrowLoc;
     basket.classId = pThrowLoc->classId;
     basket.threadId = dvmDbgGetThreadSelfId();
@@ -1087,9 +1257,6 @@ bool dvmJdwpPostException(JdwpState* state, const JdwpLocation* pThrowLoc,
             expandBufAdd8BE(pReq, exceptionId);
             dvmJdwpAddLocation(pReq, pCatchLoc);
         }
-
-        /* don't let the GC discard it */
-        dvmDbgRegisterObjectId(exceptionId);
     }
 
     cleanupMatchList(state, matchList, matchCount);
@@ -1125,6 +1292,7 @@ bool dvmJdwpPostClassPrepare(JdwpState* state, int tag, RefTypeId refTypeId,
     char* nameAlloc = NULL;
 
     memset(&basket, 0, sizeof(basket));
+    basket.classNameLen = -1;
     basket.classId = refTypeId;
     basket.threadId = dvmDbgGetThreadSelfId();
     basket.className = nameAlloc =
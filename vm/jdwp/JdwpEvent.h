@@ -22,6 +22,17 @@
 #include "JdwpConstants.h"
 #include "ExpandBuf.h"
 
+/*
+ * How a ClassMatch or ClassExclude pattern is compared against a class
+ * name.  Patterns may start or end with '*'; we work out which when the
+ * event is registered.
+ */
+enum JdwpPatternKind {
+    kPatternExact = 0,          /* "java.lang.Object" */
+    kPatternPrefix,             /* "java.*" */
+    kPatternSuffix,             /* "*.Foo" */
+};
+
 /*
  * Event modifiers.  A JdwpEvent may have zero or more of these.
  */
@@ -45,10 +56,14 @@ union JdwpEventMod {
     } classOnly;
     struct {
         u1          modKind;
+        u1          patternKind;    /* JdwpPatternKind */
+        int         patternLen;     /* #of chars to compare */
         char*       classPattern;
     } classMatch;
     struct {
         u1          modKind;
+        u1          patternKind;    /* must match classMatch layout */
+        int         patternLen;
         char*       classPattern;
     } classExclude;
     struct {
@@ -87,6 +102,14 @@ struct JdwpEvent {
     JdwpEvent* prev;           /* linked list */
     JdwpEvent* next;
 
+    /*
+     * Each event is also on exactly one index chain (by location, class
+     * name, or kind); "indexHead" points at the head of that chain.
+     */
+    JdwpEvent* indexPrev;
+    JdwpEvent* indexNext;
+    JdwpEvent** indexHead;
+
     JdwpEventKind eventKind;      /* what kind of event is this? */
     JdwpSuspendPolicy suspendPolicy;  /* suspend all, none, or self? */
     int modCount;       /* #of entries in mods[] */
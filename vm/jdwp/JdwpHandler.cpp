@@ -93,6 +93,17 @@ static void jdwpWriteValue(ExpandBuf* pReply, int width, u8 value)
     }
 }
 
+/*
+ * Returns "true" if "id" can't name a live thread or thread group: either
+ * it's null, or the object it referred to has been collected.  The
+ * dvmDbg thread accessors fail cleanly on such IDs, but we'd rather hand
+ * the debugger the right error code than a half-filled reply.
+ */
+static bool isStaleObjectId(ObjectId id)
+{
+    return id == 0 || dvmDbgIsCollected(id);
+}
+
 /*
  * Common code for *_InvokeMethod requests.
  *
@@ -106,6 +117,9 @@ static JdwpError finishInvoke(JdwpState* state,
 {
     assert(!isConstructor || objectId != 0);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     u4 numArgs = read4BE(&buf);
 
     ALOGV("    --> threadId=%llx objectId=%llx", threadId, objectId);
@@ -774,6 +788,9 @@ static JdwpError handleCT_NewInstance(JdwpState* state,
     ObjectId threadId = dvmReadObjectId(&buf);
     MethodId methodId = dvmReadMethodId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     ALOGV("Creating instance of %s", dvmDbgGetClassDescriptor(classId));
     ObjectId objectId = dvmDbgCreateObject(classId);
     if (objectId == 0)
@@ -857,6 +874,8 @@ static JdwpError handleOR_ReferenceType(JdwpState* state,
 {
     ObjectId objectId = dvmReadObjectId(&buf);
     ALOGV("  Req for type of objectId=0x%llx", objectId);
+    if (dvmDbgIsCollected(objectId))
+        return ERR_INVALID_OBJECT;
 
     u1 refTypeTag;
     RefTypeId typeId;
@@ -878,6 +897,8 @@ static JdwpError handleOR_GetValues(JdwpState* state,
     u4 numFields = read4BE(&buf);
 
     ALOGV("  Req for %d fields from objectId=0x%llx", numFields, objectId);
+    if (dvmDbgIsCollected(objectId))
+        return ERR_INVALID_OBJECT;
 
     expandBufAdd4BE(pReply, numFields);
 
@@ -899,6 +920,8 @@ static JdwpError handleOR_SetValues(JdwpState* state,
     u4 numFields = read4BE(&buf);
 
     ALOGV("  Req to set %d fields in objectId=0x%llx", numFields, objectId);
+    if (dvmDbgIsCollected(objectId))
+        return ERR_INVALID_OBJECT;
 
     for (u4 i = 0; i < numFields; i++) {
         FieldId fieldId = dvmReadFieldId(&buf);
@@ -935,6 +958,9 @@ static JdwpError handleOR_InvokeMethod(JdwpState* state,
     RefTypeId classId = dvmReadRefTypeId(&buf);
     MethodId methodId = dvmReadMethodId(&buf);
 
+    if (dvmDbgIsCollected(objectId))
+        return ERR_INVALID_OBJECT;
+
     return finishInvoke(state, buf, dataLen, pReply,
             threadId, objectId, classId, methodId, false);
 }
@@ -945,7 +971,11 @@ static JdwpError handleOR_InvokeMethod(JdwpState* state,
 static JdwpError handleOR_DisableCollection(JdwpState* state,
     const u1* buf, int dataLen, ExpandBuf* pReply)
 {
-    // this is currently a no-op
+    ObjectId objectId = dvmReadObjectId(&buf);
+    ALOGV("  Req DisableCollection(0x%llx)", objectId);
+
+    if (!dvmDbgDisableCollection(objectId))
+        return ERR_INVALID_OBJECT;
     return ERR_NONE;
 }
 
@@ -955,7 +985,11 @@ static JdwpError handleOR_DisableCollection(JdwpState* state,
 static JdwpError handleOR_EnableCollection(JdwpState* state,
     const u1* buf, int dataLen, ExpandBuf* pReply)
 {
-    // this is currently a no-op
+    ObjectId objectId = dvmReadObjectId(&buf);
+    ALOGV("  Req EnableCollection(0x%llx)", objectId);
+
+    if (!dvmDbgEnableCollection(objectId))
+        return ERR_INVALID_OBJECT;
     return ERR_NONE;
 }
 
@@ -970,8 +1004,7 @@ static JdwpError handleOR_IsCollected(JdwpState* state,
     objectId = dvmReadObjectId(&buf);
     ALOGV("  Req IsCollected(0x%llx)", objectId);
 
-    // TODO: currently returning false; must integrate with GC
-    expandBufAdd1(pReply, 0);
+    expandBufAdd1(pReply, dvmDbgIsCollected(objectId));
 
     return ERR_NONE;
 }
@@ -983,6 +1016,8 @@ static JdwpError handleSR_Value(JdwpState* state,
     const u1* buf, int dataLen, ExpandBuf* pReply)
 {
     ObjectId stringObject = dvmReadObjectId(&buf);
+    if (dvmDbgIsCollected(stringObject))
+        return ERR_INVALID_OBJECT;
     char* str = dvmDbgStringToUtf8(stringObject);
 
     ALOGV("  Req for str %llx --> '%s'", stringObject, str);
@@ -1001,6 +1036,9 @@ static JdwpError handleTR_Name(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     ALOGV("  Req for name of thread 0x%llx", threadId);
     char* name = dvmDbgGetThreadName(threadId);
     if (name == NULL)
@@ -1023,6 +1061,8 @@ static JdwpError handleTR_Suspend(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
     if (threadId == dvmDbgGetThreadSelfId()) {
         ALOGI("  Warning: ignoring request to suspend self");
         return ERR_THREAD_NOT_SUSPENDED;
@@ -1042,6 +1082,8 @@ static JdwpError handleTR_Resume(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
     if (threadId == dvmDbgGetThreadSelfId()) {
         ALOGI("  Warning: ignoring request to resume self");
         return ERR_NONE;
@@ -1061,6 +1103,9 @@ static JdwpError handleTR_Status(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     ALOGV("  Req for status of thread 0x%llx", threadId);
 
     u4 threadStatus;
@@ -1086,7 +1131,9 @@ static JdwpError handleTR_ThreadGroup(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
-    /* currently not handling these */
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     ObjectId threadGroupId = dvmDbgGetThreadGroup(threadId);
     expandBufAddObjectId(pReply, threadGroupId);
 
@@ -1106,7 +1153,7 @@ static JdwpError handleTR_Frames(JdwpState* state,
     u4 startFrame = read4BE(&buf);
     u4 length = read4BE(&buf);
 
-    if (!dvmDbgThreadExists(threadId))
+    if (isStaleObjectId(threadId) || !dvmDbgThreadExists(threadId))
         return ERR_INVALID_THREAD;
     if (!dvmDbgIsSuspended(threadId)) {
         ALOGV("  Rejecting req for frames in running thread '%s' (%llx)",
@@ -1152,7 +1199,7 @@ static JdwpError handleTR_FrameCount(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
-    if (!dvmDbgThreadExists(threadId))
+    if (isStaleObjectId(threadId) || !dvmDbgThreadExists(threadId))
         return ERR_INVALID_THREAD;
     if (!dvmDbgIsSuspended(threadId)) {
         ALOGV("  Rejecting req for frames in running thread '%s' (%llx)",
@@ -1195,6 +1242,9 @@ static JdwpError handleTR_SuspendCount(JdwpState* state,
 {
     ObjectId threadId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(threadId))
+        return ERR_INVALID_THREAD;
+
     u4 suspendCount = dvmDbgGetThreadSuspendCount(threadId);
     expandBufAdd4BE(pReply, suspendCount);
 
@@ -1212,14 +1262,16 @@ static JdwpError handleTGR_Name(JdwpState* state,
     ObjectId threadGroupId = dvmReadObjectId(&buf);
     ALOGV("  Req for name of threadGroupId=0x%llx", threadGroupId);
 
+    if (isStaleObjectId(threadGroupId))
+        return ERR_INVALID_THREAD_GROUP;
+
     char* name = dvmDbgGetThreadGroupName(threadGroupId);
-    if (name != NULL)
-        expandBufAddUtf8String(pReply, (u1*) name);
-    else {
-        expandBufAddUtf8String(pReply, (u1*) "BAD-GROUP-ID");
+    if (name == NULL) {
         ALOGW("bad thread group ID");
+        return ERR_INVALID_THREAD_GROUP;
     }
 
+    expandBufAddUtf8String(pReply, (u1*) name);
     free(name);
 
     return ERR_NONE;
@@ -1234,6 +1286,9 @@ static JdwpError handleTGR_Parent(JdwpState* state,
 {
     ObjectId groupId = dvmReadObjectId(&buf);
 
+    if (isStaleObjectId(groupId))
+        return ERR_INVALID_THREAD_GROUP;
+
     ObjectId parentGroup = dvmDbgGetThreadGroupParent(groupId);
     expandBufAddObjectId(pReply, parentGroup);
 
@@ -1250,6 +1305,9 @@ static JdwpError handleTGR_Children(JdwpState* state,
     ObjectId threadGroupId = dvmReadObjectId(&buf);
     ALOGV("  Req for threads in threadGroupId=0x%llx", threadGroupId);
 
+    if (isStaleObjectId(threadGroupId))
+        return ERR_INVALID_THREAD_GROUP;
+
     ObjectId* pThreadIds;
     u4 threadCount;
     dvmDbgGetThreadGroupThreads(threadGroupId, &pThreadIds, &threadCount);
@@ -1283,6 +1341,8 @@ static JdwpError handleAR_Length(JdwpState* state,
 {
     ObjectId arrayId = dvmReadObjectId(&buf);
     ALOGV("  Req for length of array 0x%llx", arrayId);
+    if (dvmDbgIsCollected(arrayId))
+        return ERR_INVALID_OBJECT;
 
     u4 arrayLength = dvmDbgGetArrayLength(arrayId);
 
@@ -1303,6 +1363,8 @@ static JdwpError handleAR_GetValues(JdwpState* state,
     u4 firstIndex = read4BE(&buf);
     u4 length = read4BE(&buf);
 
+    if (dvmDbgIsCollected(arrayId))
+        return ERR_INVALID_OBJECT;
     u1 tag = dvmDbgGetArrayElementTag(arrayId);
     ALOGV("  Req for array values 0x%llx first=%d len=%d (elem tag=%c)",
         arrayId, firstIndex, length, tag);
@@ -1328,6 +1390,8 @@ static JdwpError handleAR_SetValues(JdwpState* state,
 
     ALOGV("  Req to set array values 0x%llx first=%d count=%d",
         arrayId, firstIndex, values);
+    if (dvmDbgIsCollected(arrayId))
+        return ERR_INVALID_OBJECT;
 
     if (!dvmDbgSetArrayElements(arrayId, firstIndex, values, buf))
         return ERR_INVALID_LENGTH;
@@ -1348,6 +1412,8 @@ static JdwpError handleCLR_VisibleClasses(JdwpState* state,
     int i;
 
     classLoaderObject = dvmReadObjectId(&buf);
+    if (dvmDbgIsCollected(classLoaderObject))
+        return ERR_INVALID_OBJECT;
 
     dvmDbgGetVisibleClassList(classLoaderObject, &numClasses, &classRefBuf);
 
@@ -1420,6 +1486,10 @@ static JdwpError handleER_Set(JdwpState* state,
             {
                 ObjectId threadId = dvmReadObjectId(&buf);
                 LOGVV("    ThreadOnly: %llx", threadId);
+                if (isStaleObjectId(threadId)) {
+                    dvmJdwpEventFree(pEvent);
+                    return ERR_INVALID_THREAD;
+                }
                 pEvent->mods[idx].threadOnly.threadId = threadId;
             }
             break;
@@ -1504,6 +1574,10 @@ static JdwpError handleER_Set(JdwpState* state,
                 LOGVV("    Step: thread=%llx size=%s depth=%s",
                     threadId, dvmJdwpStepSizeStr(size),
                     dvmJdwpStepDepthStr(depth));
+                if (isStaleObjectId(threadId)) {
+                    dvmJdwpEventFree(pEvent);
+                    return ERR_INVALID_THREAD;
+                }
 
                 pEvent->mods[idx].step.threadId = threadId;
                 pEvent->mods[idx].step.size = size;
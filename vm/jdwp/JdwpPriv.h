@@ -67,6 +67,15 @@ const JdwpTransport* dvmJdwpSocketTransport();
 const JdwpTransport* dvmJdwpAndroidAdbTransport();
 
 
+/*
+ * Sizes of the event index hash tables.  These must be powers of two.
+ * The event kind table is big enough that none of the JdwpEventKind
+ * values collide.
+ */
+#define kJdwpEventKindBuckets   64
+#define kJdwpLocationBuckets    256
+#define kJdwpClassBuckets       64
+
 /*
  * State for JDWP functions.
  */
@@ -104,6 +113,19 @@ struct JdwpState {
     JdwpEvent*      eventList;      /* linked list of events */
     pthread_mutex_t eventLock;      /* guards numEvents/eventList */
 
+    /*
+     * Indexes into eventList, so posting an event only has to look at
+     * the registered events that could plausibly match.  Also guarded
+     * by eventLock.
+     */
+    JdwpEvent*      eventsByKind[kJdwpEventKindBuckets];
+    JdwpEvent*      eventsByLocation[kJdwpLocationBuckets];
+    JdwpEvent*      eventsByClass[kJdwpClassBuckets];
+
+    /* scratch storage for matching events; guarded by eventLock */
+    JdwpEvent**     matchListPool;
+    int             matchListPoolSize;
+
     /*
      * Synchronize suspension of event thread (to avoid receiving "resume"
      * events before the thread has finished suspending itself).
@@ -1887,7 +1887,28 @@ HANDLE_OPCODE(OP_SPARSE_SWITCH /*vAA, +BBBB*/)
 #endif
         testVal = GET_REGISTER(vsrc1);
 
-        offset = dvmInterpHandleSparseSwitch(switchData, testVal);
+        /*
+         * Most sparse switches only have a handful of keys; scan those
+         * here rather than calling out to the binary search.
+         */
+        if (switchData[0] == kSparseSwitchSignature && switchData[1] <= 4) {
+            const s4* keys = (const s4*) (switchData + 2);
+            int size = switchData[1];
+            int i;
+
+            offset = 3;
+            for (i = 0; i < size; i++) {
+                s4 key = s4FromSwitchData(&keys[i]);
+                if (key == (s4) testVal) {
+                    offset = s4FromSwitchData(&keys[size + i]);
+                    break;
+                }
+                if (key > (s4) testVal)
+                    break;
+            }
+        } else {
+            offset = dvmInterpHandleSparseSwitch(switchData, testVal);
+        }
         ILOGV("> branch taken (0x%04x)", offset);
         if (offset <= 0)  /* uncommon */
             PERIODIC_CHECKS(offset);
@@ -92,6 +92,18 @@ void dvmInternalNativeShutdown()
     dvmHashTableFree(gDvm.userDexFiles);
 }
 
+/*
+ * Print the interface cache stats for each DEX file the app loaded.
+ */
+void dvmDumpUserDexCacheStats()
+{
+    if (gDvm.userDexFiles == NULL)
+        return;
+    dvmHashTableLock(gDvm.userDexFiles);
+    dvmHashForeach(gDvm.userDexFiles, dvmDumpDexOrJarCacheStats, NULL);
+    dvmHashTableUnlock(gDvm.userDexFiles);
+}
+
 /*
  * Search the internal native set for a match.
  */
@@ -23,6 +23,9 @@
 bool dvmInternalNativeStartup(void);
 void dvmInternalNativeShutdown(void);
 
+/* print the interface cache stats of the user-loaded DEX files */
+void dvmDumpUserDexCacheStats(void);
+
 /* search the internal native set for a match */
 DalvikNativeFunc dvmLookupInternalNativeMethod(const Method* method);
 
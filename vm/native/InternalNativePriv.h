@@ -79,6 +79,11 @@ u4 dvmFixMethodFlags(u4 flags);
  */
 void dvmFreeDexOrJar(void* vptr);
 
+/*
+ * dvmHashForeach callback that prints a DexOrJar's interface cache stats.
+ */
+int dvmDumpDexOrJarCacheStats(void* vptr, void* arg);
+
 /*
  * Tables of methods.
  */
@@ -61,6 +61,25 @@ void dvmFreeDexOrJar(void* vptr)
     free(pDexOrJar);
 }
 
+/*
+ * (This is a dvmHashForeach callback.)
+ */
+int dvmDumpDexOrJarCacheStats(void* vptr, void* arg)
+{
+    DexOrJar* pDexOrJar = (DexOrJar*) vptr;
+    DvmDex* pDvmDex;
+
+    if (pDexOrJar->isDex)
+        pDvmDex = dvmGetRawDexFileDex(pDexOrJar->pRawDexFile);
+    else
+        pDvmDex = dvmGetJarFileDex(pDexOrJar->pJarFile);
+    if (pDvmDex != NULL) {
+        dvmFprintf(stdout, "%s: ", pDexOrJar->fileName);
+        dvmDumpAtomicCacheStats(pDvmDex->pInterfaceCache);
+    }
+    return 0;
+}
+
 /*
  * (This is a dvmHashTableLookup compare func.)
  *
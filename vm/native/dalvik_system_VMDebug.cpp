@@ -680,9 +680,7 @@ static void Dalvik_dalvik_system_VMDebug_cacheRegisterMap(const u4* args,
         /*
          * Got it.  See if there's a register map here.
          */
-        const RegisterMap* pMap;
-        pMap = dvmGetExpandedRegisterMap(method);
-        if (pMap == NULL) {
+        if (!dvmPrepareRegisterMap(method)) {
             ALOGV("No map for %s.%s %s",
                 classAndMethodDesc, methodName, methodDescr);
         } else {
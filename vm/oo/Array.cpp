@@ -408,7 +408,8 @@ static ClassObject* createArrayClass(const char* descriptor, Object* loader)
      */
     newClass->interfaceCount = 2;
     newClass->interfaces = (ClassObject**)dvmLinearAlloc(newClass->classLoader,
-                                sizeof(ClassObject*) * 2);
+                                sizeof(ClassObject*) * 2,
+                                kLinearAllocInterfaces);
     memset(newClass->interfaces, 0, sizeof(ClassObject*) * 2);
     newClass->interfaces[0] =
         dvmFindSystemClassNoInit("Ljava/lang/Cloneable;");
@@ -431,12 +432,15 @@ static ClassObject* createArrayClass(const char* descriptor, Object* loader)
      */
     newClass->iftableCount = 2;
     newClass->iftable = (InterfaceEntry*) dvmLinearAlloc(newClass->classLoader,
-                                sizeof(InterfaceEntry) * 2);
+                                sizeof(InterfaceEntry) * 2,
+                                kLinearAllocInterfaces);
     memset(newClass->iftable, 0, sizeof(InterfaceEntry) * 2);
     newClass->iftable[0].clazz = newClass->interfaces[0];
     newClass->iftable[1].clazz = newClass->interfaces[1];
     dvmLinearReadOnly(newClass->classLoader, newClass->iftable);
 
+    dvmBuildTypeCheckTables(newClass);
+
     /*
      * Inherit access flags from the element.  Arrays can't be used as a
      * superclass or interface, so we want to add "abstract final" and remove
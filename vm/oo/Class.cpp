@@ -23,6 +23,7 @@
 
 #include "Dalvik.h"
 #include "libdex/DexClass.h"
+#include "oo/LinkImage.h"
 #include "analysis/Optimize.h"
 
 #include <stdlib.h>
@@ -186,8 +187,10 @@ static void loadIFieldFromDex(ClassObject* clazz,
 static bool precacheReferenceOffsets(ClassObject* clazz);
 static void computeRefOffsets(ClassObject* clazz);
 static void freeMethodInnards(Method* meth);
-static bool createVtable(ClassObject* clazz);
-static bool createIftable(ClassObject* clazz);
+static bool createVtable(ClassObject* clazz,
+    const LinkImageClass** ppImage);
+static bool createIftable(ClassObject* clazz, const LinkImageClass* pImage);
+static void createItable(ClassObject* clazz);
 static bool insertMethodStubs(ClassObject* clazz);
 static bool computeFieldOffsets(ClassObject* clazz);
 static void throwEarlierClassFailure(ClassObject* clazz);
@@ -228,47 +231,48 @@ static void linearAllocTests()
 
     switch (test) {
     case 0:
-        fiddle = (char*)dvmLinearAlloc(NULL, 3200-28);
+        fiddle = (char*)dvmLinearAlloc(NULL, 3200-28, kLinearAllocOther);
         dvmLinearReadOnly(NULL, (char*)fiddle);
         break;
     case 1:
-        fiddle = (char*)dvmLinearAlloc(NULL, 3200-24);
+        fiddle = (char*)dvmLinearAlloc(NULL, 3200-24, kLinearAllocOther);
         dvmLinearReadOnly(NULL, (char*)fiddle);
         break;
     case 2:
-        fiddle = (char*)dvmLinearAlloc(NULL, 3200-20);
+        fiddle = (char*)dvmLinearAlloc(NULL, 3200-20, kLinearAllocOther);
         dvmLinearReadOnly(NULL, (char*)fiddle);
         break;
     case 3:
-        fiddle = (char*)dvmLinearAlloc(NULL, 3200-16);
+        fiddle = (char*)dvmLinearAlloc(NULL, 3200-16, kLinearAllocOther);
         dvmLinearReadOnly(NULL, (char*)fiddle);
         break;
     case 4:
-        fiddle = (char*)dvmLinearAlloc(NULL, 3200-12);
+        fiddle = (char*)dvmLinearAlloc(NULL, 3200-12, kLinearAllocOther);
         dvmLinearReadOnly(NULL, (char*)fiddle);
         break;
     }
-    fiddle = (char*)dvmLinearAlloc(NULL, 896);
+    fiddle = (char*)dvmLinearAlloc(NULL, 896, kLinearAllocOther);
     dvmLinearReadOnly(NULL, (char*)fiddle);
-    fiddle = (char*)dvmLinearAlloc(NULL, 20);      // watch addr of this alloc
+    // watch addr of this alloc
+    fiddle = (char*)dvmLinearAlloc(NULL, 20, kLinearAllocOther);
     dvmLinearReadOnly(NULL, (char*)fiddle);
 
-    fiddle = (char*)dvmLinearAlloc(NULL, 1);
+    fiddle = (char*)dvmLinearAlloc(NULL, 1, kLinearAllocOther);
     fiddle[0] = 'q';
     dvmLinearReadOnly(NULL, fiddle);
-    fiddle = (char*)dvmLinearAlloc(NULL, 4096);
+    fiddle = (char*)dvmLinearAlloc(NULL, 4096, kLinearAllocOther);
     fiddle[0] = 'x';
     fiddle[4095] = 'y';
     dvmLinearReadOnly(NULL, fiddle);
     dvmLinearFree(NULL, fiddle);
-    fiddle = (char*)dvmLinearAlloc(NULL, 0);
+    fiddle = (char*)dvmLinearAlloc(NULL, 0, kLinearAllocOther);
     dvmLinearReadOnly(NULL, fiddle);
-    fiddle = (char*)dvmLinearRealloc(NULL, fiddle, 12);
+    fiddle = (char*)dvmLinearRealloc(NULL, fiddle, 12, kLinearAllocOther);
     fiddle[11] = 'z';
     dvmLinearReadOnly(NULL, (char*)fiddle);
-    fiddle = (char*)dvmLinearRealloc(NULL, fiddle, 5);
+    fiddle = (char*)dvmLinearRealloc(NULL, fiddle, 5, kLinearAllocOther);
     dvmLinearReadOnly(NULL, fiddle);
-    fiddle = (char*)dvmLinearAlloc(NULL, 17001);
+    fiddle = (char*)dvmLinearAlloc(NULL, 17001, kLinearAllocOther);
     fiddle[0] = 'x';
     fiddle[17000] = 'y';
     dvmLinearReadOnly(NULL, (char*)fiddle);
@@ -276,10 +280,14 @@ static void linearAllocTests()
     char* str = (char*)dvmLinearStrdup(NULL, "This is a test!");
     ALOGI("GOT: '%s'", str);
 
-    /* try to check the bounds; allocator may round allocation size up */
-    fiddle = (char*)dvmLinearAlloc(NULL, 12);
-    ALOGI("Should be 1: %d", dvmLinearAllocContains(fiddle, 12));
-    ALOGI("Should be 0: %d", dvmLinearAllocContains(fiddle, 13));
+    /*
+     * Try to check the bounds.  Small allocations come out of a per-thread
+     * chunk, so use one that's big enough to come from the end of the
+     * shared region and doesn't need rounding.
+     */
+    fiddle = (char*)dvmLinearAlloc(NULL, 4092, kLinearAllocOther);
+    ALOGI("Should be 1: %d", dvmLinearAllocContains(fiddle, 4092));
+    ALOGI("Should be 0: %d", dvmLinearAllocContains(fiddle, 4093));
     ALOGI("Should be 0: %d", dvmLinearAllocContains(fiddle - 128*1024, 1));
 
     dvmLinearAllocDump(NULL);
@@ -504,6 +512,8 @@ void dvmClassShutdown()
  * ===========================================================================
  */
 
+static DvmDex* getClassPathEntryDex(const ClassPathEntry* cpe);
+
 /*
  * Dump the contents of a ClassPathEntry array.
  */
@@ -521,10 +531,10 @@ static void dumpClassPath(const ClassPathEntry* cpe)
         }
 
         ALOGI("  %2d: type=%s %s %p", idx, kindStr, cpe->fileName, cpe->ptr);
-        if (CALC_CACHE_STATS && cpe->kind == kCpeJar) {
-            JarFile* pJarFile = (JarFile*) cpe->ptr;
-            DvmDex* pDvmDex = dvmGetJarFileDex(pJarFile);
-            dvmDumpAtomicCacheStats(pDvmDex->pInterfaceCache);
+        if (gDvm.atomicCacheStats) {
+            DvmDex* pDvmDex = getClassPathEntryDex(cpe);
+            if (pDvmDex != NULL)
+                dvmDumpAtomicCacheStats(pDvmDex->pInterfaceCache);
         }
 
         cpe++;
@@ -540,6 +550,26 @@ void dvmDumpBootClassPath()
     dumpClassPath(gDvm.bootClassPath);
 }
 
+/*
+ * Dump the interface cache stats of each DEX file on the bootstrap class
+ * path.
+ */
+void dvmDumpBootInterfaceCacheStats()
+{
+    const ClassPathEntry* cpe = gDvm.bootClassPath;
+
+    if (cpe == NULL)
+        return;
+    while (cpe->kind != kCpeLastEntry) {
+        DvmDex* pDvmDex = getClassPathEntryDex(cpe);
+        if (pDvmDex != NULL) {
+            dvmFprintf(stdout, "%s: ", cpe->fileName);
+            dvmDumpAtomicCacheStats(pDvmDex->pInterfaceCache);
+        }
+        cpe++;
+    }
+}
+
 /*
  * Returns "true" if the class path contains the specified path.
  */
@@ -763,6 +793,22 @@ bail:
     return cpe;
 }
 
+/*
+ * Get the DvmDex for a bootstrap class path entry.  Returns NULL if the
+ * entry is of an unknown kind.
+ */
+static DvmDex* getClassPathEntryDex(const ClassPathEntry* cpe)
+{
+    switch (cpe->kind) {
+    case kCpeJar:
+        return dvmGetJarFileDex((JarFile*) cpe->ptr);
+    case kCpeDex:
+        return dvmGetRawDexFileDex((RawDexFile*) cpe->ptr);
+    default:
+        return NULL;
+    }
+}
+
 /*
  * Search the DEX files we loaded from the bootstrap class path for a DEX
  * file that has the class with the matching descriptor.
@@ -773,56 +819,43 @@ bail:
 static DvmDex* searchBootPathForClass(const char* descriptor,
     const DexClassDef** ppClassDef)
 {
-    const ClassPathEntry* cpe = gDvm.bootClassPath;
+    const ClassPathEntry* cpe;
     const DexClassDef* pFoundDef = NULL;
     DvmDex* pFoundFile = NULL;
 
     LOGVV("+++ class '%s' not yet loaded, scanning bootclasspath...",
         descriptor);
 
-    while (cpe->kind != kCpeLastEntry) {
+    /*
+     * The lookup hash is the same for every DEX file, so compute it once
+     * and start fetching the candidate bucket from each file before we
+     * probe any of them.
+     */
+    u4 hash = dexComputeClassDescriptorHash(descriptor);
+    for (cpe = gDvm.bootClassPath; cpe->kind != kCpeLastEntry; cpe++) {
+        DvmDex* pDvmDex = getClassPathEntryDex(cpe);
+        if (pDvmDex != NULL)
+            dexPrefetchClassLookup(pDvmDex->pDexFile, hash);
+    }
+
+    for (cpe = gDvm.bootClassPath; cpe->kind != kCpeLastEntry; cpe++) {
         //ALOGV("+++  checking '%s' (%d)", cpe->fileName, cpe->kind);
 
-        switch (cpe->kind) {
-        case kCpeJar:
-            {
-                JarFile* pJarFile = (JarFile*) cpe->ptr;
-                const DexClassDef* pClassDef;
-                DvmDex* pDvmDex;
-
-                pDvmDex = dvmGetJarFileDex(pJarFile);
-                pClassDef = dexFindClass(pDvmDex->pDexFile, descriptor);
-                if (pClassDef != NULL) {
-                    /* found */
-                    pFoundDef = pClassDef;
-                    pFoundFile = pDvmDex;
-                    goto found;
-                }
-            }
-            break;
-        case kCpeDex:
-            {
-                RawDexFile* pRawDexFile = (RawDexFile*) cpe->ptr;
-                const DexClassDef* pClassDef;
-                DvmDex* pDvmDex;
-
-                pDvmDex = dvmGetRawDexFileDex(pRawDexFile);
-                pClassDef = dexFindClass(pDvmDex->pDexFile, descriptor);
-                if (pClassDef != NULL) {
-                    /* found */
-                    pFoundDef = pClassDef;
-                    pFoundFile = pDvmDex;
-                    goto found;
-                }
-            }
-            break;
-        default:
+        DvmDex* pDvmDex = getClassPathEntryDex(cpe);
+        if (pDvmDex == NULL) {
             ALOGE("Unknown kind %d", cpe->kind);
             assert(false);
-            break;
+            continue;
         }
 
-        cpe++;
+        const DexClassDef* pClassDef =
+            dexFindClassWithHash(pDvmDex->pDexFile, descriptor, hash);
+        if (pClassDef != NULL) {
+            /* found */
+            pFoundDef = pClassDef;
+            pFoundFile = pDvmDex;
+            goto found;
+        }
     }
 
     /*
@@ -837,8 +870,8 @@ static DvmDex* searchBootPathForClass(const char* descriptor,
     if (gDvm.bootClassPathOptExtra != NULL) {
         const DexClassDef* pClassDef;
 
-        pClassDef =
-            dexFindClass(gDvm.bootClassPathOptExtra->pDexFile, descriptor);
+        pClassDef = dexFindClassWithHash(gDvm.bootClassPathOptExtra->pDexFile,
+            descriptor, hash);
         if (pClassDef != NULL) {
             /* found */
             pFoundDef = pClassDef;
@@ -851,6 +884,18 @@ found:
     return pFoundFile;
 }
 
+/*
+ * Find the DexClassDef for a class on the bootstrap class path without
+ * loading it.  Returns NULL if the class isn't there.
+ */
+const DexClassDef* dvmFindBootClassDef(const char* descriptor,
+    DvmDex** ppDvmDex)
+{
+    const DexClassDef* pClassDef;
+    *ppDvmDex = searchBootPathForClass(descriptor, &pClassDef);
+    return (*ppDvmDex != NULL) ? pClassDef : NULL;
+}
+
 /*
  * Set the "extra" DEX, which becomes a de facto member of the bootstrap
  * class set.
@@ -1633,15 +1678,14 @@ static ClassObject* findClassNoInit(const char* descriptor, Object* loader,
         dvmUnlockObject(self, (Object*) clazz);
 
         /*
-         * Add class stats to global counters.
-         *
-         * TODO: these should probably be atomic ops.
+         * Add class stats to global counters.  Classes may be linked on
+         * several threads at once (see ClassPreload.cpp).
          */
-        gDvm.numLoadedClasses++;
-        gDvm.numDeclaredMethods +=
-            clazz->virtualMethodCount + clazz->directMethodCount;
-        gDvm.numDeclaredInstFields += clazz->ifieldCount;
-        gDvm.numDeclaredStaticFields += clazz->sfieldCount;
+        android_atomic_inc(&gDvm.numLoadedClasses);
+        android_atomic_add(clazz->virtualMethodCount + clazz->directMethodCount,
+            &gDvm.numDeclaredMethods);
+        android_atomic_add(clazz->ifieldCount, &gDvm.numDeclaredInstFields);
+        android_atomic_add(clazz->sfieldCount, &gDvm.numDeclaredStaticFields);
 
         /*
          * Cache pointers to basic classes.  We want to use these in
@@ -1811,7 +1855,8 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
     if (pInterfacesList != NULL) {
         newClass->interfaceCount = pInterfacesList->size;
         newClass->interfaces = (ClassObject**) dvmLinearAlloc(classLoader,
-                newClass->interfaceCount * sizeof(ClassObject*));
+                newClass->interfaceCount * sizeof(ClassObject*),
+                kLinearAllocInterfaces);
 
         for (i = 0; i < newClass->interfaceCount; i++) {
             const DexTypeItem* pType = dexGetTypeItem(pInterfacesList, i);
@@ -1856,7 +1901,8 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
 
             newClass->ifieldCount = count;
             newClass->ifields = (InstField*) dvmLinearAlloc(classLoader,
-                                                    count * sizeof(InstField));
+                                                    count * sizeof(InstField),
+                                                    kLinearAllocFields);
 
             for (i = 0; i < count; i++) {
                 dexReadClassDataField(&pEncodedData, &field, &lastIndex);
@@ -1907,7 +1953,7 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
 
         newClass->directMethodCount = count;
         newClass->directMethods = (Method*) dvmLinearAlloc(classLoader,
-                count * sizeof(Method));
+                count * sizeof(Method), kLinearAllocMethods);
         for (i = 0; i < count; i++) {
             dexReadClassDataMethod(&pEncodedData, &method, &lastIndex);
             loadMethodFromDex(newClass, &method, &newClass->directMethods[i]);
@@ -1931,7 +1977,7 @@ static ClassObject* loadClassFromDex0(DvmDex* pDvmDex,
 
         newClass->virtualMethodCount = count;
         newClass->virtualMethods = (Method*) dvmLinearAlloc(classLoader,
-                count * sizeof(Method));
+                count * sizeof(Method), kLinearAllocMethods);
         for (i = 0; i < count; i++) {
             dexReadClassDataMethod(&pEncodedData, &method, &lastIndex);
             loadMethodFromDex(newClass, &method, &newClass->virtualMethods[i]);
@@ -2101,6 +2147,11 @@ void dvmFreeClassInnards(ClassObject* clazz)
     clazz->ifviPoolCount = -1;
     NULL_AND_LINEAR_FREE(clazz->ifviPool);
 
+    clazz->superDepth = -1;
+    NULL_AND_LINEAR_FREE(clazz->superDisplay);
+    NULL_AND_LINEAR_FREE(clazz->ifHash);
+    NULL_AND_LINEAR_FREE(clazz->itable);
+
     clazz->sfieldCount = -1;
     /* The sfields are attached to the ClassObject, and will be freed
      * with it. */
@@ -2126,9 +2177,10 @@ static void freeMethodInnards(Method* meth)
 #endif
 
     /*
-     * Some register maps are allocated on the heap, either because of late
-     * verification or because we're caching an uncompressed form.
+     * Some register maps are allocated on the heap because of late
+     * verification.  The GC may also have cached an indexed form.
      */
+    dvmRegisterMapCacheRemove(meth);
     const RegisterMap* pMap = meth->registerMap;
     if (pMap != NULL && dvmRegisterMapGetOnHeap(pMap)) {
         dvmFreeRegisterMap((RegisterMap*) pMap);
@@ -2259,7 +2311,8 @@ void dvmMakeCodeReadWrite(Method* meth)
         meth->clazz->descriptor, meth->name, dexCodeSize);
 
     DexCode* newCode =
-        (DexCode*) dvmLinearAlloc(meth->clazz->classLoader, dexCodeSize);
+        (DexCode*) dvmLinearAlloc(meth->clazz->classLoader, dexCodeSize,
+            kLinearAllocCode);
     memcpy(newCode, methodDexCode, dexCodeSize);
 
     meth->insns = newCode->insns;
@@ -2524,6 +2577,7 @@ bool dvmLinkClass(ClassObject* clazz)
 {
     u4 superclassIdx = 0;
     u4 *interfaceIdxArray = NULL;
+    const LinkImageClass* pLinkImage = NULL;
     bool okay = false;
     int i;
 
@@ -2788,7 +2842,7 @@ bool dvmLinkClass(ClassObject* clazz)
 
         dvmLinearReadOnly(clazz->classLoader, clazz->virtualMethods);
     } else {
-        if (!createVtable(clazz)) {
+        if (!createVtable(clazz, &pLinkImage)) {
             ALOGW("failed creating vtable");
             goto bail;
         }
@@ -2797,9 +2851,14 @@ bool dvmLinkClass(ClassObject* clazz)
     /*
      * Populate interface method tables.  Can alter the vtable.
      */
-    if (!createIftable(clazz))
+    if (!createIftable(clazz, pLinkImage))
         goto bail;
 
+    /*
+     * Set up the tables used for instanceof and checkcast.
+     */
+    dvmBuildTypeCheckTables(clazz);
+
     /*
      * Insert special-purpose "stub" method implementations.
      */
@@ -2873,19 +2932,78 @@ bail:
     return okay;
 }
 
+/*
+ * Fill in the vtable from the link image computed by dexopt.  The
+ * superclass vtable has already been copied in.
+ *
+ * The image is only used if it matches the superclass we actually linked
+ * against.  Overrides are spot-checked against the method they replace;
+ * that's one comparison per method instead of one per inherited method.
+ * On a mismatch the vtable is left untouched and we return "false".
+ */
+static bool fillVtableFromImage(ClassObject* clazz,
+    const LinkImageClass* pImage)
+{
+    const int superCount = clazz->super->vtableCount;
+    const u2* slots = dvmLinkImageGetVtableSlots(pImage);
+    int nextNewSlot = superCount;
+    int i;
+
+    if (pImage->superVtableCount != superCount ||
+        pImage->virtualMethodCount != clazz->virtualMethodCount ||
+        pImage->vtableCount > superCount + clazz->virtualMethodCount)
+    {
+        ALOGV("Link image for %s is stale", clazz->descriptor);
+        return false;
+    }
+
+    for (i = 0; i < clazz->virtualMethodCount; i++) {
+        int slot = slots[i];
+        if (slot < superCount) {
+            Method* superMeth = clazz->vtable[slot];
+            if (dvmIsFinalMethod(superMeth) ||
+                dvmCompareMethodNamesAndProtos(&clazz->virtualMethods[i],
+                    superMeth) != 0)
+            {
+                break;
+            }
+        } else if (slot != nextNewSlot++) {
+            /* new methods are appended in declaration order */
+            break;
+        }
+    }
+    if (i != clazz->virtualMethodCount || nextNewSlot != pImage->vtableCount) {
+        ALOGW("Link image for %s doesn't match, ignoring",
+            clazz->descriptor);
+        return false;
+    }
+
+    for (i = 0; i < clazz->virtualMethodCount; i++) {
+        Method* localMeth = &clazz->virtualMethods[i];
+        clazz->vtable[slots[i]] = localMeth;
+        localMeth->methodIndex = slots[i];
+    }
+    return true;
+}
+
 /*
  * Create the virtual method table.
  *
  * The top part of the table is a copy of the table from our superclass,
  * with our local methods overriding theirs.  The bottom part of the table
  * has any new methods we defined.
+ *
+ * On success, "*ppImage" is set to the link image if it was used to lay
+ * out the vtable, or NULL if we had to search.
  */
-static bool createVtable(ClassObject* clazz)
+static bool createVtable(ClassObject* clazz, const LinkImageClass** ppImage)
 {
     bool result = false;
     int maxCount;
     int i;
 
+    *ppImage = NULL;
+
     if (clazz->super != NULL) {
         //ALOGI("SUPER METHODS %d %s->%s", clazz->super->vtableCount,
         //    clazz->descriptor, clazz->super->descriptor);
@@ -2911,7 +3029,7 @@ static bool createVtable(ClassObject* clazz)
      */
     dvmLinearReadWrite(clazz->classLoader, clazz->virtualMethods);
     clazz->vtable = (Method**) dvmLinearAlloc(clazz->classLoader,
-                        sizeof(Method*) * maxCount);
+                        sizeof(Method*) * maxCount, kLinearAllocVtables);
     if (clazz->vtable == NULL)
         goto bail;
 
@@ -2922,10 +3040,22 @@ static bool createVtable(ClassObject* clazz)
             sizeof(*(clazz->vtable)) * clazz->super->vtableCount);
         actualCount = clazz->super->vtableCount;
 
+        /*
+         * If dexopt recorded where our methods go, just put them there.
+         */
+        const LinkImageClass* pImage = dvmLinkImageGetClass(clazz);
+        if (pImage != NULL && fillVtableFromImage(clazz, pImage)) {
+            actualCount = pImage->vtableCount;
+            i = clazz->virtualMethodCount;      /* skip the search */
+            *ppImage = pImage;
+        } else {
+            i = 0;
+        }
+
         /*
          * See if any of our virtual methods override the superclass.
          */
-        for (i = 0; i < clazz->virtualMethodCount; i++) {
+        for ( ; i < clazz->virtualMethodCount; i++) {
             Method* localMeth = &clazz->virtualMethods[i];
             int si;
 
@@ -2982,7 +3112,8 @@ static bool createVtable(ClassObject* clazz)
             assert(clazz->vtable != NULL);
             dvmLinearReadOnly(clazz->classLoader, clazz->vtable);
             clazz->vtable = (Method **)dvmLinearRealloc(clazz->classLoader,
-                clazz->vtable, sizeof(*(clazz->vtable)) * actualCount);
+                clazz->vtable, sizeof(*(clazz->vtable)) * actualCount,
+                kLinearAllocVtables);
             if (clazz->vtable == NULL) {
                 ALOGE("vtable realloc failed");
                 goto bail;
@@ -3032,9 +3163,12 @@ bail:
  *
  * Because of "Miranda methods", this may reallocate clazz->virtualMethods.
  *
+ * "pImage" is the link image createVtable() accepted for this class, or
+ * NULL if there wasn't one.
+ *
  * Returns "true" on success.
  */
-static bool createIftable(ClassObject* clazz)
+static bool createIftable(ClassObject* clazz, const LinkImageClass* pImage)
 {
     bool result = false;
     bool zapIftable = false;
@@ -3069,7 +3203,8 @@ static bool createIftable(ClassObject* clazz)
      * superclass' table in.
      */
     clazz->iftable = (InterfaceEntry*) dvmLinearAlloc(clazz->classLoader,
-                        sizeof(InterfaceEntry) * ifCount);
+                        sizeof(InterfaceEntry) * ifCount,
+                        kLinearAllocInterfaces);
     zapIftable = true;
     memset(clazz->iftable, 0x00, sizeof(InterfaceEntry) * ifCount);
     if (superIfCount != 0) {
@@ -3135,7 +3270,8 @@ static bool createIftable(ClassObject* clazz)
             InterfaceEntry* oldmem = clazz->iftable;
 
             clazz->iftable = (InterfaceEntry*) dvmLinearAlloc(clazz->classLoader,
-                            sizeof(InterfaceEntry) * newIfCount);
+                            sizeof(InterfaceEntry) * newIfCount,
+                            kLinearAllocInterfaces);
             memcpy(clazz->iftable, oldmem, sizeof(InterfaceEntry) * newIfCount);
             dvmLinearFree(clazz->classLoader, oldmem);
         }
@@ -3185,15 +3321,27 @@ static bool createIftable(ClassObject* clazz)
 
     if (poolSize == 0) {
         LOGVV("INTF: didn't find any new interfaces with methods");
+        createItable(clazz);
         result = true;
         goto bail;
     }
 
     clazz->ifviPoolCount = poolSize;
     clazz->ifviPool = (int*) dvmLinearAlloc(clazz->classLoader,
-                        poolSize * sizeof(int*));
+                        poolSize * sizeof(int*), kLinearAllocInterfaces);
     zapIfvipool = true;
 
+    /*
+     * See if dexopt recorded the vtable slots for us.  It only does so
+     * for classes that don't need Miranda methods.
+     */
+    const u2* pImageIfvi;
+    pImageIfvi = NULL;
+    if (pImage != NULL && pImage->ifviPoolCount == poolSize) {
+        assert(pImage->vtableCount == clazz->vtableCount);
+        pImageIfvi = dvmLinkImageGetIfviPool(pImage);
+    }
+
     /*
      * Fill in the vtable offsets for the interfaces that weren't part of
      * our superclass.
@@ -3238,33 +3386,53 @@ static bool createIftable(ClassObject* clazz)
          */
         for (methIdx = 0; methIdx < interface->virtualMethodCount; methIdx++) {
             Method* imeth = &interface->virtualMethods[methIdx];
-            int j;
+            int j = -1;
 
-            IF_LOGVV() {
-                char* desc = dexProtoCopyMethodDescriptor(&imeth->prototype);
-                LOGVV("INTF:  matching '%s' '%s'", imeth->name, desc);
-                free(desc);
+            /*
+             * Try the slot dexopt found first.  The vtable came from the
+             * same image, but the slot is still checked by name and
+             * prototype so a bad entry falls back to the search.
+             */
+            if (pImageIfvi != NULL) {
+                int slot = pImageIfvi[poolOffset -
+                    interface->virtualMethodCount + methIdx];
+                if (slot < clazz->vtableCount &&
+                    dvmCompareMethodNamesAndProtos(imeth,
+                        clazz->vtable[slot]) == 0)
+                {
+                    j = slot;
+                }
             }
 
-            for (j = clazz->vtableCount-1; j >= 0; j--) {
-                if (dvmCompareMethodNamesAndProtos(imeth, clazz->vtable[j])
-                    == 0)
-                {
-                    LOGVV("INTF:   matched at %d", j);
-                    if (!dvmIsAbstractMethod(clazz->vtable[j]) &&
-                        !dvmIsPublicMethod(clazz->vtable[j]))
+            if (j < 0) {
+                IF_LOGVV() {
+                    char* desc =
+                        dexProtoCopyMethodDescriptor(&imeth->prototype);
+                    LOGVV("INTF:  matching '%s' '%s'", imeth->name, desc);
+                    free(desc);
+                }
+
+                for (j = clazz->vtableCount-1; j >= 0; j--) {
+                    if (dvmCompareMethodNamesAndProtos(imeth,
+                            clazz->vtable[j]) == 0)
                     {
-                        ALOGW("Implementation of %s.%s is not public",
-                            clazz->descriptor, clazz->vtable[j]->name);
-                        dvmThrowIllegalAccessError(
-                            "interface implementation not public");
-                        goto bail;
+                        LOGVV("INTF:   matched at %d", j);
+                        break;
                     }
-                    clazz->iftable[i].methodIndexArray[methIdx] = j;
-                    break;
                 }
             }
-            if (j < 0) {
+            if (j >= 0) {
+                if (!dvmIsAbstractMethod(clazz->vtable[j]) &&
+                    !dvmIsPublicMethod(clazz->vtable[j]))
+                {
+                    ALOGW("Implementation of %s.%s is not public",
+                        clazz->descriptor, clazz->vtable[j]->name);
+                    dvmThrowIllegalAccessError(
+                        "interface implementation not public");
+                    goto bail;
+                }
+                clazz->iftable[i].methodIndexArray[methIdx] = j;
+            } else {
                 IF_ALOGV() {
                     char* desc =
                         dexProtoCopyMethodDescriptor(&imeth->prototype);
@@ -3280,12 +3448,14 @@ static bool createIftable(ClassObject* clazz)
                     if (mirandaList == NULL) {
                         mirandaList = (Method**)dvmLinearAlloc(
                                         clazz->classLoader,
-                                        mirandaAlloc * sizeof(Method*));
+                                        mirandaAlloc * sizeof(Method*),
+                                        kLinearAllocVtables);
                     } else {
                         dvmLinearReadOnly(clazz->classLoader, mirandaList);
                         mirandaList = (Method**)dvmLinearRealloc(
                                 clazz->classLoader,
-                                mirandaList, mirandaAlloc * sizeof(Method*));
+                                mirandaList, mirandaAlloc * sizeof(Method*),
+                                kLinearAllocVtables);
                     }
                     assert(mirandaList != NULL);    // mem failed + we leaked
                 }
@@ -3359,12 +3529,14 @@ static bool createIftable(ClassObject* clazz)
          */
         if (clazz->virtualMethods == NULL) {
             newVirtualMethods = (Method*) dvmLinearAlloc(clazz->classLoader,
-                sizeof(Method) * (clazz->virtualMethodCount + mirandaCount));
+                sizeof(Method) * (clazz->virtualMethodCount + mirandaCount),
+                kLinearAllocMethods);
         } else {
             //dvmLinearReadOnly(clazz->classLoader, clazz->virtualMethods);
             newVirtualMethods = (Method*) dvmLinearRealloc(clazz->classLoader,
                 clazz->virtualMethods,
-                sizeof(Method) * (clazz->virtualMethodCount + mirandaCount));
+                sizeof(Method) * (clazz->virtualMethodCount + mirandaCount),
+                kLinearAllocMethods);
         }
         if (newVirtualMethods != clazz->virtualMethods) {
             /*
@@ -3403,7 +3575,8 @@ static bool createIftable(ClassObject* clazz)
         assert(clazz->vtable != NULL);
         clazz->vtable = (Method**) dvmLinearRealloc(clazz->classLoader,
                         clazz->vtable,
-                        sizeof(Method*) * (clazz->vtableCount + mirandaCount));
+                        sizeof(Method*) * (clazz->vtableCount + mirandaCount),
+                        kLinearAllocVtables);
         if (clazz->vtable == NULL) {
             assert(false);
             goto bail;
@@ -3468,6 +3641,7 @@ static bool createIftable(ClassObject* clazz)
 
     //dvmDumpClass(clazz);
 
+    createItable(clazz);
     result = true;
 
 bail:
@@ -3481,6 +3655,84 @@ bail:
 }
 
 
+/*
+ * Build the itable from the iftable and the finished vtable.
+ *
+ * Only concrete classes need one, since those are the only possible
+ * receivers of invoke-interface.  For a class with just one or two
+ * interfaces, the iftable search is about as fast, so we don't bother.
+ *
+ * The table and all of the conflict lists go in a single allocation.
+ */
+static void createItable(ClassObject* clazz)
+{
+    static const int kMinInterfaces = 3;
+    int slotCount[ITABLE_SIZE];
+    int i, j;
+
+    if (dvmIsInterfaceClass(clazz) || dvmIsAbstractClass(clazz) ||
+        clazz->iftableCount < kMinInterfaces)
+    {
+        return;
+    }
+
+    /*
+     * Count the methods landing in each slot, so we know how much space
+     * the conflict lists need.
+     */
+    memset(slotCount, 0, sizeof(slotCount));
+    int numMethods = 0;
+    for (i = 0; i < clazz->iftableCount; i++) {
+        const ClassObject* iface = clazz->iftable[i].clazz;
+        for (j = 0; j < iface->virtualMethodCount; j++) {
+            slotCount[dvmItableSlot(&iface->virtualMethods[j])]++;
+            numMethods++;
+        }
+    }
+    if (numMethods == 0)
+        return;
+
+    int numEntries = ITABLE_SIZE;
+    for (i = 0; i < ITABLE_SIZE; i++) {
+        if (slotCount[i] > 1)
+            numEntries += slotCount[i] + 1;
+    }
+
+    ItableEntry* itable = (ItableEntry*) dvmLinearAlloc(clazz->classLoader,
+        numEntries * sizeof(ItableEntry), kLinearAllocInterfaces);
+    memset(itable, 0, numEntries * sizeof(ItableEntry));
+
+    /* carve out the conflict lists; "slotCount" becomes a fill index */
+    ItableEntry* pConflicts = itable + ITABLE_SIZE;
+    for (i = 0; i < ITABLE_SIZE; i++) {
+        if (slotCount[i] > 1) {
+            itable[i].conflicts = pConflicts;
+            pConflicts += slotCount[i] + 1;
+        }
+        slotCount[i] = 0;
+    }
+    assert(pConflicts == itable + numEntries);
+
+    for (i = 0; i < clazz->iftableCount; i++) {
+        const InterfaceEntry* pIfEntry = &clazz->iftable[i];
+        const ClassObject* iface = pIfEntry->clazz;
+        for (j = 0; j < iface->virtualMethodCount; j++) {
+            const Method* ifMethod = &iface->virtualMethods[j];
+            int vtableIndex = pIfEntry->methodIndexArray[j];
+            assert(vtableIndex >= 0 && vtableIndex < clazz->vtableCount);
+
+            ItableEntry* pEntry = &itable[dvmItableSlot(ifMethod)];
+            if (pEntry->conflicts != NULL)
+                pEntry = &pEntry->conflicts[slotCount[pEntry - itable]++];
+            pEntry->interfaceMethod = ifMethod;
+            pEntry->method = clazz->vtable[vtableIndex];
+        }
+    }
+
+    dvmLinearReadOnly(clazz->classLoader, itable);
+    clazz->itable = itable;
+}
+
 /*
  * Provide "stub" implementations for methods without them.
  *
@@ -60,6 +60,11 @@ int dvmGetBootPathSize(void);
 StringObject* dvmGetBootPathResource(const char* name, int idx);
 void dvmDumpBootClassPath(void);
 
+/*
+ * Print the interface cache stats for each bootstrap DEX file.
+ */
+void dvmDumpBootInterfaceCacheStats(void);
+
 /*
  * Determine whether "path" is a member of "cpe".
  */
@@ -104,6 +109,14 @@ ClassObject* dvmFindSystemClassNoInit(const char* descriptor);
  */
 ClassObject* dvmFindLoadedClass(const char* descriptor);
 
+/*
+ * Find the DEX class definition for a class on the bootstrap class path,
+ * without loading the class.  On success "*ppDvmDex" is set to the DEX
+ * file that holds it.
+ */
+const DexClassDef* dvmFindBootClassDef(const char* descriptor,
+    DvmDex** ppDvmDex);
+
 /*
  * Load the named class (by descriptor) from the specified DEX file.
  * Used by class loaders to instantiate a class object from a
@@ -119,6 +132,40 @@ ClassObject* dvmDefineClass(DvmDex* pDvmDex, const char* descriptor,
  */
 bool dvmLinkClass(ClassObject* clazz);
 
+/*
+ * Hash an interface method into an itable slot.
+ */
+INLINE u4 dvmItableSlot(const Method* interfaceMethod) {
+    return (((u4) (uintptr_t) interfaceMethod * 2654435761u) >> 16) &
+        (ITABLE_SIZE-1);
+}
+
+/*
+ * Find the implementation of "interfaceMethod" in the itable for "clazz".
+ * Returns NULL if the class has no itable or the method isn't in it; the
+ * caller should fall back on searching the iftable.
+ */
+INLINE Method* dvmItableLookup(const ClassObject* clazz,
+    const Method* interfaceMethod)
+{
+    const ItableEntry* pEntry = clazz->itable;
+    if (pEntry == NULL)
+        return NULL;
+
+    pEntry += dvmItableSlot(interfaceMethod);
+    if (pEntry->interfaceMethod == interfaceMethod)
+        return pEntry->method;
+    if (pEntry->conflicts != NULL) {
+        for (pEntry = pEntry->conflicts; pEntry->interfaceMethod != NULL;
+            pEntry++)
+        {
+            if (pEntry->interfaceMethod == interfaceMethod)
+                return pEntry->method;
+        }
+    }
+    return NULL;
+}
+
 /*
  * Determine if a class has been initialized.
  */
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Parallel preloading of boot classes.
+ *
+ * The zygote normally loads its preloaded classes one at a time from
+ * ZygoteInit, and every class goes through loadClassFromDex and
+ * dvmLinkClass on the main thread.  Loading and linking don't run any
+ * Java code, so we can do that part ahead of time on a small pool of
+ * threads.  Initialization (<clinit>) is left alone: it still happens on
+ * the main thread, in the order ZygoteInit asks for it, which keeps the
+ * class initialization semantics exactly as before.
+ *
+ * Classes are sorted into levels by their superclass and interface
+ * dependencies.  A class at level N only depends on classes at levels
+ * below N, so all classes within a level can be linked in any order
+ * without waiting on each other.  Each level is handed to the pool, and
+ * threads claim classes from it with an atomic counter until it runs
+ * dry.  Superclasses that aren't named in the list are added to it, so
+ * they are linked in the right level as well.
+ */
+#include "Dalvik.h"
+#include "oo/ClassPreload.h"
+
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+/* upper limit on worker threads, including the caller */
+#define kMaxPreloadThreads  16
+
+/*
+ * Pseudo-depths used while computing dependency levels.
+ */
+enum {
+    kDepthUnknown = -1,
+    kDepthInProgress = -2,
+};
+
+typedef std::map<std::string, int> PreloadDepthMap;
+
+/*
+ * Shared state for the worker pool.  "lock" guards everything except
+ * "nextIndex" and the counters, which are updated atomically.
+ */
+struct PreloadPool {
+    pthread_mutex_t lock;
+    pthread_cond_t  workCond;       /* new level posted, or shutdown */
+    pthread_cond_t  doneCond;       /* a worker finished the level */
+
+    const std::vector<std::string>* level;
+    int             generation;     /* bumped for each level */
+    int             busyWorkers;    /* workers still on this level */
+    bool            shutdown;
+
+    volatile int32_t nextIndex;     /* next class to claim in "level" */
+    volatile int32_t numLinked;
+    volatile int32_t numFailed;
+};
+
+/*
+ * Read the list of class names, converting them to descriptors.
+ */
+static bool readPreloadList(const char* fileName,
+    std::vector<std::string>* pDescriptors)
+{
+    FILE* fp = fopen(fileName, "r");
+    if (fp == NULL) {
+        ALOGW("Unable to open preload list '%s': %s",
+            fileName, strerror(errno));
+        return false;
+    }
+
+    char lineBuf[512];
+    while (fgets(lineBuf, sizeof(lineBuf), fp) != NULL) {
+        char* cp = lineBuf;
+        while (isspace(*cp))
+            cp++;
+        if (*cp == '\0' || *cp == '#')
+            continue;
+
+        char* end = cp + strlen(cp);
+        while (end > cp && isspace(end[-1]))
+            end--;
+        *end = '\0';
+
+        char* descriptor = dvmDotToDescriptor(cp);
+        if (descriptor == NULL)
+            continue;
+        pDescriptors->push_back(descriptor);
+        free(descriptor);
+    }
+
+    fclose(fp);
+    return true;
+}
+
+/*
+ * Compute the dependency level of "descriptor", adding it and anything it
+ * depends on to "pDepths".  Classes that aren't on the bootstrap class path
+ * get level 0; they'll simply fail to load.
+ */
+static int computeDepth(const std::string& descriptor,
+    PreloadDepthMap* pDepths)
+{
+    PreloadDepthMap::iterator it = pDepths->find(descriptor);
+    if (it != pDepths->end() && it->second != kDepthUnknown) {
+        /* a circular reference is the linker's problem, not ours */
+        return (it->second == kDepthInProgress) ? 0 : it->second;
+    }
+    (*pDepths)[descriptor] = kDepthInProgress;
+
+    int depth = 0;
+    if (descriptor[0] == '[') {
+        /* arrays come right after their element class */
+        size_t elemStart = descriptor.find_first_not_of('[');
+        if (descriptor[elemStart] == 'L') {
+            depth = computeDepth(descriptor.substr(elemStart), pDepths) + 1;
+        }
+    } else {
+        DvmDex* pDvmDex;
+        const DexClassDef* pClassDef =
+            dvmFindBootClassDef(descriptor.c_str(), &pDvmDex);
+        if (pClassDef != NULL) {
+            const DexFile* pDexFile = pDvmDex->pDexFile;
+
+            if (pClassDef->superclassIdx != kDexNoIndex) {
+                const char* superDesc =
+                    dexStringByTypeIdx(pDexFile, pClassDef->superclassIdx);
+                int superDepth = computeDepth(superDesc, pDepths) + 1;
+                if (superDepth > depth)
+                    depth = superDepth;
+            }
+
+            const DexTypeList* pInterfaces =
+                dexGetInterfacesList(pDexFile, pClassDef);
+            if (pInterfaces != NULL) {
+                for (u4 i = 0; i < pInterfaces->size; i++) {
+                    const char* ifaceDesc = dexStringByTypeIdx(pDexFile,
+                        dexTypeListGetIdx(pInterfaces, i));
+                    int ifaceDepth = computeDepth(ifaceDesc, pDepths) + 1;
+                    if (ifaceDepth > depth)
+                        depth = ifaceDepth;
+                }
+            }
+        }
+    }
+
+    (*pDepths)[descriptor] = depth;
+    return depth;
+}
+
+/*
+ * Claim and link classes from the current level until it's exhausted.
+ */
+static void drainLevel(PreloadPool* pPool)
+{
+    Thread* self = dvmThreadSelf();
+    const std::vector<std::string>& level = *pPool->level;
+
+    while (true) {
+        int idx = android_atomic_inc(&pPool->nextIndex);
+        if (idx >= (int) level.size())
+            break;
+
+        ClassObject* clazz = dvmFindSystemClassNoInit(level[idx].c_str());
+        if (clazz == NULL) {
+            ALOGV("Preload of '%s' failed", level[idx].c_str());
+            dvmClearException(self);
+            android_atomic_inc(&pPool->numFailed);
+        } else {
+            android_atomic_inc(&pPool->numLinked);
+        }
+    }
+}
+
+/*
+ * Worker thread entry point.
+ */
+static void* preloadWorkerThreadStart(void* arg)
+{
+    PreloadPool* pPool = (PreloadPool*) arg;
+    Thread* self = dvmThreadSelf();
+    int seenGeneration = 0;
+
+    dvmLinearAllocUseThreadChunk();
+    while (true) {
+        ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+        dvmLockMutex(&pPool->lock);
+        while (pPool->generation == seenGeneration && !pPool->shutdown)
+            pthread_cond_wait(&pPool->workCond, &pPool->lock);
+        bool shutdown = pPool->shutdown;
+        seenGeneration = pPool->generation;
+        dvmUnlockMutex(&pPool->lock);
+        dvmChangeStatus(self, oldStatus);
+
+        if (shutdown)
+            break;
+
+        drainLevel(pPool);
+
+        dvmLockMutex(&pPool->lock);
+        if (--pPool->busyWorkers == 0)
+            pthread_cond_signal(&pPool->doneCond);
+        dvmUnlockMutex(&pPool->lock);
+    }
+    dvmLinearAllocReleaseThreadChunk();
+
+    return NULL;
+}
+
+/*
+ * Post one level to the pool, help out, and wait for the workers.
+ */
+static void runLevel(PreloadPool* pPool, const std::vector<std::string>* level,
+    int numWorkers)
+{
+    Thread* self = dvmThreadSelf();
+
+    dvmLockMutex(&pPool->lock);
+    pPool->level = level;
+    pPool->nextIndex = 0;
+    pPool->busyWorkers = numWorkers;
+    pPool->generation++;
+    pthread_cond_broadcast(&pPool->workCond);
+    dvmUnlockMutex(&pPool->lock);
+
+    drainLevel(pPool);
+
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    dvmLockMutex(&pPool->lock);
+    while (pPool->busyWorkers != 0)
+        pthread_cond_wait(&pPool->doneCond, &pPool->lock);
+    dvmUnlockMutex(&pPool->lock);
+    dvmChangeStatus(self, oldStatus);
+}
+
+/*
+ * Load and link everything in the preload list.
+ */
+void dvmPreloadClasses()
+{
+    if (gDvm.preloadClassesFile == NULL)
+        return;
+
+    u8 startWhen = dvmGetRelativeTimeUsec();
+
+    /*
+     * Stage 1: read the list.
+     */
+    std::vector<std::string> descriptors;
+    if (!readPreloadList(gDvm.preloadClassesFile, &descriptors))
+        return;
+    u8 readWhen = dvmGetRelativeTimeUsec();
+
+    /*
+     * Stage 2: sort the classes into dependency levels.
+     */
+    PreloadDepthMap depths;
+    int maxDepth = 0;
+    for (size_t i = 0; i < descriptors.size(); i++) {
+        int depth = computeDepth(descriptors[i], &depths);
+        if (depth > maxDepth)
+            maxDepth = depth;
+    }
+    std::vector<std::vector<std::string> > levels(maxDepth + 1);
+    for (PreloadDepthMap::const_iterator it = depths.begin();
+         it != depths.end(); ++it)
+    {
+        levels[it->second].push_back(it->first);
+    }
+    u8 sortWhen = dvmGetRelativeTimeUsec();
+
+    ALOGI("Preload: %zd classes listed, %zd with dependencies, %d levels"
+          " (read %llums, sort %llums)",
+        descriptors.size(), depths.size(), maxDepth + 1,
+        (readWhen - startWhen) / 1000, (sortWhen - readWhen) / 1000);
+
+    /*
+     * Stage 3: start the workers.  The calling thread counts as one.
+     */
+    int numThreads = gDvm.preloadThreads;
+    if (numThreads <= 0) {
+        numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (numThreads > kMaxPreloadThreads)
+        numThreads = kMaxPreloadThreads;
+    if (numThreads < 1)
+        numThreads = 1;
+
+    PreloadPool pool;
+    memset(&pool, 0, sizeof(pool));
+    dvmInitMutex(&pool.lock);
+    pthread_cond_init(&pool.workCond, NULL);
+    pthread_cond_init(&pool.doneCond, NULL);
+
+    pthread_t workers[kMaxPreloadThreads];
+    int numWorkers = 0;
+    while (numWorkers < numThreads - 1) {
+        char name[32];
+        snprintf(name, sizeof(name), "ClassPreload-%d", numWorkers + 1);
+        if (!dvmCreateInternalThread(&workers[numWorkers], name,
+                preloadWorkerThreadStart, &pool))
+        {
+            ALOGW("Preload: only started %d of %d worker threads",
+                numWorkers, numThreads - 1);
+            break;
+        }
+        numWorkers++;
+    }
+    u8 spawnWhen = dvmGetRelativeTimeUsec();
+
+    /*
+     * Stage 4: load and link, one level at a time.
+     */
+    dvmLinearAllocUseThreadChunk();
+    for (size_t depth = 0; depth < levels.size(); depth++) {
+        u8 levelStart = dvmGetRelativeTimeUsec();
+        runLevel(&pool, &levels[depth], numWorkers);
+        ALOGV("Preload: level %zd: %zd classes in %llums",
+            depth, levels[depth].size(),
+            (dvmGetRelativeTimeUsec() - levelStart) / 1000);
+    }
+    dvmLinearAllocReleaseThreadChunk();
+    u8 linkWhen = dvmGetRelativeTimeUsec();
+
+    /*
+     * Stage 5: shut the pool down.  Wake the workers so they return, then
+     * join them; once the joins finish they've left the VM's thread list
+     * and we're back to a single thread.
+     */
+    Thread* self = dvmThreadSelf();
+    dvmLockMutex(&pool.lock);
+    pool.shutdown = true;
+    pthread_cond_broadcast(&pool.workCond);
+    dvmUnlockMutex(&pool.lock);
+
+    ThreadStatus oldStatus = dvmChangeStatus(self, THREAD_VMWAIT);
+    for (int i = 0; i < numWorkers; i++)
+        pthread_join(workers[i], NULL);
+    dvmChangeStatus(self, oldStatus);
+
+    pthread_cond_destroy(&pool.workCond);
+    pthread_cond_destroy(&pool.doneCond);
+    dvmDestroyMutex(&pool.lock);
+    u8 endWhen = dvmGetRelativeTimeUsec();
+
+    ALOGI("Preload: linked %d classes (%d failed) on %d threads:"
+          " spawn %llums, link %llums, join %llums, total %llums",
+        pool.numLinked, pool.numFailed, numWorkers + 1,
+        (spawnWhen - sortWhen) / 1000, (linkWhen - spawnWhen) / 1000,
+        (endWhen - linkWhen) / 1000, (endWhen - startWhen) / 1000);
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Parallel loading and linking of boot classes at startup.
+ */
+#ifndef DALVIK_OO_CLASSPRELOAD_H_
+#define DALVIK_OO_CLASSPRELOAD_H_
+
+/*
+ * Load and link (but do not initialize) the classes named in
+ * gDvm.preloadClassesFile, using gDvm.preloadThreads threads.
+ *
+ * The file has one class name per line, in the "java.lang.Object" form
+ * used by the framework's preloaded-classes list.  Blank lines and lines
+ * starting with '#' are ignored.  Classes that can't be found or linked
+ * are skipped.
+ *
+ * All worker threads have exited by the time this returns, so it's safe
+ * to call from the zygote before it starts forking.
+ */
+void dvmPreloadClasses(void);
+
+#endif  // DALVIK_OO_CLASSPRELOAD_H_
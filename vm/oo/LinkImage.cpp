@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Generation and lookup of pre-computed class link layouts.
+ */
+#include "Dalvik.h"
+#include "oo/LinkImage.h"
+#include "libdex/DexClass.h"
+
+#include <stddef.h>
+
+/*
+ * Growable output buffer.
+ */
+struct LinkImageBuffer {
+    u1*     data;
+    size_t  size;
+    size_t  alloc;
+};
+
+/*
+ * Make sure there's room for "len" more bytes.  Returns a pointer to the
+ * start of the new area, or NULL on allocation failure.
+ */
+static u1* reserveBytes(LinkImageBuffer* pBuf, size_t len)
+{
+    if (pBuf->size + len > pBuf->alloc) {
+        size_t newAlloc = pBuf->alloc * 2;
+        if (newAlloc < pBuf->size + len)
+            newAlloc = pBuf->size + len;
+        u1* newData = (u1*) realloc(pBuf->data, newAlloc);
+        if (newData == NULL)
+            return NULL;
+        pBuf->data = newData;
+        pBuf->alloc = newAlloc;
+    }
+
+    u1* ptr = pBuf->data + pBuf->size;
+    pBuf->size += len;
+    return ptr;
+}
+
+/*
+ * Return the number of virtual methods declared in the DEX file for a
+ * class.  ClassObject::virtualMethodCount also counts Miranda methods.
+ */
+static u4 getDeclaredVirtualCount(const DexFile* pDexFile,
+    const DexClassDef* pClassDef)
+{
+    const u1* pEncodedData = dexGetClassData(pDexFile, pClassDef);
+    if (pEncodedData == NULL)
+        return 0;
+
+    DexClassDataHeader header;
+    dexReadClassDataHeader(&pEncodedData, &header);
+    return header.virtualMethodsSize;
+}
+
+/*
+ * Append the link image data for one class.  Returns the offset of the
+ * entry, 0 if the class has nothing worth recording, or -1 on failure.
+ */
+static int writeClass(LinkImageBuffer* pBuf, DvmDex* pDvmDex,
+    const DexClassDef* pClassDef)
+{
+    const DexFile* pDexFile = pDvmDex->pDexFile;
+    const char* classDescriptor =
+        dexStringByTypeIdx(pDexFile, pClassDef->classIdx);
+    ClassObject* clazz = dvmLookupClass(classDescriptor, NULL, false);
+
+    /*
+     * We only have something to say about concrete or abstract classes
+     * from this DEX file that linked successfully.  Interfaces and
+     * java.lang.Object are cheap to link anyway.
+     *
+     * The classes were loaded through a different DvmDex for the same
+     * mapping, so we can't compare pDvmDex.  The descriptor points into
+     * the DEX string data, which tells us where the class came from.
+     */
+    const u1* descPtr = (const u1*) (clazz != NULL ? clazz->descriptor : NULL);
+    if (clazz == NULL || descPtr < pDexFile->baseAddr ||
+        descPtr >= pDexFile->baseAddr + pDexFile->pHeader->fileSize ||
+        !dvmIsClassLinked(clazz) || dvmIsInterfaceClass(clazz) ||
+        clazz->super == NULL)
+    {
+        return 0;
+    }
+
+    u4 declaredCount = getDeclaredVirtualCount(pDexFile, pClassDef);
+    int mirandaCount = clazz->virtualMethodCount - declaredCount;
+    if (mirandaCount < 0) {
+        ALOGW("Unexpected virtual method count in %s", clazz->descriptor);
+        return 0;
+    }
+
+    int ifviCount = (mirandaCount == 0) ? clazz->ifviPoolCount : 0;
+    size_t entrySize = offsetof(LinkImageClass, data) +
+        (declaredCount + ifviCount) * sizeof(u2);
+    entrySize = (entrySize + 3) & ~3;
+
+    int offset = pBuf->size;
+    LinkImageClass* pImage = (LinkImageClass*) reserveBytes(pBuf, entrySize);
+    if (pImage == NULL)
+        return -1;
+    memset(pImage, 0, entrySize);
+
+    pImage->superVtableCount = clazz->super->vtableCount;
+    pImage->vtableCount = clazz->vtableCount - mirandaCount;
+    pImage->virtualMethodCount = declaredCount;
+    pImage->ifviPoolCount = ifviCount;
+
+    u2* ptr = pImage->data;
+    for (u4 i = 0; i < declaredCount; i++)
+        *ptr++ = clazz->virtualMethods[i].methodIndex;
+    for (int i = 0; i < ifviCount; i++)
+        *ptr++ = (u2) clazz->ifviPool[i];
+
+    return offset;
+}
+
+/*
+ * Generate the link image for every class def in the DEX file.
+ */
+LinkImageBuilder* dvmGenerateLinkImage(DvmDex* pDvmDex)
+{
+    const DexFile* pDexFile = pDvmDex->pDexFile;
+    u4 count = pDexFile->pHeader->classDefsSize;
+    LinkImageBuffer buf;
+    u4 idx;
+
+    assert(gDvm.optimizing);
+
+    memset(&buf, 0, sizeof(buf));
+    size_t headerSize = offsetof(LinkImageClassPool, classDataOffset) +
+        count * sizeof(u4);
+    if (reserveBytes(&buf, headerSize) == NULL)
+        goto fail;
+    ((LinkImageClassPool*) buf.data)->numClasses = count;
+
+    for (idx = 0; idx < count; idx++) {
+        int offset = writeClass(&buf, pDvmDex, dexGetClassDef(pDexFile, idx));
+        if (offset < 0)
+            goto fail;
+
+        /* buffer may have moved */
+        ((LinkImageClassPool*) buf.data)->classDataOffset[idx] = offset;
+    }
+
+    ALOGV("Link image: %d classes, %zd bytes", count, buf.size);
+
+    LinkImageBuilder* pBuilder;
+    pBuilder = (LinkImageBuilder*) malloc(sizeof(LinkImageBuilder));
+    if (pBuilder == NULL)
+        goto fail;
+    pBuilder->data = buf.data;
+    pBuilder->size = buf.size;
+    return pBuilder;
+
+fail:
+    free(buf.data);
+    return NULL;
+}
+
+/*
+ * Free the builder.
+ */
+void dvmFreeLinkImageBuilder(LinkImageBuilder* pBuilder)
+{
+    if (pBuilder == NULL)
+        return;
+
+    free(pBuilder->data);
+    free(pBuilder);
+}
+
+/*
+ * Find the link image data for "clazz".
+ */
+const LinkImageClass* dvmLinkImageGetClass(const ClassObject* clazz)
+{
+    if (clazz->pDvmDex == NULL)
+        return NULL;
+
+    const DexFile* pDexFile = clazz->pDvmDex->pDexFile;
+    const LinkImageClassPool* pPool =
+        (const LinkImageClassPool*) pDexFile->pLinkImagePool;
+    if (pPool == NULL)
+        return NULL;
+
+    const DexClassDef* pClassDef = dexFindClass(pDexFile, clazz->descriptor);
+    if (pClassDef == NULL)
+        return NULL;
+
+    u4 classDefIdx = dexGetIndexForClassDef(pDexFile, pClassDef);
+    if (classDefIdx >= pPool->numClasses) {
+        ALOGW("bad class index in link image (%d vs %d)",
+            classDefIdx, pPool->numClasses);
+        return NULL;
+    }
+
+    u4 offset = pPool->classDataOffset[classDefIdx];
+    if (offset == 0)
+        return NULL;
+
+    return (const LinkImageClass*) (((const u1*) pPool) + offset);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Pre-computed class link layout ("link image").
+ *
+ * When dexopt links the classes in a DEX file it records where each
+ * virtual method landed in the vtable, and which vtable slots implement
+ * each interface method.  The data is stored as an opt chunk, so it is
+ * mapped read-only and shared along with the rest of the optimized DEX.
+ * At run time createVtable() and createIftable() use it to fill in the
+ * tables directly instead of comparing method names and prototypes
+ * against every inherited method.
+ *
+ * The layout only depends on the class and its superclasses and
+ * interfaces.  Those are covered by the optimized DEX dependency list,
+ * and each entry is checked against the live superclass before use, so a
+ * stale entry just falls back to the normal linking path.
+ */
+#ifndef DALVIK_OO_LINKIMAGE_H_
+#define DALVIK_OO_LINKIMAGE_H_
+
+/*
+ * Top-level structure of the link image opt chunk.  Like the register
+ * map pool, it has one offset per class def; zero means "no data".
+ */
+struct LinkImageClassPool {
+    u4      numClasses;
+
+    /* offset table starts here, 32-bit aligned */
+    u4      classDataOffset[1];
+};
+
+/*
+ * Per-class data.  "vtableCount" is the size of the vtable as built by
+ * createVtable(), before any Miranda methods are appended.  "data" holds
+ * "virtualMethodCount" vtable slots followed by "ifviPoolCount" interface
+ * method indices.  "ifviPoolCount" is zero if the interface indices
+ * weren't recorded (e.g. because the class needed Miranda methods).
+ */
+struct LinkImageClass {
+    u2      superVtableCount;
+    u2      vtableCount;
+    u2      virtualMethodCount;
+    u2      ifviPoolCount;
+    u2      data[1];
+};
+
+/*
+ * Generated link image, ready to be written out as an opt chunk.
+ */
+struct LinkImageBuilder {
+    void*       data;
+    size_t      size;
+};
+
+/*
+ * Generate the link image for all linked classes in "pDvmDex".  Only
+ * meaningful in dexopt, after the classes have been loaded.
+ */
+LinkImageBuilder* dvmGenerateLinkImage(DvmDex* pDvmDex);
+
+/*
+ * Free the builder.
+ */
+void dvmFreeLinkImageBuilder(LinkImageBuilder* pBuilder);
+
+/*
+ * Find the link image data for a class that is being linked.  Returns
+ * NULL if there isn't any.
+ */
+const LinkImageClass* dvmLinkImageGetClass(const ClassObject* clazz);
+
+/*
+ * Accessors for the variable-length part of LinkImageClass.
+ */
+INLINE const u2* dvmLinkImageGetVtableSlots(const LinkImageClass* pImage) {
+    return pImage->data;
+}
+INLINE const u2* dvmLinkImageGetIfviPool(const LinkImageClass* pImage) {
+    return pImage->data + pImage->virtualMethodCount;
+}
+
+#endif  // DALVIK_OO_LINKIMAGE_H_
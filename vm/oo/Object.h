@@ -187,6 +187,25 @@ struct InterfaceEntry {
     int*            methodIndexArray;
 };
 
+/*
+ * Number of slots in an interface method table (itable).  Must be a
+ * power of 2.
+ */
+#define ITABLE_SIZE     16
+
+/*
+ * One slot in an itable.  Interface methods are hashed into the table by
+ * address.  If only one method lands in a slot, "interfaceMethod" and
+ * "method" map it to its implementation.  If several do, they are listed
+ * in "conflicts", which ends with an entry whose "interfaceMethod" is
+ * NULL.
+ */
+struct ItableEntry {
+    const Method*   interfaceMethod;
+    Method*         method;
+    ItableEntry*    conflicts;
+};
+
 
 
 /*
@@ -467,6 +486,29 @@ struct ClassObject : Object {
     /* source file name, if known */
     const char*     sourceFile;
 
+    /*
+     * Supertype display, for constant-time subclass checks.  Entry "i" is
+     * our ancestor at depth "i"; java.lang.Object is at depth 0 and this
+     * class is at "superDepth".  NULL until the class is linked.
+     */
+    int             superDepth;
+    ClassObject**   superDisplay;
+
+    /*
+     * Open-addressed hash set of the interfaces in iftable, so interface
+     * checks don't have to scan it.  NULL if the class implements only a
+     * few interfaces.  "ifHashMask" is the table size minus one.
+     */
+    int             ifHashMask;
+    ClassObject**   ifHash;
+
+    /*
+     * Interface method table, ITABLE_SIZE entries, for invoke-interface
+     * on instances of this class.  NULL for interfaces, abstract classes,
+     * and classes that implement only a couple of interfaces.
+     */
+    ItableEntry*    itable;
+
     /* static fields */
     int             sfieldCount;
     StaticField     sfields[0]; /* MUST be last item */
@@ -28,9 +28,10 @@
 //#define BOOL_TO_INT(x)  ((x) ? 1 : 0)
 
 /*
- * Number of entries in instanceof cache.  MUST be a power of 2.
+ * Classes that implement at least this many interfaces get a hash set.
+ * For fewer, scanning iftable is just as fast.
  */
-#define INSTANCEOF_CACHE_SIZE   1024
+#define IFHASH_MIN_INTERFACES   4
 
 
 /*
@@ -38,7 +39,7 @@
  */
 bool dvmInstanceofStartup()
 {
-    gDvm.instanceofCache = dvmAllocAtomicCache(INSTANCEOF_CACHE_SIZE);
+    gDvm.instanceofCache = dvmAllocAtomicCache(gDvm.instanceofCacheSize);
     if (gDvm.instanceofCache == NULL)
         return false;
     return true;
@@ -173,6 +174,20 @@ int dvmImplements(const ClassObject* clazz, const ClassObject* interface)
 
     assert(dvmIsInterfaceClass(interface));
 
+    if (clazz->ifHash != NULL) {
+        /* the table is at most half full, so we always hit an empty slot */
+        u4 mask = clazz->ifHashMask;
+        u4 idx = dvmInterfaceHash(interface) & mask;
+        while (true) {
+            const ClassObject* entry = clazz->ifHash[idx];
+            if (entry == interface)
+                return 1;
+            if (entry == NULL)
+                return 0;
+            idx = (idx + 1) & mask;
+        }
+    }
+
     /*
      * All interfaces implemented directly and by our superclass, and
      * recursively all super-interfaces of those interfaces, are listed
@@ -186,6 +201,59 @@ int dvmImplements(const ClassObject* clazz, const ClassObject* interface)
     return 0;
 }
 
+/*
+ * Build the supertype display and the interface hash set.
+ *
+ * The superclass's display might not exist yet if this is an array class
+ * created very early in startup.  In that case we leave ours NULL too,
+ * and subclass checks walk the superclass chain instead.
+ */
+void dvmBuildTypeCheckTables(ClassObject* clazz)
+{
+    ClassObject* super = clazz->super;
+
+    if (super == NULL || super->superDisplay != NULL) {
+        int depth = (super == NULL) ? 0 : super->superDepth + 1;
+        ClassObject** display = (ClassObject**)
+            dvmLinearAlloc(clazz->classLoader,
+                (depth + 1) * sizeof(ClassObject*), kLinearAllocSupertypes);
+        if (depth > 0)
+            memcpy(display, super->superDisplay, depth * sizeof(ClassObject*));
+        display[depth] = clazz;
+        dvmLinearReadOnly(clazz->classLoader, display);
+
+        clazz->superDepth = depth;
+        clazz->superDisplay = display;
+    }
+
+    if (clazz->iftableCount >= IFHASH_MIN_INTERFACES) {
+        /* keep the load factor at or below 1/2 */
+        int size = IFHASH_MIN_INTERFACES * 2;
+        while (size < clazz->iftableCount * 2)
+            size <<= 1;
+
+        ClassObject** table = (ClassObject**)
+            dvmLinearAlloc(clazz->classLoader, size * sizeof(ClassObject*),
+                kLinearAllocSupertypes);
+        memset(table, 0, size * sizeof(ClassObject*));
+
+        u4 mask = size - 1;
+        for (int i = 0; i < clazz->iftableCount; i++) {
+            ClassObject* interface = clazz->iftable[i].clazz;
+            u4 idx = dvmInterfaceHash(interface) & mask;
+            while (table[idx] != NULL) {
+                assert(table[idx] != interface);
+                idx = (idx + 1) & mask;
+            }
+            table[idx] = interface;
+        }
+        dvmLinearReadOnly(clazz->classLoader, table);
+
+        clazz->ifHashMask = mask;
+        clazz->ifHash = table;
+    }
+}
+
 /*
  * Determine whether or not we can put an object into an array, based on
  * the class hierarchy.  The object might itself by an array, which means
@@ -235,15 +303,27 @@ static inline int isInstanceof(const ClassObject* instance,
 
 
 /*
- * Do the instanceof calculation, pulling the result from the cache if
- * possible.
+ * Do the instanceof calculation.  Interface and plain class checks are
+ * answered from the tables built at link time.  Checks against array
+ * classes have to compare the element types, so we pull the result from
+ * the cache if possible.
  */
 int dvmInstanceofNonTrivial(const ClassObject* instance,
     const ClassObject* clazz)
 {
+    if (dvmIsInterfaceClass(clazz))
+        return dvmImplements(instance, clazz);
+
+    if (!dvmIsArrayClass(clazz) && instance->superDisplay != NULL &&
+        clazz->superDisplay != NULL)
+    {
+        int depth = clazz->superDepth;
+        return BOOL_TO_INT(depth <= instance->superDepth &&
+                           instance->superDisplay[depth] == clazz);
+    }
+
 #define ATOMIC_CACHE_CALC isInstanceof(instance, clazz)
 #define ATOMIC_CACHE_NULL_ALLOWED true
-    return ATOMIC_CACHE_LOOKUP(gDvm.instanceofCache,
-                INSTANCEOF_CACHE_SIZE, instance, clazz);
+    return ATOMIC_CACHE_LOOKUP(gDvm.instanceofCache, instance, clazz);
 #undef ATOMIC_CACHE_CALC
 }
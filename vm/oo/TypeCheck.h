@@ -36,7 +36,7 @@ extern "C" int dvmInstanceofNonTrivial(const ClassObject* instance,
 INLINE int dvmInstanceof(const ClassObject* instance, const ClassObject* clazz)
 {
     if (instance == clazz) {
-        if (CALC_CACHE_STATS)
+        if (gDvm.instanceofCache->calcStats)
             gDvm.instanceofCache->trivial++;
         return 1;
     } else
@@ -50,12 +50,30 @@ INLINE int dvmInstanceof(const ClassObject* instance, const ClassObject* clazz)
  */
 int dvmImplements(const ClassObject* clazz, const ClassObject* interface);
 
+/*
+ * Build the supertype display and interface hash for a class.  The
+ * superclass and iftable must already be set up.  Called while linking.
+ */
+void dvmBuildTypeCheckTables(ClassObject* clazz);
+
+/*
+ * Hash function for the interface hash set.
+ */
+INLINE u4 dvmInterfaceHash(const ClassObject* interface) {
+    return ((u4) (uintptr_t) interface * 2654435761u) >> 16;
+}
+
 /*
  * Determine whether "sub" is a sub-class of "clazz".
  *
  * Returns 0 (false) if not, 1 (true) if so.
  */
 INLINE int dvmIsSubClass(const ClassObject* sub, const ClassObject* clazz) {
+    if (sub->superDisplay != NULL && clazz->superDisplay != NULL) {
+        int depth = clazz->superDepth;
+        return depth <= sub->superDepth && sub->superDisplay[depth] == clazz;
+    }
+
     do {
         /*printf("###### sub='%s' clazz='%s'\n", sub->name, clazz->name);*/
         if (sub == clazz)
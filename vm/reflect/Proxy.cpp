@@ -126,7 +126,7 @@ ClassObject* dvmGenerateProxyClass(StringObject* str, ArrayObject* interfaces,
      */
     newClass->directMethodCount = 1;
     newClass->directMethods = (Method*) dvmLinearAlloc(newClass->classLoader,
-            1 * sizeof(Method));
+            1 * sizeof(Method), kLinearAllocMethods);
     createConstructor(newClass, &newClass->directMethods[0]);
     dvmLinearReadOnly(newClass->classLoader, newClass->directMethods);
 
@@ -145,7 +145,8 @@ ClassObject* dvmGenerateProxyClass(StringObject* str, ArrayObject* interfaces,
         newClass->virtualMethodCount = methodCount;
         size_t virtualMethodsSize = methodCount * sizeof(Method);
         newClass->virtualMethods =
-            (Method*)dvmLinearAlloc(newClass->classLoader, virtualMethodsSize);
+            (Method*)dvmLinearAlloc(newClass->classLoader, virtualMethodsSize,
+                kLinearAllocMethods);
         for (int i = 0; i < newClass->virtualMethodCount; i++) {
             createHandlerMethod(newClass, &newClass->virtualMethods[i], methods[i]);
         }
@@ -162,7 +163,8 @@ ClassObject* dvmGenerateProxyClass(StringObject* str, ArrayObject* interfaces,
         newClass->interfaceCount = interfaceCount;
         size_t interfacesSize = sizeof(ClassObject*) * interfaceCount;
         newClass->interfaces =
-            (ClassObject**)dvmLinearAlloc(newClass->classLoader, interfacesSize);
+            (ClassObject**)dvmLinearAlloc(newClass->classLoader, interfacesSize,
+                kLinearAllocInterfaces);
         for (size_t i = 0; i < interfaceCount; i++)
           newClass->interfaces[i] = ifArray[i];
         dvmLinearReadOnly(newClass->classLoader, newClass->interfaces);